@@ -1,12 +1,35 @@
 #pragma once
 
+#include <algorithm> // std::min, std::max
 #include <string>
 #include <cmath> // expf
 #include <unordered_map>
+#include <vector>
 #include <Eigen/Dense>
 
+// Which implementation of each activation a model uses (see
+// DSP::set_activation_policy()). Each model has its own, so e.g. a monitoring
+// instance can use kFast next to an exact rendering instance.
+enum class EActivationPolicy
+{
+  // The ones that the names in the model file give (Activation's table, which
+  // enable_fast_tanh() changes)
+  kDefault = 0,
+  // std::tanh and expf
+  kExact,
+  // A rational approximation of tanh, and sigmoid through it
+  kFast,
+  // Tables of tanh and sigmoid (activations::TANH_TABLE and SIGMOID_TABLE)
+  kTable
+};
+
 namespace activations
 {
+inline float tanh(const float x)
+{
+  return std::tanh(x);
+}
+
 inline float relu(float x)
 {
   return x > 0.0f ? x : 0.0f;
@@ -32,13 +55,109 @@ inline float fast_tanh(const float x)
           / (2.44506634652299f + (2.44506634652299f + x2) * fabsf(x + 0.814642734961073f * x * ax)));
 }
 
+// sigmoid(x) = (1 + tanh(x / 2)) / 2
+inline float fast_sigmoid(const float x)
+{
+  return 0.5f + 0.5f * fast_tanh(0.5f * x);
+}
+
+// How ActivationTable reads between its entries
+enum class EInterpolation
+{
+  kLinear = 0,
+  // Catmull-Rom, through the two entries either side
+  kCubic
+};
+
+// A function of one value, looked up in a table of it at evenly spaced points
+// on [-range, range] instead of being computed. Beyond that, it's held at
+// its value at the ends, which suits functions that saturate (tanh,
+// sigmoid). The lookups have no branches, and apply() gathers 8 at a time
+// with AVX2 where the build allows.
+class ActivationTable
+{
+public:
+  // size is the number of points, at least 2.
+  ActivationTable(float (*f)(float), const float range, const int size, const EInterpolation interpolation);
+  float operator()(const float x) const
+  {
+    return this->_interpolation == EInterpolation::kCubic ? this->cubic(x) : this->linear(x);
+  };
+  float linear(const float x) const
+  {
+    int i;
+    float frac;
+    this->_locate(x, i, frac);
+    const float* v = this->_values.data() + 1 + i;
+    return v[0] + frac * (v[1] - v[0]);
+  };
+  float cubic(const float x) const
+  {
+    int i;
+    float frac;
+    this->_locate(x, i, frac);
+    const float* v = this->_values.data() + 1 + i;
+    // The coefficients, highest first
+    const float c3 = 3.0f * (v[0] - v[1]) + v[2] - v[-1];
+    const float c2 = 2.0f * v[-1] + 4.0f * v[1] - (5.0f * v[0] + v[2]);
+    const float c1 = v[1] - v[-1];
+    return v[0] + 0.5f * frac * (c1 + frac * (c2 + frac * c3));
+  };
+  // In place, with the table's interpolation
+  void apply(float* data, const long size) const;
+  float get_range() const { return this->_range; };
+  int get_size() const { return this->_size; };
+  EInterpolation get_interpolation() const { return this->_interpolation; };
+
+private:
+  // Where x falls: frac of the way from point i to point i + 1 (clamped to
+  // the range)
+  void _locate(const float x, int& i, float& frac) const
+  {
+    const float clamped = std::min(std::max(x, -this->_range), this->_range);
+    const float t = (clamped + this->_range) * this->_inverse_step;
+    // t is at most size - 1, which goes to the last interval with frac = 1.
+    i = std::min((int)t, this->_size - 2);
+    frac = t - (float)i;
+  };
+
+  float _range;
+  float _inverse_step;
+  int _size;
+  EInterpolation _interpolation;
+  // f at the points, with one more point before them and two after, for the
+  // cubic's neighbors
+  std::vector<float> _values;
+};
+
+// The tables that EActivationPolicy::kTable uses: 2048 points, linear. Tanh
+// covers [-8, 8] and sigmoid [-16, 16], and both are within 1e-5 of exact.
+extern const ActivationTable TANH_TABLE;
+extern const ActivationTable SIGMOID_TABLE;
+
+inline float table_tanh(const float x)
+{
+  return TANH_TABLE.linear(x);
+}
+
+inline float table_sigmoid(const float x)
+{
+  return SIGMOID_TABLE.linear(x);
+}
+
 class Activation
 {
 public:
   Activation() = default;
   virtual ~Activation() = default;
   virtual void apply(Eigen::MatrixXf& matrix) { apply(matrix.data(), matrix.rows() * matrix.cols()); }
-  virtual void apply(Eigen::Block<Eigen::MatrixXf> block) { apply(block.data(), block.rows() * block.cols()); }
+  virtual void apply(Eigen::Block<Eigen::MatrixXf> block)
+  {
+    // Only the columns are contiguous (e.g. when the block is some of the
+    // rows).
+    for (long j = 0; j < block.cols(); j++)
+      apply(block.col(j).data(), block.rows());
+  }
   virtual void apply(Eigen::Block<Eigen::MatrixXf, -1, -1, true> block)
   {
     apply(block.data(), block.rows() * block.cols());
@@ -46,6 +165,12 @@ public:
   virtual void apply(float* data, long size) {}
 
   static Activation* get_activation(const std::string name);
+  // The implementation of the named activation for the policy. Other than for
+  // kDefault, enable_fast_tanh() doesn't change it.
+  static Activation* get_activation(const std::string name, const EActivationPolicy policy);
+  // Make "Tanh" the fast approximation, for every model made afterwards (and
+  // not the ones that have been). Not thread-safe; prefer a model's
+  // EActivationPolicy.
   static void enable_fast_tanh();
   static void disable_fast_tanh();
 
@@ -113,4 +238,28 @@ public:
   }
 };
 
+class ActivationFastSigmoid : public Activation
+{
+public:
+  void apply(float* data, long size) override
+  {
+    for (long pos = 0; pos < size; pos++)
+    {
+      data[pos] = fast_sigmoid(data[pos]);
+    }
+  }
+};
+
+class ActivationTableTanh : public Activation
+{
+public:
+  void apply(float* data, long size) override { TANH_TABLE.apply(data, size); }
+};
+
+class ActivationTableSigmoid : public Activation
+{
+public:
+  void apply(float* data, long size) override { SIGMOID_TABLE.apply(data, size); }
+};
+
 }; // namespace activations
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include <algorithm> // std::copy, std::fill
+#include <cstdlib>
+#include <new> // std::bad_alloc
+
+#ifdef _WIN32
+#include <malloc.h> // _aligned_malloc()
+#else
+#include <sys/mman.h> // madvise(), mlock()
+#endif
+
+#include "arena.h"
+
+// Values per region boundary
+constexpr const long _VALUES_PER_ALIGNMENT = (long)(Arena::ALIGNMENT / sizeof(float));
+// Transparent huge pages are 2 MB on x86-64 and (usually) ARM64.
+constexpr const size_t _HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+void* _allocate_aligned(const size_t alignment, const size_t size)
+{
+#ifdef _WIN32
+  void* p = _aligned_malloc(size, alignment);
+#else
+  void* p = nullptr;
+  if (posix_memalign(&p, alignment, size) != 0)
+    p = nullptr;
+#endif
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void _free_aligned(void* p)
+{
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+Arena::Arena()
+: _data(nullptr)
+, _size(0)
+, _locked(false)
+, _huge_pages(false)
+{
+}
+
+Arena::Arena(const Arena& other)
+: Arena()
+{
+  *this = other;
+}
+
+Arena& Arena::operator=(const Arena& other)
+{
+  if (this == &other)
+    return *this;
+  this->_free_();
+  this->_staging = other._staging;
+  if (other._data != nullptr)
+  {
+    // Laid out the same, with the other's contents (its scratch as well,
+    // which doesn't matter)
+    this->_staging.assign(other._data, other._data + other._size / sizeof(float));
+    this->allocate_(other._options);
+  }
+  return *this;
+}
+
+Arena::~Arena()
+{
+  this->_free_();
+}
+
+void Arena::clear_()
+{
+  this->_free_();
+  this->_staging.clear();
+}
+
+long Arena::add_(const float* values, const long num_values)
+{
+  const long offset = this->_align_staging_();
+  this->_staging.insert(this->_staging.end(), values, values + num_values);
+  return offset;
+}
+
+long Arena::reserve_(const long num_values)
+{
+  const long offset = this->_align_staging_();
+  this->_staging.resize(this->_staging.size() + num_values, 0.0f);
+  return offset;
+}
+
+void Arena::allocate_(const ArenaOptions& options)
+{
+  this->_free_();
+  this->_options = options;
+  this->_align_staging_();
+  if (this->_staging.empty())
+    return;
+  const size_t alignment = options.huge_pages ? _HUGE_PAGE_SIZE : ALIGNMENT;
+  // Whole units of the alignment, which aligned allocation wants (and huge
+  // pages need)
+  const size_t used = this->_staging.size() * sizeof(float);
+  this->_size = (used + alignment - 1) / alignment * alignment;
+  this->_data = static_cast<float*>(_allocate_aligned(alignment, this->_size));
+#if defined(MADV_HUGEPAGE)
+  // Before it's touched, so that it's faulted in as huge pages
+  if (options.huge_pages)
+    this->_huge_pages = madvise(this->_data, this->_size, MADV_HUGEPAGE) == 0;
+#endif
+  std::copy(this->_staging.begin(), this->_staging.end(), this->_data);
+  std::fill(this->_data + this->_staging.size(), this->_data + this->_size / sizeof(float), 0.0f);
+  this->_staging.clear();
+  this->_staging.shrink_to_fit();
+#ifndef _WIN32
+  if (options.lock)
+    this->_locked = mlock(this->_data, this->_size) == 0;
+#endif
+}
+
+long Arena::_align_staging_()
+{
+  const long size = (long)this->_staging.size();
+  const long offset = (size + _VALUES_PER_ALIGNMENT - 1) / _VALUES_PER_ALIGNMENT * _VALUES_PER_ALIGNMENT;
+  this->_staging.resize(offset, 0.0f);
+  return offset;
+}
+
+void Arena::_free_()
+{
+  if (this->_data == nullptr)
+    return;
+#ifndef _WIN32
+  if (this->_locked)
+    munlock(this->_data, this->_size);
+#endif
+  _free_aligned(this->_data);
+  this->_data = nullptr;
+  this->_size = 0;
+  this->_locked = false;
+  this->_huge_pages = false;
+}
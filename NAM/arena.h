@@ -0,0 +1,66 @@
+#pragma once
+// One block of memory for a model's weights and scratch, instead of an
+// allocation for each matrix
+
+#include <cstddef>
+#include <vector>
+
+// How an Arena's memory is set up. Both are requests: what the OS allows is
+// done, and Arena says which it got.
+struct ArenaOptions
+{
+  // Ask for transparent huge pages (madvise(MADV_HUGEPAGE), Linux), so that
+  // the arena takes fewer TLB entries. The arena is rounded up to whole huge
+  // pages, which can be more than a small model needs.
+  bool huge_pages = false;
+  // Keep the arena in RAM (mlock()), so that the audio thread can't fault on
+  // it after the model has been paged out. Subject to RLIMIT_MEMLOCK.
+  bool lock = false;
+};
+
+// Laid out in order with add_() and reserve_(), then allocated in one piece
+// by allocate_(). Each region starts on a 64-byte boundary (a cache line, and
+// an AVX-512 register), and is found by its offset, so copies of the arena
+// work as they are.
+class Arena
+{
+public:
+  // Bytes that each region is aligned to
+  static constexpr size_t ALIGNMENT = 64;
+
+  Arena();
+  Arena(const Arena& other);
+  Arena& operator=(const Arena& other);
+  ~Arena();
+
+  // Laying it out (not real-time safe):
+  // Start over, freeing the memory.
+  void clear_();
+  // A region with a copy of num_values values. Returns its offset.
+  long add_(const float* values, const long num_values);
+  // A region of num_values zeros, e.g. for scratch. Returns its offset.
+  long reserve_(const long num_values);
+  // Allocate everything that's been added and reserved, and copy it in.
+  void allocate_(const ArenaOptions& options);
+
+  // After allocate_()
+  float* get(const long offset) { return this->_data + offset; };
+  const float* get(const long offset) const { return this->_data + offset; };
+  // Bytes allocated (0 before allocate_())
+  size_t get_size() const { return this->_size; };
+  bool is_locked() const { return this->_locked; };
+  bool has_huge_pages() const { return this->_huge_pages; };
+
+private:
+  float* _data;
+  size_t _size;
+  ArenaOptions _options;
+  bool _locked;
+  bool _huge_pages;
+  // What add_() and reserve_() have laid out, until allocate_()
+  std::vector<float> _staging;
+
+  // The offset of the next region
+  long _align_staging_();
+  void _free_();
+};
@@ -0,0 +1,221 @@
+#include <algorithm> // std::min, std::fill
+#include <chrono>
+#include <cstring> // memmove
+#include <sstream>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "async.h"
+
+// Blocks that can be in flight at once (with the worker, queued for it, or
+// waiting to be collected)
+constexpr const int _NUM_SLOTS = 4;
+// How long the worker sleeps before checking for work again, in case it
+// missed a wake-up
+constexpr const std::chrono::microseconds _WORKER_POLL_INTERVAL(500);
+
+template <typename SampleType>
+AsyncDSP<SampleType>::AsyncDSP(std::unique_ptr<DSP<SampleType>> model, const int max_num_frames, const int cpu)
+: DSP<SampleType>(model->GetLoudness())
+, _model(std::move(model))
+, _max_num_frames(max_num_frames)
+, _cpu(cpu)
+, _jobs(_NUM_SLOTS)
+, _done(_NUM_SLOTS)
+, _last_sent(0)
+, _fifo_size(max_num_frames)
+, _frames_to_drop(0)
+, _num_dropped_frames(0)
+, _running(true)
+, _realtime(false)
+{
+  if (max_num_frames <= 0)
+    throw std::runtime_error("AsyncDSP needs a positive maximum buffer size");
+  this->_register_params_of_(*this->_model);
+  this->SetExpectedSampleRate(this->_model->GetExpectedSampleRate());
+  this->_slots.resize(_NUM_SLOTS);
+  for (int i = 0; i < _NUM_SLOTS; i++)
+  {
+    this->_slots[i].input.resize(max_num_frames);
+    this->_slots[i].output.resize(max_num_frames);
+    this->_free_slots.push_back(i);
+  }
+  // Room for the initial block of silence plus every slot coming back at once
+  // (and the blocks skipped in the meantime)
+  this->_fifo.resize(2 * (_NUM_SLOTS + 1) * max_num_frames);
+  std::fill(this->_fifo.begin(), this->_fifo.end(), (SampleType)0.0);
+  this->_worker = std::thread(&AsyncDSP<SampleType>::_run_worker, this);
+}
+
+template <typename SampleType>
+AsyncDSP<SampleType>::~AsyncDSP()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_wake_mutex);
+    this->_running.store(false);
+  }
+  this->_wake.notify_one();
+  this->_worker.join();
+}
+
+template <typename SampleType>
+void AsyncDSP<SampleType>::process(SampleType** inputs, SampleType** outputs, const int num_channels,
+                                   const int num_frames, const SampleType input_gain, const SampleType output_gain)
+{
+  if (num_frames > this->_max_num_frames)
+  {
+    std::stringstream ss;
+    ss << "AsyncDSP was given " << num_frames << " frames, but was set up for at most " << this->_max_num_frames;
+    throw std::runtime_error(ss.str());
+  }
+
+  // Whatever the worker has finished
+  int index;
+  while (this->_done.pop(index))
+  {
+    this->_collect_(this->_slots[index]);
+    this->_free_slots.push_back(index);
+  }
+
+  // Send this block off. If the worker is so far behind that every slot is
+  // taken, it's skipped and silence takes its place (after the blocks that
+  // are ahead of it).
+  if (!this->_free_slots.empty())
+  {
+    index = this->_free_slots.back();
+    this->_free_slots.pop_back();
+    _Slot& slot = this->_slots[index];
+    // MONO ONLY
+    std::memcpy(slot.input.data(), inputs[0], num_frames * sizeof(SampleType));
+    slot.num_frames = num_frames;
+    slot.input_gain = input_gain;
+    slot.output_gain = output_gain;
+    slot.normalize = this->mNormalizeOutputLoudness;
+    slot.silence_after = 0;
+    this->_last_sent = index;
+    this->_jobs.push(index);
+    this->_wake.notify_one();
+  }
+  else
+  {
+    this->_slots[this->_last_sent].silence_after += num_frames;
+  }
+
+  // Hand out the oldest output. If there isn't enough, fill with silence and
+  // remember to drop the real output when it shows up.
+  const long ready = std::min((long)num_frames, this->_fifo_size);
+  for (int c = 0; c < num_channels; c++)
+  {
+    std::memcpy(outputs[c], this->_fifo.data(), ready * sizeof(SampleType));
+    std::fill(outputs[c] + ready, outputs[c] + num_frames, (SampleType)0.0);
+  }
+  this->_fifo_size -= ready;
+  std::memmove(this->_fifo.data(), this->_fifo.data() + ready, this->_fifo_size * sizeof(SampleType));
+  if (ready < num_frames)
+  {
+    this->_frames_to_drop += num_frames - ready;
+    this->_num_dropped_frames += num_frames - ready;
+  }
+}
+
+template <typename SampleType>
+void AsyncDSP<SampleType>::finalize_(const int num_frames)
+{
+  this->DSP<SampleType>::finalize_(num_frames);
+}
+
+template <typename SampleType>
+int AsyncDSP<SampleType>::GetLatency() const
+{
+  return this->_max_num_frames + this->_model->GetLatency();
+}
+
+template <typename SampleType>
+void AsyncDSP<SampleType>::_collect_(_Slot& slot)
+{
+  this->_append_(slot.output.data(), slot.num_frames);
+  this->_append_(nullptr, slot.silence_after);
+}
+
+template <typename SampleType>
+void AsyncDSP<SampleType>::_append_(const SampleType* frames, const long num_frames)
+{
+  const long drop = std::min(num_frames, this->_frames_to_drop);
+  this->_frames_to_drop -= drop;
+  const long n = std::min(num_frames - drop, (long)this->_fifo.size() - this->_fifo_size);
+  SampleType* destination = this->_fifo.data() + this->_fifo_size;
+  if (frames != nullptr)
+    std::memcpy(destination, frames + drop, n * sizeof(SampleType));
+  else
+  {
+    std::fill(destination, destination + n, (SampleType)0.0);
+    this->_num_dropped_frames += n;
+  }
+  this->_fifo_size += n;
+}
+
+template <typename SampleType>
+void AsyncDSP<SampleType>::_run_worker()
+{
+  this->_realtime.store(this->_set_up_worker_thread());
+  while (this->_running.load())
+  {
+    int index;
+    if (!this->_jobs.pop(index))
+    {
+      std::unique_lock<std::mutex> lock(this->_wake_mutex);
+      this->_wake.wait_for(lock, _WORKER_POLL_INTERVAL,
+                           [this] { return !this->_running.load() || this->_jobs.size() > 0; });
+      continue;
+    }
+    _Slot& slot = this->_slots[index];
+    this->_forward_params_(*this->_model);
+    this->_model->SetNormalize(slot.normalize);
+    SampleType* input = slot.input.data();
+    SampleType* output = slot.output.data();
+    this->_model->process(&input, &output, 1, slot.num_frames, slot.input_gain, slot.output_gain);
+    this->_model->finalize_(slot.num_frames);
+    this->_done.push(index);
+  }
+}
+
+template <typename SampleType>
+bool AsyncDSP<SampleType>::_set_up_worker_thread()
+{
+#if defined(_WIN32)
+  if (this->_cpu >= 0)
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << this->_cpu);
+  return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+#if defined(__linux__)
+  if (this->_cpu >= 0)
+  {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(this->_cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+#endif
+  // Halfway up the realtime range, below where hosts tend to put their own
+  // audio threads.
+  sched_param param;
+  param.sched_priority = (sched_get_priority_min(SCHED_FIFO) + sched_get_priority_max(SCHED_FIFO)) / 2;
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#endif
+}
+
+template <typename SampleType>
+void AsyncDSP<SampleType>::set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds)
+{
+  this->_model->set_thread_pool(pool, thresholds);
+}
+
+template class AsyncDSP<double>;
+template class AsyncDSP<float>;
@@ -0,0 +1,107 @@
+#pragma once
+// Running a model on a thread of its own
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "namdsp.h"
+#include "spsc_queue.h"
+
+// Wraps a model so that it runs on a dedicated worker thread, one block
+// behind the host.
+//
+// Each call to process() hands the block to the worker and returns output
+// that the worker finished earlier. A block that takes longer than usual
+// (up to a whole buffer period) no longer makes the host miss its deadline;
+// only the average has to keep up. The audio thread never waits or
+// allocates: blocks go back and forth in preallocated slots whose indices
+// travel through lock-free SPSC queues.
+//
+// The worker asks for realtime priority and, optionally, a CPU of its own.
+// Both are best effort (e.g. on Linux, realtime scheduling usually needs
+// permission); see is_realtime(). Pinning isn't available on macOS.
+//
+// The latency is max_num_frames (one block, when the host always provides
+// that many) plus the model's own. If the worker falls further behind than
+// that, silence stands in for the missing output and the late output is
+// dropped when it arrives, so the latency never changes.
+template <typename SampleType>
+class AsyncDSP : public DSP<SampleType>
+{
+public:
+  // Takes ownership of the model.
+  // max_num_frames: The longest buffer that the host will provide.
+  // cpu: The CPU to pin the worker to, or -1 to leave it to the OS.
+  AsyncDSP(std::unique_ptr<DSP<SampleType>> model, const int max_num_frames, const int cpu = -1);
+  ~AsyncDSP();
+  // The model's parameters are this one's. Changes reach it on the worker
+  // thread.
+  using DSP<SampleType>::process;
+  void process(SampleType** inputs, SampleType** outputs, const int num_channels, const int num_frames,
+               const SampleType input_gain, const SampleType output_gain) override;
+  // The worker finalizes the model.
+  void finalize_(const int num_frames) override;
+  // One block (max_num_frames) plus the model's latency, in samples.
+  int GetLatency() const override;
+  // Passed on to the model. Call before processing starts.
+  void set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds = ParallelThresholds()) override;
+  // Whether the worker got realtime priority
+  bool is_realtime() const { return this->_realtime.load(); };
+  // How many frames of output have been replaced with silence because the
+  // worker was late
+  long get_num_dropped_frames() const { return this->_num_dropped_frames.load(); };
+
+private:
+  // A block on its way to the worker and back
+  struct _Slot
+  {
+    std::vector<SampleType> input;
+    std::vector<SampleType> output;
+    int num_frames;
+    SampleType input_gain;
+    SampleType output_gain;
+    bool normalize;
+    // Frames of silence to follow the output: blocks that were skipped while
+    // this one was in flight. Only the audio thread touches this.
+    long silence_after;
+  };
+
+  void _run_worker();
+  // Priority and affinity, from the worker thread. Returns whether realtime
+  // priority was granted.
+  bool _set_up_worker_thread();
+  // Add the output of a finished slot to the FIFO.
+  void _collect_(_Slot& slot);
+  // Add frames (or silence, if null) to the FIFO, less any that are owed.
+  void _append_(const SampleType* frames, const long num_frames);
+
+  std::unique_ptr<DSP<SampleType>> _model;
+  int _max_num_frames;
+  int _cpu;
+  std::vector<_Slot> _slots;
+  // Slot indices going to the worker and coming back from it
+  SPSCQueue<int> _jobs;
+  SPSCQueue<int> _done;
+  // Slots that the audio thread is holding (only it touches this)
+  std::vector<int> _free_slots;
+  // The slot that was sent to the worker most recently
+  int _last_sent;
+  // Output waiting to be handed to the host. It starts out with one block of
+  // silence.
+  std::vector<SampleType> _fifo;
+  long _fifo_size;
+  // Frames that were replaced with silence and still need to be dropped from
+  // the output when it arrives
+  long _frames_to_drop;
+  std::atomic<long> _num_dropped_frames;
+  std::atomic<bool> _running;
+  std::atomic<bool> _realtime;
+  // For the worker to sleep on when there's nothing to do
+  std::mutex _wake_mutex;
+  std::condition_variable _wake;
+  std::thread _worker;
+};
@@ -0,0 +1,180 @@
+#include <algorithm> // std::min, std::fill
+#include <cmath> // fabs
+#include <stdexcept>
+
+#include "bypass.h"
+
+template <typename SampleType>
+SilenceBypassDSP<SampleType>::SilenceBypassDSP(std::unique_ptr<DSP<SampleType>> model, const int max_num_frames,
+                                               const SampleType threshold)
+: DSP<SampleType>(model->GetLoudness())
+, _model(std::move(model))
+, _max_num_frames(max_num_frames)
+, _threshold(threshold)
+, _gate(nullptr)
+, _warm_up(-1)
+, _silence_output(0.0f)
+, _silent_frames(0)
+, _quiet_frames(0)
+, _bypassed(false)
+, _needs_replay(false)
+, _num_bypassed_frames(0)
+, _history_position(0)
+{
+  if (max_num_frames <= 0)
+    throw std::runtime_error("SilenceBypassDSP needs a positive maximum buffer size");
+  this->_register_params_of_(*this->_model);
+  this->SetExpectedSampleRate(this->_model->GetExpectedSampleRate());
+  // So that bypassed blocks don't allocate
+  this->_input_post_gain.reserve(max_num_frames);
+  this->_core_dsp_output.resize(max_num_frames);
+
+  // Find the output for silence on a copy, so that the model's own state is
+  // left alone.
+  std::unique_ptr<DSP<SampleType>> copy = this->_model->clone();
+  const long warm_up = this->_model->get_warm_up_frames();
+  const long history = this->_model->get_history_frames();
+  if (copy == nullptr || warm_up < 0 || history < 0)
+    return;
+  this->_warm_up = warm_up;
+  // By the time the gate opens, any anti-pop ramp is long over, so the replay
+  // only needs the receptive field.
+  this->_history.resize(std::max(history, 1L));
+  std::fill(this->_history.begin(), this->_history.end(), (SampleType)0.0);
+  this->_replay_input.resize(max_num_frames);
+  this->_replay_output.resize(max_num_frames);
+  std::fill(this->_replay_input.begin(), this->_replay_input.end(), (SampleType)0.0);
+  copy->SetNormalize(false);
+  SampleType* input = this->_replay_input.data();
+  SampleType* output = this->_replay_output.data();
+  for (long frames_left = warm_up + 1; frames_left > 0; frames_left -= max_num_frames)
+  {
+    const int n = (int)std::min((long)max_num_frames, frames_left);
+    copy->process(&input, &output, 1, n, (SampleType)1.0, (SampleType)1.0);
+    copy->finalize_(n);
+    this->_silence_output = (float)output[n - 1];
+  }
+}
+
+template <typename SampleType>
+void SilenceBypassDSP<SampleType>::process(SampleType** inputs, SampleType** outputs, const int num_channels,
+                                           const int num_frames, const SampleType input_gain,
+                                           const SampleType output_gain)
+{
+  this->_forward_params_(*this->_model);
+  this->_model->SetNormalize(this->mNormalizeOutputLoudness);
+  if (this->_warm_up < 0)
+  {
+    this->_bypassed = false;
+    this->_model->process(inputs, outputs, num_channels, num_frames, input_gain, output_gain);
+    return;
+  }
+
+  // MONO ONLY
+  const SampleType* input = inputs[0];
+  const bool silent = this->_is_silent(input, num_frames, input_gain);
+  const bool gated = this->_gate != nullptr && this->_gate->isGating();
+  // After enough silence, the model's output is its output for silence.
+  const bool exact = silent && this->_silent_frames >= this->_warm_up;
+  this->_bypassed = exact || (gated && this->_quiet_frames >= this->_warm_up);
+  this->_silent_frames = silent ? this->_silent_frames + num_frames : 0;
+  this->_quiet_frames = silent || gated ? this->_quiet_frames + num_frames : 0;
+
+  if (this->_bypassed)
+  {
+    // Skipping anything but silence leaves the model's history wrong.
+    this->_needs_replay = this->_needs_replay || !exact;
+    this->_num_bypassed_frames += num_frames;
+    this->_input_post_gain.resize(num_frames);
+    this->_ensure_core_dsp_output_ready_();
+    std::fill(this->_core_dsp_output.begin(), this->_core_dsp_output.begin() + num_frames, this->_silence_output);
+    this->_apply_output_level_(outputs, num_channels, num_frames, output_gain);
+  }
+  else
+  {
+    if (this->_needs_replay)
+    {
+      this->_replay_(input_gain);
+      this->_needs_replay = false;
+    }
+    this->_model->process(inputs, outputs, num_channels, num_frames, input_gain, output_gain);
+  }
+  if (this->_gate != nullptr)
+    this->_record_(input, num_frames);
+}
+
+template <typename SampleType>
+void SilenceBypassDSP<SampleType>::finalize_(const int num_frames)
+{
+  this->DSP<SampleType>::finalize_(num_frames);
+  if (!this->_bypassed)
+    this->_model->finalize_(num_frames);
+}
+
+template <typename SampleType>
+void SilenceBypassDSP<SampleType>::set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds)
+{
+  this->_model->set_thread_pool(pool, thresholds);
+}
+
+template <typename SampleType>
+void SilenceBypassDSP<SampleType>::prewarm()
+{
+  this->_model->prewarm();
+  if (this->_warm_up < 0)
+    return;
+  // As if it had been nothing but silence so far
+  this->_silent_frames = this->_warm_up;
+  this->_quiet_frames = this->_warm_up;
+  this->_needs_replay = false;
+  std::fill(this->_history.begin(), this->_history.end(), (SampleType)0.0);
+}
+
+template <typename SampleType>
+bool SilenceBypassDSP<SampleType>::_is_silent(const SampleType* input, const int num_frames,
+                                              const SampleType input_gain) const
+{
+  const SampleType threshold = this->_threshold / std::max((SampleType)std::fabs(input_gain), (SampleType)1.0e-30);
+  for (int i = 0; i < num_frames; i++)
+    if (std::fabs(input[i]) > threshold)
+      return false;
+  return true;
+}
+
+template <typename SampleType>
+void SilenceBypassDSP<SampleType>::_record_(const SampleType* input, const int num_frames)
+{
+  const long size = (long)this->_history.size();
+  // Only the end of a long block matters.
+  const int start = (int)std::max(0L, num_frames - size);
+  for (int i = start; i < num_frames; i++)
+  {
+    this->_history[this->_history_position] = input[i];
+    this->_history_position = this->_history_position + 1 < size ? this->_history_position + 1 : 0;
+  }
+}
+
+template <typename SampleType>
+void SilenceBypassDSP<SampleType>::_replay_(const SampleType input_gain)
+{
+  // Oldest first, which is where the next frame would be recorded
+  const long size = (long)this->_history.size();
+  SampleType* input = this->_replay_input.data();
+  SampleType* output = this->_replay_output.data();
+  long position = this->_history_position;
+  for (long done = 0; done < size;)
+  {
+    const int n = (int)std::min((long)this->_max_num_frames, size - done);
+    for (int i = 0; i < n; i++)
+    {
+      input[i] = this->_history[position];
+      position = position + 1 < size ? position + 1 : 0;
+    }
+    this->_model->process(&input, &output, 1, n, input_gain, (SampleType)1.0);
+    this->_model->finalize_(n);
+    done += n;
+  }
+}
+
+template class SilenceBypassDSP<double>;
+template class SilenceBypassDSP<float>;
@@ -0,0 +1,89 @@
+#pragma once
+// Not running models while there's nothing to hear
+
+#include <memory>
+#include <vector>
+
+#include "namdsp.h"
+#include "NoiseGate.h"
+
+// Wraps a model so that it isn't run while its input is silent, or while a
+// noise gate in front of it is closed.
+//
+// Once the input has been quiet for long enough that the model's output only
+// depends on the quiet part (DSP::get_warm_up_frames()), whole quiet blocks
+// skip the model and get its output for silence instead, worked out when the
+// wrapper is made.
+// * Silence (every sample within threshold of zero): the model's history is
+//   already full of silence and wouldn't change if it were run, so it picks
+//   up right where it left off when the signal comes back.
+// * A closed gate (the input isn't silent, but the gate will mute whatever
+//   the model makes of it): the input keeps being recorded, and when the gate
+//   opens, the last DSP::get_history_frames() of it (the receptive field) are
+//   run through the model (output discarded) before the block, so its history
+//   is right. That callback does the work of that many more frames: about
+//   4100 for a standard WaveNet, or 64 buffers' worth at 64 frames.
+// Models without a bounded warm-up (LSTM) are always run.
+template <typename SampleType>
+class SilenceBypassDSP : public DSP<SampleType>
+{
+public:
+  // Takes ownership of the model.
+  // max_num_frames: The longest buffer that the host will provide (the
+  // replay is done in pieces this long).
+  // threshold: Samples at most this far from zero (after the input gain)
+  // count as silence; the default is -120 dB.
+  SilenceBypassDSP(std::unique_ptr<DSP<SampleType>> model, const int max_num_frames,
+                   const SampleType threshold = (SampleType)1.0e-6);
+  // The model's parameters are this one's.
+  using DSP<SampleType>::process;
+  void process(SampleType** inputs, SampleType** outputs, const int num_channels, const int num_frames,
+               const SampleType input_gain, const SampleType output_gain) override;
+  void finalize_(const int num_frames) override;
+  int GetLatency() const override { return this->_model->GetLatency(); };
+  // Passed on to the model
+  void set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds = ParallelThresholds()) override;
+  // Also lets silence be bypassed from the start
+  void prewarm() override;
+  // Also bypass while this gate is gating (it needs to run before the model
+  // in each block, e.g. as a Chain's first stage, and to outlive this).
+  // nullptr for silence only (the default).
+  void set_gate(dsp::noise_gate::Trigger<SampleType>* gate) { this->_gate = gate; };
+  // Whether the last block skipped the model
+  bool is_bypassed() const { return this->_bypassed; };
+  // Frames that skipped the model so far
+  long get_num_bypassed_frames() const { return this->_num_bypassed_frames; };
+  DSP<SampleType>* get_model() { return this->_model.get(); };
+
+private:
+  // Whether every sample in the block is within the threshold of zero
+  bool _is_silent(const SampleType* input, const int num_frames, const SampleType input_gain) const;
+  // Keep the last _history.size() frames of input (for after the gate opens).
+  void _record_(const SampleType* input, const int num_frames);
+  // Run the recorded input through the model, throwing the output away.
+  void _replay_(const SampleType input_gain);
+
+  std::unique_ptr<DSP<SampleType>> _model;
+  int _max_num_frames;
+  SampleType _threshold;
+  dsp::noise_gate::Trigger<SampleType>* _gate;
+  // The model's warm-up, or -1 if it can't be bypassed
+  long _warm_up;
+  // Its (core) output once it's been given nothing but silence
+  float _silence_output;
+  // How many frames in a row (up to the end of the last block) have been
+  // silent, and silent or gated
+  long _silent_frames;
+  long _quiet_frames;
+  bool _bypassed;
+  // Whether the model has missed input that wasn't silence
+  bool _needs_replay;
+  long _num_bypassed_frames;
+  // The last get_history_frames() of input, in a ring, and where the next
+  // one goes. Only kept up with when there's a gate.
+  std::vector<SampleType> _history;
+  long _history_position;
+  // For the replay: input in order, and output to throw away
+  std::vector<SampleType> _replay_input;
+  std::vector<SampleType> _replay_output;
+};
@@ -0,0 +1,122 @@
+#include <algorithm> // std::min
+#include <cstring> // memcpy
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "chain.h"
+
+template <typename SampleType>
+Chain<SampleType>::Chain(const int num_channels, const int max_num_frames)
+: _num_channels(num_channels)
+, _max_num_frames(max_num_frames)
+{
+  if (num_channels < 1 || max_num_frames < 1)
+  {
+    std::stringstream ss;
+    ss << "Chain needs at least one channel and one frame; got " << num_channels << " channels and "
+       << max_num_frames << " frames";
+    throw std::runtime_error(ss.str());
+  }
+  this->_ping.resize(num_channels * max_num_frames);
+  this->_pong.resize(num_channels * max_num_frames);
+  this->_ping_pointers.resize(num_channels);
+  this->_pong_pointers.resize(num_channels);
+  this->_host_pointers.resize(num_channels);
+  for (int c = 0; c < num_channels; c++)
+  {
+    this->_ping_pointers[c] = this->_ping.data() + c * max_num_frames;
+    this->_pong_pointers[c] = this->_pong.data() + c * max_num_frames;
+  }
+}
+
+template <typename SampleType>
+void Chain<SampleType>::add(DSP<float>* model)
+{
+  if (model == nullptr)
+    throw std::runtime_error("Tried to add a null model to a chain");
+  this->_stages.push_back({model, nullptr});
+}
+
+template <typename SampleType>
+void Chain<SampleType>::add(dsp::DSP<float>* stage)
+{
+  if (stage == nullptr)
+    throw std::runtime_error("Tried to add a null stage to a chain");
+  this->_stages.push_back({nullptr, stage});
+}
+
+template <typename SampleType>
+void Chain<SampleType>::process(SampleType** inputs, SampleType** outputs, const int num_frames)
+{
+  for (int start = 0; start < num_frames; start += this->_max_num_frames)
+    this->_process_piece(inputs, outputs, start, std::min(this->_max_num_frames, num_frames - start));
+}
+
+template <typename SampleType>
+void Chain<SampleType>::_process_piece(SampleType** inputs, SampleType** outputs, const int start,
+                                       const int num_frames)
+{
+  const int num_channels = this->_num_channels;
+  float** current = this->_ping_pointers.data();
+  float** spare = this->_pong_pointers.data();
+
+  // In
+  if constexpr (std::is_same<SampleType, float>::value)
+  {
+    // Work in the host's output buffer.
+    for (int c = 0; c < num_channels; c++)
+    {
+      this->_host_pointers[c] = outputs[c] + start;
+      if (outputs[c] != inputs[c])
+        std::memcpy(outputs[c] + start, inputs[c] + start, num_frames * sizeof(float));
+    }
+    current = this->_host_pointers.data();
+  }
+  else
+  {
+    for (int c = 0; c < num_channels; c++)
+      for (int i = 0; i < num_frames; i++)
+        current[c][i] = (float)inputs[c][start + i];
+  }
+
+  for (const auto& stage : this->_stages)
+  {
+    if (stage.model != nullptr)
+    {
+      stage.model->process(current, spare, num_channels, num_frames, 1.0f, 1.0f);
+      stage.model->finalize_(num_frames);
+      std::swap(current, spare);
+    }
+    else
+      stage.stage->ProcessInPlace(current, num_channels, num_frames);
+  }
+
+  // Out
+  if constexpr (std::is_same<SampleType, float>::value)
+  {
+    // Only needed if the audio ended up in a working buffer.
+    if (current != this->_host_pointers.data())
+      for (int c = 0; c < num_channels; c++)
+        std::memcpy(outputs[c] + start, current[c], num_frames * sizeof(float));
+  }
+  else
+  {
+    for (int c = 0; c < num_channels; c++)
+      for (int i = 0; i < num_frames; i++)
+        outputs[c][start + i] = (SampleType)current[c][i];
+  }
+}
+
+template <typename SampleType>
+int Chain<SampleType>::get_latency() const
+{
+  int latency = 0;
+  for (const auto& stage : this->_stages)
+    if (stage.model != nullptr)
+      latency += stage.model->GetLatency();
+  return latency;
+}
+
+template class Chain<double>;
+template class Chain<float>;
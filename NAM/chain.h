@@ -0,0 +1,60 @@
+#pragma once
+// Running several processors in series
+
+#include <vector>
+
+#include "coredsp.h"
+#include "namdsp.h"
+
+// A signal chain, e.g. noise gate trigger -> model -> EQ -> IR -> noise gate
+// gain, that passes one set of buffers from stage to stage instead of each
+// stage having its own copy of the audio.
+//
+// The chain works in float. The host's audio is converted once on the way in
+// and once on the way out (for a float host, the chain works right in the
+// host's output buffer). In between:
+// * dsp::DSP stages use ProcessInPlace().
+// * Models (DSP) read one buffer and write the other, and the two swap roles
+//   ("ping-pong"), which is no more work than a copy would have been.
+// All of the buffers are allocated up front.
+//
+// The chain doesn't own its stages; they need to outlive it.
+template <typename SampleType>
+class Chain
+{
+public:
+  // max_num_frames: The longest buffer that the host will provide. Longer
+  // buffers work, but are processed in pieces.
+  Chain(const int num_channels, const int max_num_frames);
+  // Stages run in the order that they're added.
+  void add(DSP<float>* model);
+  void add(dsp::DSP<float>* stage);
+  // inputs and outputs are [channel][frame] and may be the same.
+  void process(SampleType** inputs, SampleType** outputs, const int num_frames);
+  // Sum of the models' latencies, in samples.
+  int get_latency() const;
+  int get_num_channels() const { return this->_num_channels; };
+  size_t get_num_stages() const { return this->_stages.size(); };
+
+private:
+  // One of the two is set.
+  struct _Stage
+  {
+    DSP<float>* model;
+    dsp::DSP<float>* stage;
+  };
+
+  void _process_piece(SampleType** inputs, SampleType** outputs, const int start, const int num_frames);
+
+  int _num_channels;
+  int _max_num_frames;
+  std::vector<_Stage> _stages;
+  // The two working buffers, each num_channels * max_num_frames, and
+  // pointers to their channels
+  std::vector<float> _ping;
+  std::vector<float> _pong;
+  std::vector<float*> _ping_pointers;
+  std::vector<float*> _pong_pointers;
+  // Pointers into the host's buffers, offset to the current piece
+  std::vector<float*> _host_pointers;
+};
@@ -37,7 +37,7 @@ convnet::BatchNorm::BatchNorm(const int dim, std::vector<float>::iterator& param
   this->loc = _bias - this->scale.cwiseProduct(running_mean);
 }
 
-void convnet::BatchNorm::process_(Eigen::MatrixXf& x, const long i_start, const long i_end) const
+void convnet::BatchNorm::process_(Eigen::Ref<Eigen::MatrixXf> x, const long i_start, const long i_end) const
 {
   // todo using colwise?
   // #speed but conv probably dominates
@@ -57,18 +57,21 @@ void convnet::ConvNetBlock::set_params_(const int in_channels, const int out_cha
   this->conv.set_size_and_params_(in_channels, out_channels, 2, _dilation, !batchnorm, params);
   if (this->_batchnorm)
     this->batchnorm = BatchNorm(out_channels, params);
+  this->_activation_name = activation;
   this->activation = activations::Activation::get_activation(activation);
 }
 
-void convnet::ConvNetBlock::process_(const Eigen::MatrixXf& input, Eigen::MatrixXf& output, const long i_start,
-                                     const long i_end) const
+void convnet::ConvNetBlock::process_(const Eigen::Ref<const Eigen::MatrixXf>& input,
+                                     Eigen::Ref<Eigen::MatrixXf> output, const long i_start, const long i_end,
+                                     const Arena& arena) const
 {
   const long ncols = i_end - i_start;
-  this->conv.process_(input, output, i_start, ncols, i_start);
+  this->conv.process_(input, output, i_start, ncols, i_start, &arena);
   if (this->_batchnorm)
     this->batchnorm.process_(output, i_start, i_end);
 
-  this->activation->apply(output.middleCols(i_start, ncols));
+  // (The block values' columns are contiguous.)
+  this->activation->apply(output.col(i_start).data(), output.rows() * ncols);
 }
 
 long convnet::ConvNetBlock::get_out_channels() const
@@ -76,6 +79,11 @@ long convnet::ConvNetBlock::get_out_channels() const
   return this->conv.get_out_channels();
 }
 
+void convnet::ConvNetBlock::set_activation_policy_(const EActivationPolicy policy)
+{
+  this->activation = activations::Activation::get_activation(this->_activation_name, policy);
+}
+
 convnet::_Head::_Head(const int channels, std::vector<float>::iterator& params)
 {
   this->_weight.resize(channels);
@@ -84,8 +92,8 @@ convnet::_Head::_Head(const int channels, std::vector<float>::iterator& params)
   this->_bias = *(params++);
 }
 
-void convnet::_Head::process_(const Eigen::MatrixXf& input, Eigen::VectorXf& output, const long i_start,
-                              const long i_end) const
+void convnet::_Head::process_(const Eigen::Ref<const Eigen::MatrixXf>& input, Eigen::VectorXf& output,
+                              const long i_start, const long i_end) const
 {
   const long length = i_end - i_start;
   output.resize(length);
@@ -104,19 +112,172 @@ template <typename SampleType>
 convnet::ConvNet<SampleType>::ConvNet(const SampleType loudness, const int channels, const std::vector<int>& dilations,
                           const bool batchnorm, const std::string activation, std::vector<float>& params)
 : Buffer<SampleType>(loudness, *std::max_element(dilations.begin(), dilations.end()))
+, _block_vals_size(0)
 {
   this->_verify_params(channels, dilations, batchnorm, params.size());
   this->_blocks.resize(dilations.size());
   std::vector<float>::iterator it = params.begin();
   for (int i = 0; i < dilations.size(); i++)
     this->_blocks[i].set_params_(i == 0 ? 1 : channels, channels, dilations[i], batchnorm, activation, it);
-  this->_block_vals.resize(this->_blocks.size() + 1);
   this->_head = _Head(channels, it);
   if (it != params.end())
     throw std::runtime_error("Didn't touch all the params when initializing wavenet");
+  // Sized with the input buffer from the start, so that there's always
+  // history to save (see get_state())
+  this->_block_vals.assign(this->_blocks.size() + 1, -1);
+  this->_layout_arena_();
   this->_reset_anti_pop_();
 }
 
+template <typename SampleType>
+void convnet::ConvNet<SampleType>::set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds)
+{
+  for (auto& block : this->_blocks)
+    block.conv.set_thread_pool_(pool, thresholds.min_tile_cost);
+}
+
+template <typename SampleType>
+void convnet::ConvNet<SampleType>::set_weight_precision(const EWeightPrecision precision)
+{
+  for (auto& block : this->_blocks)
+  {
+    block.conv.take_weights_from_(this->_arena);
+    block.conv.set_weight_precision_(precision);
+  }
+  this->_layout_arena_();
+}
+
+template <typename SampleType>
+void convnet::ConvNet<SampleType>::set_arena_options(const ArenaOptions& options)
+{
+  this->_arena_options = options;
+  this->_layout_arena_();
+}
+
+template <typename SampleType>
+size_t convnet::ConvNet<SampleType>::get_memory_size() const
+{
+  size_t size = this->Buffer<SampleType>::get_memory_size() + this->_head.get_memory_size()
+                + this->_head_output.size() * sizeof(float);
+  for (const auto& block : this->_blocks)
+    size += block.get_memory_size();
+  return size;
+}
+
+template <typename SampleType>
+void convnet::ConvNet<SampleType>::_layout_arena_()
+{
+  // What's in the block values, at the new size
+  const long buffer_size = (long)this->_input_buffer.size();
+  std::vector<Eigen::MatrixXf> block_vals(this->_block_vals.size());
+  for (size_t k = 0; k < this->_block_vals.size(); k++)
+  {
+    block_vals[k].setZero(this->_get_block_vals_rows_(k), buffer_size);
+    const long cols = std::min(buffer_size, this->_block_vals_size);
+    if (this->_block_vals[k] >= 0)
+      block_vals[k].leftCols(cols) = this->_get_block_vals_(k).leftCols(cols);
+  }
+  // The weights come back out of the arena, then go into the new one, in the
+  // order that they're used, then the block values.
+  for (auto& block : this->_blocks)
+    block.conv.take_weights_from_(this->_arena);
+  this->_arena.clear_();
+  for (auto& block : this->_blocks)
+    block.conv.move_weights_to_(this->_arena);
+  for (size_t k = 0; k < block_vals.size(); k++)
+    this->_block_vals[k] = this->_arena.add_(block_vals[k].data(), block_vals[k].size());
+  this->_block_vals_size = buffer_size;
+  this->_arena.allocate_(this->_arena_options);
+}
+
+template <typename SampleType>
+Eigen::Map<Eigen::MatrixXf> convnet::ConvNet<SampleType>::_get_block_vals_(const size_t k)
+{
+  return Eigen::Map<Eigen::MatrixXf>(
+    this->_arena.get(this->_block_vals[k]), this->_get_block_vals_rows_(k), this->_block_vals_size);
+}
+
+template <typename SampleType>
+Eigen::Map<const Eigen::MatrixXf> convnet::ConvNet<SampleType>::_get_block_vals_(const size_t k) const
+{
+  return Eigen::Map<const Eigen::MatrixXf>(
+    this->_arena.get(this->_block_vals[k]), this->_get_block_vals_rows_(k), this->_block_vals_size);
+}
+
+template <typename SampleType>
+long convnet::ConvNet<SampleType>::_get_block_vals_rows_(const size_t k) const
+{
+  return k == 0 ? 1 : this->_blocks[k - 1].get_out_channels();
+}
+
+template <typename SampleType>
+void convnet::ConvNet<SampleType>::set_activation_policy(const EActivationPolicy policy)
+{
+  for (auto& block : this->_blocks)
+    block.set_activation_policy_(policy);
+}
+
+template <typename SampleType>
+void convnet::ConvNet<SampleType>::get_activation_ranges(std::vector<ActivationRange*>& ranges)
+{
+  for (auto& block : this->_blocks)
+    ranges.push_back(&block.conv.get_input_range());
+}
+
+template <typename SampleType>
+void convnet::ConvNet<SampleType>::prewarm()
+{
+  // As WaveNet::prewarm(): a long silence leaves every column of each
+  // block's input the same, so process one frame with them filled in.
+  this->_input_post_gain.assign(1, 0.0f);
+  this->_update_buffers_();
+  const long i = this->_input_buffer_offset;
+  this->_get_block_vals_(0)(0, i) = 0.0f;
+  for (auto k = 0; k < this->_blocks.size(); k++)
+  {
+    const long d = this->_blocks[k].conv.get_dilation();
+    auto block_vals = this->_get_block_vals_(k);
+    block_vals.middleCols(i - d, d) = block_vals.col(i).replicate(1, d);
+    this->_blocks[k].process_(block_vals, this->_get_block_vals_(k + 1), i, i + 1, this->_arena);
+  }
+  this->finalize_(1);
+  this->_anti_pop_countdown = this->_anti_pop_ramp;
+}
+
+template <typename SampleType>
+bool convnet::ConvNet<SampleType>::get_state(DSPState& state) const
+{
+  state::Writer writer(state, "ConvNet");
+  this->_write_input_buffer_(writer);
+  // What each block looks back on; the last _block_vals is only output.
+  const long i = this->_input_buffer_offset;
+  for (auto k = 0; k < this->_blocks.size(); k++)
+  {
+    const long d = this->_blocks[k].conv.get_dilation();
+    const auto block_vals = this->_get_block_vals_(k);
+    writer.write(block_vals.middleCols(i - d, d).data(), block_vals.rows() * d);
+  }
+  writer.write(this->_anti_pop_countdown);
+  return true;
+}
+
+template <typename SampleType>
+void convnet::ConvNet<SampleType>::set_state(const DSPState& state)
+{
+  state::Reader reader(state, "ConvNet");
+  // As _rewind_buffers_() leaves them
+  this->_read_input_buffer_(reader);
+  const long i = this->_input_buffer_offset;
+  for (auto k = 0; k < this->_blocks.size(); k++)
+  {
+    const long d = this->_blocks[k].conv.get_dilation();
+    auto block_vals = this->_get_block_vals_(k);
+    reader.read(block_vals.middleCols(i - d, d).data(), block_vals.rows() * d);
+  }
+  this->_anti_pop_countdown = reader.read_long();
+  reader.finish();
+}
+
 template <typename SampleType>
 void convnet::ConvNet<SampleType>::_process_core_()
 {
@@ -126,12 +287,13 @@ void convnet::ConvNet<SampleType>::_process_core_()
   const long num_frames = this->_input_post_gain.size();
   const long i_end = i_start + num_frames;
   // TODO one unnecessary copy :/ #speed
+  auto input = this->_get_block_vals_(0);
   for (auto i = i_start; i < i_end; i++)
-    this->_block_vals[0](0, i) = this->_input_buffer[i];
+    input(0, i) = this->_input_buffer[i];
   for (auto i = 0; i < this->_blocks.size(); i++)
-    this->_blocks[i].process_(this->_block_vals[i], this->_block_vals[i + 1], i_start, i_end);
+    this->_blocks[i].process_(this->_get_block_vals_(i), this->_get_block_vals_(i + 1), i_start, i_end, this->_arena);
   // TODO clean up this allocation
-  this->_head.process_(this->_block_vals[this->_blocks.size()], this->_head_output, i_start, i_end);
+  this->_head.process_(this->_get_block_vals_(this->_blocks.size()), this->_head_output, i_start, i_end);
   // Copy to required output array (TODO tighten this up)
   for (int s = 0; s < num_frames; s++)
     this->_core_dsp_output[s] = this->_head_output(s);
@@ -150,10 +312,9 @@ template <typename SampleType>
 void convnet::ConvNet<SampleType>::_update_buffers_()
 {
   this->Buffer<SampleType>::_update_buffers_();
-  const long buffer_size = this->_input_buffer.size();
-  this->_block_vals[0].resize(1, buffer_size);
-  for (long i = 1; i < this->_block_vals.size(); i++)
-    this->_block_vals[i].resize(this->_blocks[i - 1].get_out_channels(), buffer_size);
+  // Keep what's in them if the input buffer grew.
+  if ((long)this->_input_buffer.size() != this->_block_vals_size)
+    this->_layout_arena_();
 }
 
 template <typename SampleType>
@@ -168,10 +329,11 @@ void convnet::ConvNet<SampleType>::_rewind_buffers_()
     // We actually don't need to pull back a lot...just as far as the first
     // input sample would grab from dilation
     const long _dilation = this->_blocks[k].conv.get_dilation();
+    auto block_vals = this->_get_block_vals_(k);
     for (long i = this->_receptive_field - _dilation, j = this->_input_buffer_offset - _dilation;
          j < this->_input_buffer_offset; i++, j++)
-      for (long r = 0; r < this->_block_vals[k].rows(); r++)
-        this->_block_vals[k](r, i) = this->_block_vals[k](r, j);
+      for (long r = 0; r < block_vals.rows(); r++)
+        block_vals(r, i) = block_vals(r, j);
   }
   // Now we can do the rest of the rewind
   this->Buffer<SampleType>::_rewind_buffers_();
@@ -197,10 +359,16 @@ template <typename SampleType>
 void convnet::ConvNet<SampleType>::_reset_anti_pop_()
 {
   // You need the "real" receptive field, not the buffers.
+  this->_anti_pop_countdown = -this->_get_receptive_field();
+}
+
+template <typename SampleType>
+long convnet::ConvNet<SampleType>::_get_receptive_field() const
+{
   long receptive_field = 1;
   for (int i = 0; i < this->_blocks.size(); i++)
     receptive_field += this->_blocks[i].conv.get_dilation();
-  this->_anti_pop_countdown = -receptive_field;
+  return receptive_field;
 }
 
 template class convnet::ConvNet<double>;
@@ -22,7 +22,8 @@ class BatchNorm
 public:
   BatchNorm(){};
   BatchNorm(const int dim, std::vector<float>::iterator& params);
-  void process_(Eigen::MatrixXf& input, const long i_start, const long i_end) const;
+  void process_(Eigen::Ref<Eigen::MatrixXf> input, const long i_start, const long i_end) const;
+  size_t get_memory_size() const { return (this->scale.size() + this->loc.size()) * sizeof(float); };
 
 private:
   // TODO simplify to just ax+b
@@ -40,13 +41,19 @@ public:
   ConvNetBlock() { this->_batchnorm = false; };
   void set_params_(const int in_channels, const int out_channels, const int _dilation, const bool batchnorm,
                    const std::string activation, std::vector<float>::iterator& params);
-  void process_(const Eigen::MatrixXf& input, Eigen::MatrixXf& output, const long i_start, const long i_end) const;
+  // arena: The model's, which has the convolution's weights
+  void process_(const Eigen::Ref<const Eigen::MatrixXf>& input, Eigen::Ref<Eigen::MatrixXf> output,
+                const long i_start, const long i_end, const Arena& arena) const;
   long get_out_channels() const;
+  // Bytes kept outside the arena
+  size_t get_memory_size() const { return this->conv.get_memory_size() + this->batchnorm.get_memory_size(); };
+  void set_activation_policy_(const EActivationPolicy policy);
   Conv1D conv;
 
 private:
   BatchNorm batchnorm;
   bool _batchnorm;
+  std::string _activation_name;
   activations::Activation* activation;
 };
 
@@ -55,7 +62,9 @@ class _Head
 public:
   _Head() { this->_bias = (float)0.0; };
   _Head(const int channels, std::vector<float>::iterator& params);
-  void process_(const Eigen::MatrixXf& input, Eigen::VectorXf& output, const long i_start, const long i_end) const;
+  void process_(const Eigen::Ref<const Eigen::MatrixXf>& input, Eigen::VectorXf& output, const long i_start,
+                const long i_end) const;
+  size_t get_memory_size() const { return this->_weight.size() * sizeof(float); };
 
 private:
   Eigen::VectorXf _weight;
@@ -70,18 +79,50 @@ public:
           std::vector<float>& params);
   ConvNet(const SampleType loudness, const int channels, const std::vector<int>& dilations, const bool batchnorm,
           const std::string activation, std::vector<float>& params);
+  void set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds = ParallelThresholds()) override;
+  // The blocks' convolutions
+  void set_weight_precision(const EWeightPrecision precision) override;
+  void set_activation_policy(const EActivationPolicy policy) override;
+  void get_activation_ranges(std::vector<ActivationRange*>& ranges) override;
+  // The arena has the blocks' fp32 weights, then what goes in and out of
+  // each block (the input buffer's length, which includes their history).
+  // It's laid out again when the input buffer grows, for a longer block.
+  void set_arena_options(const ArenaOptions& options) override;
+  const Arena* get_arena() const override { return &this->_arena; };
+  size_t get_memory_size() const override;
+  std::unique_ptr<DSP<SampleType>> clone() const override { return std::make_unique<ConvNet<SampleType>>(*this); };
+  // The receptive field, plus the anti-pop ramp in case the original is
+  // still on it
+  long get_warm_up_frames() const override { return this->_get_receptive_field() + this->_anti_pop_ramp; };
+  long get_history_frames() const override { return this->_get_receptive_field(); };
+  void prewarm() override;
+  bool get_state(DSPState& state) const override;
+  void set_state(const DSPState& state) override;
 
 protected:
   std::vector<ConvNetBlock> _blocks;
-  std::vector<Eigen::MatrixXf> _block_vals;
+  // Where each block's input (and the last one's output) is in the arena
+  std::vector<long> _block_vals;
+  // Their columns, as the input buffer's when the arena was laid out
+  long _block_vals_size;
   Eigen::VectorXf _head_output;
   _Head _head;
+  Arena _arena;
+  ArenaOptions _arena_options;
+  // Lay the arena out again (for the input buffer's size), keeping what's in
+  // the block values
+  void _layout_arena_();
+  Eigen::Map<Eigen::MatrixXf> _get_block_vals_(const size_t k);
+  Eigen::Map<const Eigen::MatrixXf> _get_block_vals_(const size_t k) const;
+  long _get_block_vals_rows_(const size_t k) const;
   void _verify_params(const int channels, const std::vector<int>& dilations, const bool batchnorm,
                       const size_t actual_params);
   void _update_buffers_() override;
   void _rewind_buffers_() override;
 
   void _process_core_() override;
+  // The "real" receptive field (one-indexed), not the buffers'
+  long _get_receptive_field() const;
 
   // The net starts with random parameters inside; we need to wait for a full
   // receptive field to pass through before we can count on the output being
@@ -1,3 +1,4 @@
+#include <cmath> // std::sqrt
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
@@ -99,105 +100,150 @@ std::unique_ptr<DSP<SampleType>> get_dsp_legacy(const std::filesystem::path mode
   return get_dsp<SampleType>(config_filename);
 }
 
+// Read the sample rate that the model was trained at.
+// Returns a negative number if the model file doesn't say.
+double _get_expected_sample_rate(const nlohmann::json& j)
+{
+  if (j.find("sample_rate") != j.end())
+    return j["sample_rate"];
+  if (j.find("metadata") != j.end() && j["metadata"].find("sample_rate") != j["metadata"].end())
+    return j["metadata"]["sample_rate"];
+  return -1.0;
+}
+
+// The convolutions' input ranges that nam_quantize saved, if there are any
 template <typename SampleType>
-std::unique_ptr<DSP<SampleType>> get_dsp(const std::filesystem::path config_filename)
+void _set_activation_ranges(const nlohmann::json& j, DSP<SampleType>& model)
 {
-  if (!std::filesystem::exists(config_filename))
-    throw std::runtime_error("Config JSON doesn't exist!\n");
-  std::ifstream i(config_filename);
-  nlohmann::json j;
-  i >> j;
-  verify_config_version(j["version"]);
+  if (j.find("int8_calibration") == j.end())
+    return;
+  const nlohmann::json& values = j["int8_calibration"]["activation_ranges"];
+  std::vector<ActivationRange*> ranges;
+  model.get_activation_ranges(ranges);
+  if (values.size() != ranges.size())
+  {
+    std::stringstream ss;
+    ss << "The model file has " << values.size() << " calibrated ranges, but the model has " << ranges.size()
+       << " convolutions";
+    throw std::runtime_error(ss.str());
+  }
+  for (size_t i = 0; i < ranges.size(); i++)
+    ranges[i]->max_abs = values[i];
+}
 
-  auto architecture = j["architecture"];
-  nlohmann::json config = j["config"];
-  std::vector<float> params = GetWeights(j, config_filename);
-  bool haveLoudness = false;
-  double loudness = TARGET_DSP_LOUDNESS;
-  if (j.find("metadata") != j.end())
+// Load-time passes ===========================================================
+// These rewrite a model's config and weights between parsing and building it,
+// into an equivalent model that does less work per sample.
+
+// Fold each ConvNet block's BatchNorm into its convolution, which gets a bias
+// instead: scale * (W x) + loc = (scale * W) x + loc.
+void _fold_batchnorm(nlohmann::json& config, std::vector<float>& params)
+{
+  const int channels = config["channels"];
+  const size_t num_blocks = config["dilations"].size();
+  std::vector<float> folded;
+  folded.reserve(params.size());
+  size_t start = 0;
+  for (size_t b = 0; b < num_blocks; b++)
   {
-    if (j["metadata"].find("loudness") != j["metadata"].end())
+    // Kernel size 2, ordered by output channel, input channel, then tap
+    const size_t row_size = 2 * (b == 0 ? 1 : channels);
+    const size_t num_params = channels * row_size + 4 * channels + 1;
+    if (params.size() < start + num_params)
     {
-      loudness = j["metadata"]["loudness"];
-      haveLoudness = true;
+      std::stringstream ss;
+      ss << "ConvNet block " << b << " is missing weights";
+      throw std::runtime_error(ss.str());
     }
+    const float* weights = params.data() + start;
+    const float* running_mean = weights + channels * row_size;
+    const float* running_var = running_mean + channels;
+    const float* bn_weight = running_var + channels;
+    const float* bn_bias = bn_weight + channels;
+    const float eps = bn_bias[channels];
+    std::vector<float> loc(channels);
+    for (int i = 0; i < channels; i++)
+    {
+      const float scale = bn_weight[i] / std::sqrt(eps + running_var[i]);
+      for (size_t k = 0; k < row_size; k++)
+        folded.push_back(scale * weights[i * row_size + k]);
+      loc[i] = bn_bias[i] - scale * running_mean[i];
+    }
+    folded.insert(folded.end(), loc.begin(), loc.end());
+    start += num_params;
   }
+  // The head
+  folded.insert(folded.end(), params.begin() + start, params.end());
+  params = folded;
+  config["batchnorm"] = false;
+}
 
+// Fold WaveNet's head scale (the last weight) into the last head rechannel
+// (the weights before it), whose output is all that it scales.
+void _fold_head_scale(nlohmann::json& config, std::vector<float>& params)
+{
+  const nlohmann::json& last_layers = config["layers"].back();
+  const int head_size = last_layers["head_size"];
+  const int channels = last_layers["channels"];
+  const bool head_bias = last_layers["head_bias"];
+  const size_t num_params = head_size * (channels + (head_bias ? 1 : 0));
+  if (params.size() < num_params + 1)
+    throw std::runtime_error("WaveNet is missing weights");
+  const float head_scale = params.back();
+  for (size_t i = params.size() - 1 - num_params; i < params.size() - 1; i++)
+    params[i] *= head_scale;
+  params.back() = 1.0f;
+  config["head_scale"] = 1.0f;
+}
 
+// Stretch a model's time scales by the factor, so that it runs at factor times
+// the sample rate that it was trained at: each dilation (and Linear's
+// receptive field) is multiplied by it, which is the same as putting
+// factor - 1 zeros between the taps of each kernel. The model's nonlinearities
+// then see its input at the higher rate, while its filters keep their lengths
+// in time.
+void _stretch_time_scales(const std::string& architecture, nlohmann::json& config, std::vector<float>& params,
+                          const int factor)
+{
   if (architecture == "Linear")
   {
     const int receptive_field = config["receptive_field"];
-    const bool _bias = config["bias"];
-    return std::make_unique<Linear<SampleType>>(loudness, receptive_field, _bias, params);
+    const int stretched = (receptive_field - 1) * factor + 1;
+    std::vector<float> stretched_params(stretched, 0.0f);
+    for (int i = 0; i < receptive_field; i++)
+      stretched_params[i * factor] = params[i];
+    // The bias, if there is one
+    stretched_params.insert(stretched_params.end(), params.begin() + receptive_field, params.end());
+    params = stretched_params;
+    config["receptive_field"] = stretched;
   }
   else if (architecture == "ConvNet")
   {
-    const int channels = config["channels"];
-    const bool batchnorm = config["batchnorm"];
-    std::vector<int> dilations;
-    for (int i = 0; i < config["dilations"].size(); i++)
-      dilations.push_back(config["dilations"][i]);
-    const std::string activation = config["activation"];
-    return std::make_unique<convnet::ConvNet<SampleType>>(loudness, channels, dilations, batchnorm, activation, params);
-  }
-  else if (architecture == "LSTM")
-  {
-    const int num_layers = config["num_layers"];
-    const int input_size = config["input_size"];
-    const int hidden_size = config["hidden_size"];
-    auto json = nlohmann::json{};
-    return std::make_unique<lstm::LSTM<SampleType>>(loudness, num_layers, input_size, hidden_size, params, json);
-  }
-  else if (architecture == "CatLSTM")
-  {
-    const int num_layers = config["num_layers"];
-    const int input_size = config["input_size"];
-    const int hidden_size = config["hidden_size"];
-    return std::make_unique<lstm::LSTM<SampleType>>(loudness, num_layers, input_size, hidden_size, params, config["parametric"]);
+    for (auto& dilation : config["dilations"])
+      dilation = factor * (int)dilation;
   }
   else if (architecture == "WaveNet" || architecture == "CatWaveNet")
   {
-    std::vector<wavenet::LayerArrayParams> layer_array_params;
-    for (int i = 0; i < config["layers"].size(); i++)
-    {
-      nlohmann::json layer_config = config["layers"][i];
-      std::vector<int> dilations;
-      for (int j = 0; j < layer_config["dilations"].size(); j++)
-        dilations.push_back(layer_config["dilations"][j]);
-      layer_array_params.push_back(
-        wavenet::LayerArrayParams(layer_config["input_size"], layer_config["condition_size"], layer_config["head_size"],
-                                  layer_config["channels"], layer_config["kernel_size"], dilations,
-                                  layer_config["activation"], layer_config["gated"], layer_config["head_bias"]));
-    }
-    const bool with_head = config["head"] == NULL;
-    const float head_scale = config["head_scale"];
-    // Solves compilation issue on macOS Error: No matching constructor for
-    // initialization of 'wavenet::WaveNet' Solution from
-    // https://stackoverflow.com/a/73956681/3768284
-    auto parametric_json = architecture == "CatWaveNet" ? config["parametric"] : nlohmann::json{};
-    return std::make_unique<wavenet::WaveNet<SampleType>>(
-      loudness, layer_array_params, head_scale, with_head, parametric_json, params);
+    for (auto& layer_config : config["layers"])
+      for (auto& dilation : layer_config["dilations"])
+        dilation = factor * (int)dilation;
   }
   else
   {
-    throw std::runtime_error("Unrecognized architecture");
+    // An LSTM steps once per sample, with nothing to stretch.
+    std::stringstream ss;
+    ss << "Can't stretch the time scales of architecture " << architecture;
+    throw std::runtime_error(ss.str());
   }
 }
 
+// Instantiate the DSP described by the (version-checked) model file contents.
 template <typename SampleType>
-std::unique_ptr<DSP<SampleType>> get_dsp_stream(const std::string& raw_json)
+std::unique_ptr<DSP<SampleType>> _get_dsp_from_json(nlohmann::json& j, std::vector<float>& params,
+                                                    const DSPLoadOptions& options)
 {
-  nlohmann::json j;
-  std::stringstream ss;
-
-  ss << raw_json;
-  ss >> j;
-
-  verify_config_version(j["version"]);
-
   auto architecture = j["architecture"];
   nlohmann::json config = j["config"];
-  std::vector<float> params = GetWeights(j);
   bool haveLoudness = false;
   double loudness = TARGET_DSP_LOUDNESS;
   if (j.find("metadata") != j.end())
@@ -209,12 +255,24 @@ std::unique_ptr<DSP<SampleType>> get_dsp_stream(const std::string& raw_json)
     }
   }
 
+  if (options.time_scale < 1)
+    throw std::runtime_error("The time scale must be at least 1");
+  if (options.time_scale > 1)
+    _stretch_time_scales(architecture, config, params, options.time_scale);
+  if (options.fold_weights)
+  {
+    if (architecture == "ConvNet" && config["batchnorm"])
+      _fold_batchnorm(config, params);
+    else if (architecture == "WaveNet" || architecture == "CatWaveNet")
+      _fold_head_scale(config, params);
+  }
 
+  std::unique_ptr<DSP<SampleType>> model;
   if (architecture == "Linear")
   {
     const int receptive_field = config["receptive_field"];
     const bool _bias = config["bias"];
-    return std::make_unique<Linear<SampleType>>(loudness, receptive_field, _bias, params);
+    model = std::make_unique<Linear<SampleType>>(loudness, receptive_field, _bias, params);
   }
   else if (architecture == "ConvNet")
   {
@@ -224,7 +282,7 @@ std::unique_ptr<DSP<SampleType>> get_dsp_stream(const std::string& raw_json)
     for (int i = 0; i < config["dilations"].size(); i++)
       dilations.push_back(config["dilations"][i]);
     const std::string activation = config["activation"];
-    return std::make_unique<convnet::ConvNet<SampleType>>(loudness, channels, dilations, batchnorm, activation, params);
+    model = std::make_unique<convnet::ConvNet<SampleType>>(loudness, channels, dilations, batchnorm, activation, params);
   }
   else if (architecture == "LSTM")
   {
@@ -232,14 +290,14 @@ std::unique_ptr<DSP<SampleType>> get_dsp_stream(const std::string& raw_json)
     const int input_size = config["input_size"];
     const int hidden_size = config["hidden_size"];
     auto json = nlohmann::json{};
-    return std::make_unique<lstm::LSTM<SampleType>>(loudness, num_layers, input_size, hidden_size, params, json);
+    model = std::make_unique<lstm::LSTM<SampleType>>(loudness, num_layers, input_size, hidden_size, params, json);
   }
   else if (architecture == "CatLSTM")
   {
     const int num_layers = config["num_layers"];
     const int input_size = config["input_size"];
     const int hidden_size = config["hidden_size"];
-    return std::make_unique<lstm::LSTM<SampleType>>(loudness, num_layers, input_size, hidden_size, params, config["parametric"]);
+    model = std::make_unique<lstm::LSTM<SampleType>>(loudness, num_layers, input_size, hidden_size, params, config["parametric"]);
   }
   else if (architecture == "WaveNet" || architecture == "CatWaveNet")
   {
@@ -261,13 +319,51 @@ std::unique_ptr<DSP<SampleType>> get_dsp_stream(const std::string& raw_json)
     // initialization of 'wavenet::WaveNet' Solution from
     // https://stackoverflow.com/a/73956681/3768284
     auto parametric_json = architecture == "CatWaveNet" ? config["parametric"] : nlohmann::json{};
-    return std::make_unique<wavenet::WaveNet<SampleType>>(
+    model = std::make_unique<wavenet::WaveNet<SampleType>>(
       loudness, layer_array_params, head_scale, with_head, parametric_json, params);
   }
   else
   {
     throw std::runtime_error("Unrecognized architecture");
   }
+  const double sample_rate = _get_expected_sample_rate(j);
+  model->SetExpectedSampleRate(sample_rate > 0.0 ? options.time_scale * sample_rate : sample_rate);
+  _set_activation_ranges(j, *model);
+  model->set_weight_precision(options.weight_precision);
+  model->set_activation_policy(options.activation_policy);
+  model->set_arena_options(options.arena);
+  if (options.prewarm)
+    model->prewarm();
+  return model;
+}
+
+template <typename SampleType>
+std::unique_ptr<DSP<SampleType>> get_dsp(const std::filesystem::path config_filename, const DSPLoadOptions& options)
+{
+  if (!std::filesystem::exists(config_filename))
+    throw std::runtime_error("Config JSON doesn't exist!\n");
+  std::ifstream i(config_filename);
+  nlohmann::json j;
+  i >> j;
+  verify_config_version(j["version"]);
+
+  std::vector<float> params = GetWeights(j, config_filename);
+  return _get_dsp_from_json<SampleType>(j, params, options);
+}
+
+template <typename SampleType>
+std::unique_ptr<DSP<SampleType>> get_dsp_stream(const std::string& raw_json, const DSPLoadOptions& options)
+{
+  nlohmann::json j;
+  std::stringstream ss;
+
+  ss << raw_json;
+  ss >> j;
+
+  verify_config_version(j["version"]);
+
+  std::vector<float> params = GetWeights(j);
+  return _get_dsp_from_json<SampleType>(j, params, options);
 }
 
 void dummy()
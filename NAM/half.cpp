@@ -0,0 +1,170 @@
+#include <cstring> // memcpy
+#include <stdexcept>
+
+#if defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+#include <immintrin.h>
+#define NAM_HALF_SIMD
+#endif
+
+#include "half.h"
+
+// multiply_() does this many columns of the input at a time, sharing the
+// widened weights between them.
+constexpr const long _COLUMN_BLOCK = 4;
+
+uint32_t _get_bits(const float x)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+float _from_bits(const uint32_t bits)
+{
+  float x;
+  std::memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+uint16_t half::float_to_half(const float x)
+{
+  const uint32_t bits = _get_bits(x);
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+  if (((bits >> 23) & 0xff) == 0xff) // Inf or NaN
+    return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+  if (exponent >= 0x1f) // Too big
+    return sign | 0x7c00;
+  if (exponent <= 0)
+  {
+    // Subnormal, or too small
+    if (exponent < -10)
+      return sign;
+    mantissa |= 0x800000;
+    const int shift = 14 - exponent;
+    uint16_t h = (uint16_t)(mantissa >> shift);
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (h & 1)))
+      h++;
+    return sign | h;
+  }
+  uint16_t h = sign | (uint16_t)(exponent << 10) | (uint16_t)(mantissa >> 13);
+  const uint32_t remainder = mantissa & 0x1fff;
+  // Rounding up can carry into the exponent, which is still right.
+  if (remainder > 0x1000 || (remainder == 0x1000 && (h & 1)))
+    h++;
+  return h;
+}
+
+float half::half_to_float(const uint16_t x)
+{
+  const uint32_t sign = (uint32_t)(x & 0x8000) << 16;
+  const uint32_t exponent = (x >> 10) & 0x1f;
+  const uint32_t mantissa = x & 0x3ff;
+  if (exponent == 0) // Zero or subnormal: mantissa * 2^-24
+    return (sign ? -1.0f : 1.0f) * (float)mantissa * 5.9604644775390625e-8f;
+  if (exponent == 0x1f)
+    return _from_bits(sign | 0x7f800000 | (mantissa << 13));
+  return _from_bits(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+uint16_t half::float_to_bfloat16(const float x)
+{
+  const uint32_t bits = _get_bits(x);
+  if ((bits & 0x7fffffff) > 0x7f800000) // NaN; keep it one
+    return (uint16_t)((bits >> 16) | 0x40);
+  return (uint16_t)((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+float half::bfloat16_to_float(const uint16_t x)
+{
+  return _from_bits((uint32_t)x << 16);
+}
+
+HalfMatrix::HalfMatrix(const Eigen::MatrixXf& m, const EWeightPrecision precision)
+: _rows(m.rows())
+, _cols(m.cols())
+, _precision(precision)
+, _data(m.size())
+{
+  if (precision != EWeightPrecision::kFloat16 && precision != EWeightPrecision::kBFloat16)
+    throw std::runtime_error("HalfMatrix needs a half precision");
+  for (long i = 0; i < m.size(); i++)
+    this->_data[i] = precision == EWeightPrecision::kFloat16 ? half::float_to_half(m.data()[i])
+                                                              : half::float_to_bfloat16(m.data()[i]);
+}
+
+Eigen::MatrixXf HalfMatrix::widen() const
+{
+  Eigen::MatrixXf m(this->_rows, this->_cols);
+  for (long j = 0; j < this->_cols; j++)
+    for (long i = 0; i < this->_rows; i++)
+      m(i, j) = this->_get_(i, j);
+  return m;
+}
+
+float HalfMatrix::_get_(const long i, const long j) const
+{
+  const uint16_t x = this->_data[j * this->_rows + i];
+  return this->_precision == EWeightPrecision::kFloat16 ? half::half_to_float(x) : half::bfloat16_to_float(x);
+}
+
+#ifdef NAM_HALF_SIMD
+// 8 weights, widened
+inline __m256 _widen(const uint16_t* x, const bool is_bfloat16)
+{
+  const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x));
+  if (is_bfloat16)
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+  return _mm256_cvtph_ps(h);
+}
+#endif
+
+void HalfMatrix::multiply_(const Eigen::Ref<const Eigen::MatrixXf>& input, Eigen::Ref<Eigen::MatrixXf> output,
+                           const long row_start, const bool accumulate) const
+{
+  const long num_rows = output.rows();
+  const long ncols = input.cols();
+  long row = 0;
+#ifdef NAM_HALF_SIMD
+  const bool is_bfloat16 = this->_precision == EWeightPrecision::kBFloat16;
+  // 8 rows by _COLUMN_BLOCK columns at a time
+  for (; row + 8 <= num_rows; row += 8)
+  {
+    const uint16_t* weights = this->_data.data() + row_start + row;
+    long j = 0;
+    for (; j + _COLUMN_BLOCK <= ncols; j += _COLUMN_BLOCK)
+    {
+      __m256 sums[_COLUMN_BLOCK];
+      for (long b = 0; b < _COLUMN_BLOCK; b++)
+        sums[b] = accumulate ? _mm256_loadu_ps(&output(row, j + b)) : _mm256_setzero_ps();
+      for (long k = 0; k < this->_cols; k++)
+      {
+        const __m256 w = _widen(weights + k * this->_rows, is_bfloat16);
+        for (long b = 0; b < _COLUMN_BLOCK; b++)
+          sums[b] = _mm256_fmadd_ps(w, _mm256_set1_ps(input(k, j + b)), sums[b]);
+      }
+      for (long b = 0; b < _COLUMN_BLOCK; b++)
+        _mm256_storeu_ps(&output(row, j + b), sums[b]);
+    }
+    for (; j < ncols; j++)
+    {
+      __m256 sum = accumulate ? _mm256_loadu_ps(&output(row, j)) : _mm256_setzero_ps();
+      for (long k = 0; k < this->_cols; k++)
+        sum = _mm256_fmadd_ps(_widen(weights + k * this->_rows, is_bfloat16), _mm256_set1_ps(input(k, j)), sum);
+      _mm256_storeu_ps(&output(row, j), sum);
+    }
+  }
+#endif
+  // The rest (or all of it, without SIMD)
+  for (; row < num_rows; row++)
+    for (long j = 0; j < ncols; j++)
+    {
+      float sum = accumulate ? output(row, j) : 0.0f;
+      for (long k = 0; k < this->_cols; k++)
+        sum += this->_get_(row_start + row, k) * input(k, j);
+      output(row, j) = sum;
+    }
+}
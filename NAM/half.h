@@ -0,0 +1,64 @@
+#pragma once
+// Keeping weights at half precision (fp16 or bf16). They're widened to fp32
+// as they're used, and everything is accumulated in fp32.
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+
+// How a model keeps its weights
+enum class EWeightPrecision
+{
+  kFloat32 = 0,
+  // IEEE half: more mantissa, but only up to 65504
+  kFloat16,
+  // bfloat16: fp32's range with 8 bits of mantissa
+  kBFloat16,
+  // Int8, with int8 activations too. The model needs to have been calibrated
+  // (see int8.h).
+  kInt8
+};
+
+namespace half
+{
+// Round to nearest (even)
+uint16_t float_to_half(const float x);
+float half_to_float(const uint16_t x);
+uint16_t float_to_bfloat16(const float x);
+float bfloat16_to_float(const uint16_t x);
+}; // namespace half
+
+// A matrix kept at half precision, for multiplying fp32 matrices by
+class HalfMatrix
+{
+public:
+  HalfMatrix()
+  : _rows(0)
+  , _cols(0)
+  , _precision(EWeightPrecision::kFloat16){};
+  // precision needs to be kFloat16 or kBFloat16.
+  HalfMatrix(const Eigen::MatrixXf& m, const EWeightPrecision precision);
+  long rows() const { return this->_rows; };
+  long cols() const { return this->_cols; };
+  long size() const { return this->_rows * this->_cols; };
+  // Bytes of weights
+  size_t get_memory_size() const { return this->_data.size() * sizeof(uint16_t); };
+  // Back to fp32
+  Eigen::MatrixXf widen() const;
+  // output = (or += if accumulate) rows [row_start, row_start + output.rows())
+  // of this, times input.
+  // Uses F16C and FMA (AVX2 for bf16) where the build allows, otherwise one
+  // element at a time.
+  void multiply_(const Eigen::Ref<const Eigen::MatrixXf>& input, Eigen::Ref<Eigen::MatrixXf> output,
+                 const long row_start, const bool accumulate) const;
+
+private:
+  long _rows;
+  long _cols;
+  EWeightPrecision _precision;
+  // Column-major, as Eigen's
+  std::vector<uint16_t> _data;
+
+  float _get_(const long i, const long j) const;
+};
@@ -0,0 +1,257 @@
+#include <algorithm> // std::min, std::max
+#include <cmath> // std::nearbyint
+#include <cstring> // memcpy
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#define NAM_INT8_SIMD
+#if (defined(__AVX512VNNI__) && defined(__AVX512VL__)) || defined(__AVXVNNI__)
+#define NAM_INT8_VNNI
+#endif
+#endif
+
+#include "int8.h"
+
+// multiply_() does this many columns of the input at a time, sharing the
+// weights between them.
+constexpr const int _COLUMN_BLOCK = 4;
+
+long _round_up_to_4(const long n)
+{
+  return (n + 3) / 4 * 4;
+}
+
+// Round x / scale to [-127, 127] (to nearest even, as SIMD does). -128 is
+// left out so that the dot products can take the absolute value of
+// activations; see _dot().
+int8_t _quantize(const float x, const float inverse_scale)
+{
+  return (int8_t)std::nearbyint(std::min(127.0f, std::max(-127.0f, x * inverse_scale)));
+}
+
+Int8Matrix::Int8Matrix(const Eigen::MatrixXf& m)
+: _rows(m.rows())
+, _cols(m.cols())
+, _padded_cols(_round_up_to_4(m.cols()))
+{
+  const long num_blocks = (this->_rows + 7) / 8;
+  // Whole blocks' worth, so that SIMD can load them 8 at a time
+  this->_scales.assign(num_blocks * 8, 0.0f);
+  this->_offsets.assign(num_blocks * 8, 0);
+  this->_data.assign(num_blocks * 8 * this->_padded_cols, 0);
+  for (long i = 0; i < this->_rows; i++)
+  {
+    const float max_abs = this->_cols > 0 ? m.row(i).cwiseAbs().maxCoeff() : 0.0f;
+    if (max_abs == 0.0f)
+      continue;
+    this->_scales[i] = max_abs / 127.0f;
+    const float inverse_scale = 127.0f / max_abs;
+    const long block = i / 8;
+    for (long j = 0; j < this->_cols; j++)
+    {
+      const int8_t w = _quantize(m(i, j), inverse_scale);
+      this->_data[(block * (this->_padded_cols / 4) + j / 4) * 32 + (i % 8) * 4 + j % 4] = w;
+      this->_offsets[i] -= Int8Input::ZERO_POINT * w;
+    }
+  }
+}
+
+Eigen::MatrixXf Int8Matrix::widen() const
+{
+  Eigen::MatrixXf m(this->_rows, this->_cols);
+  for (long j = 0; j < this->_cols; j++)
+    for (long i = 0; i < this->_rows; i++)
+      m(i, j) = this->_scales[i] * this->_get_(i, j);
+  return m;
+}
+
+int8_t Int8Matrix::_get_(const long i, const long j) const
+{
+  return this->_data[((i / 8) * (this->_padded_cols / 4) + j / 4) * 32 + (i % 8) * 4 + j % 4];
+}
+
+#ifdef NAM_INT8_SIMD
+// The sums that the dot products of a block of rows start from
+inline __m256i _start_sums(const int32_t* offsets)
+{
+#ifdef NAM_INT8_VNNI
+  // Unsigned activations, so take the zero point's share back off.
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets));
+#else
+  return _mm256_setzero_si256();
+#endif
+}
+
+// acc + the dot products of each 32-bit lane's 4 activations x with its 4
+// weights w
+inline __m256i _dot(const __m256i acc, const __m256i x, const __m256i w)
+{
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+  return _mm256_dpbusd_epi32(acc, x, w);
+#elif defined(__AVXVNNI__)
+  return _mm256_dpbusd_avx_epi32(acc, x, w);
+#else
+  // Unsigned activations up to 255 could saturate the pairs' 16-bit sums, so
+  // go back to signed and multiply |x| by w with x's sign, which can't, as
+  // neither is -128.
+  const __m256i signed_x = _mm256_xor_si256(x, _mm256_set1_epi8((char)0x80));
+  const __m256i pairs = _mm256_maddubs_epi16(_mm256_sign_epi8(signed_x, signed_x), _mm256_sign_epi8(w, signed_x));
+  return _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+#endif
+}
+
+// 4 activations, for every lane
+inline __m256i _broadcast(const uint8_t* x)
+{
+  int32_t four;
+  std::memcpy(&four, x, sizeof(four));
+  return _mm256_set1_epi32(four);
+}
+
+// Scale 8 rows' sums back to fp32 and write (or add) the first num_rows of
+// them.
+inline void _store(const __m256i sums, const __m256 scales, float* output, const long num_rows,
+                   const bool accumulate)
+{
+  const __m256 y = _mm256_mul_ps(_mm256_cvtepi32_ps(sums), scales);
+  if (num_rows >= 8)
+  {
+    _mm256_storeu_ps(output, accumulate ? _mm256_add_ps(_mm256_loadu_ps(output), y) : y);
+    return;
+  }
+  float values[8];
+  _mm256_storeu_ps(values, y);
+  for (long i = 0; i < num_rows; i++)
+    output[i] = accumulate ? output[i] + values[i] : values[i];
+}
+
+// NUM_BLOCKS blocks of 8 rows by NUM_COLS columns x, into output (of which
+// num_rows rows are wanted). Each broadcast of the activations is shared by
+// the blocks, and each load of the weights by the columns.
+template <int NUM_BLOCKS, int NUM_COLS>
+inline void _multiply_blocks(const int8_t* weights, const long num_groups, const int32_t* offsets, const float* scales,
+                             const float input_scale, const uint8_t* const* x, float* output, const long output_stride,
+                             const long num_rows, const bool accumulate)
+{
+  __m256i sums[NUM_BLOCKS][NUM_COLS];
+  for (int r = 0; r < NUM_BLOCKS; r++)
+    for (int b = 0; b < NUM_COLS; b++)
+      sums[r][b] = _start_sums(offsets + 8 * r);
+  for (long g = 0; g < num_groups; g++)
+  {
+    __m256i xs[NUM_COLS];
+    for (int b = 0; b < NUM_COLS; b++)
+      xs[b] = _broadcast(x[b] + 4 * g);
+    for (int r = 0; r < NUM_BLOCKS; r++)
+    {
+      const __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + (r * num_groups + g) * 32));
+      for (int b = 0; b < NUM_COLS; b++)
+        sums[r][b] = _dot(sums[r][b], xs[b], w);
+    }
+  }
+  for (int r = 0; r < NUM_BLOCKS; r++)
+  {
+    const __m256 block_scales = _mm256_mul_ps(_mm256_loadu_ps(scales + 8 * r), _mm256_set1_ps(input_scale));
+    for (int b = 0; b < NUM_COLS; b++)
+      _store(sums[r][b], block_scales, output + b * output_stride + 8 * r, num_rows - 8 * r, accumulate);
+  }
+}
+
+// All of the columns, for NUM_BLOCKS blocks of rows
+template <int NUM_BLOCKS>
+inline void _multiply_rows(const int8_t* weights, const long num_groups, const int32_t* offsets, const float* scales,
+                           const Int8Input& input, const long col_start, Eigen::Ref<Eigen::MatrixXf> output,
+                           const long row, const bool accumulate)
+{
+  const long ncols = output.cols();
+  const long num_rows = output.rows() - row;
+  const float input_scale = input.get_scale();
+  const uint8_t* x[_COLUMN_BLOCK];
+  long j = 0;
+  for (; j + _COLUMN_BLOCK <= ncols; j += _COLUMN_BLOCK)
+  {
+    for (long b = 0; b < _COLUMN_BLOCK; b++)
+      x[b] = input.col(col_start + j + b);
+    _multiply_blocks<NUM_BLOCKS, _COLUMN_BLOCK>(weights, num_groups, offsets, scales, input_scale, x,
+                                                &output(row, j), output.outerStride(), num_rows, accumulate);
+  }
+  for (; j < ncols; j++)
+  {
+    x[0] = input.col(col_start + j);
+    _multiply_blocks<NUM_BLOCKS, 1>(weights, num_groups, offsets, scales, input_scale, x, &output(row, j),
+                                    output.outerStride(), num_rows, accumulate);
+  }
+}
+#endif
+
+void Int8Matrix::multiply_(const Int8Input& input, const long col_start, Eigen::Ref<Eigen::MatrixXf> output,
+                           const long row_start, const bool accumulate) const
+{
+  const long num_rows = output.rows();
+  const long ncols = output.cols();
+  const float input_scale = input.get_scale();
+  long row = 0;
+#ifdef NAM_INT8_SIMD
+  const long num_groups = this->_padded_cols / 4;
+  // 16 rows at a time, then 8 (even if fewer are wanted)
+  for (; row_start % 8 == 0 && row < num_rows; row += 16)
+  {
+    const long block = (row_start + row) / 8;
+    const int8_t* weights = this->_data.data() + block * num_groups * 32;
+    const int32_t* offsets = this->_offsets.data() + block * 8;
+    const float* scales = this->_scales.data() + block * 8;
+    if (num_rows - row > 8)
+      _multiply_rows<2>(weights, num_groups, offsets, scales, input, col_start, output, row, accumulate);
+    else
+      _multiply_rows<1>(weights, num_groups, offsets, scales, input, col_start, output, row, accumulate);
+  }
+#endif
+  // The rest (or all of it, without SIMD)
+  for (; row < num_rows; row++)
+  {
+    const float scale = this->_scales[row_start + row] * input_scale;
+    for (long j = 0; j < ncols; j++)
+    {
+      const uint8_t* x = input.col(col_start + j);
+      int32_t sum = this->_offsets[row_start + row];
+      for (long k = 0; k < this->_cols; k++)
+        sum += (int32_t)this->_get_(row_start + row, k) * x[k];
+      output(row, j) = (accumulate ? output(row, j) : 0.0f) + scale * sum;
+    }
+  }
+}
+
+void Int8Input::quantize_(const Eigen::Ref<const Eigen::MatrixXf>& input, const ActivationRange& range,
+                          const long col_start)
+{
+  this->_rows = input.rows();
+  this->_padded_rows = _round_up_to_4(input.rows());
+  this->_cols = col_start + input.cols();
+  this->_scale = range.max_abs / 127.0f;
+  const size_t size = this->_padded_rows * this->_cols;
+  if (this->_data.size() < size)
+    this->_data.resize(size);
+  const float inverse_scale = range.max_abs > 0.0f ? 127.0f / range.max_abs : 0.0f;
+  for (long j = col_start; j < this->_cols; j++)
+  {
+    const float* column = input.data() + (j - col_start) * input.outerStride();
+    uint8_t* x = this->_data.data() + j * this->_padded_rows;
+    long i = 0;
+#ifdef NAM_INT8_SIMD
+    // 8 at a time
+    const __m256 inverse_scales = _mm256_set1_ps(inverse_scale);
+    for (; i + 8 <= this->_rows; i += 8)
+    {
+      __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(column + i), inverse_scales));
+      q = _mm256_min_epi32(_mm256_max_epi32(q, _mm256_set1_epi32(-127)), _mm256_set1_epi32(127));
+      q = _mm256_add_epi32(q, _mm256_set1_epi32(ZERO_POINT));
+      const __m128i q16 = _mm_packus_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(x + i), _mm_packus_epi16(q16, q16));
+    }
+#endif
+    for (; i < this->_rows; i++)
+      x[i] = (uint8_t)(_quantize(column[i], inverse_scale) + ZERO_POINT);
+    for (; i < this->_padded_rows; i++)
+      x[i] = ZERO_POINT;
+  }
+}
@@ -0,0 +1,108 @@
+#pragma once
+// Int8 weights and activations (EWeightPrecision::kInt8), multiplied with
+// integer dot products and scaled back to fp32 as the results are written.
+//
+// Weights have a scale for each output channel (row). Each convolution's
+// input has one scale, from the range that it was seen to cover while the
+// model was calibrated: run at fp32 over typical audio (see nam_quantize).
+
+#include <algorithm> // std::max
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+
+// How far from zero a convolution's input goes. Int8 maps [-max_abs, max_abs]
+// onto [-127, 127]; anything beyond that is clipped.
+struct ActivationRange
+{
+  // While this is set, the convolution widens the range to cover its input.
+  bool calibrating = false;
+  // 0 until it's been calibrated
+  float max_abs = 0.0f;
+
+  void observe(const Eigen::Ref<const Eigen::MatrixXf>& input)
+  {
+    if (this->calibrating && input.size() > 0)
+      this->max_abs = std::max(this->max_abs, input.cwiseAbs().maxCoeff());
+  };
+};
+
+// A matrix quantized to int8, to multiply by Int8Input
+class Int8Input;
+class Int8Matrix
+{
+public:
+  Int8Matrix()
+  : _rows(0)
+  , _cols(0)
+  , _padded_cols(0){};
+  explicit Int8Matrix(const Eigen::MatrixXf& m);
+  long rows() const { return this->_rows; };
+  long cols() const { return this->_cols; };
+  long size() const { return this->_rows * this->_cols; };
+  // Bytes of weights, scales and offsets
+  size_t get_memory_size() const
+  {
+    return this->_data.size() * sizeof(int8_t) + this->_scales.size() * sizeof(float)
+           + this->_offsets.size() * sizeof(int32_t);
+  };
+  // Back to fp32 (with the rounding that quantizing did)
+  Eigen::MatrixXf widen() const;
+  // output = (or += if accumulate) rows [row_start, row_start + output.rows())
+  // of this, times columns [col_start, col_start + output.cols()) of input.
+  // Uses VNNI (AVX-512 or AVX) or AVX2 where the build allows, for row_start
+  // that are multiples of 8; otherwise one element at a time.
+  void multiply_(const Int8Input& input, const long col_start, Eigen::Ref<Eigen::MatrixXf> output,
+                 const long row_start, const bool accumulate) const;
+
+private:
+  long _rows;
+  long _cols;
+  // _cols, rounded up to a multiple of 4
+  long _padded_cols;
+  std::vector<float> _scales;
+  // What Int8Input's zero point adds to each row's dot products, to take
+  // back off
+  std::vector<int32_t> _offsets;
+  // Blocks of 8 rows (the last one padded with zeros). Each block has 4
+  // columns at a time: the 4 weights of row 0, then of row 1, etc., so that
+  // each row's dot product stays in its own 32-bit lane.
+  std::vector<int8_t> _data;
+
+  int8_t _get_(const long i, const long j) const;
+};
+
+// A matrix of activations quantized to int8, for Int8Matrix::multiply_()
+class Int8Input
+{
+public:
+  Int8Input()
+  : _rows(0)
+  , _padded_rows(0)
+  , _cols(0)
+  , _scale(0.0f){};
+  // Quantize input to the range, as columns [col_start, col_start +
+  // input.cols()), keeping the ones before (which need to have been quantized
+  // from as many rows, to the same range). Only allocates when this is bigger
+  // than it's been before.
+  void quantize_(const Eigen::Ref<const Eigen::MatrixXf>& input, const ActivationRange& range,
+                 const long col_start = 0);
+  long rows() const { return this->_rows; };
+  long cols() const { return this->_cols; };
+  // Bytes allocated (for the biggest input so far)
+  size_t get_memory_size() const { return this->_data.capacity() * sizeof(uint8_t); };
+  // Quantized values are stored as unsigned, plus this
+  static constexpr int ZERO_POINT = 128;
+  // Column j, padded with (quantized) zeros to a multiple of 4 values
+  const uint8_t* col(const long j) const { return this->_data.data() + j * this->_padded_rows; };
+  // What one step of the quantized values is worth
+  float get_scale() const { return this->_scale; };
+
+private:
+  long _rows;
+  long _padded_rows;
+  long _cols;
+  float _scale;
+  std::vector<uint8_t> _data;
+};
@@ -1,10 +1,25 @@
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 
 #include "lstm.h"
 
+// prewarm() stops once the output has moved by less than _PREWARM_TOLERANCE
+// for _PREWARM_SETTLED_FRAMES frames in a row, or after _MAX_PREWARM_FRAMES.
+constexpr const float _PREWARM_TOLERANCE = 1.0e-7f;
+constexpr const long _PREWARM_SETTLED_FRAMES = 64;
+constexpr const long _MAX_PREWARM_FRAMES = 48000;
+
 lstm::LSTMCell::LSTMCell(const int input_size, const int hidden_size, std::vector<float>::iterator& params)
+: _input_size(input_size)
+, _hidden_size(hidden_size)
+, _arena_w(-1)
+, _arena_b(-1)
+, _arena_xh(-1)
+, _arena_ifgo(-1)
+, _arena_c(-1)
+, _update_state(&LSTMCell::_update_state_<activations::sigmoid, activations::tanh>)
 {
   // Resize arrays
   this->_w.resize(4 * hidden_size, input_size + hidden_size);
@@ -26,25 +41,175 @@ lstm::LSTMCell::LSTMCell(const int input_size, const int hidden_size, std::vecto
     this->_c[i] = *(params++);
 }
 
-void lstm::LSTMCell::process_(const Eigen::VectorXf& x)
+void lstm::LSTMCell::move_to_(Arena& arena)
+{
+  if (this->_arena_w >= 0)
+    return;
+  this->_arena_w = arena.add_(this->_w.data(), this->_w.size());
+  this->_arena_b = arena.add_(this->_b.data(), this->_b.size());
+  this->_arena_xh = arena.add_(this->_xh.data(), this->_xh.size());
+  this->_arena_ifgo = arena.add_(this->_ifgo.data(), this->_ifgo.size());
+  this->_arena_c = arena.add_(this->_c.data(), this->_c.size());
+  this->_w.resize(0, 0);
+  this->_b.resize(0);
+  this->_xh.resize(0);
+  this->_ifgo.resize(0);
+  this->_c.resize(0);
+}
+
+void lstm::LSTMCell::take_from_(const Arena& arena)
 {
+  if (this->_arena_w < 0)
+    return;
   const long hidden_size = this->_get_hidden_size();
+  const long xh_size = this->_get_input_size() + hidden_size;
+  this->_w = Eigen::Map<const Eigen::MatrixXf>(arena.get(this->_arena_w), 4 * hidden_size, xh_size);
+  this->_b = Eigen::Map<const Eigen::VectorXf>(arena.get(this->_arena_b), 4 * hidden_size);
+  this->_xh = Eigen::Map<const Eigen::VectorXf>(arena.get(this->_arena_xh), xh_size);
+  this->_ifgo = Eigen::Map<const Eigen::VectorXf>(arena.get(this->_arena_ifgo), 4 * hidden_size);
+  this->_c = Eigen::Map<const Eigen::VectorXf>(arena.get(this->_arena_c), hidden_size);
+  this->_arena_w = this->_arena_b = this->_arena_xh = this->_arena_ifgo = this->_arena_c = -1;
+}
+
+Eigen::Map<const Eigen::VectorXf> lstm::LSTMCell::get_hidden_state(const Arena& arena) const
+{
+  return Eigen::Map<const Eigen::VectorXf>(
+    arena.get(this->_arena_xh) + this->_get_input_size(), this->_get_hidden_size());
+}
+
+size_t lstm::LSTMCell::get_memory_size() const
+{
+  return (this->_w.size() + this->_b.size() + this->_constant_w.size() + this->_base_b.size() + this->_xh.size()
+          + this->_ifgo.size() + this->_c.size())
+         * sizeof(float);
+}
+
+Eigen::Map<Eigen::MatrixXf> lstm::LSTMCell::_get_w_(Arena& arena) const
+{
+  return Eigen::Map<Eigen::MatrixXf>(
+    arena.get(this->_arena_w), 4 * this->_get_hidden_size(), this->_get_input_size() + this->_get_hidden_size());
+}
+
+Eigen::Map<Eigen::VectorXf> lstm::LSTMCell::_get_b_(Arena& arena) const
+{
+  return Eigen::Map<Eigen::VectorXf>(arena.get(this->_arena_b), 4 * this->_get_hidden_size());
+}
+
+Eigen::Map<Eigen::VectorXf> lstm::LSTMCell::_get_xh_(Arena& arena) const
+{
+  return Eigen::Map<Eigen::VectorXf>(arena.get(this->_arena_xh), this->_get_input_size() + this->_get_hidden_size());
+}
+
+Eigen::Map<Eigen::VectorXf> lstm::LSTMCell::_get_ifgo_(Arena& arena) const
+{
+  return Eigen::Map<Eigen::VectorXf>(arena.get(this->_arena_ifgo), 4 * this->_get_hidden_size());
+}
+
+void lstm::LSTMCell::process_(const Eigen::Ref<const Eigen::VectorXf>& x, Arena& arena)
+{
   const long input_size = this->_get_input_size();
+  auto xh = this->_get_xh_(arena);
   // Assign inputs
-  this->_xh(Eigen::seq(0, input_size - 1)) = x;
+  xh.head(input_size) = x;
   // The matmul
-  this->_ifgo = this->_w * this->_xh + this->_b;
+  this->_get_ifgo_(arena).noalias() = this->_get_w_(arena) * xh + this->_get_b_(arena);
+  (this->*_update_state)(arena);
+}
+
+template <float (*SIGMOID)(float), float (*TANH)(float)>
+void lstm::LSTMCell::_update_state_(Arena& arena)
+{
+  const long hidden_size = this->_get_hidden_size();
+  const long input_size = this->_get_input_size();
+  const float* ifgo = arena.get(this->_arena_ifgo);
+  float* c = arena.get(this->_arena_c);
+  float* xh = arena.get(this->_arena_xh);
   // Elementwise updates (apply nonlinearities here)
   const long i_offset = 0;
   const long f_offset = hidden_size;
   const long g_offset = 2 * hidden_size;
   const long o_offset = 3 * hidden_size;
   for (auto i = 0; i < hidden_size; i++)
-    this->_c[i] = activations::sigmoid(this->_ifgo[i + f_offset]) * this->_c[i]
-                  + activations::sigmoid(this->_ifgo[i + i_offset]) * tanhf(this->_ifgo[i + g_offset]);
+    c[i] = SIGMOID(ifgo[i + f_offset]) * c[i] + SIGMOID(ifgo[i + i_offset]) * TANH(ifgo[i + g_offset]);
   const long h_offset = input_size;
   for (int i = 0; i < hidden_size; i++)
-    this->_xh[i + h_offset] = activations::sigmoid(this->_ifgo[i + o_offset]) * tanhf(this->_c[i]);
+    xh[i + h_offset] = SIGMOID(ifgo[i + o_offset]) * TANH(c[i]);
+}
+
+void lstm::LSTMCell::_update_state_table_(Arena& arena)
+{
+  const long hidden_size = this->_get_hidden_size();
+  const long input_size = this->_get_input_size();
+  float* ifgo = arena.get(this->_arena_ifgo);
+  float* c = arena.get(this->_arena_c);
+  // i and f are next to each other.
+  activations::SIGMOID_TABLE.apply(ifgo, 2 * hidden_size);
+  activations::TANH_TABLE.apply(ifgo + 2 * hidden_size, hidden_size);
+  activations::SIGMOID_TABLE.apply(ifgo + 3 * hidden_size, hidden_size);
+  const float* i_gate = ifgo;
+  const float* f_gate = ifgo + hidden_size;
+  const float* g_gate = ifgo + 2 * hidden_size;
+  const float* o_gate = ifgo + 3 * hidden_size;
+  // tanh(c) goes where h does, to be multiplied by o there.
+  float* h = arena.get(this->_arena_xh) + input_size;
+  for (long i = 0; i < hidden_size; i++)
+  {
+    c[i] = f_gate[i] * c[i] + i_gate[i] * g_gate[i];
+    h[i] = c[i];
+  }
+  activations::TANH_TABLE.apply(h, hidden_size);
+  for (long i = 0; i < hidden_size; i++)
+    h[i] *= o_gate[i];
+}
+
+void lstm::LSTMCell::set_activation_policy_(const EActivationPolicy policy)
+{
+  if (policy == EActivationPolicy::kFast)
+    this->_update_state = &LSTMCell::_update_state_<activations::fast_sigmoid, activations::fast_tanh>;
+  else if (policy == EActivationPolicy::kTable)
+    this->_update_state = &LSTMCell::_update_state_table_;
+  else
+    this->_update_state = &LSTMCell::_update_state_<activations::sigmoid, activations::tanh>;
+}
+
+void lstm::LSTMCell::split_constant_inputs_(const long num_inputs)
+{
+  if (num_inputs <= 0)
+    return;
+  const long hidden_size = this->_get_hidden_size();
+  const long input_size = this->_get_input_size() - num_inputs;
+  this->_input_size = input_size;
+  this->_constant_w = this->_w.middleCols(input_size, num_inputs);
+  Eigen::MatrixXf w(this->_w.rows(), input_size + hidden_size);
+  w.leftCols(input_size) = this->_w.leftCols(input_size);
+  w.rightCols(hidden_size) = this->_w.rightCols(hidden_size);
+  this->_w = w;
+  Eigen::VectorXf xh(input_size + hidden_size);
+  xh.head(input_size) = this->_xh.head(input_size);
+  xh.tail(hidden_size) = this->_xh.tail(hidden_size);
+  this->_xh = xh;
+  this->_base_b = this->_b;
+}
+
+void lstm::LSTMCell::set_constant_inputs_(const Eigen::VectorXf& values, Arena& arena)
+{
+  if (this->_constant_w.cols() == 0)
+    return;
+  auto b = this->_get_b_(arena);
+  b.noalias() = this->_constant_w * values;
+  b += this->_base_b;
+}
+
+void lstm::LSTMCell::write_state_(state::Writer& writer, const Arena& arena) const
+{
+  writer.write(arena.get(this->_arena_xh) + this->_get_input_size(), this->_get_hidden_size());
+  writer.write(arena.get(this->_arena_c), this->_get_hidden_size());
+}
+
+void lstm::LSTMCell::read_state_(state::Reader& reader, Arena& arena)
+{
+  reader.read(arena.get(this->_arena_xh) + this->_get_input_size(), this->_get_hidden_size());
+  reader.read(arena.get(this->_arena_c), this->_get_hidden_size());
 }
 
 template <typename SampleType>
@@ -58,6 +223,8 @@ template <typename SampleType>
 lstm::LSTM<SampleType>::LSTM(const SampleType loudness, const int num_layers, const int input_size, const int hidden_size,
                  std::vector<float>& params, nlohmann::json& parametric)
 : DSP<SampleType>(loudness)
+, _head_size(hidden_size)
+, _arena_head_weight(-1)
 {
   this->_init_parametric(parametric);
   std::vector<float>::iterator it = params.begin();
@@ -68,6 +235,43 @@ lstm::LSTM<SampleType>::LSTM(const SampleType loudness, const int num_layers, co
     this->_head_weight[i] = *(it++);
   this->_head_bias = *(it++);
   assert(it == params.end());
+  if (this->_layers.size() > 0)
+    this->_layers[0].split_constant_inputs_(this->_params.size());
+  this->_layout_arena_();
+}
+
+template <typename SampleType>
+void lstm::LSTM<SampleType>::set_arena_options(const ArenaOptions& options)
+{
+  this->_arena_options = options;
+  this->_layout_arena_();
+}
+
+template <typename SampleType>
+size_t lstm::LSTM<SampleType>::get_memory_size() const
+{
+  size_t size = this->DSP<SampleType>::get_memory_size()
+                + (this->_head_weight.size() + this->_input.size() + this->_params.size()) * sizeof(float);
+  for (const auto& layer : this->_layers)
+    size += layer.get_memory_size();
+  return size;
+}
+
+template <typename SampleType>
+void lstm::LSTM<SampleType>::_layout_arena_()
+{
+  // Everything comes back out of the arena, then goes into the new one.
+  for (auto& layer : this->_layers)
+    layer.take_from_(this->_arena);
+  if (this->_arena_head_weight >= 0)
+    this->_head_weight =
+      Eigen::Map<const Eigen::VectorXf>(this->_arena.get(this->_arena_head_weight), this->_head_size);
+  this->_arena.clear_();
+  for (auto& layer : this->_layers)
+    layer.move_to_(this->_arena);
+  this->_arena_head_weight = this->_arena.add_(this->_head_weight.data(), this->_head_size);
+  this->_head_weight.resize(0);
+  this->_arena.allocate_(this->_arena_options);
 }
 
 template <typename SampleType>
@@ -79,25 +283,72 @@ void lstm::LSTM<SampleType>::_init_parametric(nlohmann::json& parametric)
     parametric_names.push_back(it.key());
   }
   std::sort(parametric_names.begin(), parametric_names.end());
+  // Param with handle h goes at 1 + h in the first layer's input.
+  for (std::vector<std::string>::iterator it = parametric_names.begin(); it != parametric_names.end(); ++it)
+    this->_register_param_(*it);
+
+  this->_input.setZero(1); // TODO amp parameters
+  this->_params.setZero(parametric.size());
+}
+
+template <typename SampleType>
+void lstm::LSTM<SampleType>::prewarm()
+{
+  // The state never quite forgets, so there's no shortcut to where silence
+  // leaves it; just wait for the output to stop moving.
+  this->_update_input_params_();
+  float previous = this->_process_sample(0.0f);
+  long settled = 0;
+  for (long i = 1; i < _MAX_PREWARM_FRAMES && settled < _PREWARM_SETTLED_FRAMES; i++)
   {
-    int i = 1;
-    for (std::vector<std::string>::iterator it = parametric_names.begin(); it != parametric_names.end(); ++it, i++)
-      this->_parametric_map[*it] = i;
+    const float output = this->_process_sample(0.0f);
+    settled = std::abs(output - previous) < _PREWARM_TOLERANCE ? settled + 1 : 0;
+    previous = output;
   }
+}
 
-  this->_input_and_params.resize(1 + parametric.size()); // TODO amp parameters
+template <typename SampleType>
+bool lstm::LSTM<SampleType>::get_state(DSPState& state) const
+{
+  state::Writer writer(state, "LSTM");
+  for (const auto& layer : this->_layers)
+    layer.write_state_(writer, this->_arena);
+  return true;
+}
+
+template <typename SampleType>
+void lstm::LSTM<SampleType>::set_activation_policy(const EActivationPolicy policy)
+{
+  for (auto& layer : this->_layers)
+    layer.set_activation_policy_(policy);
+}
+
+template <typename SampleType>
+void lstm::LSTM<SampleType>::set_state(const DSPState& state)
+{
+  state::Reader reader(state, "LSTM");
+  for (auto& layer : this->_layers)
+    layer.read_state_(reader, this->_arena);
+  reader.finish();
+}
+
+template <typename SampleType>
+void lstm::LSTM<SampleType>::_update_input_params_()
+{
+  if (!this->_stale_params)
+    return;
+  for (size_t h = 0; h < this->_param_values.size(); h++)
+    this->_params(h) = (float)this->_param_values[h];
+  if (this->_layers.size() > 0)
+    this->_layers[0].set_constant_inputs_(this->_params, this->_arena);
+  this->_stale_params = false;
 }
 
 template <typename SampleType>
 void lstm::LSTM<SampleType>::_process_core_()
 {
-  // Get params into the input vector before starting
-  if (this->_stale_params)
-  {
-    for (std::unordered_map<std::string, double>::iterator it = this->_params.begin(); it != this->_params.end(); ++it)
-      this->_input_and_params[this->_parametric_map[it->first]] = it->second;
-    this->_stale_params = false;
-  }
+  // Get the params to the first layer before starting
+  this->_update_input_params_();
   // Process samples, placing results in the required output location
   for (int i = 0; i < this->_input_post_gain.size(); i++)
     this->_core_dsp_output[i] = this->_process_sample(this->_input_post_gain[i]);
@@ -108,11 +359,12 @@ float lstm::LSTM<SampleType>::_process_sample(const float x)
 {
   if (this->_layers.size() == 0)
     return x;
-  this->_input_and_params(0) = x;
-  this->_layers[0].process_(this->_input_and_params);
+  this->_input(0) = x;
+  this->_layers[0].process_(this->_input, this->_arena);
   for (int i = 1; i < this->_layers.size(); i++)
-    this->_layers[i].process_(this->_layers[i - 1].get_hidden_state());
-  return this->_head_weight.dot(this->_layers[this->_layers.size() - 1].get_hidden_state()) + this->_head_bias;
+    this->_layers[i].process_(this->_layers[i - 1].get_hidden_state(this->_arena), this->_arena);
+  const Eigen::Map<const Eigen::VectorXf> head_weight(this->_arena.get(this->_arena_head_weight), this->_head_size);
+  return head_weight.dot(this->_layers.back().get_hidden_state(this->_arena)) + this->_head_bias;
 }
 
 template class lstm::LSTM<double>;
@@ -1,7 +1,6 @@
 #pragma once
 // LSTM implementation
 
-#include <map>
 #include <vector>
 
 #include <Eigen/Dense>
@@ -22,8 +21,27 @@ class LSTMCell
 {
 public:
   LSTMCell(const int input_size, const int hidden_size, std::vector<float>::iterator& params);
-  Eigen::VectorXf get_hidden_state() const { return this->_xh(Eigen::placeholders::lastN(this->_get_hidden_size())); };
-  void process_(const Eigen::VectorXf& x);
+  // Move the weights, bias and state that process_() uses into the model's
+  // arena, and back (e.g. to lay it out again). The rest of the methods
+  // need the arena that they're in.
+  void move_to_(Arena& arena);
+  void take_from_(const Arena& arena);
+  Eigen::Map<const Eigen::VectorXf> get_hidden_state(const Arena& arena) const;
+  void process_(const Eigen::Ref<const Eigen::VectorXf>& x, Arena& arena);
+  // Take the last num_inputs inputs out of the product, for inputs that are
+  // the same for every sample (the model's params): what they add goes into
+  // the bias instead, from set_constant_inputs_(). They start at 0. Call
+  // before move_to_().
+  void split_constant_inputs_(const long num_inputs);
+  void set_constant_inputs_(const Eigen::VectorXf& values, Arena& arena);
+  // kFast approximates the gates' sigmoids and the tanhs, and kTable looks
+  // them up; otherwise, they're exact.
+  void set_activation_policy_(const EActivationPolicy policy);
+  // The hidden and cell states, for LSTM::get_state()/set_state()
+  void write_state_(state::Writer& writer, const Arena& arena) const;
+  void read_state_(state::Reader& reader, Arena& arena);
+  // Bytes kept outside the arena
+  size_t get_memory_size() const;
 
 private:
   // Parameters
@@ -31,6 +49,9 @@ private:
   // (dx+dh) -> (4*dh)
   Eigen::MatrixXf _w;
   Eigen::VectorXf _b;
+  // The constant inputs' weights, and the bias before they're added
+  Eigen::MatrixXf _constant_w;
+  Eigen::VectorXf _base_b;
 
   // State
   // Concatenated input and hidden state
@@ -41,8 +62,32 @@ private:
   // Cell state
   Eigen::VectorXf _c;
 
-  long _get_hidden_size() const { return this->_b.size() / 4; };
-  long _get_input_size() const { return this->_xh.size() - this->_get_hidden_size(); };
+  long _input_size;
+  long _hidden_size;
+  // Where _w, _b, _xh, _ifgo and _c are in the arena after move_to_() (-1
+  // before)
+  long _arena_w;
+  long _arena_b;
+  long _arena_xh;
+  long _arena_ifgo;
+  long _arena_c;
+
+  // The elementwise part of process_(), with the activations bound by
+  // set_activation_policy_()
+  void (LSTMCell::*_update_state)(Arena& arena);
+  template <float (*SIGMOID)(float), float (*TANH)(float)>
+  void _update_state_(Arena& arena);
+  // kTable: the same, with each activation applied to all of its gates at
+  // once, so that the tables' lookups can be gathered 8 at a time
+  void _update_state_table_(Arena& arena);
+
+  long _get_hidden_size() const { return this->_hidden_size; };
+  long _get_input_size() const { return this->_input_size; };
+  // Where each one is in the arena
+  Eigen::Map<Eigen::MatrixXf> _get_w_(Arena& arena) const;
+  Eigen::Map<Eigen::VectorXf> _get_b_(Arena& arena) const;
+  Eigen::Map<Eigen::VectorXf> _get_xh_(Arena& arena) const;
+  Eigen::Map<Eigen::VectorXf> _get_ifgo_(Arena& arena) const;
 };
 
 // The multi-layer LSTM model
@@ -55,21 +100,43 @@ public:
   LSTM(const SampleType loudness, const int num_layers, const int input_size, const int hidden_size,
        std::vector<float>& params, nlohmann::json& parametric);
   ~LSTM() = default;
+  std::unique_ptr<DSP<SampleType>> clone() const override { return std::make_unique<LSTM<SampleType>>(*this); };
+  // Runs silence through until the output settles
+  void prewarm() override;
+  void set_activation_policy(const EActivationPolicy policy) override;
+  // The arena has each layer's weights, bias and state, in the order that
+  // they're used, then the head's weights.
+  void set_arena_options(const ArenaOptions& options) override;
+  const Arena* get_arena() const override { return &this->_arena; };
+  size_t get_memory_size() const override;
+  bool get_state(DSPState& state) const override;
+  void set_state(const DSPState& state) override;
 
 protected:
+  // Here until _layout_arena_(), then in the arena at _arena_head_weight
   Eigen::VectorXf _head_weight;
+  long _head_size;
+  long _arena_head_weight;
   float _head_bias;
+  Arena _arena;
+  ArenaOptions _arena_options;
+  void _layout_arena_();
   void _process_core_() override;
   std::vector<LSTMCell> _layers;
 
+  // Pass the params on to the first layer if they've changed.
+  void _update_input_params_();
+
   float _process_sample(const float x);
 
   // Initialize the parametric map
   void _init_parametric(nlohmann::json& parametric);
 
-  // Mapping from param name to index in _input_and_params:
-  std::map<std::string, int> _parametric_map;
-  // Input sample first, params second
-  Eigen::VectorXf _input_and_params;
+  // The input sample
+  Eigen::VectorXf _input;
+  // The params in handle order. They come after the input sample as the
+  // first layer's inputs, but as they only change now and then, the layer
+  // keeps them out of its product.
+  Eigen::VectorXf _params;
 };
 }; // namespace lstm
@@ -1,5 +1,6 @@
 #include <algorithm> // std::max_element
 #include <algorithm>
+#include <cctype> // std::tolower
 #include <cmath> // pow, tanh, expf
 #include <filesystem>
 #include <fstream>
@@ -15,11 +16,18 @@
 // #define tanh_impl_ fast_tanh_
 
 constexpr const long _INPUT_BUFFER_SAFETY_FACTOR = 32;
+// How many parameter updates can be waiting for the audio thread
+constexpr const size_t _PARAM_QUEUE_CAPACITY = 256;
+// Output channels are split among threads in multiples of this (a few SIMD
+// registers' worth)
+constexpr const long _TILE_ROWS = 8;
 
 template <typename SampleType>
 DSP<SampleType>::DSP()
 : mLoudness(TARGET_DSP_LOUDNESS)
+, mExpectedSampleRate(-1.0)
 , mNormalizeOutputLoudness(false)
+, _param_updates(_PARAM_QUEUE_CAPACITY)
 , _stale_params(true)
 {
 }
@@ -27,17 +35,46 @@ DSP<SampleType>::DSP()
 template <typename SampleType>
 DSP<SampleType>::DSP(const SampleType loudness)
 : mLoudness(loudness)
+, mExpectedSampleRate(-1.0)
 , mNormalizeOutputLoudness(false)
+, _param_updates(_PARAM_QUEUE_CAPACITY)
 , _stale_params(true)
 {
 }
 
+template <typename SampleType>
+DSP<SampleType>::DSP(const DSP<SampleType>& other)
+: mLoudness(other.mLoudness)
+, mExpectedSampleRate(other.mExpectedSampleRate)
+, mNormalizeOutputLoudness(other.mNormalizeOutputLoudness)
+, _param_names(other._param_names)
+, _param_values(other._param_values)
+, _param_updates(other._param_updates.capacity())
+, _stale_params(other._stale_params)
+, _input_post_gain(other._input_post_gain)
+, _core_dsp_output(other._core_dsp_output)
+{
+}
+
+template <typename SampleType>
+void DSP<SampleType>::process(SampleType** inputs, SampleType** outputs, const int num_channels, const int num_frames,
+                              const SampleType input_gain, const SampleType output_gain,
+                              const std::unordered_map<std::string, SampleType>& params)
+{
+  for (auto it = params.begin(); it != params.end(); ++it)
+  {
+    const int handle = this->get_param_handle(it->first);
+    if (handle >= 0)
+      this->_param_updates.push({handle, (double)it->second});
+  }
+  this->process(inputs, outputs, num_channels, num_frames, input_gain, output_gain);
+}
+
 template <typename SampleType>
 void DSP<SampleType>::process(SampleType** inputs, SampleType** outputs, const int num_channels, const int num_frames,
-                  const SampleType input_gain, const SampleType output_gain,
-                  const std::unordered_map<std::string, SampleType>& params)
+                              const SampleType input_gain, const SampleType output_gain)
 {
-  this->_get_params_(params);
+  this->_update_params_();
   this->_apply_input_level_(inputs, num_channels, num_frames, input_gain);
   this->_ensure_core_dsp_output_ready_();
   this->_process_core_();
@@ -48,19 +85,100 @@ template <typename SampleType>
 void DSP<SampleType>::finalize_(const int num_frames) {}
 
 template <typename SampleType>
-void DSP<SampleType>::_get_params_(const std::unordered_map<std::string, SampleType>& input_params)
+size_t DSP<SampleType>::get_memory_size() const
 {
-  this->_stale_params = false;
-  for (auto it = input_params.begin(); it != input_params.end(); ++it)
+  return (this->_input_post_gain.capacity() + this->_core_dsp_output.capacity()) * sizeof(float)
+         + this->_param_values.capacity() * sizeof(double) + this->get_arena_size();
+}
+
+template <typename SampleType>
+void DSP<SampleType>::set_state(const DSPState& state)
+{
+  throw std::runtime_error("This model's state can't be restored");
+}
+
+// Case-insensitive string comparison that doesn't allocate
+bool _names_match(const std::string& a, const std::string& b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i]))
+      return false;
+  return true;
+}
+
+template <typename SampleType>
+int DSP<SampleType>::get_param_handle(const std::string& name) const
+{
+  // There are only ever a few, so a linear search is fine.
+  for (size_t i = 0; i < this->_param_names.size(); i++)
+    if (_names_match(this->_param_names[i], name))
+      return (int)i;
+  return -1;
+}
+
+template <typename SampleType>
+bool DSP<SampleType>::set_param(const int handle, const double value)
+{
+  if (handle < 0 || handle >= (int)this->_param_names.size())
+  {
+    std::stringstream ss;
+    ss << "Invalid parameter handle " << handle << "; model has " << this->_param_names.size() << " parameters";
+    throw std::runtime_error(ss.str());
+  }
+  return this->_param_updates.push({handle, value});
+}
+
+template <typename SampleType>
+int DSP<SampleType>::_register_param_(const std::string& name)
+{
+  if (this->get_param_handle(name) >= 0)
   {
-    const std::string key = util::lowercase(it->first);
-    const double value = it->second;
-    if (this->_params.find(key) == this->_params.end()) // Not contained
-      this->_stale_params = true;
-    else if (this->_params[key] != value) // Contained but new value
-      this->_stale_params = true;
-    this->_params[key] = value;
+    std::stringstream ss;
+    ss << "Parameter " << name << " was registered twice";
+    throw std::runtime_error(ss.str());
   }
+  this->_param_names.push_back(name);
+  this->_param_values.push_back(0.0);
+  this->_stale_params = true;
+  return (int)this->_param_names.size() - 1;
+}
+
+template <typename SampleType>
+void DSP<SampleType>::_set_param_value_(const int handle, const double value)
+{
+  if (this->_param_values[handle] != value)
+  {
+    this->_param_values[handle] = value;
+    this->_stale_params = true;
+  }
+}
+
+template <typename SampleType>
+void DSP<SampleType>::_update_params_()
+{
+  ParamUpdate update;
+  while (this->_param_updates.pop(update))
+    this->_set_param_value_(update.handle, update.value);
+}
+
+template <typename SampleType>
+void DSP<SampleType>::_register_params_of_(const DSP<SampleType>& model)
+{
+  for (const auto& name : model._param_names)
+    this->_register_param_(name);
+}
+
+template <typename SampleType>
+void DSP<SampleType>::_forward_params_(DSP<SampleType>& model)
+{
+  this->_update_params_();
+  if (!this->_stale_params)
+    return;
+  for (size_t i = 0; i < this->_param_values.size(); i++)
+    model._set_param_value_((int)i, this->_param_values[i]);
+  this->_stale_params = false;
 }
 
 template <typename SampleType>
@@ -179,6 +297,20 @@ void Buffer<SampleType>::_reset_input_buffer()
   this->_input_buffer_offset = this->_receptive_field;
 }
 
+template <typename SampleType>
+void Buffer<SampleType>::_write_input_buffer_(state::Writer& writer) const
+{
+  writer.write(&this->_input_buffer[this->_input_buffer_offset - this->_receptive_field], this->_receptive_field);
+}
+
+template <typename SampleType>
+void Buffer<SampleType>::_read_input_buffer_(state::Reader& reader)
+{
+  // As if it had just been rewound
+  reader.read(this->_input_buffer.data(), this->_receptive_field);
+  this->_reset_input_buffer();
+}
+
 template <typename SampleType>
 void Buffer<SampleType>::finalize_(const int num_frames)
 {
@@ -186,6 +318,13 @@ void Buffer<SampleType>::finalize_(const int num_frames)
   this->_input_buffer_offset += num_frames;
 }
 
+template <typename SampleType>
+size_t Buffer<SampleType>::get_memory_size() const
+{
+  return this->DSP<SampleType>::get_memory_size()
+         + (this->_input_buffer.capacity() + this->_output_buffer.capacity()) * sizeof(float);
+}
+
 // Linear =====================================================================
 
 template <typename SampleType>
@@ -224,10 +363,39 @@ void Linear<SampleType>::_process_core_()
   }
 }
 
+template <typename SampleType>
+size_t Linear<SampleType>::get_memory_size() const
+{
+  return this->Buffer<SampleType>::get_memory_size() + this->_weight.size() * sizeof(float);
+}
+
+template <typename SampleType>
+bool Linear<SampleType>::get_state(DSPState& state) const
+{
+  state::Writer writer(state, "Linear");
+  this->_write_input_buffer_(writer);
+  return true;
+}
+
+template <typename SampleType>
+void Linear<SampleType>::set_state(const DSPState& state)
+{
+  state::Reader reader(state, "Linear");
+  this->_read_input_buffer_(reader);
+  reader.finish();
+}
+
 // NN modules =================================================================
 
+void _check_not_in_arena(const long arena_weight)
+{
+  if (arena_weight >= 0)
+    throw std::runtime_error("The convolution's weights are in an arena; take them back first");
+}
+
 void Conv1D::set_params_(std::vector<float>::iterator& params)
 {
+  _check_not_in_arena(this->_arena_weight);
   if (this->_weight.size() > 0)
   {
     const long out_channels = this->_weight[0].rows();
@@ -249,6 +417,9 @@ void Conv1D::set_size_(const int in_channels, const int out_channels, const int
   for (int i = 0; i < this->_weight.size(); i++)
     this->_weight[i].resize(out_channels,
                             in_channels); // y = Ax, input array (C,L)
+  this->_in_channels = in_channels;
+  this->_out_channels = out_channels;
+  this->_do_bias = do_bias;
   if (do_bias)
     this->_bias.resize(out_channels);
   else
@@ -263,31 +434,207 @@ void Conv1D::set_size_and_params_(const int in_channels, const int out_channels,
   this->set_params_(params);
 }
 
-void Conv1D::process_(const Eigen::MatrixXf& input, Eigen::MatrixXf& output, const long i_start, const long ncols,
-                      const long j_start) const
+// The precision that a convolution with in_channels keeps its weights at when
+// the model is set to precision.
+// One input channel (the audio itself, in practice) stays fp32 instead of
+// int8: int8 audio is too coarse, and there are few weights to save.
+EWeightPrecision _get_precision(const EWeightPrecision precision, const long in_channels)
+{
+  return precision == EWeightPrecision::kInt8 && in_channels == 1 ? EWeightPrecision::kFloat32 : precision;
+}
+
+void _check_calibrated(const EWeightPrecision precision, const ActivationRange& range)
+{
+  if (precision == EWeightPrecision::kInt8 && !(range.max_abs > 0.0f))
+    throw std::runtime_error("Int8 weights need the model to have been calibrated (see nam_quantize)");
+}
+
+long Conv1D::get_kernel_size() const
 {
+  if (this->_weight_precision == EWeightPrecision::kFloat32)
+    return this->_weight.size();
+  if (this->_weight_precision == EWeightPrecision::kInt8)
+    return this->_int8_weight.size();
+  return this->_half_weight.size();
+}
+
+void Conv1D::set_weight_precision_(const EWeightPrecision model_precision)
+{
+  const EWeightPrecision precision = _get_precision(model_precision, this->_in_channels);
+  if (precision == this->_weight_precision)
+    return;
+  _check_not_in_arena(this->_arena_weight);
+  _check_calibrated(precision, this->_input_range);
+  // Back to fp32 first
+  if (this->_weight_precision != EWeightPrecision::kFloat32)
+  {
+    this->_weight.clear();
+    for (const auto& weight : this->_half_weight)
+      this->_weight.push_back(weight.widen());
+    for (const auto& weight : this->_int8_weight)
+      this->_weight.push_back(weight.widen());
+    this->_half_weight.clear();
+    this->_int8_weight.clear();
+  }
+  if (precision == EWeightPrecision::kInt8)
+  {
+    for (const auto& weight : this->_weight)
+      this->_int8_weight.push_back(Int8Matrix(weight));
+    this->_weight.clear();
+  }
+  else if (precision != EWeightPrecision::kFloat32)
+  {
+    for (const auto& weight : this->_weight)
+      this->_half_weight.push_back(HalfMatrix(weight, precision));
+    this->_weight.clear();
+  }
+  this->_weight_precision = precision;
+}
+
+// How many tiles (of whole multiples of _TILE_ROWS output channels) to split
+// a matrix product into, and how many rows go in each
+void _get_tiles(const ThreadPool* pool, const long min_cost, const long cost, const long rows, int& num_tiles,
+                long& rows_per_tile)
+{
+  num_tiles = 1;
+  rows_per_tile = rows;
+  if (pool == nullptr || cost < min_cost)
+    return;
+  const long max_tiles = std::min((long)pool->get_num_threads(), rows / _TILE_ROWS);
+  if (max_tiles <= 1)
+    return;
+  rows_per_tile = _TILE_ROWS * ((rows + _TILE_ROWS * max_tiles - 1) / (_TILE_ROWS * max_tiles));
+  num_tiles = (int)((rows + rows_per_tile - 1) / rows_per_tile);
+}
+
+void Conv1D::process_(const Eigen::Ref<const Eigen::MatrixXf>& input, Eigen::Ref<Eigen::MatrixXf> output,
+                      const long i_start, const long ncols, const long j_start, const Arena* arena) const
+{
+  this->_input_range.observe(input.middleCols(i_start, ncols));
+  if (this->_weight_precision == EWeightPrecision::kInt8)
+  {
+    // Each tap's columns in turn, once for all of the tiles. (Not all of the
+    // columns that the kernel spans, which can be many more.)
+    const long kernel_size = this->get_kernel_size();
+    for (long k = 0; k < kernel_size; k++)
+      this->_int8_input.quantize_(
+        input.middleCols(i_start + this->_dilation * (k + 1 - kernel_size), ncols), this->_input_range, k * ncols);
+  }
+  const long out_channels = this->get_out_channels();
+  int num_tiles;
+  long rows_per_tile;
+  _get_tiles(this->_thread_pool, this->_min_tile_cost, this->get_num_params() * ncols, out_channels, num_tiles,
+             rows_per_tile);
+  if (num_tiles <= 1)
+    this->_process_rows_(input, output, i_start, ncols, j_start, 0, out_channels, arena);
+  else
+    this->_thread_pool->run(num_tiles, [&](const int tile) {
+      const long row_start = tile * rows_per_tile;
+      this->_process_rows_(input, output, i_start, ncols, j_start, row_start,
+                           std::min(rows_per_tile, out_channels - row_start), arena);
+    });
+}
+
+void Conv1D::_process_rows_(const Eigen::Ref<const Eigen::MatrixXf>& input, Eigen::Ref<Eigen::MatrixXf> output,
+                            const long i_start, const long ncols, const long j_start, const long row_start,
+                            const long num_rows, const Arena* arena) const
+{
+  auto output_block = output.block(row_start, j_start, num_rows, ncols);
   // This is the clever part ;)
-  for (long k = 0; k < this->_weight.size(); k++)
+  const long kernel_size = this->get_kernel_size();
+  for (long k = 0; k < kernel_size; k++)
   {
-    const long offset = this->_dilation * (k + 1 - this->_weight.size());
-    if (k == 0)
-      output.middleCols(j_start, ncols) = this->_weight[k] * input.middleCols(i_start + offset, ncols);
+    const long offset = this->_dilation * (k + 1 - kernel_size);
+    if (this->_weight_precision == EWeightPrecision::kInt8)
+      this->_int8_weight[k].multiply_(this->_int8_input, k * ncols, output_block, row_start, k > 0);
+    else if (this->_weight_precision != EWeightPrecision::kFloat32)
+      this->_half_weight[k].multiply_(input.middleCols(i_start + offset, ncols), output_block, row_start, k > 0);
+    else if (k == 0)
+      output_block.noalias() =
+        this->_get_tap_(k, arena).middleRows(row_start, num_rows) * input.middleCols(i_start + offset, ncols);
     else
-      output.middleCols(j_start, ncols) += this->_weight[k] * input.middleCols(i_start + offset, ncols);
+      output_block.noalias() +=
+        this->_get_tap_(k, arena).middleRows(row_start, num_rows) * input.middleCols(i_start + offset, ncols);
   }
-  if (this->_bias.size() > 0)
-    output.middleCols(j_start, ncols).colwise() += this->_bias;
+  if (this->_do_bias)
+    output_block.colwise() += this->_get_bias_(arena).segment(row_start, num_rows);
+}
+
+Eigen::Map<const Eigen::MatrixXf> Conv1D::_get_tap_(const long k, const Arena* arena) const
+{
+  const long size = this->_out_channels * this->_in_channels;
+  const float* data =
+    this->_arena_weight >= 0 ? arena->get(this->_arena_weight) + k * size : this->_weight[k].data();
+  return Eigen::Map<const Eigen::MatrixXf>(data, this->_out_channels, this->_in_channels);
+}
+
+Eigen::Map<const Eigen::VectorXf> Conv1D::_get_bias_(const Arena* arena) const
+{
+  const float* data = this->_arena_bias >= 0 ? arena->get(this->_arena_bias) : this->_bias.data();
+  return Eigen::Map<const Eigen::VectorXf>(data, this->_do_bias ? this->_out_channels : 0);
+}
+
+void Conv1D::move_weights_to_(Arena& arena)
+{
+  if (this->_weight_precision != EWeightPrecision::kFloat32 || this->_arena_weight >= 0)
+    return;
+  // The taps, one after another
+  std::vector<float> taps;
+  for (const auto& weight : this->_weight)
+    taps.insert(taps.end(), weight.data(), weight.data() + weight.size());
+  this->_arena_weight = arena.add_(taps.data(), (long)taps.size());
+  for (auto& weight : this->_weight)
+    weight.resize(0, 0);
+  if (this->_do_bias)
+  {
+    this->_arena_bias = arena.add_(this->_bias.data(), this->_bias.size());
+    this->_bias.resize(0);
+  }
+}
+
+void Conv1D::take_weights_from_(const Arena& arena)
+{
+  if (this->_arena_weight < 0)
+    return;
+  for (long k = 0; k < (long)this->_weight.size(); k++)
+    this->_weight[k] = this->_get_tap_(k, &arena);
+  this->_bias = this->_get_bias_(&arena);
+  this->_arena_weight = -1;
+  this->_arena_bias = -1;
+}
+
+void Conv1D::set_thread_pool_(ThreadPool* pool, const long min_cost)
+{
+  this->_thread_pool = pool;
+  this->_min_tile_cost = min_cost;
 }
 
 long Conv1D::get_num_params() const
 {
-  long num_params = this->_bias.size();
-  for (long i = 0; i < this->_weight.size(); i++)
-    num_params += this->_weight[i].size();
-  return num_params;
+  const long bias_size = this->_do_bias ? this->_out_channels : 0;
+  return bias_size + this->get_kernel_size() * this->_out_channels * this->_in_channels;
+}
+
+size_t Conv1D::get_memory_size() const
+{
+  size_t size = this->_bias.size() * sizeof(float) + this->_int8_input.get_memory_size();
+  for (const auto& weight : this->_weight)
+    size += weight.size() * sizeof(float);
+  for (const auto& weight : this->_half_weight)
+    size += weight.get_memory_size();
+  for (const auto& weight : this->_int8_weight)
+    size += weight.get_memory_size();
+  return size;
 }
 
 Conv1x1::Conv1x1(const int in_channels, const int out_channels, const bool _bias)
+: _in_channels(in_channels)
+, _out_channels(out_channels)
+, _weight_precision(EWeightPrecision::kFloat32)
+, _thread_pool(nullptr)
+, _min_tile_cost(0)
+, _arena_weight(-1)
+, _arena_bias(-1)
 {
   this->_weight.resize(out_channels, in_channels);
   this->_do_bias = _bias;
@@ -297,20 +644,145 @@ Conv1x1::Conv1x1(const int in_channels, const int out_channels, const bool _bias
 
 void Conv1x1::set_params_(std::vector<float>::iterator& params)
 {
-  for (int i = 0; i < this->_weight.rows(); i++)
-    for (int j = 0; j < this->_weight.cols(); j++)
+  this->set_params_(params, 0, this->_out_channels);
+}
+
+void Conv1x1::set_params_(std::vector<float>::iterator& params, const long row_start, const long num_rows)
+{
+  _check_not_in_arena(this->_arena_weight);
+  for (long i = row_start; i < row_start + num_rows; i++)
+    for (long j = 0; j < this->_weight.cols(); j++)
       this->_weight(i, j) = *(params++);
   if (this->_do_bias)
-    for (int i = 0; i < this->_bias.size(); i++)
+    for (long i = row_start; i < row_start + num_rows; i++)
       this->_bias(i) = *(params++);
 }
 
-Eigen::MatrixXf Conv1x1::process(const Eigen::MatrixXf& input) const
+Eigen::MatrixXf Conv1x1::split_off_inputs_(const long num_inputs)
 {
-  if (this->_do_bias)
-    return (this->_weight * input).colwise() + this->_bias;
+  if (num_inputs > this->_in_channels || this->_weight_precision != EWeightPrecision::kFloat32
+      || this->_arena_weight >= 0)
+    throw std::runtime_error("Can't split inputs off this convolution");
+  const long in_channels = this->_in_channels - num_inputs;
+  const Eigen::MatrixXf split = this->_weight.rightCols(num_inputs);
+  this->_weight = this->_weight.leftCols(in_channels).eval();
+  this->_in_channels = in_channels;
+  return split;
+}
+
+Eigen::MatrixXf Conv1x1::process(const Eigen::Ref<const Eigen::MatrixXf>& input, const Arena* arena) const
+{
+  this->_input_range.observe(input);
+  const bool is_int8 = this->_weight_precision == EWeightPrecision::kInt8;
+  if (is_int8)
+    this->_int8_input.quantize_(input, this->_input_range);
+  const long out_channels = this->get_out_channels();
+  int num_tiles;
+  long rows_per_tile;
+  _get_tiles(this->_thread_pool, this->_min_tile_cost, this->get_num_params() * input.cols(), out_channels,
+             num_tiles, rows_per_tile);
+  const bool is_float32 = this->_weight_precision == EWeightPrecision::kFloat32;
+  if (num_tiles <= 1 && is_float32)
+  {
+    if (this->_do_bias)
+      return (this->_get_weight_(arena) * input).colwise() + this->_get_bias_(arena);
+    else
+      return this->_get_weight_(arena) * input;
+  }
+
+  Eigen::MatrixXf output(out_channels, input.cols());
+  auto process_rows = [&](const long row_start, const long num_rows) {
+    if (is_int8)
+      this->_int8_weight.multiply_(this->_int8_input, 0, output.middleRows(row_start, num_rows), row_start, false);
+    else if (!is_float32)
+      this->_half_weight.multiply_(input, output.middleRows(row_start, num_rows), row_start, false);
+    else
+      output.middleRows(row_start, num_rows).noalias() =
+        this->_get_weight_(arena).middleRows(row_start, num_rows) * input;
+    if (this->_do_bias)
+      output.middleRows(row_start, num_rows).colwise() += this->_get_bias_(arena).segment(row_start, num_rows);
+  };
+  if (num_tiles <= 1)
+    process_rows(0, out_channels);
   else
-    return this->_weight * input;
+    this->_thread_pool->run(num_tiles, [&](const int tile) {
+      const long row_start = tile * rows_per_tile;
+      process_rows(row_start, std::min(rows_per_tile, out_channels - row_start));
+    });
+  return output;
+}
+
+void Conv1x1::set_thread_pool_(ThreadPool* pool, const long min_cost)
+{
+  this->_thread_pool = pool;
+  this->_min_tile_cost = min_cost;
+}
+
+Eigen::Map<const Eigen::MatrixXf> Conv1x1::_get_weight_(const Arena* arena) const
+{
+  const float* data = this->_arena_weight >= 0 ? arena->get(this->_arena_weight) : this->_weight.data();
+  return Eigen::Map<const Eigen::MatrixXf>(data, this->_out_channels, this->_in_channels);
+}
+
+Eigen::Map<const Eigen::VectorXf> Conv1x1::_get_bias_(const Arena* arena) const
+{
+  const float* data = this->_arena_bias >= 0 ? arena->get(this->_arena_bias) : this->_bias.data();
+  return Eigen::Map<const Eigen::VectorXf>(data, this->_do_bias ? this->_out_channels : 0);
+}
+
+void Conv1x1::move_weights_to_(Arena& arena)
+{
+  if (this->_weight_precision != EWeightPrecision::kFloat32 || this->_arena_weight >= 0)
+    return;
+  this->_arena_weight = arena.add_(this->_weight.data(), this->_weight.size());
+  this->_weight.resize(0, 0);
+  if (this->_do_bias)
+  {
+    this->_arena_bias = arena.add_(this->_bias.data(), this->_bias.size());
+    this->_bias.resize(0);
+  }
+}
+
+void Conv1x1::take_weights_from_(const Arena& arena)
+{
+  if (this->_arena_weight < 0)
+    return;
+  this->_weight = this->_get_weight_(&arena);
+  this->_bias = this->_get_bias_(&arena);
+  this->_arena_weight = -1;
+  this->_arena_bias = -1;
+}
+
+size_t Conv1x1::get_memory_size() const
+{
+  return (this->_weight.size() + this->_bias.size()) * sizeof(float) + this->_half_weight.get_memory_size()
+         + this->_int8_weight.get_memory_size() + this->_int8_input.get_memory_size();
+}
+
+void Conv1x1::set_weight_precision_(const EWeightPrecision model_precision)
+{
+  const EWeightPrecision precision = _get_precision(model_precision, this->_in_channels);
+  if (precision == this->_weight_precision)
+    return;
+  _check_not_in_arena(this->_arena_weight);
+  _check_calibrated(precision, this->_input_range);
+  if (this->_weight_precision == EWeightPrecision::kInt8)
+    this->_weight = this->_int8_weight.widen();
+  else if (this->_weight_precision != EWeightPrecision::kFloat32)
+    this->_weight = this->_half_weight.widen();
+  this->_half_weight = HalfMatrix();
+  this->_int8_weight = Int8Matrix();
+  if (precision == EWeightPrecision::kInt8)
+  {
+    this->_int8_weight = Int8Matrix(this->_weight);
+    this->_weight.resize(0, 0);
+  }
+  else if (precision != EWeightPrecision::kFloat32)
+  {
+    this->_half_weight = HalfMatrix(this->_weight, precision);
+    this->_weight.resize(0, 0);
+  }
+  this->_weight_precision = precision;
 }
 
 template class DSP<double>;
@@ -10,6 +10,12 @@
 #include <Eigen/Dense>
 
 #include "activations.h"
+#include "arena.h"
+#include "half.h"
+#include "int8.h"
+#include "spsc_queue.h"
+#include "state.h"
+#include "thread_pool.h"
 
 enum EArchitectures
 {
@@ -35,6 +41,13 @@ public:
 // How loud do we want the models to be? in dB
 #define TARGET_DSP_LOUDNESS -18.0
 
+// A new value for a model's parameter, on its way to the audio thread
+struct ParamUpdate
+{
+  int handle;
+  double value;
+};
+
 template <typename SampleType>
 class DSP
 {
@@ -52,8 +65,14 @@ public:
   //    overridden in subclasses).
   // 4. The output level is applied and the result stored to `output`.
   virtual void process(SampleType** inputs, SampleType** outputs, const int num_channels, const int num_frames,
-                       const SampleType input_gain, const SampleType output_gain,
-                       const std::unordered_map<std::string, SampleType>& params);
+                       const SampleType input_gain, const SampleType output_gain);
+  // Compatibility: set the parameters by name (not case-sensitive) and then
+  // process. Names that the model doesn't have are ignored.
+  // Prefer get_param_handle() and set_param(), and don't mix the two (this
+  // goes through the same queue, from the audio thread).
+  void process(SampleType** inputs, SampleType** outputs, const int num_channels, const int num_frames,
+               const SampleType input_gain, const SampleType output_gain,
+               const std::unordered_map<std::string, SampleType>& params);
   // Anything to take care of before next buffer comes in.
   // For example:
   // * Move the buffer index forward
@@ -63,15 +82,102 @@ public:
   virtual void finalize_(const int num_frames);
   void SetNormalize(const bool normalize) { this->mNormalizeOutputLoudness = normalize; };
   bool HasLoudness() { return mLoudness != TARGET_DSP_LOUDNESS; };
+  SampleType GetLoudness() const { return this->mLoudness; };
+  // The sample rate that the model was trained at, or a negative number if it
+  // isn't known.
+  double GetExpectedSampleRate() const { return this->mExpectedSampleRate; };
+  void SetExpectedSampleRate(const double sampleRate) { this->mExpectedSampleRate = sampleRate; };
+  // How many samples the output lags the input by.
+  virtual int GetLatency() const { return 0; };
+  // Split up the work within each block across a thread pool, where it's big
+  // enough to be worth it (see ParallelThresholds). nullptr (the default)
+  // does everything on the thread that calls process().
+  // Models that don't benefit ignore this. The pool needs to outlive the
+  // model.
+  virtual void set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds = ParallelThresholds()){};
+  // Keep the convolutions' weights at this precision, for less memory (and
+  // memory traffic) at some cost in accuracy. Models that don't have any
+  // ignore this. Not real-time safe.
+  virtual void set_weight_precision(const EWeightPrecision precision){};
+  // Which implementation of each activation to use. Models bind them here,
+  // once, rather than looking them up as they process. Not real-time safe.
+  virtual void set_activation_policy(const EActivationPolicy policy){};
+  // How to set up the arena that the model keeps its weights and scratch in
+  // (see arena.h). Models without one ignore this. Not real-time safe.
+  virtual void set_arena_options(const ArenaOptions& options){};
+  // The model's arena, or nullptr if it doesn't have one
+  virtual const Arena* get_arena() const { return nullptr; };
+  // Bytes in the model's arena (0 if it doesn't have one)
+  size_t get_arena_size() const { return this->get_arena() != nullptr ? this->get_arena()->get_size() : 0; };
+  // Bytes that the model keeps for its weights, state and scratch, in its
+  // arena and out of it (not counting the objects that hold them)
+  virtual size_t get_memory_size() const;
+  // Add the ranges of the convolutions' inputs to ranges, always in the same
+  // order, for calibrating the model for int8 weights (see int8.h). Models
+  // that don't have any add nothing.
+  virtual void get_activation_ranges(std::vector<ActivationRange*>& ranges){};
+  // A copy of the model, state and all, that runs independently of it (e.g.
+  // on another thread). Updates still waiting in the parameter queue aren't
+  // copied. nullptr if the model can't be copied.
+  virtual std::unique_ptr<DSP<SampleType>> clone() const { return nullptr; };
+  // How many frames a copy of the model needs to be run over before its
+  // output matches the original's, whatever state the copy started in. -1 if
+  // there's no such bound (e.g. recurrent models, whose state never quite
+  // forgets).
+  virtual long get_warm_up_frames() const { return -1; };
+  // How many frames of input the model's output depends on once any anti-pop
+  // ramp is over (which get_warm_up_frames() allows for as well): the model
+  // run over the last this many frames picks up where it would have been.
+  // -1 if there's no such bound.
+  virtual long get_history_frames() const { return -1; };
+  // Bring the model to the state that it would be in after a long silence,
+  // skipping any anti-pop ramp, so that its first block is usable at full
+  // level. This takes longer than a block; do it when the model is loaded
+  // (see DSPLoadOptions), not on the audio thread. Models that start out in
+  // that state don't need to do anything.
+  virtual void prewarm(){};
+  // The model's runtime state: what it's kept of the input so far, not its
+  // weights or parameters. Passing it to set_state() of this model or of
+  // another copy of it (from clone() or the same model file) picks up where
+  // this one was, e.g. to switch to a model that's already warm or to fork a
+  // stream. Reuses state's memory. Returns false if the model's state can't
+  // be saved.
+  virtual bool get_state(DSPState& state) const { return false; };
+  // Throws if the state isn't from the same kind of model (which can leave
+  // this one's state partly changed). Doesn't allocate otherwise.
+  virtual void set_state(const DSPState& state);
+
+  // Parameters ("knobs")
+  // The names of the model's parameters. A parameter's handle is its index
+  // here.
+  const std::vector<std::string>& get_param_names() const { return this->_param_names; };
+  // The handle for the parameter with the provided name (not case-sensitive),
+  // or -1 if the model doesn't have it. Look handles up once, when the model
+  // is loaded.
+  int get_param_handle(const std::string& name) const;
+  // Send a parameter a new value. It takes effect at the start of the next
+  // call to process().
+  // Lock-free, for one thread (e.g. the UI) other than the audio thread.
+  // Returns false if the update queue is full; try again later.
+  bool set_param(const int handle, const double value);
 
 protected:
+  // For clone(). The copy gets its own (empty) parameter queue.
+  DSP(const DSP<SampleType>& other);
+
   // How loud is the model?
   SampleType mLoudness;
+  // What sample rate the model expects to be run at
+  double mExpectedSampleRate;
   // Should we normalize according to this loudness?
   bool mNormalizeOutputLoudness;
-  // Parameters (aka "knobs")
-  std::unordered_map<std::string, double> _params;
-  // If the params have changed since the last buffer was processed:
+  // Parameters (aka "knobs"), indexed by handle
+  std::vector<std::string> _param_names;
+  std::vector<double> _param_values;
+  // Updates from set_param(), waiting for the audio thread
+  SPSCQueue<ParamUpdate> _param_updates;
+  // Dirty bit: set when a parameter's value changes. Models that use the
+  // parameters clear it once they've picked up the new values.
   bool _stale_params;
   // Where to store the samples after applying input gain
   std::vector<float> _input_post_gain;
@@ -80,10 +186,19 @@ protected:
 
   // Methods
 
-  // Copy the parameters to the DSP module.
-  // If anything has changed, then set this->_stale_params to true.
-  // (TODO use "listener" approach)
-  void _get_params_(const std::unordered_map<std::string, SampleType>& input_params);
+  // Declare a parameter (with value 0) and return its handle.
+  // Call while the model is being constructed.
+  int _register_param_(const std::string& name);
+  // Set a parameter's value, marking the params stale if it's a change.
+  // Audio thread.
+  void _set_param_value_(const int handle, const double value);
+  // Apply the updates that have come in from set_param().
+  void _update_params_();
+  // For models that wrap another: register its parameters as this one's
+  // (call in the constructor), and pass any changes on to it (call before
+  // running it).
+  void _register_params_of_(const DSP<SampleType>& model);
+  void _forward_params_(DSP<SampleType>& model);
 
   // Apply the input gain
   // Result populates this->_input_post_gain
@@ -111,6 +226,7 @@ public:
   Buffer(const int receptive_field);
   Buffer(const double loudness, const int receptive_field);
   void finalize_(const int num_frames);
+  size_t get_memory_size() const override;
 
 protected:
   // Input buffer
@@ -124,6 +240,9 @@ protected:
   void _set_receptive_field(const int new_receptive_field, const int input_buffer_size);
   void _set_receptive_field(const int new_receptive_field);
   void _reset_input_buffer();
+  // The last receptive field of input, for get_state()/set_state()
+  void _write_input_buffer_(state::Writer& writer) const;
+  void _read_input_buffer_(state::Reader& reader);
   // Use this->_input_post_gain
   virtual void _update_buffers_();
   virtual void _rewind_buffers_();
@@ -136,6 +255,12 @@ class Linear : public Buffer<SampleType>
 public:
   Linear(const int receptive_field, const bool _bias, const std::vector<float>& params);
   Linear(const SampleType loudness, const int receptive_field, const bool _bias, const std::vector<float>& params);
+  std::unique_ptr<DSP<SampleType>> clone() const override { return std::make_unique<Linear<SampleType>>(*this); };
+  long get_warm_up_frames() const override { return this->_receptive_field - 1; };
+  long get_history_frames() const override { return this->_receptive_field - 1; };
+  size_t get_memory_size() const override;
+  bool get_state(DSPState& state) const override;
+  void set_state(const DSPState& state) override;
   void _process_core_() override;
 
 protected:
@@ -147,7 +272,16 @@ protected:
 class Conv1D
 {
 public:
-  Conv1D() { this->_dilation = 1; };
+  Conv1D()
+  : _do_bias(false)
+  , _in_channels(0)
+  , _out_channels(0)
+  , _dilation(1)
+  , _weight_precision(EWeightPrecision::kFloat32)
+  , _thread_pool(nullptr)
+  , _min_tile_cost(0)
+  , _arena_weight(-1)
+  , _arena_bias(-1){};
   void set_params_(std::vector<float>::iterator& params);
   void set_size_(const int in_channels, const int out_channels, const int kernel_size, const bool do_bias,
                  const int _dilation);
@@ -156,20 +290,71 @@ public:
   // Process from input to output
   //  Rightmost indices of input go from i_start to i_end,
   //  Indices on output for from j_start (to j_start + i_end - i_start)
-  void process_(const Eigen::MatrixXf& input, Eigen::MatrixXf& output, const long i_start, const long i_end,
-                const long j_start) const;
-  long get_in_channels() const { return this->_weight.size() > 0 ? this->_weight[0].cols() : 0; };
-  long get_kernel_size() const { return this->_weight.size(); };
+  //  arena: The one that the weights are in, if they've been moved to one
+  void process_(const Eigen::Ref<const Eigen::MatrixXf>& input, Eigen::Ref<Eigen::MatrixXf> output,
+                const long i_start, const long i_end, const long j_start, const Arena* arena = nullptr) const;
+  long get_in_channels() const { return this->_in_channels; };
+  long get_kernel_size() const;
   long get_num_params() const;
-  long get_out_channels() const { return this->_weight.size() > 0 ? this->_weight[0].rows() : 0; };
+  long get_out_channels() const { return this->_out_channels; };
   int get_dilation() const { return this->_dilation; };
+  // Tap k's weights (the first looks furthest back), while they're fp32 and
+  // not in an arena
+  const Eigen::MatrixXf& get_weight(const long k) const { return this->_weight[k]; };
+  // Empty without a bias (or while it's in an arena)
+  const Eigen::VectorXf& get_bias() const { return this->_bias; };
+  bool has_bias() const { return this->_do_bias; };
+  // Move the fp32 weights into the arena, the taps one after another, then the
+  // bias, so that the arena has the only copy; process_() then needs it. At
+  // another precision, they stay here. Take them back before the arena is laid
+  // out again, or to change them. Neither is real-time safe.
+  void move_weights_to_(Arena& arena);
+  void take_weights_from_(const Arena& arena);
+  // Where they are in the arena (-1 while they're here)
+  long get_arena_weight() const { return this->_arena_weight; };
+  long get_arena_bias() const { return this->_arena_bias; };
+  // Bytes of weights (and int8 scratch) kept here rather than in an arena
+  size_t get_memory_size() const;
+  // After the params are set. With one input channel, kInt8 is kFloat32.
+  // Throws for kInt8 if the input range hasn't been calibrated.
+  void set_weight_precision_(const EWeightPrecision model_precision);
+  // The range of the input, for int8 weights
+  ActivationRange& get_input_range() { return this->_input_range; };
+  // Split blocks that cost at least min_cost multiply-adds into tiles of
+  // output channels, run on the pool. nullptr turns it off.
+  void set_thread_pool_(ThreadPool* pool, const long min_cost);
 
 private:
   // Gonna wing this...
   // conv[kernel](cout, cin)
+  // At half precision, _half_weight has the weights instead; at int8,
+  // _int8_weight.
   std::vector<Eigen::MatrixXf> _weight;
+  std::vector<HalfMatrix> _half_weight;
+  std::vector<Int8Matrix> _int8_weight;
   Eigen::VectorXf _bias;
+  bool _do_bias;
+  long _in_channels;
+  long _out_channels;
   int _dilation;
+  EWeightPrecision _weight_precision;
+  ThreadPool* _thread_pool;
+  long _min_tile_cost;
+  // See move_weights_to_()
+  long _arena_weight;
+  long _arena_bias;
+  // Widened by process_() while calibrating
+  mutable ActivationRange _input_range;
+  // The columns of the input that each tap uses, quantized for _int8_weight
+  mutable Int8Input _int8_input;
+
+  // process_(), for output channels [row_start, row_start + num_rows)
+  void _process_rows_(const Eigen::Ref<const Eigen::MatrixXf>& input, Eigen::Ref<Eigen::MatrixXf> output,
+                      const long i_start, const long ncols, const long j_start, const long row_start,
+                      const long num_rows, const Arena* arena) const;
+  // The fp32 weights, wherever they are
+  Eigen::Map<const Eigen::MatrixXf> _get_tap_(const long k, const Arena* arena) const;
+  Eigen::Map<const Eigen::VectorXf> _get_bias_(const Arena* arena) const;
 };
 
 // Really just a linear layer
@@ -178,16 +363,56 @@ class Conv1x1
 public:
   Conv1x1(const int in_channels, const int out_channels, const bool _bias);
   void set_params_(std::vector<float>::iterator& params);
+  // Just output channels [row_start, row_start + num_rows), e.g. for one of
+  // several convolutions that are stacked in this one
+  void set_params_(std::vector<float>::iterator& params, const long row_start, const long num_rows);
+  // Take the last num_inputs input channels out of the convolution and return
+  // their weights, e.g. to handle inputs that hardly change separately. Call
+  // before set_weight_precision_().
+  Eigen::MatrixXf split_off_inputs_(const long num_inputs);
   // :param input: (N,Cin) or (Cin,)
+  // :param arena: As Conv1D::process_()'s
   // :return: (N,Cout) or (Cout,), respectively
-  Eigen::MatrixXf process(const Eigen::MatrixXf& input) const;
+  Eigen::MatrixXf process(const Eigen::Ref<const Eigen::MatrixXf>& input, const Arena* arena = nullptr) const;
 
-  long get_out_channels() const { return this->_weight.rows(); };
+  long get_num_params() const { return this->_out_channels * (this->_in_channels + (this->_do_bias ? 1 : 0)); };
+  long get_in_channels() const { return this->_in_channels; };
+  long get_out_channels() const { return this->_out_channels; };
+  // As Conv1D's
+  const Eigen::MatrixXf& get_weight() const { return this->_weight; };
+  const Eigen::VectorXf& get_bias() const { return this->_bias; };
+  bool has_bias() const { return this->_do_bias; };
+  void move_weights_to_(Arena& arena);
+  void take_weights_from_(const Arena& arena);
+  long get_arena_weight() const { return this->_arena_weight; };
+  long get_arena_bias() const { return this->_arena_bias; };
+  size_t get_memory_size() const;
+  // As Conv1D::set_thread_pool_()
+  void set_thread_pool_(ThreadPool* pool, const long min_cost);
+  // As Conv1D's
+  void set_weight_precision_(const EWeightPrecision model_precision);
+  ActivationRange& get_input_range() { return this->_input_range; };
+  const ActivationRange& get_input_range() const { return this->_input_range; };
 
 private:
+  // As Conv1D's
   Eigen::MatrixXf _weight;
+  HalfMatrix _half_weight;
+  Int8Matrix _int8_weight;
   Eigen::VectorXf _bias;
+  long _in_channels;
+  long _out_channels;
+  EWeightPrecision _weight_precision;
   bool _do_bias;
+  ThreadPool* _thread_pool;
+  long _min_tile_cost;
+  mutable ActivationRange _input_range;
+  mutable Int8Input _int8_input;
+  long _arena_weight;
+  long _arena_bias;
+
+  Eigen::Map<const Eigen::MatrixXf> _get_weight_(const Arena* arena) const;
+  Eigen::Map<const Eigen::VectorXf> _get_bias_(const Arena* arena) const;
 };
 
 // Utilities ==================================================================
@@ -197,12 +422,38 @@ private:
 // this plugin version.
 void verify_config_version(const std::string version);
 
+// How get_dsp() and get_dsp_stream() set up the model
+struct DSPLoadOptions
+{
+  // Call DSP::prewarm(), trading a slower load for a model that's ready at
+  // full level from the first block.
+  bool prewarm = false;
+  // See DSP::set_weight_precision(). kInt8 needs a model file with
+  // calibrated ranges in it (from nam_quantize).
+  EWeightPrecision weight_precision = EWeightPrecision::kFloat32;
+  // See DSP::set_activation_policy().
+  EActivationPolicy activation_policy = EActivationPolicy::kDefault;
+  // See DSP::set_arena_options().
+  ArenaOptions arena;
+  // Run the load-time passes that fold ConvNet's BatchNorm and WaveNet's head
+  // scale into the weights before them. Off only to check the passes against
+  // the model as trained.
+  bool fold_weights = true;
+  // Stretch the model's time scales by this factor (its dilations, with the
+  // kernels zero-stuffed to match), so that it runs at this many times the
+  // sample rate it was trained at. For oversampling a model trained at the
+  // host's rate; see get_oversampled_dsp(). Not for LSTMs.
+  int time_scale = 1;
+};
+
 // Takes the model file and uses it to instantiate an instance of DSP.
 template <typename SampleType>
-std::unique_ptr<DSP<SampleType>> get_dsp(const std::filesystem::path model_file);
+std::unique_ptr<DSP<SampleType>> get_dsp(const std::filesystem::path model_file,
+                                         const DSPLoadOptions& options = DSPLoadOptions());
 // Legacy loader for directory-type DSPs
 template <typename SampleType>
 std::unique_ptr<DSP<SampleType>> get_dsp_legacy(const std::filesystem::path dirname);
 
 template <typename SampleType>
-std::unique_ptr<DSP<SampleType>> get_dsp_stream(const std::string& raw_json);
+std::unique_ptr<DSP<SampleType>> get_dsp_stream(const std::string& raw_json,
+                                                const DSPLoadOptions& options = DSPLoadOptions());
@@ -0,0 +1,81 @@
+#include <algorithm> // std::min
+#include <cmath> // ceil
+#include <stdexcept>
+
+#include "oversampling.h"
+
+template <typename SampleType>
+OversampledDSP<SampleType>::OversampledDSP(std::unique_ptr<DSP<SampleType>> model, const int factor,
+                                           const int max_num_frames)
+: DSP<SampleType>(model->GetLoudness())
+, _model(std::move(model))
+, _max_num_frames(max_num_frames)
+{
+  if (max_num_frames <= 0)
+    throw std::runtime_error("OversampledDSP needs a positive maximum buffer size");
+  this->_oversampler.Reset(factor, max_num_frames);
+  this->_model_output.resize(factor * max_num_frames);
+  this->_register_params_of_(*this->_model);
+  const double model_sample_rate = this->_model->GetExpectedSampleRate();
+  this->SetExpectedSampleRate(model_sample_rate > 0.0 ? model_sample_rate / factor : model_sample_rate);
+}
+
+template <typename SampleType>
+void OversampledDSP<SampleType>::process(SampleType** inputs, SampleType** outputs, const int num_channels,
+                                         const int num_frames, const SampleType input_gain,
+                                         const SampleType output_gain)
+{
+  this->_forward_params_(*this->_model);
+  this->_model->SetNormalize(this->mNormalizeOutputLoudness);
+  const int factor = this->GetFactor();
+  for (int start = 0; start < num_frames; start += this->_max_num_frames)
+  {
+    const int n = std::min(this->_max_num_frames, num_frames - start);
+    // MONO ONLY
+    SampleType* model_input = this->_oversampler.Upsample(inputs[0] + start, n);
+    SampleType* model_output = this->_model_output.data();
+    this->_model->process(&model_input, &model_output, 1, factor * n, input_gain, output_gain);
+    this->_model->finalize_(factor * n);
+    this->_oversampler.Downsample(model_output, n, outputs[0] + start);
+    for (int c = 1; c < num_channels; c++)
+      for (int s = start; s < start + n; s++)
+        outputs[c][s] = outputs[0][s];
+  }
+}
+
+template <typename SampleType>
+void OversampledDSP<SampleType>::finalize_(const int num_frames)
+{
+  this->DSP<SampleType>::finalize_(num_frames);
+}
+
+template <typename SampleType>
+int OversampledDSP<SampleType>::GetLatency() const
+{
+  const int factor = this->_oversampler.GetFactor();
+  return (int)std::ceil(this->_oversampler.GetLatency() + (double)this->_model->GetLatency() / factor);
+}
+
+template <typename SampleType>
+void OversampledDSP<SampleType>::set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds)
+{
+  this->_model->set_thread_pool(pool, thresholds);
+}
+
+template <typename SampleType>
+std::unique_ptr<OversampledDSP<SampleType>> get_oversampled_dsp(const std::filesystem::path model_file,
+                                                                const int factor, const int max_num_frames,
+                                                                const DSPLoadOptions& options)
+{
+  DSPLoadOptions stretched = options;
+  stretched.time_scale = factor;
+  return std::make_unique<OversampledDSP<SampleType>>(
+    get_dsp<SampleType>(model_file, stretched), factor, max_num_frames);
+}
+
+template class OversampledDSP<double>;
+template class OversampledDSP<float>;
+template std::unique_ptr<OversampledDSP<double>> get_oversampled_dsp<double>(const std::filesystem::path, const int,
+                                                                             const int, const DSPLoadOptions&);
+template std::unique_ptr<OversampledDSP<float>> get_oversampled_dsp<float>(const std::filesystem::path, const int,
+                                                                           const int, const DSPLoadOptions&);
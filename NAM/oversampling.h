@@ -0,0 +1,61 @@
+#pragma once
+// Running models at a multiple of the host's sample rate
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "namdsp.h"
+#include "Oversampler.h"
+
+// Wraps a model so that it runs at 2x or 4x the host's sample rate, with
+// half-band filters on the way in and out.
+// The model either was trained at the higher rate, or was trained at the
+// host's rate and loaded with its time scales stretched to match (see
+// get_oversampled_dsp()), so that its nonlinearities alias less. (Oversampling
+// just the nonlinearities inside a model isn't offered since each filter would
+// add its delay inside the network's residual paths.)
+// The expected sample rate of the wrapper is the model's divided by the
+// factor, so it can be put inside a ResamplingDSP.
+template <typename SampleType>
+class OversampledDSP : public DSP<SampleType>
+{
+public:
+  // Takes ownership of the model.
+  // factor: 1, 2, or 4
+  // max_num_frames: The longest buffer that the host will provide. Longer
+  // buffers work, but are processed in pieces.
+  OversampledDSP(std::unique_ptr<DSP<SampleType>> model, const int factor, const int max_num_frames);
+  // The model's parameters are this one's.
+  using DSP<SampleType>::process;
+  void process(SampleType** inputs, SampleType** outputs, const int num_channels, const int num_frames,
+               const SampleType input_gain, const SampleType output_gain) override;
+  // The model sees factor times as many frames as the host, so it's finalized
+  // inside process().
+  void finalize_(const int num_frames) override;
+  // Latency of the filters plus the model's, in samples at the host's rate.
+  int GetLatency() const override;
+  // Passed on to the model
+  void set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds = ParallelThresholds()) override;
+  void prewarm() override { this->_model->prewarm(); };
+  int GetFactor() const { return this->_oversampler.GetFactor(); };
+  DSP<SampleType>* get_model() { return this->_model.get(); };
+
+private:
+  std::unique_ptr<DSP<SampleType>> _model;
+  dsp::oversampling::Oversampler<SampleType> _oversampler;
+  int _max_num_frames;
+  // Model output at the oversampled rate
+  std::vector<SampleType> _model_output;
+};
+
+// Load a model trained at the host's rate to run oversampled by the factor,
+// with its dilations stretched by it (DSPLoadOptions::time_scale) so that it
+// keeps the response it was trained to have. Options are passed on to
+// get_dsp(), apart from the time scale. Not for LSTMs.
+template <typename SampleType>
+std::unique_ptr<OversampledDSP<SampleType>> get_oversampled_dsp(const std::filesystem::path model_file,
+                                                                const int factor, const int max_num_frames,
+                                                                const DSPLoadOptions& options = DSPLoadOptions());
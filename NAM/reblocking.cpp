@@ -0,0 +1,115 @@
+#include <algorithm> // std::min, std::fill
+#include <stdexcept>
+
+#include "reblocking.h"
+
+template <typename SampleType>
+ReblockingDSP<SampleType>::ReblockingDSP(std::unique_ptr<DSP<SampleType>> model, const int block_size,
+                                         const EReblockingMode mode)
+: DSP<SampleType>(model->GetLoudness())
+, _model(std::move(model))
+, _block_size(block_size)
+, _mode(mode)
+, _position(0)
+{
+  if (block_size <= 0)
+    throw std::runtime_error("ReblockingDSP needs a positive block size");
+  this->_register_params_of_(*this->_model);
+  this->SetExpectedSampleRate(this->_model->GetExpectedSampleRate());
+  if (mode == EReblockingMode::kThroughput)
+  {
+    this->_block_input.resize(block_size);
+    this->_block_output.resize(block_size);
+    std::fill(this->_block_input.begin(), this->_block_input.end(), (SampleType)0.0);
+    std::fill(this->_block_output.begin(), this->_block_output.end(), (SampleType)0.0);
+  }
+}
+
+template <typename SampleType>
+void ReblockingDSP<SampleType>::process(SampleType** inputs, SampleType** outputs, const int num_channels,
+                                        const int num_frames, const SampleType input_gain,
+                                        const SampleType output_gain)
+{
+  this->_forward_params_(*this->_model);
+  if (this->_mode == EReblockingMode::kZeroLatency)
+  {
+    this->_model->SetNormalize(this->mNormalizeOutputLoudness);
+    for (int start = 0; start < num_frames; start += this->_block_size)
+    {
+      const int n = std::min(this->_block_size, num_frames - start);
+      // MONO ONLY
+      SampleType* model_input = inputs[0] + start;
+      SampleType* model_output = outputs[0] + start;
+      this->_model->process(&model_input, &model_output, 1, n, input_gain, output_gain);
+      this->_model->finalize_(n);
+    }
+    for (int c = 1; c < num_channels; c++)
+      for (int s = 0; s < num_frames; s++)
+        outputs[c][s] = outputs[0][s];
+    return;
+  }
+
+  // The levels are applied here, on the way into and out of the blocks.
+  this->_apply_input_level_(inputs, num_channels, num_frames, input_gain);
+  this->_ensure_core_dsp_output_ready_();
+  for (int done = 0; done < num_frames;)
+  {
+    const int n = std::min(num_frames - done, this->_block_size - this->_position);
+    for (int i = 0; i < n; i++)
+    {
+      this->_block_input[this->_position + i] = (SampleType)this->_input_post_gain[done + i];
+      this->_core_dsp_output[done + i] = (float)this->_block_output[this->_position + i];
+    }
+    this->_position += n;
+    done += n;
+    if (this->_position == this->_block_size)
+      this->_run_block_();
+  }
+  this->_apply_output_level_(outputs, num_channels, num_frames, output_gain);
+}
+
+template <typename SampleType>
+void ReblockingDSP<SampleType>::finalize_(const int num_frames)
+{
+  this->DSP<SampleType>::finalize_(num_frames);
+}
+
+template <typename SampleType>
+int ReblockingDSP<SampleType>::GetLatency() const
+{
+  const int model_latency = this->_model->GetLatency();
+  return this->_mode == EReblockingMode::kThroughput ? model_latency + this->_block_size : model_latency;
+}
+
+template <typename SampleType>
+void ReblockingDSP<SampleType>::set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds)
+{
+  this->_model->set_thread_pool(pool, thresholds);
+}
+
+template <typename SampleType>
+void ReblockingDSP<SampleType>::prewarm()
+{
+  this->_model->prewarm();
+  if (this->_mode != EReblockingMode::kThroughput)
+    return;
+  // The block before the first one: silence, which doesn't move a prewarmed
+  // model.
+  std::fill(this->_block_input.begin(), this->_block_input.end(), (SampleType)0.0);
+  this->_run_block_();
+}
+
+template <typename SampleType>
+void ReblockingDSP<SampleType>::_run_block_()
+{
+  // The levels have been (or will be) applied by this.
+  this->_model->SetNormalize(false);
+  SampleType* model_input = this->_block_input.data();
+  SampleType* model_output = this->_block_output.data();
+  this->_model->process(&model_input, &model_output, 1, this->_block_size, (SampleType)1.0, (SampleType)1.0);
+  this->_model->finalize_(this->_block_size);
+  this->_position = 0;
+}
+
+template class ReblockingDSP<double>;
+template class ReblockingDSP<float>;
@@ -0,0 +1,71 @@
+#pragma once
+// Running models on blocks of a size of our choosing, whatever the host's
+
+#include <memory>
+#include <vector>
+
+#include "namdsp.h"
+
+// How ReblockingDSP runs its model
+enum class EReblockingMode
+{
+  // Each buffer is run as soon as it comes in, in pieces of at most the block
+  // size. No latency is added, but buffers shorter than the block size are
+  // run as they are.
+  kZeroLatency = 0,
+  // The model is only ever run on whole blocks, collected from the host's
+  // buffers. Adds a block of latency.
+  kThroughput
+};
+
+// Wraps a model so that the work in each call to it doesn't depend on the
+// host's buffer size, which can be anything from a handful of frames to
+// thousands, and can change from one buffer to the next.
+//
+// Short blocks cost more per frame: a WaveNet's products are too small to
+// make good use of the CPU, and each block has overhead of its own. In
+// kThroughput mode, the block size is a latency budget: bigger blocks are
+// cheaper per frame and add more latency (which GetLatency() includes). The
+// model also sees the same block size every time, so it never has to resize
+// anything. kZeroLatency can only split long buffers up, which keeps the
+// model's working memory down to the block size.
+//
+// In kThroughput mode, parameter changes and the input gain apply from the
+// next frame in, and the output gain and normalization to the next frame
+// out, so those are a block apart.
+template <typename SampleType>
+class ReblockingDSP : public DSP<SampleType>
+{
+public:
+  // Takes ownership of the model.
+  ReblockingDSP(std::unique_ptr<DSP<SampleType>> model, const int block_size, const EReblockingMode mode);
+  // The model's parameters are this one's.
+  using DSP<SampleType>::process;
+  void process(SampleType** inputs, SampleType** outputs, const int num_channels, const int num_frames,
+               const SampleType input_gain, const SampleType output_gain) override;
+  // The model is run on its own blocks, so it's finalized inside process().
+  void finalize_(const int num_frames) override;
+  // The model's latency, plus a block in kThroughput mode
+  int GetLatency() const override;
+  // Passed on to the model
+  void set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds = ParallelThresholds()) override;
+  // Also fills the first block's output with the model's output for silence.
+  void prewarm() override;
+  int get_block_size() const { return this->_block_size; };
+  EReblockingMode get_mode() const { return this->_mode; };
+  DSP<SampleType>* get_model() { return this->_model.get(); };
+
+private:
+  // kThroughput: run the model on the block that's been collected.
+  void _run_block_();
+
+  std::unique_ptr<DSP<SampleType>> _model;
+  int _block_size;
+  EReblockingMode _mode;
+  // kThroughput: the block being collected, and the model's output for the
+  // one before it, which goes out as the new one comes in (frame i of the
+  // output as frame i of the input).
+  std::vector<SampleType> _block_input;
+  std::vector<SampleType> _block_output;
+  int _position;
+};
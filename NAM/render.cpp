@@ -0,0 +1,82 @@
+#include <algorithm> // std::min, std::max
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "render.h"
+#include "thread_pool.h"
+
+// Frames per call to process(). Segments (and their warm-ups) start on
+// multiples of this so that each copy sees the same blocks that a serial
+// render would have.
+constexpr const long _RENDER_BLOCK_SIZE = 4096;
+
+// Run input[start, end) through the model. The output goes to output[start,
+// end), or nowhere if output is nullptr.
+template <typename SampleType>
+void _render_range(DSP<SampleType>& model, const SampleType* input, SampleType* output, const long start,
+                   const long end)
+{
+  std::vector<SampleType> discard(output == nullptr ? _RENDER_BLOCK_SIZE : 0);
+  for (long i = start; i < end; i += _RENDER_BLOCK_SIZE)
+  {
+    const int n = (int)std::min(_RENDER_BLOCK_SIZE, end - i);
+    // process() doesn't write to its input.
+    SampleType* block_input = const_cast<SampleType*>(input + i);
+    SampleType* block_output = output == nullptr ? discard.data() : output + i;
+    model.process(&block_input, &block_output, 1, n, (SampleType)1.0, (SampleType)1.0);
+    model.finalize_(n);
+  }
+}
+
+template <typename SampleType>
+void render_offline(const DSP<SampleType>& model, const SampleType* input, SampleType* output, const long num_frames,
+                    const int num_threads, const long warm_up)
+{
+  const long model_warm_up = model.get_warm_up_frames();
+  const long frames_before = model_warm_up >= 0 ? model_warm_up : warm_up;
+  // Round the warm-up up to whole blocks
+  const long warm_up_blocks = (std::max(frames_before, 0L) + _RENDER_BLOCK_SIZE - 1) / _RENDER_BLOCK_SIZE;
+  const long num_blocks = (num_frames + _RENDER_BLOCK_SIZE - 1) / _RENDER_BLOCK_SIZE;
+
+  // Split into as many segments as there are threads, but no more than
+  // would have each copy spend longer warming up than rendering.
+  int num_segments = 1;
+  if (frames_before >= 0)
+  {
+    const int max_threads = num_threads > 0 ? num_threads : std::max(1, (int)std::thread::hardware_concurrency());
+    num_segments = (int)std::max(1L, std::min((long)max_threads, num_blocks / std::max(warm_up_blocks, 1L)));
+  }
+  const long segment_blocks = (num_blocks + num_segments - 1) / std::max(num_segments, 1);
+
+  std::vector<std::unique_ptr<DSP<SampleType>>> copies;
+  for (int i = 0; i < num_segments; i++)
+  {
+    copies.push_back(model.clone());
+    if (copies.back() == nullptr)
+      throw std::runtime_error("Can't render this model offline because it can't be copied");
+    // The segments are the parallelism; don't also split each block.
+    if (num_segments > 1)
+      copies.back()->set_thread_pool(nullptr);
+  }
+
+  auto render_segment = [&](const int segment) {
+    const long start = std::min(segment * segment_blocks * _RENDER_BLOCK_SIZE, num_frames);
+    const long end = std::min(start + segment_blocks * _RENDER_BLOCK_SIZE, num_frames);
+    const long warm_up_start = std::max(0L, start - warm_up_blocks * _RENDER_BLOCK_SIZE);
+    _render_range(*copies[segment], input, (SampleType*)nullptr, warm_up_start, start);
+    _render_range(*copies[segment], input, output, start, end);
+  };
+  if (num_segments == 1)
+    render_segment(0);
+  else
+  {
+    ThreadPool pool(num_segments - 1);
+    pool.run(num_segments, render_segment);
+  }
+}
+
+template void render_offline<double>(const DSP<double>& model, const double* input, double* output,
+                                     const long num_frames, const int num_threads, const long warm_up);
+template void render_offline<float>(const DSP<float>& model, const float* input, float* output, const long num_frames,
+                                    const int num_threads, const long warm_up);
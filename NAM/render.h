@@ -0,0 +1,26 @@
+#pragma once
+// Rendering whole files offline, on all cores
+
+#include "namdsp.h"
+
+// Run num_frames of (mono) input through the model at unity gain and write
+// the result to output, as fast as the machine allows.
+//
+// The output is what the model would give if it processed the input itself,
+// from the state that it's in now. The model isn't changed; the work is done
+// on copies of it (see DSP::clone()).
+//
+// Models with a finite receptive field (WaveNet, ConvNet, Linear) have the
+// input split into segments that are rendered in parallel. Each segment's
+// copy is first run over the input just before the segment (see
+// DSP::get_warm_up_frames()) and that output thrown away, so the seams don't
+// show.
+// Recurrent models (LSTM) have no such bound and are rendered in one piece,
+// unless warm_up says how many frames to run each copy over first. The seams
+// are then approximate, though an LSTM's state usually forgets quickly.
+//
+// num_threads: 0 for one per core.
+// Throws if the model can't be copied.
+template <typename SampleType>
+void render_offline(const DSP<SampleType>& model, const SampleType* input, SampleType* output, const long num_frames,
+                    const int num_threads = 0, const long warm_up = -1);
@@ -0,0 +1,109 @@
+#include <algorithm> // std::min, std::fill
+#include <cmath> // ceil
+#include <cstring> // memmove
+#include <stdexcept>
+
+#include "resampling.h"
+
+template <typename SampleType>
+ResamplingDSP<SampleType>::ResamplingDSP(std::unique_ptr<DSP<SampleType>> model, const double host_sample_rate,
+                                         const int max_num_frames)
+: DSP<SampleType>(model->GetLoudness())
+, _model(std::move(model))
+, _resampling(false)
+, _max_num_frames(max_num_frames)
+, _fifo_size(0)
+, _latency(0)
+{
+  if (max_num_frames <= 0)
+    throw std::runtime_error("ResamplingDSP needs a positive maximum buffer size");
+  this->_register_params_of_(*this->_model);
+  const double model_sample_rate = this->_model->GetExpectedSampleRate();
+  this->SetExpectedSampleRate(model_sample_rate);
+  this->_resampling = model_sample_rate > 0.0 && model_sample_rate != host_sample_rate;
+  if (!this->_resampling)
+    return;
+
+  this->_to_model.Reset(host_sample_rate, model_sample_rate, max_num_frames);
+  const size_t max_model_frames = this->_to_model.GetMaxOutputFrames(max_num_frames);
+  this->_from_model.Reset(model_sample_rate, host_sample_rate, max_model_frames);
+  this->_model_input.resize(max_model_frames);
+  this->_model_output.resize(max_model_frames);
+
+  // Each stage can hand over its output a sample early or late relative to
+  // the ideal; leave a little slack for that.
+  const double latency_seconds = this->_to_model.GetLatencySeconds() + this->_from_model.GetLatencySeconds();
+  this->_latency = (int)std::ceil(latency_seconds * host_sample_rate) + 2;
+  this->_fifo.resize(this->_latency + this->_from_model.GetMaxOutputFrames(max_model_frames) + 1);
+  std::fill(this->_fifo.begin(), this->_fifo.end(), (SampleType)0.0);
+  this->_fifo_size = this->_latency;
+}
+
+template <typename SampleType>
+void ResamplingDSP<SampleType>::process(SampleType** inputs, SampleType** outputs, const int num_channels,
+                                        const int num_frames, const SampleType input_gain,
+                                        const SampleType output_gain)
+{
+  this->_forward_params_(*this->_model);
+  this->_model->SetNormalize(this->mNormalizeOutputLoudness);
+  if (!this->_resampling)
+  {
+    this->_model->process(inputs, outputs, num_channels, num_frames, input_gain, output_gain);
+    return;
+  }
+
+  for (int start = 0; start < num_frames; start += this->_max_num_frames)
+  {
+    const int n = std::min(this->_max_num_frames, num_frames - start);
+    // MONO ONLY
+    const size_t num_model_frames = this->_to_model.Process(inputs[0] + start, n, this->_model_input.data());
+    if (num_model_frames > 0)
+    {
+      SampleType* model_input = this->_model_input.data();
+      SampleType* model_output = this->_model_output.data();
+      this->_model->process(&model_input, &model_output, 1, (int)num_model_frames, input_gain, (SampleType)1.0);
+      this->_model->finalize_((int)num_model_frames);
+      this->_fifo_size +=
+        this->_from_model.Process(model_output, num_model_frames, this->_fifo.data() + this->_fifo_size);
+    }
+
+    // Hand out what's ready. Shouldn't run dry, but fill with silence if so.
+    const long ready = std::min((long)n, this->_fifo_size);
+    for (int c = 0; c < num_channels; c++)
+    {
+      for (long s = 0; s < ready; s++)
+        outputs[c][start + s] = output_gain * this->_fifo[s];
+      for (long s = ready; s < n; s++)
+        outputs[c][start + s] = (SampleType)0.0;
+    }
+    this->_fifo_size -= ready;
+    std::memmove(this->_fifo.data(), this->_fifo.data() + ready, this->_fifo_size * sizeof(SampleType));
+  }
+}
+
+template <typename SampleType>
+void ResamplingDSP<SampleType>::finalize_(const int num_frames)
+{
+  this->DSP<SampleType>::finalize_(num_frames);
+  if (!this->_resampling)
+    this->_model->finalize_(num_frames);
+}
+
+template <typename SampleType>
+int ResamplingDSP<SampleType>::GetLatency() const
+{
+  if (!this->_resampling)
+    return this->_model->GetLatency();
+  // Model latency is in samples at its own rate.
+  const double to_host = this->_to_model.GetInputSampleRate() / this->_to_model.GetOutputSampleRate();
+  return this->_latency + (int)std::ceil(this->_model->GetLatency() * to_host);
+}
+
+template <typename SampleType>
+void ResamplingDSP<SampleType>::set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds)
+{
+  this->_model->set_thread_pool(pool, thresholds);
+}
+
+template class ResamplingDSP<double>;
+template class ResamplingDSP<float>;
@@ -0,0 +1,56 @@
+#pragma once
+// Running models at the sample rate they were trained at
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "namdsp.h"
+#include "Resampler.h"
+
+// Wraps a model so that it's run at its expected sample rate
+// (DSP::GetExpectedSampleRate()), converting the host's audio to and from that
+// rate around it.
+// If the model doesn't know its sample rate (or it matches the host's), the
+// model is run directly and there's no added latency.
+template <typename SampleType>
+class ResamplingDSP : public DSP<SampleType>
+{
+public:
+  // Takes ownership of the model.
+  // max_num_frames: The longest buffer that the host will provide. Longer
+  // buffers work, but are processed in pieces.
+  ResamplingDSP(std::unique_ptr<DSP<SampleType>> model, const double host_sample_rate, const int max_num_frames);
+  // The model's parameters are this one's.
+  using DSP<SampleType>::process;
+  void process(SampleType** inputs, SampleType** outputs, const int num_channels, const int num_frames,
+               const SampleType input_gain, const SampleType output_gain) override;
+  // When resampling, the model sees a different number of frames than the
+  // host, so it's finalized inside process().
+  void finalize_(const int num_frames) override;
+  // Latency of the conversions, in samples at the host's rate.
+  int GetLatency() const override;
+  // Passed on to the model
+  void set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds = ParallelThresholds()) override;
+  void prewarm() override { this->_model->prewarm(); };
+  bool IsResampling() const { return this->_resampling; };
+  DSP<SampleType>* get_model() { return this->_model.get(); };
+
+private:
+  std::unique_ptr<DSP<SampleType>> _model;
+  bool _resampling;
+  int _max_num_frames;
+  // Host rate -> model rate
+  dsp::Resampler<SampleType> _to_model;
+  // Model rate -> host rate
+  dsp::Resampler<SampleType> _from_model;
+  std::vector<SampleType> _model_input;
+  std::vector<SampleType> _model_output;
+  // Output that's back at the host's rate, waiting to be handed out.
+  // It starts out with _latency samples of silence so that it never runs dry
+  // while the filters fill up.
+  std::vector<SampleType> _fifo;
+  long _fifo_size;
+  int _latency;
+};
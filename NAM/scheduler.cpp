@@ -0,0 +1,286 @@
+#include <algorithm> // std::max
+#include <chrono>
+#include <cstring> // memcpy
+#include <sstream>
+#include <stdexcept>
+
+#include "scheduler.h"
+
+// How long an idle worker keeps looking for work before it sleeps
+constexpr const std::chrono::microseconds _SPIN_TIME(50);
+
+StreamScheduler::StreamScheduler(const int num_threads, const int max_streams)
+: _next_worker(0)
+, _pending(0)
+, _num_blocks(0)
+, _num_steals(0)
+, _running(true)
+{
+  if (max_streams < 1)
+    throw std::runtime_error("StreamScheduler needs room for at least one stream");
+  const int n = num_threads > 0 ? num_threads : std::max(1, (int)std::thread::hardware_concurrency());
+  this->_streams.resize(max_streams);
+  for (int i = 0; i < n; i++)
+  {
+    this->_run_queues.push_back(std::unique_ptr<_RunQueue>(new _RunQueue));
+    this->_run_queues.back()->streams.resize(max_streams);
+  }
+  for (int i = 0; i < n; i++)
+    this->_workers.push_back(std::thread(&StreamScheduler::_work_, this, i));
+}
+
+StreamScheduler::~StreamScheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_wake_mutex);
+    this->_running.store(false);
+  }
+  this->_wake.notify_all();
+  for (auto& worker : this->_workers)
+    worker.join();
+}
+
+int StreamScheduler::add_stream(std::unique_ptr<DSP<float>> model, const int max_num_frames, const int queue_depth,
+                                const int worker)
+{
+  if (model == nullptr)
+    throw std::runtime_error("Tried to add a stream without a model");
+  std::unique_ptr<_Stream> stream(new _Stream(queue_depth));
+  stream->model = std::move(model);
+  stream->chain = nullptr;
+  stream->num_channels = 1;
+  stream->max_num_frames = max_num_frames;
+  return this->_add_stream_(std::move(stream), queue_depth, worker);
+}
+
+int StreamScheduler::add_stream(Chain<float>* chain, const int max_num_frames, const int queue_depth,
+                                const int worker)
+{
+  if (chain == nullptr)
+    throw std::runtime_error("Tried to add a stream without a chain");
+  std::unique_ptr<_Stream> stream(new _Stream(queue_depth));
+  stream->chain = chain;
+  stream->num_channels = chain->get_num_channels();
+  stream->max_num_frames = max_num_frames;
+  return this->_add_stream_(std::move(stream), queue_depth, worker);
+}
+
+int StreamScheduler::_add_stream_(std::unique_ptr<_Stream> stream, const int queue_depth, const int worker)
+{
+  if (stream->max_num_frames < 1 || queue_depth < 1)
+  {
+    std::stringstream ss;
+    ss << "Stream needs a positive block size and queue depth; got " << stream->max_num_frames << " and "
+       << queue_depth;
+    throw std::runtime_error(ss.str());
+  }
+  const int num_channels = stream->num_channels;
+  const int max_num_frames = stream->max_num_frames;
+  stream->inputs.resize(queue_depth);
+  stream->outputs.resize(queue_depth);
+  stream->input_pointers.resize(queue_depth);
+  stream->output_pointers.resize(queue_depth);
+  stream->num_frames.resize(queue_depth);
+  for (int slot = 0; slot < queue_depth; slot++)
+  {
+    stream->inputs[slot].resize(num_channels * max_num_frames);
+    stream->outputs[slot].resize(num_channels * max_num_frames);
+    for (int c = 0; c < num_channels; c++)
+    {
+      stream->input_pointers[slot].push_back(stream->inputs[slot].data() + c * max_num_frames);
+      stream->output_pointers[slot].push_back(stream->outputs[slot].data() + c * max_num_frames);
+    }
+    stream->free_slots.push_back(slot);
+  }
+
+  std::lock_guard<std::mutex> lock(this->_streams_mutex);
+  const int num_workers = (int)this->_workers.size();
+  if (worker >= 0)
+    stream->worker.store(worker % num_workers);
+  else
+  {
+    stream->worker.store(this->_next_worker);
+    this->_next_worker = (this->_next_worker + 1) % num_workers;
+  }
+  for (size_t i = 0; i < this->_streams.size(); i++)
+    if (this->_streams[i] == nullptr)
+    {
+      this->_streams[i] = std::move(stream);
+      return (int)i;
+    }
+  std::stringstream ss;
+  ss << "Can't have more than " << this->_streams.size() << " streams";
+  throw std::runtime_error(ss.str());
+}
+
+void StreamScheduler::remove_stream(const int stream)
+{
+  std::unique_ptr<_Stream> removed;
+  {
+    std::lock_guard<std::mutex> lock(this->_streams_mutex);
+    this->_get_stream(stream);
+    removed = std::move(this->_streams[stream]);
+  }
+  // In this order: only a worker that's running the stream can put scheduled
+  // back once it's clear, and a worker only stops counting itself in active
+  // once it's done with the stream. (The other order could miss a worker
+  // that takes the stream off a run queue in between the two loads.)
+  while (removed->scheduled.load() || removed->active.load() > 0)
+    std::this_thread::yield();
+}
+
+bool StreamScheduler::submit(const int stream, const float* const* inputs, const int num_frames)
+{
+  _Stream& s = this->_get_stream(stream);
+  if (num_frames > s.max_num_frames)
+  {
+    std::stringstream ss;
+    ss << "Stream " << stream << " was given " << num_frames << " frames, but was set up for at most "
+       << s.max_num_frames;
+    throw std::runtime_error(ss.str());
+  }
+  if (s.free_slots.empty())
+    return false;
+  const int slot = s.free_slots.back();
+  s.free_slots.pop_back();
+  for (int c = 0; c < s.num_channels; c++)
+    std::memcpy(s.input_pointers[slot][c], inputs[c], num_frames * sizeof(float));
+  s.num_frames[slot] = num_frames;
+  s.waiting.push(slot);
+  this->_schedule_(s);
+  return true;
+}
+
+int StreamScheduler::receive(const int stream, float** outputs)
+{
+  _Stream& s = this->_get_stream(stream);
+  int slot;
+  if (!s.finished.pop(slot))
+    return 0;
+  const int num_frames = s.num_frames[slot];
+  for (int c = 0; c < s.num_channels; c++)
+    std::memcpy(outputs[c], s.output_pointers[slot][c], num_frames * sizeof(float));
+  s.free_slots.push_back(slot);
+  return num_frames;
+}
+
+int StreamScheduler::get_num_channels(const int stream) const
+{
+  return this->_get_stream(stream).num_channels;
+}
+
+int StreamScheduler::get_latency(const int stream) const
+{
+  const _Stream& s = this->_get_stream(stream);
+  return s.model != nullptr ? s.model->GetLatency() : s.chain->get_latency();
+}
+
+StreamScheduler::_Stream& StreamScheduler::_get_stream(const int stream) const
+{
+  if (stream < 0 || stream >= (int)this->_streams.size() || this->_streams[stream] == nullptr)
+  {
+    std::stringstream ss;
+    ss << "No stream " << stream;
+    throw std::runtime_error(ss.str());
+  }
+  return *this->_streams[stream];
+}
+
+void StreamScheduler::_schedule_(_Stream& stream)
+{
+  // Pairs with the fence in _run_stream_() so that a block that's pushed
+  // just as a worker finishes isn't missed by both.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool expected = false;
+  if (!stream.scheduled.compare_exchange_strong(expected, true))
+    return;
+  _RunQueue& queue = *this->_run_queues[stream.worker.load()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.streams[(queue.head + queue.size) % queue.streams.size()] = &stream;
+    queue.size++;
+    this->_pending++;
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->_wake_mutex);
+  }
+  this->_wake.notify_all();
+}
+
+void StreamScheduler::_work_(const int worker)
+{
+  _Stream* stream;
+  while (this->_running.load())
+  {
+    if (this->_take_(worker, stream))
+    {
+      this->_run_stream_(*stream, worker);
+      continue;
+    }
+    const auto spin_until = std::chrono::steady_clock::now() + _SPIN_TIME;
+    while (this->_pending.load() == 0 && this->_running.load() && std::chrono::steady_clock::now() < spin_until)
+      std::this_thread::yield();
+    if (this->_pending.load() > 0)
+      continue;
+    std::unique_lock<std::mutex> lock(this->_wake_mutex);
+    this->_wake.wait(lock, [this] { return !this->_running.load() || this->_pending.load() > 0; });
+  }
+}
+
+void StreamScheduler::_run_stream_(_Stream& stream, const int worker)
+{
+  stream.active++;
+  stream.worker.store(worker);
+  int slot;
+  while (true)
+  {
+    if (stream.waiting.pop(slot))
+    {
+      const int num_frames = stream.num_frames[slot];
+      float** inputs = stream.input_pointers[slot].data();
+      float** outputs = stream.output_pointers[slot].data();
+      if (stream.model != nullptr)
+      {
+        stream.model->process(inputs, outputs, 1, num_frames, 1.0f, 1.0f);
+        stream.model->finalize_(num_frames);
+      }
+      else
+        stream.chain->process(inputs, outputs, num_frames);
+      stream.finished.push(slot);
+      this->_num_blocks++;
+      continue;
+    }
+    stream.scheduled.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Something might have come in after the last pop but before the flag
+    // was cleared. Keep it here, unless submit() has already put it on a run
+    // queue.
+    if (stream.waiting.size() == 0)
+      break;
+    bool expected = false;
+    if (!stream.scheduled.compare_exchange_strong(expected, true))
+      break;
+  }
+  stream.active--;
+}
+
+bool StreamScheduler::_take_(const int worker, _Stream*& stream)
+{
+  const int num_queues = (int)this->_run_queues.size();
+  for (int i = 0; i < num_queues; i++)
+  {
+    _RunQueue& queue = *this->_run_queues[(worker + i) % num_queues];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.size > 0)
+    {
+      stream = queue.streams[queue.head];
+      queue.head = (queue.head + 1) % queue.streams.size();
+      queue.size--;
+      this->_pending--;
+      if (i > 0)
+        this->_num_steals++;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,137 @@
+#pragma once
+// Running many independent streams on a fixed set of threads
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chain.h"
+#include "namdsp.h"
+#include "spsc_queue.h"
+
+// Processes many streams (e.g. one per track, each with its own model or
+// chain) on a fixed pool of worker threads.
+//
+// Each stream has a queue of blocks waiting to be processed and a queue of
+// finished ones. When blocks arrive for a stream, it goes on a worker's run
+// queue. The worker processes all of the stream's waiting blocks, in order,
+// and then moves on. A stream goes back to the worker that last ran it,
+// whose caches still hold its weights and state, unless another worker runs
+// out of work and steals it. A stream is only ever run by one worker at a
+// time.
+//
+// submit() and receive() don't block or allocate. A stream should only be
+// fed by one thread at a time; different streams can be fed from different
+// threads.
+class StreamScheduler
+{
+public:
+  // num_threads: Workers; 0 for one per core.
+  // max_streams: How many streams can be open at once
+  StreamScheduler(const int num_threads, const int max_streams = 1024);
+  ~StreamScheduler();
+  StreamScheduler(const StreamScheduler&) = delete;
+  StreamScheduler& operator=(const StreamScheduler&) = delete;
+
+  // Add a stream and return its handle.
+  // max_num_frames: The longest block that will be submitted
+  // queue_depth: How many blocks can be in the stream at once (waiting,
+  // being processed, or finished but not received yet)
+  // worker: The worker to start it on (e.g. to spread a session's streams
+  // out), or -1 to deal them out in turn
+  //
+  // A model (owned by the stream; mono):
+  int add_stream(std::unique_ptr<DSP<float>> model, const int max_num_frames, const int queue_depth = 4,
+                 const int worker = -1);
+  // A chain (not owned; it needs to outlive the stream):
+  int add_stream(Chain<float>* chain, const int max_num_frames, const int queue_depth = 4, const int worker = -1);
+  // Waits until no worker is running the stream. Output that hasn't been
+  // received is thrown away. Don't submit to it while this is happening.
+  void remove_stream(const int stream);
+
+  // Queue a block (inputs[channel][frame]) to be processed.
+  // Returns false if the stream's queue is full.
+  bool submit(const int stream, const float* const* inputs, const int num_frames);
+  // Take the oldest finished block (outputs[channel][frame]).
+  // Returns its number of frames, or 0 if nothing has finished.
+  int receive(const int stream, float** outputs);
+
+  int get_num_threads() const { return (int)this->_workers.size(); };
+  int get_num_channels(const int stream) const;
+  // Latency of the stream's model or chain, in samples
+  int get_latency(const int stream) const;
+  // Totals so far
+  long get_num_blocks() const { return this->_num_blocks.load(); };
+  // Times that a worker ran a stream from another worker's run queue
+  long get_num_steals() const { return this->_num_steals.load(); };
+
+private:
+  struct _Stream
+  {
+    _Stream(const int queue_depth)
+    : waiting(queue_depth)
+    , finished(queue_depth)
+    , scheduled(false)
+    , active(0)
+    , worker(0){};
+    std::unique_ptr<DSP<float>> model;
+    Chain<float>* chain;
+    int num_channels;
+    int max_num_frames;
+    // For each slot: input and output, [channel * max_num_frames + frame],
+    // with pointers to the channels, and how many frames it holds
+    std::vector<std::vector<float>> inputs;
+    std::vector<std::vector<float>> outputs;
+    std::vector<std::vector<float*>> input_pointers;
+    std::vector<std::vector<float*>> output_pointers;
+    std::vector<int> num_frames;
+    // Slots on their way to a worker and back
+    SPSCQueue<int> waiting;
+    SPSCQueue<int> finished;
+    // Slots that the feeding thread holds (only it touches this)
+    std::vector<int> free_slots;
+    // On a run queue (or being run)
+    std::atomic<bool> scheduled;
+    // Workers running it. Usually one, but a worker that's finishing with it
+    // can overlap with the next one to take it.
+    std::atomic<int> active;
+    // The worker that ran it last
+    std::atomic<int> worker;
+  };
+  // A worker's streams to run: a ring that's only locked for a push or pop.
+  // A stream is only on one at a time, so each has room for all of them.
+  struct _RunQueue
+  {
+    std::mutex mutex;
+    std::vector<_Stream*> streams;
+    size_t head = 0;
+    size_t size = 0;
+  };
+
+  int _add_stream_(std::unique_ptr<_Stream> stream, const int queue_depth, const int worker);
+  _Stream& _get_stream(const int stream) const;
+  // Put a stream on its worker's run queue, if it isn't already on one.
+  void _schedule_(_Stream& stream);
+  void _work_(const int worker);
+  // Process everything that's waiting for the stream.
+  void _run_stream_(_Stream& stream, const int worker);
+  // Own run queue first, then the others'
+  bool _take_(const int worker, _Stream*& stream);
+
+  std::vector<std::thread> _workers;
+  std::vector<std::unique_ptr<_RunQueue>> _run_queues;
+  // Guards adding and removing streams
+  std::mutex _streams_mutex;
+  std::vector<std::unique_ptr<_Stream>> _streams;
+  int _next_worker;
+  // Streams waiting on run queues
+  std::atomic<int> _pending;
+  std::atomic<long> _num_blocks;
+  std::atomic<long> _num_steals;
+  std::atomic<bool> _running;
+  std::mutex _wake_mutex;
+  std::condition_variable _wake;
+};
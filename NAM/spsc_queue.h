@@ -0,0 +1,71 @@
+#pragma once
+// A lock-free queue for passing things between two threads
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+// A fixed-capacity, wait-free, single-producer single-consumer ring buffer.
+//
+// One thread pushes and one thread pops; neither ever blocks or allocates,
+// so either one can be the audio thread. The indices only ever increase (and
+// wrap through the capacity, which is a power of 2), so "full" and "empty" are
+// told apart without wasting a slot.
+template <typename T>
+class SPSCQueue
+{
+public:
+  // capacity is rounded up to a power of 2.
+  SPSCQueue(const size_t capacity)
+  : _head(0)
+  , _tail(0)
+  {
+    if (capacity < 1)
+      throw std::runtime_error("SPSCQueue needs a capacity of at least 1");
+    size_t size = 1;
+    while (size < capacity)
+      size *= 2;
+    this->_items.resize(size);
+    this->_mask = size - 1;
+  };
+  SPSCQueue(const SPSCQueue&) = delete;
+  SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+  // Producer: returns false (and drops the item) if the queue is full.
+  bool push(const T& item)
+  {
+    const size_t tail = this->_tail.load(std::memory_order_relaxed);
+    if (tail - this->_head.load(std::memory_order_acquire) > this->_mask)
+      return false;
+    this->_items[tail & this->_mask] = item;
+    this->_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  };
+  // Consumer: returns false if the queue is empty.
+  bool pop(T& item)
+  {
+    const size_t head = this->_head.load(std::memory_order_relaxed);
+    if (head == this->_tail.load(std::memory_order_acquire))
+      return false;
+    item = this->_items[head & this->_mask];
+    this->_head.store(head + 1, std::memory_order_release);
+    return true;
+  };
+  // Approximate unless called from one of the two threads while the other is
+  // idle.
+  size_t size() const
+  {
+    return this->_tail.load(std::memory_order_acquire) - this->_head.load(std::memory_order_acquire);
+  };
+  size_t capacity() const { return this->_items.size(); };
+
+private:
+  std::vector<T> _items;
+  size_t _mask;
+  // Next item to pop (written by the consumer) and next slot to push (written
+  // by the producer), on separate cache lines so the threads don't fight over
+  // them.
+  alignas(64) std::atomic<size_t> _head;
+  alignas(64) std::atomic<size_t> _tail;
+};
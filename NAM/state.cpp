@@ -0,0 +1,87 @@
+#include <cstdint>
+#include <cstring> // memcpy
+#include <sstream>
+#include <stdexcept>
+
+#include "state.h"
+
+state::Writer::Writer(DSPState& state, const std::string& name)
+: _state(state)
+{
+  this->_state.clear();
+  this->write((long)name.size());
+  this->_append_(name.data(), name.size());
+}
+
+void state::Writer::write(const long value)
+{
+  const int64_t v = value;
+  this->_append_(&v, sizeof(v));
+}
+
+void state::Writer::write(const float* data, const size_t size)
+{
+  this->write((long)size);
+  this->_append_(data, size * sizeof(float));
+}
+
+void state::Writer::_append_(const void* data, const size_t num_bytes)
+{
+  const size_t size = this->_state.size();
+  this->_state.resize(size + num_bytes);
+  if (num_bytes > 0)
+    std::memcpy(this->_state.data() + size, data, num_bytes);
+}
+
+state::Reader::Reader(const DSPState& state, const std::string& name)
+: _state(state)
+, _position(0)
+{
+  const long name_size = this->_state.size() >= sizeof(int64_t) ? this->read_long() : -1;
+  if (name_size != (long)name.size() || this->_state.size() - this->_position < name.size()
+      || name.compare(0, name.size(), this->_state.data() + this->_position, name.size()) != 0)
+  {
+    std::stringstream ss;
+    ss << "The state isn't from a " << name;
+    throw std::runtime_error(ss.str());
+  }
+  this->_position += name.size();
+}
+
+long state::Reader::read_long()
+{
+  int64_t value;
+  this->_take_(&value, sizeof(value));
+  return (long)value;
+}
+
+void state::Reader::read(float* data, const size_t size)
+{
+  const long stored_size = this->read_long();
+  if (stored_size != (long)size)
+  {
+    std::stringstream ss;
+    ss << "The state has " << stored_size << " values where the model has " << size
+       << "; is it from a different architecture?";
+    throw std::runtime_error(ss.str());
+  }
+  this->_take_(data, size * sizeof(float));
+}
+
+void state::Reader::finish() const
+{
+  if (this->_position != this->_state.size())
+  {
+    std::stringstream ss;
+    ss << "The state has " << this->_state.size() - this->_position << " bytes more than the model uses";
+    throw std::runtime_error(ss.str());
+  }
+}
+
+void state::Reader::_take_(void* data, const size_t num_bytes)
+{
+  if (this->_state.size() - this->_position < num_bytes)
+    throw std::runtime_error("The state is cut short");
+  std::memcpy(data, this->_state.data() + this->_position, num_bytes);
+  this->_position += num_bytes;
+}
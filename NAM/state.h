@@ -0,0 +1,49 @@
+#pragma once
+// Saving and restoring models' runtime state (DSP::get_state() and
+// DSP::set_state())
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A model's runtime state, as bytes. Only meaningful to a model with the same
+// architecture, on the same kind of machine.
+using DSPState = std::vector<char>;
+
+namespace state
+{
+// Writes a model's state: its name, then its values.
+class Writer
+{
+public:
+  // Starts the state over (keeping its memory).
+  Writer(DSPState& state, const std::string& name);
+  void write(const long value);
+  // The number of values is written too, so that Reader can check it.
+  void write(const float* data, const size_t size);
+
+private:
+  void _append_(const void* data, const size_t num_bytes);
+  DSPState& _state;
+};
+
+// Reads a state in the order that it was written. Doesn't allocate unless it
+// throws.
+class Reader
+{
+public:
+  // Throws if the state isn't from a model with this name.
+  Reader(const DSPState& state, const std::string& name);
+  long read_long();
+  // Throws if the state has a different number of values here (e.g. it's
+  // from a model with other channels or dilations).
+  void read(float* data, const size_t size);
+  // Throws if there's anything left over.
+  void finish() const;
+
+private:
+  void _take_(void* data, const size_t num_bytes);
+  const DSPState& _state;
+  size_t _position;
+};
+}; // namespace state
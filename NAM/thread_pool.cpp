@@ -0,0 +1,137 @@
+#include <algorithm> // std::max
+#include <chrono>
+
+#include "thread_pool.h"
+
+// Tasks that each worker's queue can hold. If a run() has more than fit, the
+// caller does the rest itself.
+constexpr const size_t _QUEUE_CAPACITY = 256;
+// How long an idle worker keeps looking for work before it sleeps
+constexpr const std::chrono::microseconds _SPIN_TIME(50);
+
+ThreadPool::ThreadPool(const int num_workers)
+: _pending(0)
+, _next_queue(0)
+, _running(true)
+{
+  for (int i = 0; i < num_workers; i++)
+  {
+    this->_queues.push_back(std::unique_ptr<_Queue>(new _Queue));
+    this->_queues.back()->tasks.resize(_QUEUE_CAPACITY);
+  }
+  for (int i = 0; i < num_workers; i++)
+    this->_workers.push_back(std::thread(&ThreadPool::_work_, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_wake_mutex);
+    this->_running.store(false);
+  }
+  this->_wake.notify_all();
+  for (auto& worker : this->_workers)
+    worker.join();
+}
+
+void ThreadPool::_execute(const _Task& task)
+{
+  task.job->call(task.job->task, task.index);
+  task.job->remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ThreadPool::_run_(_Job& job)
+{
+  const int num_tasks = job.remaining.load();
+  const size_t num_queues = this->_queues.size();
+  size_t q = this->_next_queue.fetch_add(1) % num_queues;
+  // Task 0 is kept for this thread.
+  for (int i = 1; i < num_tasks; i++, q = (q + 1) % num_queues)
+  {
+    _Queue& queue = *this->_queues[q];
+    bool queued = false;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.size < _QUEUE_CAPACITY)
+      {
+        queue.tasks[(queue.head + queue.size) % _QUEUE_CAPACITY] = {&job, i};
+        queue.size++;
+        this->_pending++;
+        queued = true;
+      }
+    }
+    if (!queued)
+      _execute({&job, i});
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->_wake_mutex);
+  }
+  this->_wake.notify_all();
+
+  _execute({&job, 0});
+  _Task task;
+  while (job.remaining.load(std::memory_order_acquire) > 0)
+  {
+    if (this->_take_(-1, task))
+      _execute(task);
+    else
+      std::this_thread::yield();
+  }
+}
+
+void ThreadPool::_work_(const int worker)
+{
+  _Task task;
+  while (this->_running.load())
+  {
+    if (this->_take_(worker, task))
+    {
+      _execute(task);
+      continue;
+    }
+    const auto spin_until = std::chrono::steady_clock::now() + _SPIN_TIME;
+    while (this->_pending.load() == 0 && this->_running.load() && std::chrono::steady_clock::now() < spin_until)
+      std::this_thread::yield();
+    if (this->_pending.load() > 0)
+      continue;
+    std::unique_lock<std::mutex> lock(this->_wake_mutex);
+    this->_wake.wait(lock, [this] { return !this->_running.load() || this->_pending.load() > 0; });
+  }
+}
+
+bool ThreadPool::_take_(const int worker, _Task& task)
+{
+  const int num_queues = (int)this->_queues.size();
+  if (worker >= 0)
+  {
+    _Queue& queue = *this->_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.size > 0)
+    {
+      queue.size--;
+      task = queue.tasks[(queue.head + queue.size) % _QUEUE_CAPACITY];
+      this->_pending--;
+      return true;
+    }
+  }
+  for (int i = 1; i <= num_queues; i++)
+  {
+    _Queue& queue = *this->_queues[(worker + i + num_queues) % num_queues];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.size > 0)
+    {
+      task = queue.tasks[queue.head];
+      queue.head = (queue.head + 1) % _QUEUE_CAPACITY;
+      queue.size--;
+      this->_pending--;
+      return true;
+    }
+  }
+  return false;
+}
+
+ThreadPool& get_shared_thread_pool()
+{
+  static ThreadPool pool(std::max(0, (int)std::thread::hardware_concurrency() - 1));
+  return pool;
+}
@@ -0,0 +1,110 @@
+#pragma once
+// Spreading a block's work over several cores
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// When a model splits its work across a ThreadPool. Costs are in
+// multiply-adds per block; below them, the work isn't worth the
+// synchronization.
+struct ParallelThresholds
+{
+  // Split a convolution into tiles of its output channels
+  long min_tile_cost = 1L << 19;
+  // Pipeline a WaveNet's layer arrays: while one works on part of the block,
+  // the next works on the part before it.
+  long min_pipeline_cost = 1L << 21;
+};
+
+// A work-stealing thread pool for fork-join work within a block.
+//
+// run() deals tasks out to the workers' queues. Each worker takes tasks from
+// the back of its own queue and, when that's empty, steals from the front of
+// the others'. The thread that calls run() steals too instead of waiting, so
+// run() can be called from inside a task (e.g. tiles within a pipeline stage)
+// without deadlocking. Nothing is allocated after construction.
+//
+// Idle workers spin briefly before they sleep so that back-to-back run()s
+// (one per layer, say) don't pay to wake them up each time.
+class ThreadPool
+{
+public:
+  // num_workers: threads besides the ones that call run(). With 0, run()
+  // does everything on the calling thread.
+  ThreadPool(const int num_workers);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // How many threads work on a run(), counting the caller
+  int get_num_threads() const { return (int)this->_workers.size() + 1; };
+  // Call task(i) for each i in [0, num_tasks) and return once they've all
+  // finished.
+  template <typename Task>
+  void run(const int num_tasks, const Task& task)
+  {
+    if (num_tasks <= 1 || this->_workers.empty())
+    {
+      for (int i = 0; i < num_tasks; i++)
+        task(i);
+      return;
+    }
+    _Job job(&ThreadPool::_call<Task>, &task, num_tasks);
+    this->_run_(job);
+  };
+
+private:
+  struct _Job
+  {
+    _Job(void (*call_)(const void*, const int), const void* task_, const int num_tasks)
+    : call(call_)
+    , task(task_)
+    , remaining(num_tasks){};
+    void (*call)(const void* task, const int index);
+    const void* task;
+    std::atomic<int> remaining;
+  };
+  struct _Task
+  {
+    _Job* job;
+    int index;
+  };
+  // A worker's tasks: a ring that's only locked for a push or a pop
+  struct _Queue
+  {
+    std::mutex mutex;
+    std::vector<_Task> tasks;
+    size_t head = 0;
+    size_t size = 0;
+  };
+
+  template <typename Task>
+  static void _call(const void* task, const int index)
+  {
+    (*static_cast<const Task*>(task))(index);
+  };
+  static void _execute(const _Task& task);
+  void _run_(_Job& job);
+  void _work_(const int worker);
+  // Own queue first (worker < 0 for the thread calling run(), which has
+  // none), then the others'
+  bool _take_(const int worker, _Task& task);
+
+  std::vector<std::thread> _workers;
+  std::vector<std::unique_ptr<_Queue>> _queues;
+  // Tasks waiting in the queues
+  std::atomic<int> _pending;
+  // The queue that the next run() starts dealing to
+  std::atomic<unsigned int> _next_queue;
+  std::atomic<bool> _running;
+  std::mutex _wake_mutex;
+  std::condition_variable _wake;
+};
+
+// A pool shared by all of the models in the process, with a worker for each
+// core but one. It's made the first time it's asked for.
+ThreadPool& get_shared_thread_pool();
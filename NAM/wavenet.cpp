@@ -6,6 +6,22 @@
 
 #include "wavenet.h"
 
+// When pipelining layer arrays, how many pieces to cut a block into (per
+// array), and the smallest piece worth the synchronization
+constexpr const int _PIPELINE_PIECES_PER_ARRAY = 2;
+constexpr const long _MIN_PIPELINE_PIECE = 16;
+// Blocks of up to this many frames go through _LayerArray::_process_small_()
+constexpr const long _SMALL_BLOCK_FRAMES = 64;
+// ...which does this many frames at a time with each weight that it loads
+constexpr const int _SMALL_BLOCK_VECTORS = 4;
+
+// num_values, rounded up to whole cache lines, so that what follows it is
+// aligned
+long _align_scratch(const long num_values)
+{
+  const long alignment = (long)(Arena::ALIGNMENT / sizeof(float));
+  return (num_values + alignment - 1) / alignment * alignment;
+}
 
 wavenet::_DilatedConv::_DilatedConv(const int in_channels, const int out_channels, const int kernel_size,
                                     const int bias, const int dilation)
@@ -13,43 +29,90 @@ wavenet::_DilatedConv::_DilatedConv(const int in_channels, const int out_channel
   this->set_size_(in_channels, out_channels, kernel_size, bias, dilation);
 }
 
-void wavenet::_Layer::set_params_(std::vector<float>::iterator& params)
+void wavenet::_Layer::set_params_(std::vector<float>::iterator& params, Conv1x1& input_mixins, const long mixin_row)
 {
   this->_conv.set_params_(params);
-  this->_input_mixin.set_params_(params);
+  input_mixins.set_params_(params, mixin_row, this->get_mixin_channels());
   this->_1x1.set_params_(params);
 }
 
-void wavenet::_Layer::process_(const Eigen::MatrixXf& input, const Eigen::MatrixXf& condition,
-                               Eigen::MatrixXf& head_input, Eigen::MatrixXf& output, const long i_start,
-                               const long j_start)
+void wavenet::_Layer::process_(const Eigen::Ref<const Eigen::MatrixXf>& input,
+                               const Eigen::Ref<const Eigen::MatrixXf>& mixed_in,
+                               const Eigen::Ref<const Eigen::VectorXf>& mixin_bias, Eigen::Ref<Eigen::MatrixXf> z_scratch,
+                               Eigen::Ref<Eigen::MatrixXf> head_input, Eigen::Ref<Eigen::MatrixXf> output,
+                               const long i_start, const long j_start, const Arena& arena)
 {
-  const long ncols = condition.cols();
+  const long ncols = mixed_in.cols();
   const long channels = this->get_channels();
+  auto z = z_scratch.leftCols(ncols);
   // Input dilated conv
-  this->_conv.process_(input, this->_z, i_start, ncols, 0);
+  this->_conv.process_(input, z_scratch, i_start, ncols, 0, &arena);
   // Mix-in condition
-  this->_z += this->_input_mixin.process(condition);
+  z += mixed_in.colwise() + mixin_bias;
 
-  this->_activation->apply(this->_z);
+  // (The scratch's columns are contiguous.)
+  this->_activation->apply(z.data(), z.size());
 
   if (this->_gated)
   {
-    activations::Activation::get_activation("Sigmoid")->apply(this->_z.block(channels, 0, channels, this->_z.cols()));
+    for (long j = 0; j < ncols; j++)
+      this->_gate_activation->apply(z.col(j).data() + channels, channels);
 
-    this->_z.topRows(channels).array() *= this->_z.bottomRows(channels).array();
+    z.topRows(channels).array() *= z.bottomRows(channels).array();
     // this->_z.topRows(channels) = this->_z.topRows(channels).cwiseProduct(
     //   this->_z.bottomRows(channels)
     // );
   }
 
-  head_input += this->_z.topRows(channels);
-  output.middleCols(j_start, ncols) = input.middleCols(i_start, ncols) + this->_1x1.process(this->_z.topRows(channels));
+  head_input += z.topRows(channels);
+  output.middleCols(j_start, ncols) =
+    input.middleCols(i_start, ncols) + this->_1x1.process(z.topRows(channels), &arena);
+}
+
+long wavenet::_Layer::get_cost() const
+{
+  return this->_conv.get_num_params() + this->_1x1.get_num_params();
+}
+
+void wavenet::_Layer::set_thread_pool_(ThreadPool* pool, const long min_tile_cost)
+{
+  this->_conv.set_thread_pool_(pool, min_tile_cost);
+  this->_1x1.set_thread_pool_(pool, min_tile_cost);
 }
 
-void wavenet::_Layer::set_num_frames_(const long num_frames)
+void wavenet::_Layer::set_weight_precision_(const EWeightPrecision precision)
 {
-  this->_z.resize(this->_conv.get_out_channels(), num_frames);
+  this->_conv.set_weight_precision_(precision);
+  this->_1x1.set_weight_precision_(precision);
+}
+
+void wavenet::_Layer::move_weights_to_(Arena& arena)
+{
+  this->_conv.move_weights_to_(arena);
+  this->_1x1.move_weights_to_(arena);
+}
+
+void wavenet::_Layer::take_weights_from_(const Arena& arena)
+{
+  this->_conv.take_weights_from_(arena);
+  this->_1x1.take_weights_from_(arena);
+}
+
+size_t wavenet::_Layer::get_memory_size() const
+{
+  return this->_conv.get_memory_size() + this->_1x1.get_memory_size();
+}
+
+void wavenet::_Layer::set_activation_policy_(const EActivationPolicy policy)
+{
+  this->_activation = activations::Activation::get_activation(this->_activation_name, policy);
+  this->_gate_activation = activations::Activation::get_activation("Sigmoid", policy);
+}
+
+void wavenet::_Layer::get_activation_ranges_(std::vector<ActivationRange*>& ranges)
+{
+  ranges.push_back(&this->_conv.get_input_range());
+  ranges.push_back(&this->_1x1.get_input_range());
 }
 
 // LayerArray =================================================================
@@ -58,17 +121,37 @@ void wavenet::_Layer::set_num_frames_(const long num_frames)
 
 wavenet::_LayerArray::_LayerArray(const int input_size, const int condition_size, const int head_size,
                                   const int channels, const int kernel_size, const std::vector<int>& dilations,
-                                  const std::string activation, const bool gated, const bool head_bias)
-: _rechannel(input_size, channels, false)
+                                  const std::string activation, const bool gated, const bool head_bias,
+                                  const bool input_is_condition, const int num_condition_params)
+: _rechannel_in_mixins(input_is_condition && input_size == condition_size)
+, _rechannel(input_size, channels, false)
+, _num_condition_params(num_condition_params)
+, _input_mixins(condition_size,
+                (input_is_condition && input_size == condition_size ? channels : 0)
+                  + (long)dilations.size() * (gated ? 2 * channels : channels),
+                false)
 , _head_rechannel(channels, head_size, head_bias)
+, _small_activation(_SmallActivation::kNone)
+, _small_gate_activation(_SmallActivation::kNone)
+, _small_block_frames(_SMALL_BLOCK_FRAMES)
+, _small_weights_fp32(true)
+, _scratch(0)
+, _scratch_frames(0)
 {
+  long mixin_row = this->_rechannel_in_mixins ? channels : 0;
   for (int i = 0; i < dilations.size(); i++)
+  {
     this->_layers.push_back(_Layer(condition_size, channels, kernel_size, dilations[i], activation, gated));
-  const long receptive_field = this->_get_receptive_field();
+    this->_mixin_rows.push_back(mixin_row);
+    mixin_row += this->_layers[i].get_mixin_channels();
+  }
+  this->_bind_small_activations_();
+  this->_buffer_size = LAYER_ARRAY_BUFFER_SIZE + this->_get_receptive_field() - 1;
   for (int i = 0; i < dilations.size(); i++)
   {
-    this->_layer_buffers.push_back(Eigen::MatrixXf(channels, LAYER_ARRAY_BUFFER_SIZE + receptive_field - 1));
+    this->_layer_buffers.push_back(Eigen::MatrixXf(channels, this->_buffer_size));
     this->_layer_buffers[i].setZero();
+    this->_arena_layer_buffers.push_back(-1);
   }
   this->_buffer_start = this->_get_receptive_field() - 1;
 }
@@ -86,7 +169,7 @@ long wavenet::_LayerArray::get_receptive_field() const
   return result;
 }
 
-void wavenet::_LayerArray::prepare_for_frames_(const long num_frames)
+void wavenet::_LayerArray::prepare_for_frames_(const long num_frames, Arena& arena)
 {
   // Example:
   // _buffer_start = 0
@@ -96,22 +179,52 @@ void wavenet::_LayerArray::prepare_for_frames_(const long num_frames)
   // -> No illegal writes.
   // -> no rewind needed.
   if (this->_buffer_start + num_frames > this->_get_buffer_size())
-    this->_rewind_buffers_();
+    this->_rewind_buffers_(arena);
+}
+
+void wavenet::_LayerArray::process_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                                    const Eigen::Ref<const Eigen::MatrixXf>& condition,
+                                    Eigen::Ref<Eigen::MatrixXf> head_inputs, Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                                    Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena)
+{
+  this->process_(layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, 0, condition.cols());
 }
 
-void wavenet::_LayerArray::process_(const Eigen::MatrixXf& layer_inputs, const Eigen::MatrixXf& condition,
-                                    Eigen::MatrixXf& head_inputs, Eigen::MatrixXf& layer_outputs,
-                                    Eigen::MatrixXf& head_outputs)
+void wavenet::_LayerArray::process_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                                    const Eigen::Ref<const Eigen::MatrixXf>& condition,
+                                    Eigen::Ref<Eigen::MatrixXf> head_inputs, Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                                    Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena, const long start,
+                                    const long num_frames)
 {
-  this->_layer_buffers[0].middleCols(this->_buffer_start, layer_inputs.cols()) = this->_rechannel.process(layer_inputs);
-  const long last_layer = this->_layers.size() - 1;
+  if (this->_is_small_(num_frames))
+  {
+    this->_process_small_(layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start,
+                          num_frames);
+    return;
+  }
+  this->_process_inputs_(layer_inputs, condition, start, num_frames, arena);
+  for (auto i = 0; i < this->_layers.size(); i++)
+    this->_process_layer_(i, head_inputs, layer_outputs, start, num_frames, arena);
+  head_outputs.middleCols(start, num_frames) =
+    this->_head_rechannel.process(head_inputs.middleCols(start, num_frames), &arena);
+}
+
+void wavenet::_LayerArray::prewarm_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                                    const Eigen::Ref<const Eigen::MatrixXf>& condition,
+                                    Eigen::Ref<Eigen::MatrixXf> head_inputs, Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                                    Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena)
+{
+  const long buffer_start = this->_buffer_start;
+  this->_process_inputs_(layer_inputs, condition, 0, 1, arena);
   for (auto i = 0; i < this->_layers.size(); i++)
   {
-    this->_layers[i].process_(this->_layer_buffers[i], condition, head_inputs,
-                              i == last_layer ? layer_outputs : this->_layer_buffers[i + 1], this->_buffer_start,
-                              i == last_layer ? 0 : this->_buffer_start);
+    // As far back as the layer looks (see _rewind_buffers_())
+    const long d = (this->_layers[i].get_kernel_size() - 1) * this->_layers[i].get_dilation();
+    auto buffer = this->_get_layer_buffer_(i, arena);
+    buffer.middleCols(buffer_start - d, d) = buffer.col(buffer_start).replicate(1, d);
+    this->_process_layer_(i, head_inputs, layer_outputs, 0, 1, arena);
   }
-  head_outputs = this->_head_rechannel.process(head_inputs);
+  head_outputs.leftCols(1) = this->_head_rechannel.process(head_inputs.leftCols(1), &arena);
 }
 
 void wavenet::_LayerArray::set_num_frames_(const long num_frames)
@@ -126,18 +239,74 @@ void wavenet::_LayerArray::set_num_frames_(const long num_frames)
        << "); copy errors could occur!\n";
     throw std::runtime_error(ss.str().c_str());
   }
-  for (int i = 0; i < this->_layers.size(); i++)
-    this->_layers[i].set_num_frames_(num_frames);
+}
+
+long wavenet::_LayerArray::get_cost() const
+{
+  long cost = this->_input_mixins.get_num_params() + this->_head_rechannel.get_num_params();
+  if (!this->_rechannel_in_mixins)
+    cost += this->_rechannel.get_num_params();
+  for (const auto& layer : this->_layers)
+    cost += layer.get_cost();
+  return cost;
+}
+
+void wavenet::_LayerArray::set_thread_pool_(ThreadPool* pool, const long min_tile_cost)
+{
+  this->_rechannel.set_thread_pool_(pool, min_tile_cost);
+  this->_input_mixins.set_thread_pool_(pool, min_tile_cost);
+  for (auto& layer : this->_layers)
+    layer.set_thread_pool_(pool, min_tile_cost);
+  this->_head_rechannel.set_thread_pool_(pool, min_tile_cost);
+}
+
+void wavenet::_LayerArray::set_weight_precision_(const EWeightPrecision precision)
+{
+  if (!this->_rechannel_in_mixins)
+    this->_rechannel.set_weight_precision_(precision);
+  this->_input_mixins.set_weight_precision_(precision);
+  for (auto& layer : this->_layers)
+    layer.set_weight_precision_(precision);
+  this->_head_rechannel.set_weight_precision_(precision);
+  this->_small_weights_fp32 = precision == EWeightPrecision::kFloat32;
+}
+
+void wavenet::_LayerArray::set_activation_policy_(const EActivationPolicy policy)
+{
+  for (auto& layer : this->_layers)
+    layer.set_activation_policy_(policy);
+  this->_bind_small_activations_();
+}
+
+void wavenet::_LayerArray::get_activation_ranges_(std::vector<ActivationRange*>& ranges)
+{
+  if (!this->_rechannel_in_mixins)
+    ranges.push_back(&this->_rechannel.get_input_range());
+  ranges.push_back(&this->_input_mixins.get_input_range());
+  for (auto& layer : this->_layers)
+    layer.get_activation_ranges_(ranges);
+  ranges.push_back(&this->_head_rechannel.get_input_range());
 }
 
 void wavenet::_LayerArray::set_params_(std::vector<float>::iterator& params)
 {
-  this->_rechannel.set_params_(params);
+  if (this->_rechannel_in_mixins)
+    this->_input_mixins.set_params_(params, 0, this->_get_channels());
+  else
+    this->_rechannel.set_params_(params);
   for (int i = 0; i < this->_layers.size(); i++)
-    this->_layers[i].set_params_(params);
+    this->_layers[i].set_params_(params, this->_input_mixins, this->_mixin_rows[i]);
+  this->_param_mixins = this->_input_mixins.split_off_inputs_(this->_num_condition_params);
+  this->_mixin_bias.setZero(this->_input_mixins.get_out_channels());
   this->_head_rechannel.set_params_(params);
 }
 
+void wavenet::_LayerArray::set_condition_params_(const Eigen::Ref<const Eigen::VectorXf>& values)
+{
+  if (this->_param_mixins.cols() > 0)
+    this->_mixin_bias.noalias() = this->_param_mixins * values;
+}
+
 long wavenet::_LayerArray::_get_channels() const
 {
   return this->_layers.size() > 0 ? this->_layers[0].get_channels() : 0;
@@ -152,7 +321,7 @@ long wavenet::_LayerArray::_get_receptive_field() const
   return res;
 }
 
-void wavenet::_LayerArray::_rewind_buffers_()
+void wavenet::_LayerArray::_rewind_buffers_(Arena& arena)
 // Consider wrapping instead...
 // Can make this smaller--largest dilation, not receptive field!
 {
@@ -160,11 +329,408 @@ void wavenet::_LayerArray::_rewind_buffers_()
   for (int i = 0; i < this->_layer_buffers.size(); i++)
   {
     const long d = (this->_layers[i].get_kernel_size() - 1) * this->_layers[i].get_dilation();
-    this->_layer_buffers[i].middleCols(start - d, d) = this->_layer_buffers[i].middleCols(this->_buffer_start - d, d);
+    auto buffer = this->_get_layer_buffer_(i, arena);
+    buffer.middleCols(start - d, d) = buffer.middleCols(this->_buffer_start - d, d);
   }
   this->_buffer_start = start;
 }
 
+void wavenet::_LayerArray::write_state_(state::Writer& writer, const Arena& arena) const
+{
+  for (int i = 0; i < this->_layer_buffers.size(); i++)
+  {
+    const long d = (this->_layers[i].get_kernel_size() - 1) * this->_layers[i].get_dilation();
+    const auto buffer = this->_get_layer_buffer_(i, arena);
+    writer.write(buffer.middleCols(this->_buffer_start - d, d).data(), buffer.rows() * d);
+  }
+}
+
+void wavenet::_LayerArray::read_state_(state::Reader& reader, Arena& arena)
+{
+  // As _rewind_buffers_() leaves them
+  this->_buffer_start = this->_get_receptive_field() - 1;
+  for (int i = 0; i < this->_layer_buffers.size(); i++)
+  {
+    const long d = (this->_layers[i].get_kernel_size() - 1) * this->_layers[i].get_dilation();
+    auto buffer = this->_get_layer_buffer_(i, arena);
+    reader.read(buffer.middleCols(this->_buffer_start - d, d).data(), buffer.rows() * d);
+  }
+}
+
+void wavenet::_LayerArray::_process_inputs_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                                            const Eigen::Ref<const Eigen::MatrixXf>& condition, const long start,
+                                            const long num_frames, Arena& arena)
+{
+  auto mixed_in = this->_get_mixed_in_(arena);
+  mixed_in.middleCols(start, num_frames) = this->_input_mixins.process(condition.middleCols(start, num_frames), &arena);
+  const long buffer_start = this->_buffer_start + start;
+  if (this->_rechannel_in_mixins)
+    this->_get_layer_buffer_(0, arena).middleCols(buffer_start, num_frames) =
+      mixed_in.block(0, start, this->_get_channels(), num_frames).colwise()
+      + this->_mixin_bias.head(this->_get_channels());
+  else
+    this->_get_layer_buffer_(0, arena).middleCols(buffer_start, num_frames) =
+      this->_rechannel.process(layer_inputs.middleCols(start, num_frames), &arena);
+}
+
+void wavenet::_LayerArray::_process_layer_(const int i, Eigen::Ref<Eigen::MatrixXf> head_inputs,
+                                           Eigen::Ref<Eigen::MatrixXf> layer_outputs, const long start,
+                                           const long num_frames, Arena& arena)
+{
+  const long buffer_start = this->_buffer_start + start;
+  const long mixin_channels = this->_layers[i].get_mixin_channels();
+  const auto mixed_in = this->_get_mixed_in_(arena).block(this->_mixin_rows[i], start, mixin_channels, num_frames);
+  const auto mixin_bias = this->_mixin_bias.segment(this->_mixin_rows[i], mixin_channels);
+  const auto input = this->_get_layer_buffer_(i, arena);
+  auto z = this->_get_z_(arena, num_frames);
+  if (i == this->_layers.size() - 1)
+    this->_layers[i].process_(input, mixed_in, mixin_bias, z, head_inputs.middleCols(start, num_frames),
+                              layer_outputs.middleCols(start, num_frames), buffer_start, 0, arena);
+  else
+    this->_layers[i].process_(input, mixed_in, mixin_bias, z, head_inputs.middleCols(start, num_frames),
+                              this->_get_layer_buffer_(i + 1, arena), buffer_start, buffer_start, arena);
+}
+
+Eigen::Map<Eigen::MatrixXf> wavenet::_LayerArray::_get_layer_buffer_(const size_t i, Arena& arena)
+{
+  float* data =
+    this->_arena_layer_buffers[i] >= 0 ? arena.get(this->_arena_layer_buffers[i]) : this->_layer_buffers[i].data();
+  return Eigen::Map<Eigen::MatrixXf>(data, this->_get_channels(), this->_buffer_size);
+}
+
+Eigen::Map<const Eigen::MatrixXf> wavenet::_LayerArray::_get_layer_buffer_(const size_t i, const Arena& arena) const
+{
+  const float* data =
+    this->_arena_layer_buffers[i] >= 0 ? arena.get(this->_arena_layer_buffers[i]) : this->_layer_buffers[i].data();
+  return Eigen::Map<const Eigen::MatrixXf>(data, this->_get_channels(), this->_buffer_size);
+}
+
+Eigen::Map<Eigen::MatrixXf> wavenet::_LayerArray::_get_mixed_in_(Arena& arena) const
+{
+  return Eigen::Map<Eigen::MatrixXf>(
+    arena.get(this->_scratch), this->_input_mixins.get_out_channels(), this->_scratch_frames);
+}
+
+Eigen::Map<Eigen::MatrixXf> wavenet::_LayerArray::_get_z_(Arena& arena, const long num_frames) const
+{
+  const long mixed_in_size = _align_scratch(this->_input_mixins.get_out_channels() * this->_scratch_frames);
+  return Eigen::Map<Eigen::MatrixXf>(
+    arena.get(this->_scratch + mixed_in_size), this->_layers[0].get_mixin_channels(), num_frames);
+}
+
+// Small blocks ===============================================================
+
+// y += ROWS rows of w (column-major, rows_w between its columns) times COLS
+// vectors x. Each load of the weights is shared by the vectors, and the sums
+// stay in registers for the whole product.
+template <int ROWS, int COLS>
+inline void _gemv_block(const float* w, const long rows_w, const long cols, const float* x, const long x_stride,
+                        float* y, const long y_stride)
+{
+  typedef Eigen::Matrix<float, ROWS, 1> Column;
+  typedef Eigen::Map<Eigen::Matrix<float, ROWS, COLS>, 0, Eigen::OuterStride<>> Outputs;
+  Eigen::Matrix<float, ROWS, COLS> sums = Outputs(y, Eigen::OuterStride<>(y_stride));
+  for (long c = 0; c < cols; c++)
+  {
+    const Eigen::Map<const Column> wc(w + c * rows_w);
+    for (int b = 0; b < COLS; b++)
+      sums.col(b) += wc * x[b * x_stride + c];
+  }
+  Outputs(y, Eigen::OuterStride<>(y_stride)) = sums;
+}
+
+template <int ROWS>
+inline void _gemv_rows(const float* w, const long rows_w, const long cols, const float* x, const long x_stride,
+                       float* y, const long y_stride, const long num_vectors)
+{
+  long b = 0;
+  for (; b + _SMALL_BLOCK_VECTORS <= num_vectors; b += _SMALL_BLOCK_VECTORS)
+    _gemv_block<ROWS, _SMALL_BLOCK_VECTORS>(w, rows_w, cols, x + b * x_stride, x_stride, y + b * y_stride, y_stride);
+  for (; b < num_vectors; b++)
+    _gemv_block<ROWS, 1>(w, rows_w, cols, x + b * x_stride, x_stride, y + b * y_stride, y_stride);
+}
+
+// y += w x for num_vectors vectors, with w (rows x cols, column-major), and
+// x_stride and y_stride between the vectors
+void _gemv_add(const float* w, const long rows, const long cols, const float* x, const long x_stride, float* y,
+               const long y_stride, const long num_vectors)
+{
+  long r = 0;
+  for (; r + 16 <= rows; r += 16)
+    _gemv_rows<16>(w + r, rows, cols, x, x_stride, y + r, y_stride, num_vectors);
+  for (; r + 8 <= rows; r += 8)
+    _gemv_rows<8>(w + r, rows, cols, x, x_stride, y + r, y_stride, num_vectors);
+  for (; r < rows; r++)
+    _gemv_rows<1>(w + r, rows, cols, x, x_stride, y + r, y_stride, num_vectors);
+}
+
+bool wavenet::_LayerArray::_is_small_(const long num_frames) const
+{
+  // Not while calibrating, which the convolutions do.
+  return num_frames <= this->_small_block_frames && this->_small_weights_fp32 && !this->_layers.empty()
+         && this->_small_activation != _SmallActivation::kNone && !this->_input_mixins.get_input_range().calibrating;
+}
+
+void wavenet::_LayerArray::_bind_small_activations_()
+{
+  auto get_small_activation = [](const activations::Activation* activation) {
+    if (dynamic_cast<const activations::ActivationTanh*>(activation) != nullptr)
+      return _SmallActivation::kTanh;
+    if (dynamic_cast<const activations::ActivationFastTanh*>(activation) != nullptr)
+      return _SmallActivation::kFastTanh;
+    if (dynamic_cast<const activations::ActivationHardTanh*>(activation) != nullptr)
+      return _SmallActivation::kHardTanh;
+    if (dynamic_cast<const activations::ActivationReLU*>(activation) != nullptr)
+      return _SmallActivation::kReLU;
+    if (dynamic_cast<const activations::ActivationSigmoid*>(activation) != nullptr)
+      return _SmallActivation::kSigmoid;
+    if (dynamic_cast<const activations::ActivationFastSigmoid*>(activation) != nullptr)
+      return _SmallActivation::kFastSigmoid;
+    if (dynamic_cast<const activations::ActivationTableTanh*>(activation) != nullptr)
+      return _SmallActivation::kTableTanh;
+    if (dynamic_cast<const activations::ActivationTableSigmoid*>(activation) != nullptr)
+      return _SmallActivation::kTableSigmoid;
+    return _SmallActivation::kNone;
+  };
+  // The layers all have the same ones.
+  this->_small_activation = _SmallActivation::kNone;
+  this->_small_gate_activation = _SmallActivation::kNone;
+  if (this->_layers.empty())
+    return;
+  this->_small_activation = get_small_activation(this->_layers[0].get_activation());
+  this->_small_gate_activation = get_small_activation(this->_layers[0].get_gate_activation());
+  // Without a gate that it knows, the small path can't be used.
+  const bool gate_known = this->_small_gate_activation == _SmallActivation::kSigmoid
+                          || this->_small_gate_activation == _SmallActivation::kFastSigmoid
+                          || this->_small_gate_activation == _SmallActivation::kTableSigmoid;
+  if (this->_layers[0].is_gated() && !gate_known)
+    this->_small_activation = _SmallActivation::kNone;
+}
+
+void wavenet::_LayerArray::move_weights_to_(Arena& arena)
+{
+  // (The rechannel isn't used if it's in the mixins.)
+  if (!this->_rechannel_in_mixins)
+    this->_rechannel.move_weights_to_(arena);
+  this->_input_mixins.move_weights_to_(arena);
+  for (auto& layer : this->_layers)
+    layer.move_weights_to_(arena);
+  this->_head_rechannel.move_weights_to_(arena);
+}
+
+void wavenet::_LayerArray::take_weights_from_(const Arena& arena)
+{
+  this->_rechannel.take_weights_from_(arena);
+  this->_input_mixins.take_weights_from_(arena);
+  for (auto& layer : this->_layers)
+    layer.take_weights_from_(arena);
+  this->_head_rechannel.take_weights_from_(arena);
+}
+
+void wavenet::_LayerArray::move_buffers_to_(Arena& arena)
+{
+  for (size_t i = 0; i < this->_layer_buffers.size(); i++)
+  {
+    if (this->_arena_layer_buffers[i] >= 0)
+      continue;
+    this->_arena_layer_buffers[i] = arena.add_(this->_layer_buffers[i].data(), this->_layer_buffers[i].size());
+    this->_layer_buffers[i].resize(0, 0);
+  }
+}
+
+void wavenet::_LayerArray::take_buffers_from_(const Arena& arena)
+{
+  for (size_t i = 0; i < this->_layer_buffers.size(); i++)
+  {
+    if (this->_arena_layer_buffers[i] < 0)
+      continue;
+    this->_layer_buffers[i] = this->_get_layer_buffer_(i, arena);
+    this->_arena_layer_buffers[i] = -1;
+  }
+}
+
+long wavenet::_LayerArray::get_scratch_size_(const long num_frames) const
+{
+  if (this->_layers.empty())
+    return 0;
+  // The small path works on up to _small_block_frames at a time, whatever
+  // the block.
+  const long frames = std::max(num_frames, this->_small_weights_fp32 ? this->_small_block_frames : 0);
+  return _align_scratch(this->_input_mixins.get_out_channels() * frames)
+         + this->_layers[0].get_mixin_channels() * frames;
+}
+
+void wavenet::_LayerArray::set_scratch_(const long offset, const long num_frames)
+{
+  this->_scratch = offset;
+  this->_scratch_frames = std::max(num_frames, this->_small_weights_fp32 ? this->_small_block_frames : 0);
+}
+
+size_t wavenet::_LayerArray::get_memory_size() const
+{
+  size_t size = this->_rechannel.get_memory_size() + this->_input_mixins.get_memory_size()
+                + this->_head_rechannel.get_memory_size()
+                + (this->_param_mixins.size() + this->_mixin_bias.size()) * sizeof(float);
+  for (const auto& layer : this->_layers)
+    size += layer.get_memory_size();
+  for (const auto& buffer : this->_layer_buffers)
+    size += buffer.size() * sizeof(float);
+  return size;
+}
+
+void wavenet::_LayerArray::_process_small_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                                           const Eigen::Ref<const Eigen::MatrixXf>& condition,
+                                           Eigen::Ref<Eigen::MatrixXf> head_inputs,
+                                           Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                                           Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena, const long start,
+                                           const long num_frames)
+{
+  // Once for the block, so nothing inside it has to choose.
+  switch (this->_small_activation)
+  {
+    case _SmallActivation::kTanh:
+      this->_process_small_gated_<activations::tanh>(
+        layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+      break;
+    case _SmallActivation::kFastTanh:
+      this->_process_small_gated_<activations::fast_tanh>(
+        layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+      break;
+    case _SmallActivation::kHardTanh:
+      this->_process_small_gated_<activations::hard_tanh>(
+        layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+      break;
+    case _SmallActivation::kReLU:
+      this->_process_small_gated_<activations::relu>(
+        layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+      break;
+    case _SmallActivation::kSigmoid:
+      this->_process_small_gated_<activations::sigmoid>(
+        layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+      break;
+    case _SmallActivation::kFastSigmoid:
+      this->_process_small_gated_<activations::fast_sigmoid>(
+        layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+      break;
+    case _SmallActivation::kTableTanh:
+      this->_process_small_gated_<activations::table_tanh>(
+        layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+      break;
+    case _SmallActivation::kTableSigmoid:
+      this->_process_small_gated_<activations::table_sigmoid>(
+        layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+      break;
+    default: throw std::runtime_error("Unexpected activation for a small block");
+  }
+}
+
+template <float (*ACTIVATION)(float)>
+void wavenet::_LayerArray::_process_small_gated_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                                                 const Eigen::Ref<const Eigen::MatrixXf>& condition,
+                                                 Eigen::Ref<Eigen::MatrixXf> head_inputs,
+                                                 Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                                                 Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena,
+                                                 const long start, const long num_frames)
+{
+  // (Whatever it is, if the layers aren't gated.)
+  if (this->_small_gate_activation == _SmallActivation::kFastSigmoid)
+    this->_process_small_frames_<ACTIVATION, activations::fast_sigmoid>(
+      layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+  else if (this->_small_gate_activation == _SmallActivation::kTableSigmoid)
+    this->_process_small_frames_<ACTIVATION, activations::table_sigmoid>(
+      layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+  else
+    this->_process_small_frames_<ACTIVATION, activations::sigmoid>(
+      layer_inputs, condition, head_inputs, layer_outputs, head_outputs, arena, start, num_frames);
+}
+
+template <float (*ACTIVATION)(float), float (*GATE_ACTIVATION)(float)>
+void wavenet::_LayerArray::_process_small_frames_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                                                  const Eigen::Ref<const Eigen::MatrixXf>& condition,
+                                                  Eigen::Ref<Eigen::MatrixXf> head_inputs,
+                                                  Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                                                  Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena,
+                                                  const long start, const long num_frames)
+{
+  const float* weights = arena.get(0);
+  const long channels = this->_get_channels();
+  const long mixin_channels = this->_layers[0].get_mixin_channels();
+  const long kernel_size = this->_layers[0].get_kernel_size();
+  const bool gated = this->_layers[0].is_gated();
+  const long mixed_in_rows = this->_input_mixins.get_out_channels();
+  const long condition_size = condition.rows();
+  const long input_size = layer_inputs.rows();
+  const long head_size = head_outputs.rows();
+  const long buffer_start = this->_buffer_start + start;
+
+  // The input mixins (with what the params add), and the rechannel
+  float* mixed_in = this->_get_mixed_in_(arena).data();
+  float* layer_input = this->_get_layer_buffer_(0, arena).data() + buffer_start * channels;
+  for (long j = 0; j < num_frames; j++)
+    for (long r = 0; r < mixed_in_rows; r++)
+      mixed_in[j * mixed_in_rows + r] = this->_mixin_bias(r);
+  _gemv_add(weights + this->_input_mixins.get_arena_weight(), mixed_in_rows, condition_size,
+            condition.data() + start * condition_size, condition_size, mixed_in, mixed_in_rows, num_frames);
+  if (this->_rechannel_in_mixins)
+    for (long j = 0; j < num_frames; j++)
+      for (long r = 0; r < channels; r++)
+        layer_input[j * channels + r] = mixed_in[j * mixed_in_rows + r];
+  else
+  {
+    for (long r = 0; r < num_frames * channels; r++)
+      layer_input[r] = 0.0f;
+    _gemv_add(weights + this->_rechannel.get_arena_weight(), channels, input_size, layer_inputs.data() + start * input_size,
+              input_size, layer_input, channels, num_frames);
+  }
+
+  // The layers
+  float* z = this->_get_z_(arena, num_frames).data();
+  float* head_input = head_inputs.data() + start * channels;
+  const long num_layers = (long)this->_layers.size();
+  for (long i = 0; i < num_layers; i++)
+  {
+    const _DilatedConv& conv = this->_layers[i].get_conv();
+    const Conv1x1& conv_1x1 = this->_layers[i].get_1x1();
+    const long dilation = conv.get_dilation();
+    const float* input = this->_get_layer_buffer_(i, arena).data() + buffer_start * channels;
+    float* output = i + 1 < num_layers ? this->_get_layer_buffer_(i + 1, arena).data() + buffer_start * channels
+                                       : layer_outputs.data() + start * channels;
+    const float* conv_bias = weights + conv.get_arena_bias();
+    for (long j = 0; j < num_frames; j++)
+      for (long r = 0; r < mixin_channels; r++)
+        z[j * mixin_channels + r] = conv_bias[r] + mixed_in[j * mixed_in_rows + this->_mixin_rows[i] + r];
+    for (long k = 0; k < kernel_size; k++)
+      _gemv_add(weights + conv.get_arena_weight() + k * mixin_channels * channels, mixin_channels, channels,
+                input - (kernel_size - 1 - k) * dilation * channels, channels, z, mixin_channels, num_frames);
+    for (long r = 0; r < num_frames * mixin_channels; r++)
+      z[r] = ACTIVATION(z[r]);
+    const float* bias_1x1 = weights + conv_1x1.get_arena_bias();
+    for (long j = 0; j < num_frames; j++)
+    {
+      float* zj = z + j * mixin_channels;
+      if (gated)
+        for (long r = 0; r < channels; r++)
+          zj[r] *= GATE_ACTIVATION(zj[channels + r]);
+      for (long r = 0; r < channels; r++)
+      {
+        head_input[j * channels + r] += zj[r];
+        output[j * channels + r] = input[j * channels + r] + bias_1x1[r];
+      }
+    }
+    _gemv_add(weights + conv_1x1.get_arena_weight(), channels, channels, z, mixin_channels, output, channels,
+              num_frames);
+  }
+
+  // The head rechannel
+  float* head_output = head_outputs.data() + start * head_size;
+  const bool head_bias = this->_head_rechannel.has_bias();
+  for (long j = 0; j < num_frames; j++)
+    for (long r = 0; r < head_size; r++)
+      head_output[j * head_size + r] = head_bias ? weights[this->_head_rechannel.get_arena_bias() + r] : 0.0f;
+  _gemv_add(weights + this->_head_rechannel.get_arena_weight(), head_size, channels, head_input, channels, head_output, head_size,
+            num_frames);
+}
+
 // Head =======================================================================
 
 wavenet::_Head::_Head(const int input_size, const int num_layers, const int channels, const std::string activation)
@@ -234,7 +800,11 @@ wavenet::WaveNet<SampleType>::WaveNet(const SampleType loudness, const std::vect
                           std::vector<float> params)
 : DSP<SampleType>(loudness)
 , _num_frames(0)
+, _thread_pool(nullptr)
+, _cost(0)
+, _condition(0)
 , _head_scale(head_scale)
+, _arena_frames(0)
 {
   if (with_head)
     throw std::runtime_error("Head not implemented!");
@@ -244,10 +814,11 @@ wavenet::WaveNet<SampleType>::WaveNet(const SampleType loudness, const std::vect
     this->_layer_arrays.push_back(wavenet::_LayerArray(
       layer_array_params[i].input_size, layer_array_params[i].condition_size, layer_array_params[i].head_size,
       layer_array_params[i].channels, layer_array_params[i].kernel_size, layer_array_params[i].dilations,
-      layer_array_params[i].activation, layer_array_params[i].gated, layer_array_params[i].head_bias));
-    this->_layer_array_outputs.push_back(Eigen::MatrixXf(layer_array_params[i].channels, 0));
+      layer_array_params[i].activation, layer_array_params[i].gated, layer_array_params[i].head_bias, i == 0,
+      (int)this->_param_names.size()));
+    this->_layer_array_output_rows.push_back(layer_array_params[i].channels);
     if (i == 0)
-      this->_head_arrays.push_back(Eigen::MatrixXf(layer_array_params[i].channels, 0));
+      this->_head_array_rows.push_back(layer_array_params[i].channels);
     if (i > 0)
       if (layer_array_params[i].channels != layer_array_params[i - 1].head_size)
       {
@@ -256,11 +827,14 @@ wavenet::WaveNet<SampleType>::WaveNet(const SampleType loudness, const std::vect
            << ") doesn't match head_size of preceding layer (" << layer_array_params[i - 1].head_size << "!\n";
         throw std::runtime_error(ss.str().c_str());
       }
-    this->_head_arrays.push_back(Eigen::MatrixXf(layer_array_params[i].head_size, 0));
+    this->_head_array_rows.push_back(layer_array_params[i].head_size);
   }
-  this->_head_output.resize(1, 0); // Mono output!
+  this->_layer_array_outputs.assign(this->_layer_array_output_rows.size(), 0);
+  this->_head_arrays.assign(this->_head_array_rows.size(), 0);
   this->set_params_(params);
   this->_reset_anti_pop_();
+  for (const auto& layer_array : this->_layer_arrays)
+    this->_cost += layer_array.get_cost();
 }
 
 template <typename SampleType>
@@ -270,12 +844,66 @@ void wavenet::WaveNet<SampleType>::finalize_(const int num_frames)
   this->_advance_buffers_(num_frames);
 }
 
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds)
+{
+  this->_thread_pool = pool;
+  this->_parallel_thresholds = thresholds;
+  for (auto& layer_array : this->_layer_arrays)
+    layer_array.set_thread_pool_(pool, thresholds.min_tile_cost);
+  // Whether the arrays can share scratch depends on it.
+  this->_layout_arena_();
+}
+
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::set_weight_precision(const EWeightPrecision precision)
+{
+  for (auto& layer_array : this->_layer_arrays)
+  {
+    layer_array.take_weights_from_(this->_arena);
+    layer_array.set_weight_precision_(precision);
+  }
+  this->_layout_arena_();
+}
+
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::set_activation_policy(const EActivationPolicy policy)
+{
+  for (auto& layer_array : this->_layer_arrays)
+    layer_array.set_activation_policy_(policy);
+}
+
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::set_small_block_frames(const long num_frames)
+{
+  for (auto& layer_array : this->_layer_arrays)
+    layer_array.set_small_block_frames_(num_frames);
+  this->_layout_arena_();
+}
+
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::set_arena_options(const ArenaOptions& options)
+{
+  this->_arena_options = options;
+  this->_layout_arena_();
+}
+
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::get_activation_ranges(std::vector<ActivationRange*>& ranges)
+{
+  for (auto& layer_array : this->_layer_arrays)
+    layer_array.get_activation_ranges_(ranges);
+}
+
 template <typename SampleType>
 void wavenet::WaveNet<SampleType>::set_params_(std::vector<float>& params)
 {
   std::vector<float>::iterator it = params.begin();
   for (int i = 0; i < this->_layer_arrays.size(); i++)
+  {
+    this->_layer_arrays[i].take_weights_from_(this->_arena);
     this->_layer_arrays[i].set_params_(it);
+  }
   // this->_head.set_params_(it);
   this->_head_scale = *(it++);
   if (it != params.end())
@@ -290,6 +918,89 @@ void wavenet::WaveNet<SampleType>::set_params_(std::vector<float>& params)
     ss << "Parameter mismatch: provided " << params.size() << " weights, but the model expects more.";
     throw std::runtime_error(ss.str().c_str());
   }
+  this->_layout_arena_();
+}
+
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::_layout_arena_()
+{
+  // The weights and the layer buffers come back out of the arena, then go
+  // into the new one: the weights in the order that they're used, then the
+  // buffers.
+  for (auto& layer_array : this->_layer_arrays)
+  {
+    layer_array.take_weights_from_(this->_arena);
+    layer_array.take_buffers_from_(this->_arena);
+  }
+  this->_arena.clear_();
+  for (auto& layer_array : this->_layer_arrays)
+    layer_array.move_weights_to_(this->_arena);
+  for (auto& layer_array : this->_layer_arrays)
+    layer_array.move_buffers_to_(this->_arena);
+  // Then the scratch, which nothing keeps between blocks. The arrays run one
+  // after another, so they can share theirs, and array i only uses the
+  // outputs of arrays i - 1 and i (and head arrays i and i + 1), so two of
+  // each do. Unless they're pipelined, when they run at the same time.
+  const long num_frames = this->_arena_frames;
+  const bool pipelined = this->_thread_pool != nullptr && this->_thread_pool->get_num_threads() >= 2
+                         && this->_layer_arrays.size() >= 2;
+  if (pipelined)
+    for (auto& layer_array : this->_layer_arrays)
+      layer_array.set_scratch_(this->_arena.reserve_(layer_array.get_scratch_size_(num_frames)), num_frames);
+  else
+  {
+    long scratch_size = 0;
+    for (const auto& layer_array : this->_layer_arrays)
+      scratch_size = std::max(scratch_size, layer_array.get_scratch_size_(num_frames));
+    const long scratch = this->_arena.reserve_(scratch_size);
+    for (auto& layer_array : this->_layer_arrays)
+      layer_array.set_scratch_(scratch, num_frames);
+  }
+  this->_condition = this->_arena.reserve_(num_frames);
+  auto reserve_shared = [&](const std::vector<long>& rows, std::vector<long>& offsets) {
+    const size_t num_slots = pipelined ? rows.size() : std::min(rows.size(), (size_t)2);
+    for (size_t slot = 0; slot < num_slots; slot++)
+    {
+      long slot_rows = 0;
+      for (size_t i = slot; i < rows.size(); i += num_slots)
+        slot_rows = std::max(slot_rows, rows[i]);
+      const long offset = this->_arena.reserve_(slot_rows * num_frames);
+      for (size_t i = slot; i < rows.size(); i += num_slots)
+        offsets[i] = offset;
+    }
+  };
+  reserve_shared(this->_layer_array_output_rows, this->_layer_array_outputs);
+  reserve_shared(this->_head_array_rows, this->_head_arrays);
+  this->_arena.allocate_(this->_arena_options);
+}
+
+template <typename SampleType>
+Eigen::Map<Eigen::MatrixXf> wavenet::WaveNet<SampleType>::_get_condition_()
+{
+  return Eigen::Map<Eigen::MatrixXf>(this->_arena.get(this->_condition), 1, this->_num_frames);
+}
+
+template <typename SampleType>
+Eigen::Map<Eigen::MatrixXf> wavenet::WaveNet<SampleType>::_get_layer_array_output_(const size_t i)
+{
+  return Eigen::Map<Eigen::MatrixXf>(
+    this->_arena.get(this->_layer_array_outputs[i]), this->_layer_array_output_rows[i], this->_num_frames);
+}
+
+template <typename SampleType>
+Eigen::Map<Eigen::MatrixXf> wavenet::WaveNet<SampleType>::_get_head_array_(const size_t i)
+{
+  return Eigen::Map<Eigen::MatrixXf>(this->_arena.get(this->_head_arrays[i]), this->_head_array_rows[i],
+                                     this->_num_frames);
+}
+
+template <typename SampleType>
+size_t wavenet::WaveNet<SampleType>::get_memory_size() const
+{
+  size_t size = this->DSP<SampleType>::get_memory_size() + this->_condition_params.size() * sizeof(float);
+  for (const auto& layer_array : this->_layer_arrays)
+    size += layer_array.get_memory_size();
+  return size;
 }
 
 template <typename SampleType>
@@ -302,17 +1013,72 @@ void wavenet::WaveNet<SampleType>::_advance_buffers_(const int num_frames)
 template <typename SampleType>
 void wavenet::WaveNet<SampleType>::_init_parametric_(nlohmann::json& parametric)
 {
+  std::vector<std::string> param_names;
   for (nlohmann::json::iterator it = parametric.begin(); it != parametric.end(); ++it)
-    this->_param_names.push_back(it.key());
+    param_names.push_back(it.key());
   // TODO assert continuous 0 to 1
-  std::sort(this->_param_names.begin(), this->_param_names.end());
+  std::sort(param_names.begin(), param_names.end());
+  // Param with handle h is channel 1 + h of the condition (h of
+  // _condition_params).
+  for (const auto& name : param_names)
+    this->_register_param_(name);
+  this->_condition_params.setZero(param_names.size());
+}
+
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::prewarm()
+{
+  // Without feedback, a long silence leaves every column of every buffer the
+  // same, so one frame with the history filled in gets there.
+  this->_set_num_frames_(1);
+  this->_prepare_for_frames_(1);
+  auto condition = this->_get_condition_();
+  condition(0, 0) = 0.0f;
+  this->_update_condition_params_();
+  this->_get_head_array_(0).setZero();
+  for (int i = 0; i < this->_layer_arrays.size(); i++)
+    this->_layer_arrays[i].prewarm_(i == 0 ? condition : this->_get_layer_array_output_(i - 1), condition,
+                                    this->_get_head_array_(i), this->_get_layer_array_output_(i),
+                                    this->_get_head_array_(i + 1), this->_arena);
+  this->_advance_buffers_(1);
+  this->_anti_pop_countdown = this->_anti_pop_ramp;
+}
+
+template <typename SampleType>
+bool wavenet::WaveNet<SampleType>::get_state(DSPState& state) const
+{
+  state::Writer writer(state, "WaveNet");
+  for (const auto& layer_array : this->_layer_arrays)
+    layer_array.write_state_(writer, this->_arena);
+  writer.write(this->_anti_pop_countdown);
+  return true;
+}
+
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::set_state(const DSPState& state)
+{
+  state::Reader reader(state, "WaveNet");
+  for (auto& layer_array : this->_layer_arrays)
+    layer_array.read_state_(reader, this->_arena);
+  this->_anti_pop_countdown = reader.read_long();
+  reader.finish();
+}
+
+template <typename SampleType>
+int wavenet::WaveNet<SampleType>::_get_num_pipeline_pieces_(const long num_frames) const
+{
+  const int num_arrays = (int)this->_layer_arrays.size();
+  if (this->_thread_pool == nullptr || this->_thread_pool->get_num_threads() < 2 || num_arrays < 2
+      || this->_cost * num_frames < this->_parallel_thresholds.min_pipeline_cost)
+    return 1;
+  return (int)std::min((long)(_PIPELINE_PIECES_PER_ARRAY * num_arrays), num_frames / _MIN_PIPELINE_PIECE);
 }
 
 template <typename SampleType>
 void wavenet::WaveNet<SampleType>::_prepare_for_frames_(const long num_frames)
 {
   for (auto i = 0; i < this->_layer_arrays.size(); i++)
-    this->_layer_arrays[i].prepare_for_frames_(num_frames);
+    this->_layer_arrays[i].prepare_for_frames_(num_frames, this->_arena);
 }
 
 template <typename SampleType>
@@ -327,24 +1093,46 @@ void wavenet::WaveNet<SampleType>::_process_core_()
   // the outputs for NaNs and zero them out.
   // They'll flush out eventually because the model doesn't use any feedback.
 
-  // Fill into condition array:
-  // Clumsy...
+  // Fill into condition array.
+  // The params only need to be passed on when something's changed.
+  auto condition = this->_get_condition_();
   for (int j = 0; j < num_frames; j++)
-  {
-    this->_condition(0, j) = this->_input_post_gain[j];
-    if (this->_stale_params) // Column-major assignment; good for Eigen. Let the
-                             // compiler optimize this.
-      for (int i = 0; i < this->_param_names.size(); i++)
-        this->_condition(i + 1, j) = (float)this->_params[this->_param_names[i]];
-  }
+    condition(0, j) = this->_input_post_gain[j];
+  this->_update_condition_params_();
 
   // Main layer arrays:
   // Layer-to-layer
   // Sum on head output
-  this->_head_arrays[0].setZero();
-  for (int i = 0; i < this->_layer_arrays.size(); i++)
-    this->_layer_arrays[i].process_(i == 0 ? this->_condition : this->_layer_array_outputs[i - 1], this->_condition,
-                                    this->_head_arrays[i], this->_layer_array_outputs[i], this->_head_arrays[i + 1]);
+  this->_get_head_array_(0).setZero();
+  const int num_pieces = this->_get_num_pipeline_pieces_(num_frames);
+  if (num_pieces <= 1)
+    for (int i = 0; i < this->_layer_arrays.size(); i++)
+      this->_layer_arrays[i].process_(i == 0 ? condition : this->_get_layer_array_output_(i - 1), condition,
+                                      this->_get_head_array_(i), this->_get_layer_array_output_(i),
+                                      this->_get_head_array_(i + 1), this->_arena);
+  else
+  {
+    // Pipeline: at each step, layer array i works on piece (step - i), so
+    // each array has the output of the one before it for that piece, and
+    // the arrays can run at the same time.
+    const int num_arrays = (int)this->_layer_arrays.size();
+    const long piece_size = (num_frames + num_pieces - 1) / num_pieces;
+    for (int step = 0; step < num_pieces + num_arrays - 1; step++)
+    {
+      const int first = std::max(0, step - num_pieces + 1);
+      const int last = std::min(step, num_arrays - 1);
+      this->_thread_pool->run(last - first + 1, [&](const int task) {
+        const int i = first + task;
+        const long start = (step - i) * piece_size;
+        if (start >= num_frames)
+          return;
+        this->_layer_arrays[i].process_(i == 0 ? condition : this->_get_layer_array_output_(i - 1), condition,
+                                        this->_get_head_array_(i), this->_get_layer_array_output_(i),
+                                        this->_get_head_array_(i + 1), this->_arena, start,
+                                        std::min(piece_size, num_frames - start));
+      });
+    }
+  }
   // this->_head.process_(
   //   this->_head_input,
   //   this->_head_output
@@ -353,11 +1141,15 @@ void wavenet::WaveNet<SampleType>::_process_core_()
   //  Hack: apply head scale here; revisit when/if I activate the head.
   //  assert(this->_head_output.rows() == 1);
 
-  const long final_head_array = this->_head_arrays.size() - 1;
-  assert(this->_head_arrays[final_head_array].rows() == 1);
+  auto final_head_array = this->_get_head_array_(this->_head_arrays.size() - 1);
+  assert(final_head_array.rows() == 1);
+  // get_dsp() folds the head scale into the weights; anything else that
+  // builds a WaveNet gets it applied here.
+  if (this->_head_scale != 1.0f)
+    final_head_array *= this->_head_scale;
   for (int s = 0; s < num_frames; s++)
   {
-    float out = this->_head_scale * this->_head_arrays[final_head_array](0, s);
+    float out = final_head_array(0, s);
     // This is the NaN check that we could fix with anti-popping the input
     if (isnan(out))
       out = 0.0;
@@ -367,23 +1159,33 @@ void wavenet::WaveNet<SampleType>::_process_core_()
   this->_anti_pop_();
 }
 
+template <typename SampleType>
+void wavenet::WaveNet<SampleType>::_update_condition_params_()
+{
+  if (!this->_stale_params)
+    return;
+  for (int i = 0; i < this->_param_values.size(); i++)
+    this->_condition_params(i) = (float)this->_param_values[i];
+  for (auto& layer_array : this->_layer_arrays)
+    layer_array.set_condition_params_(this->_condition_params);
+  this->_stale_params = false;
+}
+
 template <typename SampleType>
 void wavenet::WaveNet<SampleType>::_set_num_frames_(const long num_frames)
 {
   if (num_frames == this->_num_frames)
     return;
 
-  this->_condition.resize(1 + this->_param_names.size(), num_frames);
-  for (int i = 0; i < this->_head_arrays.size(); i++)
-    this->_head_arrays[i].resize(this->_head_arrays[i].rows(), num_frames);
-  for (int i = 0; i < this->_layer_array_outputs.size(); i++)
-    this->_layer_array_outputs[i].resize(this->_layer_array_outputs[i].rows(), num_frames);
-  this->_head_output.resize(this->_head_output.rows(), num_frames);
-
   for (int i = 0; i < this->_layer_arrays.size(); i++)
     this->_layer_arrays[i].set_num_frames_(num_frames);
   // this->_head.set_num_frames_(num_frames);
   this->_num_frames = num_frames;
+  if (num_frames > this->_arena_frames)
+  {
+    this->_arena_frames = num_frames;
+    this->_layout_arena_();
+  }
 }
 
 template <typename SampleType>
@@ -406,10 +1208,16 @@ template <typename SampleType>
 void wavenet::WaveNet<SampleType>::_reset_anti_pop_()
 {
   // You need the "real" receptive field, not the buffers.
+  this->_anti_pop_countdown = -this->_get_receptive_field();
+}
+
+template <typename SampleType>
+long wavenet::WaveNet<SampleType>::_get_receptive_field() const
+{
   long receptive_field = 1;
-  for (int i = 0; i < this->_layer_arrays.size(); i++)
+  for (size_t i = 0; i < this->_layer_arrays.size(); i++)
     receptive_field += this->_layer_arrays[i].get_receptive_field();
-  this->_anti_pop_countdown = -receptive_field;
+  return receptive_field;
 }
 
 template class wavenet::WaveNet<double>;
@@ -23,32 +23,59 @@ class _Layer
 public:
   _Layer(const int condition_size, const int channels, const int kernel_size, const int dilation,
          const std::string activation, const bool gated)
-  : _activation(activations::Activation::get_activation(activation))
+  : _activation_name(activation)
+  , _activation(activations::Activation::get_activation(activation))
+  , _gate_activation(activations::Activation::get_activation("Sigmoid"))
   , _gated(gated)
   , _conv(channels, gated ? 2 * channels : channels, kernel_size, true, dilation)
-  , _input_mixin(condition_size, gated ? 2 * channels : channels, false)
   , _1x1(channels, channels, true){};
-  void set_params_(std::vector<float>::iterator& params);
+  // The input mixin's weights go in input_mixins, from mixin_row on (see
+  // _LayerArray::_input_mixins).
+  void set_params_(std::vector<float>::iterator& params, Conv1x1& input_mixins, const long mixin_row);
   // :param `input`: from previous layer
+  // :param `mixed_in`: the condition's input signal, through the input mixin
+  // :param `mixin_bias`: what the condition's params add to that
+  // :param `z`: scratch, with get_mixin_channels() rows and at least as many
+  //     columns as mixed_in
   // :param `output`: to next layer
-  void process_(const Eigen::MatrixXf& input, const Eigen::MatrixXf& condition, Eigen::MatrixXf& head_input,
-                Eigen::MatrixXf& output, const long i_start, const long j_start);
-  void set_num_frames_(const long num_frames);
+  // :param `arena`: the model's, which has the weights
+  // Processes mixed_in.cols() frames.
+  void process_(const Eigen::Ref<const Eigen::MatrixXf>& input, const Eigen::Ref<const Eigen::MatrixXf>& mixed_in,
+                const Eigen::Ref<const Eigen::VectorXf>& mixin_bias, Eigen::Ref<Eigen::MatrixXf> z,
+                Eigen::Ref<Eigen::MatrixXf> head_input, Eigen::Ref<Eigen::MatrixXf> output, const long i_start,
+                const long j_start, const Arena& arena);
+  // Multiply-adds per frame
+  long get_cost() const;
+  void set_thread_pool_(ThreadPool* pool, const long min_tile_cost);
+  void set_weight_precision_(const EWeightPrecision precision);
+  // See Conv1D::move_weights_to_().
+  void move_weights_to_(Arena& arena);
+  void take_weights_from_(const Arena& arena);
+  // See Conv1D::get_memory_size().
+  size_t get_memory_size() const;
+  void get_activation_ranges_(std::vector<ActivationRange*>& ranges);
   long get_channels() const { return this->_conv.get_in_channels(); };
   int get_dilation() const { return this->_conv.get_dilation(); };
   long get_kernel_size() const { return this->_conv.get_kernel_size(); };
+  // The input mixin's output channels
+  long get_mixin_channels() const { return this->_conv.get_out_channels(); };
+  const _DilatedConv& get_conv() const { return this->_conv; };
+  const Conv1x1& get_1x1() const { return this->_1x1; };
+  const activations::Activation* get_activation() const { return this->_activation; };
+  const activations::Activation* get_gate_activation() const { return this->_gate_activation; };
+  bool is_gated() const { return this->_gated; };
+  void set_activation_policy_(const EActivationPolicy policy);
 
 private:
   // The dilated convolution at the front of the block
   _DilatedConv _conv;
-  // Input mixin
-  Conv1x1 _input_mixin;
   // The post-activation 1x1 convolution
   Conv1x1 _1x1;
-  // The internal state
-  Eigen::MatrixXf _z;
 
+  std::string _activation_name;
   activations::Activation* _activation;
+  // On the gate's half of the channels, after _activation
+  activations::Activation* _gate_activation;
   const bool _gated;
 };
 
@@ -86,9 +113,15 @@ public:
 class _LayerArray
 {
 public:
+  // input_is_condition: whether the array's input will be the condition
+  // itself (as the first array's is)
+  // num_condition_params: how many of the condition's channels (the last
+  // ones) are the model's params. They're the same for every frame, so
+  // they're not passed in with the rest of the condition, but to
+  // set_condition_params_().
   _LayerArray(const int input_size, const int condition_size, const int head_size, const int channels,
               const int kernel_size, const std::vector<int>& dilations, const std::string activation, const bool gated,
-              const bool head_bias);
+              const bool head_bias, const bool input_is_condition, const int num_condition_params);
 
   void advance_buffers_(const int num_frames);
 
@@ -96,17 +129,60 @@ public:
   // Rewind buffers if needed
   // Shift index to prepare
   //
-  void prepare_for_frames_(const long num_frames);
+  void prepare_for_frames_(const long num_frames, Arena& arena);
 
   // All arrays are "short".
-  void process_(const Eigen::MatrixXf& layer_inputs, // Short
-                const Eigen::MatrixXf& condition, // Short
-                Eigen::MatrixXf& layer_outputs, // Short
-                Eigen::MatrixXf& head_inputs, // Sum up on this.
-                Eigen::MatrixXf& head_outputs // post head-rechannel
-  );
+  void process_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs, // Short
+                const Eigen::Ref<const Eigen::MatrixXf>& condition, // Short
+                Eigen::Ref<Eigen::MatrixXf> layer_outputs, // Short
+                Eigen::Ref<Eigen::MatrixXf> head_inputs, // Sum up on this.
+                Eigen::Ref<Eigen::MatrixXf> head_outputs, // post head-rechannel
+                Arena& arena);
+  // Just frames [start, start + num_frames) of the block. The pieces of a
+  // block need to be processed in order. arena is the model's, laid out
+  // with move_weights_to_(), move_buffers_to_() and set_scratch_().
+  void process_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                const Eigen::Ref<const Eigen::MatrixXf>& condition, Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                Eigen::Ref<Eigen::MatrixXf> head_inputs, Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena,
+                const long start, const long num_frames);
+  // Process the first frame of the block as if the same input had been
+  // coming in forever, by filling each layer's history with the column that
+  // comes into it.
+  void prewarm_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                const Eigen::Ref<const Eigen::MatrixXf>& condition, Eigen::Ref<Eigen::MatrixXf> head_inputs,
+                Eigen::Ref<Eigen::MatrixXf> layer_outputs, Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena);
+  // What the layers look back on, for WaveNet::get_state()/set_state()
+  void write_state_(state::Writer& writer, const Arena& arena) const;
+  void read_state_(state::Reader& reader, Arena& arena);
+  // Throws if the buffers are too short for blocks of num_frames.
   void set_num_frames_(const long num_frames);
+  // Multiply-adds per frame
+  long get_cost() const;
+  void set_thread_pool_(ThreadPool* pool, const long min_tile_cost);
+  void set_weight_precision_(const EWeightPrecision precision);
+  void get_activation_ranges_(std::vector<ActivationRange*>& ranges);
   void set_params_(std::vector<float>::iterator& it);
+  // Real-time safe
+  void set_condition_params_(const Eigen::Ref<const Eigen::VectorXf>& values);
+  void set_activation_policy_(const EActivationPolicy policy);
+  // See WaveNet::set_small_block_frames().
+  void set_small_block_frames_(const long num_frames) { this->_small_block_frames = num_frames; };
+  // Move the convolutions' fp32 weights into the model's arena, in the order
+  // that they're used, and back (see Conv1D::move_weights_to_()). Both paths
+  // use them there.
+  void move_weights_to_(Arena& arena);
+  void take_weights_from_(const Arena& arena);
+  // The same for the layer buffers, which keep their contents between blocks
+  void move_buffers_to_(Arena& arena);
+  void take_buffers_from_(const Arena& arena);
+  // How much scratch process_() needs for blocks (or pieces) of up to
+  // num_frames, and where it is in the arena: the input mixins' output, then
+  // a layer's convolution (which the layers take turns with). It's only
+  // used during process_().
+  long get_scratch_size_(const long num_frames) const;
+  void set_scratch_(const long offset, const long num_frames);
+  // Bytes kept outside the arena
+  size_t get_memory_size() const;
 
   // "Zero-indexed" receptive field.
   // E.g. a 1x1 convolution has a z.i.r.f. of zero.
@@ -114,26 +190,114 @@ public:
 
 private:
   long _buffer_start;
-  // The rechannel before the layers
+  // Whether the rechannel is done along with the input mixins, which it can
+  // be when the input is the condition
+  const bool _rechannel_in_mixins;
+  // The rechannel before the layers (unless it's in _input_mixins)
   Conv1x1 _rechannel;
+  // The layers' input mixins, after the rechannel if it's in with them, one
+  // above another. They all see the condition, so they're done as one
+  // product for the whole array rather than one per layer.
+  // The params are the same for every frame, so what they add is worked out
+  // when they change (into _mixin_bias), and added where each row of the
+  // mixins' output is used.
+  const int _num_condition_params;
+  Conv1x1 _input_mixins;
+  // The mixins' weights for the params, and what they add
+  Eigen::MatrixXf _param_mixins;
+  Eigen::VectorXf _mixin_bias;
+  // Where each layer's rows of the mixins' output start
+  std::vector<long> _mixin_rows;
 
   // Buffers in between layers.
   // buffer [i] is the input to layer [i].
   // the last layer outputs to a short array provided by outside.
+  // They're here until move_buffers_to_(), then in the arena at
+  // _arena_layer_buffers (-1 while they're here).
   std::vector<Eigen::MatrixXf> _layer_buffers;
+  std::vector<long> _arena_layer_buffers;
+  // Columns in each of them
+  long _buffer_size;
   // The layer objects
   std::vector<_Layer> _layers;
 
   // Rechannel for the head
   Conv1x1 _head_rechannel;
 
-  long _get_buffer_size() const { return this->_layer_buffers.size() > 0 ? this->_layer_buffers[0].cols() : 0; };
+  // Small blocks:
+  // On a few frames, Eigen's setup for each product, the views of the
+  // buffers and the activation's virtual call cost more than the arithmetic.
+  // _process_small_() works on raw pointers instead, with matrix-vector
+  // products on a few frames at a time, on the weights where they are in the
+  // model's arena, and with the activation chosen once for the block.
+  enum class _SmallActivation
+  {
+    // One that _process_small_() doesn't know; it's not used.
+    kNone = 0,
+    kTanh,
+    kFastTanh,
+    kHardTanh,
+    kReLU,
+    kSigmoid,
+    kFastSigmoid,
+    kTableTanh,
+    kTableSigmoid
+  };
+  // The layers' activation, and their gates'
+  _SmallActivation _small_activation;
+  _SmallActivation _small_gate_activation;
+  // Blocks (or pipelined pieces) of up to this many frames
+  long _small_block_frames;
+  // Whether the weights are fp32 (and so in the arena), which the small path
+  // needs
+  bool _small_weights_fp32;
+  // See set_scratch_(): where it is, and the frames that it's laid out for
+  long _scratch;
+  long _scratch_frames;
+
+  long _get_buffer_size() const { return this->_buffer_size; };
+  // Layer buffer i, wherever it is
+  Eigen::Map<Eigen::MatrixXf> _get_layer_buffer_(const size_t i, Arena& arena);
+  Eigen::Map<const Eigen::MatrixXf> _get_layer_buffer_(const size_t i, const Arena& arena) const;
+  // The input mixins' output for the block, and a layer's convolution, in
+  // the scratch
+  Eigen::Map<Eigen::MatrixXf> _get_mixed_in_(Arena& arena) const;
+  Eigen::Map<Eigen::MatrixXf> _get_z_(Arena& arena, const long num_frames) const;
   long _get_channels() const;
   // "One-indexed" receptive field
   // TODO remove!
   // E.g. a 1x1 convolution has a o.i.r.f. of one.
   long _get_receptive_field() const;
-  void _rewind_buffers_();
+  void _rewind_buffers_(Arena& arena);
+  // The input mixins and the rechannel, on frames [start, start + num_frames)
+  // of the block
+  void _process_inputs_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                        const Eigen::Ref<const Eigen::MatrixXf>& condition, const long start, const long num_frames,
+                        Arena& arena);
+  // Layer i on frames [start, start + num_frames) of the block
+  void _process_layer_(const int i, Eigen::Ref<Eigen::MatrixXf> head_inputs, Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                       const long start, const long num_frames, Arena& arena);
+  // Whether process_() uses _process_small_() for num_frames
+  bool _is_small_(const long num_frames) const;
+  // Which of its activations _process_small_() uses, from the layers'
+  void _bind_small_activations_();
+  // As process_(), and with the activation known
+  void _process_small_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                       const Eigen::Ref<const Eigen::MatrixXf>& condition, Eigen::Ref<Eigen::MatrixXf> head_inputs,
+                       Eigen::Ref<Eigen::MatrixXf> layer_outputs, Eigen::Ref<Eigen::MatrixXf> head_outputs,
+                       Arena& arena, const long start, const long num_frames);
+  template <float (*ACTIVATION)(float)>
+  void _process_small_gated_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                             const Eigen::Ref<const Eigen::MatrixXf>& condition,
+                             Eigen::Ref<Eigen::MatrixXf> head_inputs, Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                             Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena, const long start,
+                             const long num_frames);
+  template <float (*ACTIVATION)(float), float (*GATE_ACTIVATION)(float)>
+  void _process_small_frames_(const Eigen::Ref<const Eigen::MatrixXf>& layer_inputs,
+                              const Eigen::Ref<const Eigen::MatrixXf>& condition,
+                              Eigen::Ref<Eigen::MatrixXf> head_inputs, Eigen::Ref<Eigen::MatrixXf> layer_outputs,
+                              Eigen::Ref<Eigen::MatrixXf> head_outputs, Arena& arena, const long start,
+                              const long num_frames);
 };
 
 // The head module
@@ -179,33 +343,85 @@ public:
 
   void finalize_(const int num_frames) override;
   void set_params_(std::vector<float>& params);
+  void set_thread_pool(ThreadPool* pool, const ParallelThresholds& thresholds = ParallelThresholds()) override;
+  void set_weight_precision(const EWeightPrecision precision) override;
+  void set_activation_policy(const EActivationPolicy policy) override;
+  void get_activation_ranges(std::vector<ActivationRange*>& ranges) override;
+  // Blocks of up to this many frames (64 by default) go through a path with
+  // less overhead than the products on whole blocks: matrix-vector products
+  // on a few frames at a time. 0 turns it off. Only for fp32 weights, and it
+  // doesn't split the products up between threads.
+  void set_small_block_frames(const long num_frames);
+  // The arena has the fp32 weights, in the order that they're used, then the
+  // layer buffers (the layers' history), then the scratch for a block: the
+  // condition, the arrays' outputs and head arrays, and each array's input
+  // mixins' output and convolution. The scratch is laid out for the longest
+  // block so far; a longer one lays the arena out again, which isn't
+  // real-time safe (nor was resizing the matrices that it replaces).
+  void set_arena_options(const ArenaOptions& options) override;
+  const Arena* get_arena() const override { return &this->_arena; };
+  size_t get_memory_size() const override;
+  std::unique_ptr<DSP<SampleType>> clone() const override { return std::make_unique<WaveNet<SampleType>>(*this); };
+  // The receptive field, plus the anti-pop ramp in case the original is
+  // still on it
+  long get_warm_up_frames() const override { return this->_get_receptive_field() + this->_anti_pop_ramp; };
+  long get_history_frames() const override { return this->_get_receptive_field(); };
+  void prewarm() override;
+  bool get_state(DSPState& state) const override;
+  void set_state(const DSPState& state) override;
 
 private:
   long _num_frames;
+  // For splitting up the work
+  ThreadPool* _thread_pool;
+  ParallelThresholds _parallel_thresholds;
+  // Multiply-adds per frame
+  long _cost;
   std::vector<_LayerArray> _layer_arrays;
-  // Their outputs
-  std::vector<Eigen::MatrixXf> _layer_array_outputs;
+  // Block-sized arrays, in the arena's scratch: where each is, and its rows.
+  // Unless the layer arrays are pipelined, only two of the arrays' outputs
+  // (and of the head arrays) are in use at once, so the rest share their
+  // space (see _layout_arena_()).
+  // The layer arrays' outputs
+  std::vector<long> _layer_array_outputs;
+  std::vector<long> _layer_array_output_rows;
   // Head _head;
 
   // Element-wise arrays:
-  Eigen::MatrixXf _condition;
+  // The input signal part of the condition
+  long _condition;
+  // The params part, which _LayerArray keeps out of the product
+  Eigen::VectorXf _condition_params;
   // One more than total layer arrays
-  std::vector<Eigen::MatrixXf> _head_arrays;
+  std::vector<long> _head_arrays;
+  std::vector<long> _head_array_rows;
   float _head_scale;
-  Eigen::MatrixXf _head_output;
-
-  // Names of the params, sorted.
-  // TODO move this up, ugh.
-  std::vector<std::string> _param_names;
+  Arena _arena;
+  ArenaOptions _arena_options;
+  // The longest block that the arena's scratch is laid out for
+  long _arena_frames;
 
   void _advance_buffers_(const int num_frames);
+  // Lay the arena out again, after anything that changes what's in it
+  void _layout_arena_();
+  // The block-sized arrays, for the current block
+  Eigen::Map<Eigen::MatrixXf> _get_condition_();
+  Eigen::Map<Eigen::MatrixXf> _get_layer_array_output_(const size_t i);
+  Eigen::Map<Eigen::MatrixXf> _get_head_array_(const size_t i);
+  // One-indexed, as _LayerArray's
+  long _get_receptive_field() const;
   // Get the info from the parametric config
   void _init_parametric_(nlohmann::json& parametric);
+  // How many pieces to pipeline a block of num_frames in (1 if it's not)
+  int _get_num_pipeline_pieces_(const long num_frames) const;
   void _prepare_for_frames_(const long num_frames);
+  // Pass the params on to the layer arrays if they've changed.
+  void _update_condition_params_();
   // Reminder: From ._input_post_gain to ._core_dsp_output
   void _process_core_() override;
 
-  // Ensure that all buffer arrays are the right size for this num_frames
+  // Ensure that all buffer arrays are the right size for this num_frames (see
+  // set_arena_options())
   void _set_num_frames_(const long num_frames);
 
   // The net starts with random parameters inside; we need to wait for a full
@@ -15,7 +15,9 @@ dsp::ImpulseResponse<SampleType>::ImpulseResponse(const char* fileName, const Sa
 : mWavState(dsp::wav::LoadReturnCode::ERROR_OTHER)
 {
   // Try to load the WAV
-  this->mWavState = dsp::wav::Load(fileName, this->mRawAudio, this->mRawAudioSampleRate);
+  double rawAudioSampleRate = 0.0;
+  this->mWavState = dsp::wav::Load(fileName, this->mRawAudio, rawAudioSampleRate);
+  this->mRawAudioSampleRate = (SampleType)rawAudioSampleRate;
   if (this->mWavState != dsp::wav::LoadReturnCode::SUCCESS)
   {
     std::stringstream ss;
@@ -30,20 +32,34 @@ template <typename SampleType>
 SampleType** dsp::ImpulseResponse<SampleType>::Process(SampleType** inputs, const size_t numChannels, const size_t numFrames)
 {
   this->_PrepareBuffers(numChannels, numFrames);
+  this->_Process(inputs, this->_GetPointers(), numChannels, numFrames);
+  return this->_GetPointers();
+}
+
+template <typename SampleType>
+void dsp::ImpulseResponse<SampleType>::ProcessInPlace(SampleType** buffers, const size_t numChannels,
+                                                      const size_t numFrames)
+{
+  this->_Process(buffers, buffers, numChannels, numFrames);
+}
+
+template <typename SampleType>
+void dsp::ImpulseResponse<SampleType>::_Process(SampleType** inputs, SampleType** outputs, const size_t numChannels,
+                                                const size_t numFrames)
+{
   this->_UpdateHistory(inputs, numChannels, numFrames);
 
   for (size_t i = 0, j = this->mHistoryIndex - this->mHistoryRequired; i < numFrames; i++, j++)
   {
     auto input = Eigen::Map<const Eigen::VectorXf>(&this->mHistory[j], this->mHistoryRequired + 1);
-    this->mOutputs[0][i] = (double)this->mWeight.dot(input);
+    outputs[0][i] = (double)this->mWeight.dot(input);
   }
   // Copy out for more-than-mono.
   for (size_t c = 1; c < numChannels; c++)
     for (size_t i = 0; i < numFrames; i++)
-      this->mOutputs[c][i] = this->mOutputs[0][i];
+      outputs[c][i] = outputs[0][i];
 
   this->_AdvanceHistoryIndex(numFrames);
-  return this->_GetPointers();
 }
 
 template <typename SampleType>
@@ -52,7 +68,7 @@ void dsp::ImpulseResponse<SampleType>::_SetWeights(const SampleType sampleRate)
   if (this->mRawAudioSampleRate == sampleRate)
   {
     this->mResampled.resize(this->mRawAudio.size());
-    memcpy(this->mResampled.data(), this->mRawAudio.data(), this->mResampled.size());
+    memcpy(this->mResampled.data(), this->mRawAudio.data(), this->mResampled.size() * sizeof(float));
   }
   else
   {
@@ -61,7 +77,7 @@ void dsp::ImpulseResponse<SampleType>::_SetWeights(const SampleType sampleRate)
     padded.resize(this->mRawAudio.size() + 2);
     padded[0] = 0.0f;
     padded[padded.size() - 1] = 0.0f;
-    memcpy(padded.data() + 1, this->mRawAudio.data(), this->mRawAudio.size());
+    memcpy(padded.data() + 1, this->mRawAudio.data(), this->mRawAudio.size() * sizeof(float));
     dsp::ResampleCubic<float>(padded, this->mRawAudioSampleRate, sampleRate, 0.0, this->mResampled);
   }
   // Simple implementation w/ no resample...
@@ -75,3 +91,6 @@ void dsp::ImpulseResponse<SampleType>::_SetWeights(const SampleType sampleRate)
     this->mWeight[j] = gain * this->mResampled[i];
   this->mHistoryRequired = irLength - 1;
 }
+
+template class dsp::ImpulseResponse<double>;
+template class dsp::ImpulseResponse<float>;
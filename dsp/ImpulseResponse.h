@@ -23,10 +23,15 @@ class ImpulseResponse : public History<SampleType>
 public:
   ImpulseResponse(const char* fileName, const SampleType sampleRate);
   SampleType** Process(SampleType** inputs, const size_t numChannels, const size_t numFrames) override;
+  // The input goes into the history before anything is written, so this can
+  // work in place.
+  void ProcessInPlace(SampleType** buffers, const size_t numChannels, const size_t numFrames) override;
   // TODO states for the IR class
   dsp::wav::LoadReturnCode GetWavState() const { return this->mWavState; };
 
 private:
+  // inputs and outputs may be the same.
+  void _Process(SampleType** inputs, SampleType** outputs, const size_t numChannels, const size_t numFrames);
   // Set the weights, given that the plugin is running at the provided sample
   // rate.
   void _SetWeights(const SampleType sampleRate);
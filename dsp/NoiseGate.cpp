@@ -5,7 +5,8 @@
 //  Created by Steven Atkinson on 2/5/23.
 //
 
-#include <cmath> // pow
+#include <cmath> // pow, floor
+#include <cstdint>
 #include <sstream>
 
 #include "NoiseGate.h"
@@ -20,6 +21,59 @@ double _DBToLevel(const double level)
   return pow(10.0, level / 10.0);
 }
 
+// Changes in the gain reduction smaller than this (in dB) go straight to the
+// target.
+constexpr double _GAIN_SNAP_DB = 1.0e-6;
+
+// Cheap versions of the above for the per-sample loops.
+// log2 and exp2 are done by splitting a float into its exponent and mantissa
+// and fitting a polynomial over the mantissa. Good to about 3e-4 dB and 1e-4
+// (relative) respectively, which is plenty for a gate.
+
+// log2(x) for x > 0
+inline float _FastLog2(const float x)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(float));
+  const float exponent = (float)((int)((bits >> 23) & 0xff) - 127);
+  bits = (bits & 0x007fffff) | 0x3f800000;
+  float m; // [1, 2)
+  std::memcpy(&m, &bits, sizeof(float));
+  // Minimax fit of log2(1 + t) over [0, 1)
+  const float t = m - 1.0f;
+  const float log2M =
+    8.76005041e-05f + t * (1.43770409f + t * (-0.674941363f + t * (0.318676624f + t * -0.0816145341f)));
+  return exponent + log2M;
+}
+
+// 2^x
+// Very small results are flushed to zero so that the products made with them
+// don't go denormal (which is very slow).
+inline float _FastExp2(const float x)
+{
+  const float clamped = std::clamp(x, -64.0f, 126.0f);
+  const float whole = std::floor(clamped);
+  const float f = clamped - whole; // [0, 1)
+  const float exp2F =
+    1.0f + f * (0.6931472f + f * (0.2402265f + f * (0.05550411f + f * (0.009618129f + f * 0.001333355f))));
+  const uint32_t bits = (uint32_t)((int)whole + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(float));
+  return x < -64.0f ? 0.0f : exp2F * scale;
+}
+
+// 10 * log10(level) = 10 * log10(2) * log2(level)
+inline float _FastLevelToDB(const float level)
+{
+  return 3.0103f * _FastLog2(level);
+}
+
+// 10 ^ (db / 10) = 2 ^ (db * log2(10) / 10)
+inline float _FastDBToLevel(const float db)
+{
+  return _FastExp2(0.33219281f * db);
+}
+
 template <typename SampleType>
 dsp::noise_gate::Trigger<SampleType>::Trigger()
 : mParams(0.05, -60.0, 1.5, 0.002, 0.050, 0.050)
@@ -33,79 +87,90 @@ double signum(const double val)
 }
 
 template <typename SampleType>
-SampleType** dsp::noise_gate::Trigger<SampleType>::Process(SampleType** inputs, const size_t numChannels, const size_t numFrames)
+typename dsp::noise_gate::Trigger<SampleType>::Constants dsp::noise_gate::Trigger<SampleType>::_GetConstants() const
 {
-  this->_PrepareBuffers(numChannels, numFrames);
-
   // A bunch of numbers we'll use a few times.
-  const SampleType alpha = pow(0.5, 1.0 / (this->mParams.GetTime() * this->mSampleRate));
-  const SampleType beta = 1.0 - alpha;
-  const SampleType threshold = this->mParams.GetThreshold();
-  const SampleType dt = 1.0 / this->mSampleRate;
-  const SampleType maxHold = this->mParams.GetHoldTime();
-  const SampleType maxGainReduction = this->_GetMaxGainReduction();
+  Constants constants;
+  constants.alpha = pow(0.5, 1.0 / (this->mParams.GetTime() * this->mSampleRate));
+  constants.beta = 1.0 - constants.alpha;
+  constants.threshold = this->mParams.GetThreshold();
+  constants.thresholdPower = _DBToLevel(constants.threshold);
+  constants.dt = 1.0 / this->mSampleRate;
+  constants.maxHold = this->mParams.GetHoldTime();
+  constants.maxGainReduction = this->_GetMaxGainReduction();
   // Amount of open or close in a sample: rate times time
-  const SampleType dOpen = -this->_GetMaxGainReduction() / this->mParams.GetOpenTime() * dt; // >0
-  const SampleType dClose = this->_GetMaxGainReduction() / this->mParams.GetCloseTime() * dt; // <0
+  constants.dOpen = -this->_GetMaxGainReduction() / this->mParams.GetOpenTime() * constants.dt; // >0
+  constants.dClose = this->_GetMaxGainReduction() / this->mParams.GetCloseTime() * constants.dt; // <0
+  return constants;
+}
 
-  // The main algorithm: compute the gain reduction
-  for (auto c = 0; c < numChannels; c++)
+template <typename SampleType>
+SampleType dsp::noise_gate::Trigger<SampleType>::_Update(const size_t c, const SampleType sample,
+                                                         const Constants& constants)
+{
+  this->mLevel[c] = std::clamp(constants.alpha * this->mLevel[c] + constants.beta * (sample * sample),
+                               SampleType(MINIMUM_LOUDNESS_POWER), SampleType(1000.0));
+  if (this->mState[c] == dsp::noise_gate::Trigger<SampleType>::State::HOLDING)
   {
-    for (auto s = 0; s < numFrames; s++)
+    this->mLastGainReductionDB[c] = 0.0;
+    // Compare as powers so there's no need for the level in dB.
+    if (this->mLevel[c] < constants.thresholdPower)
     {
-      this->mLevel[c] =
-        std::clamp(alpha * this->mLevel[c] + beta * (inputs[c][s] * inputs[c][s]), SampleType(MINIMUM_LOUDNESS_POWER), SampleType(1000.0));
-      const SampleType levelDB = _LevelToDB(this->mLevel[c]);
-      if (this->mState[c] == dsp::noise_gate::Trigger<SampleType>::State::HOLDING)
-      {
-        this->mGainReductionDB[c][s] = 0.0;
-        this->mLastGainReductionDB[c] = 0.0;
-        if (levelDB < threshold)
-        {
-          this->mTimeHeld[c] += dt;
-          if (this->mTimeHeld[c] >= maxHold)
-            this->mState[c] = dsp::noise_gate::Trigger<SampleType>::State::MOVING;
-        }
-        else
-        {
-          this->mTimeHeld[c] = 0.0;
-        }
-      }
-      else
-      { // Moving
-        const SampleType targetGainReduction = this->_GetGainReduction(levelDB);
-        if (targetGainReduction > this->mLastGainReductionDB[c])
-        {
-          const SampleType dGain = std::clamp(SampleType(0.5) * (targetGainReduction - this->mLastGainReductionDB[c]), SampleType(0.0), dOpen);
-          this->mLastGainReductionDB[c] += dGain;
-          if (this->mLastGainReductionDB[c] >= 0.0)
-          {
-            this->mLastGainReductionDB[c] = 0.0;
-            this->mState[c] = dsp::noise_gate::Trigger<SampleType>::State::HOLDING;
-            this->mTimeHeld[c] = 0.0;
-          }
-          
-          if (levelDB > threshold)
-            gating = false;
-        }
-        else if (targetGainReduction < this->mLastGainReductionDB[c])
-        {
-          const SampleType dGain = std::clamp(SampleType(0.5) * (targetGainReduction - this->mLastGainReductionDB[c]), dClose, SampleType(0.0));
-          this->mLastGainReductionDB[c] += dGain;
-          if (this->mLastGainReductionDB[c] < maxGainReduction)
-          {
-            this->mLastGainReductionDB[c] = maxGainReduction;
-          }
-          gating = true;
-        }
-        this->mGainReductionDB[c][s] = this->mLastGainReductionDB[c];
-      }
+      this->mTimeHeld[c] += constants.dt;
+      if (this->mTimeHeld[c] >= constants.maxHold)
+        this->mState[c] = dsp::noise_gate::Trigger<SampleType>::State::MOVING;
     }
+    else
+    {
+      this->mTimeHeld[c] = 0.0;
+    }
+    return 0.0;
   }
+  // Moving
+  const SampleType levelDB = _FastLevelToDB((float)this->mLevel[c]);
+  const SampleType targetGainReduction = this->_GetGainReduction(levelDB);
+  if (targetGainReduction > this->mLastGainReductionDB[c])
+  {
+    const SampleType dGain =
+      std::clamp(SampleType(0.5) * (targetGainReduction - this->mLastGainReductionDB[c]), SampleType(0.0), constants.dOpen);
+    // The gap to the target halves every sample, so it would eventually go
+    // denormal (which is very slow). Snap to the target once it's inaudible.
+    if (dGain < _GAIN_SNAP_DB)
+      this->mLastGainReductionDB[c] = targetGainReduction;
+    else
+      this->mLastGainReductionDB[c] += dGain;
+    if (this->mLastGainReductionDB[c] >= 0.0)
+    {
+      this->mLastGainReductionDB[c] = 0.0;
+      this->mState[c] = dsp::noise_gate::Trigger<SampleType>::State::HOLDING;
+      this->mTimeHeld[c] = 0.0;
+    }
 
-  // Share the results with gain objects that are listening to this trigger:
-  for (auto gain = this->mGainListeners.begin(); gain != this->mGainListeners.end(); ++gain)
-    (*gain)->SetGainReductionDB(this->mGainReductionDB);
+    if (levelDB > constants.threshold)
+      gating = false;
+  }
+  else if (targetGainReduction < this->mLastGainReductionDB[c])
+  {
+    const SampleType dGain =
+      std::clamp(SampleType(0.5) * (targetGainReduction - this->mLastGainReductionDB[c]), constants.dClose, SampleType(0.0));
+    if (dGain > -_GAIN_SNAP_DB)
+      this->mLastGainReductionDB[c] = targetGainReduction;
+    else
+      this->mLastGainReductionDB[c] += dGain;
+    if (this->mLastGainReductionDB[c] < constants.maxGainReduction)
+    {
+      this->mLastGainReductionDB[c] = constants.maxGainReduction;
+    }
+    gating = true;
+  }
+  return this->mLastGainReductionDB[c];
+}
+
+template <typename SampleType>
+SampleType** dsp::noise_gate::Trigger<SampleType>::Process(SampleType** inputs, const size_t numChannels, const size_t numFrames)
+{
+  this->_PrepareBuffers(numChannels, numFrames);
+  this->_ComputeGainReduction(inputs, numChannels, numFrames);
 
   // Copy input to output
   for (auto c = 0; c < numChannels; c++)
@@ -113,6 +178,30 @@ SampleType** dsp::noise_gate::Trigger<SampleType>::Process(SampleType** inputs,
   return this->_GetPointers();
 }
 
+template <typename SampleType>
+void dsp::noise_gate::Trigger<SampleType>::ProcessInPlace(SampleType** buffers, const size_t numChannels,
+                                                          const size_t numFrames)
+{
+  this->_PrepareState(numChannels, numFrames);
+  this->_ComputeGainReduction(buffers, numChannels, numFrames);
+}
+
+template <typename SampleType>
+void dsp::noise_gate::Trigger<SampleType>::_ComputeGainReduction(SampleType** inputs, const size_t numChannels,
+                                                                 const size_t numFrames)
+{
+  const Constants constants = this->_GetConstants();
+
+  // The main algorithm: compute the gain reduction
+  for (auto c = 0; c < numChannels; c++)
+    for (auto s = 0; s < numFrames; s++)
+      this->mGainReductionDB[c][s] = this->_Update(c, inputs[c][s], constants);
+
+  // Share the results with gain objects that are listening to this trigger:
+  for (auto gain = this->mGainListeners.begin(); gain != this->mGainListeners.end(); ++gain)
+    (*gain)->SetGainReductionDB(this->mGainReductionDB);
+}
+
 template <typename SampleType>
 bool dsp::noise_gate::Trigger<SampleType>::isGating()
 {
@@ -122,9 +211,15 @@ bool dsp::noise_gate::Trigger<SampleType>::isGating()
 template <typename SampleType>
 void dsp::noise_gate::Trigger<SampleType>::_PrepareBuffers(const size_t numChannels, const size_t numFrames)
 {
-  const size_t oldChannels = this->_GetNumChannels();
-  const size_t oldFrames = this->_GetNumFrames();
   this->DSP<SampleType>::_PrepareBuffers(numChannels, numFrames);
+  this->_PrepareState(numChannels, numFrames);
+}
+
+template <typename SampleType>
+void dsp::noise_gate::Trigger<SampleType>::_PrepareState(const size_t numChannels, const size_t numFrames)
+{
+  const size_t oldChannels = this->mLevel.size();
+  const size_t oldFrames = this->mGainReductionDB.size() > 0 ? this->mGainReductionDB[0].size() : 0;
 
   const bool updateChannels = numChannels != oldChannels;
   const bool updateFrames = updateChannels || numFrames != oldFrames;
@@ -163,24 +258,41 @@ SampleType** dsp::noise_gate::Gain<SampleType>::Process(SampleType** inputs, con
   // Assume that SetGainReductionDB() was just called to get data from a
   // trigger. Could use listeners...
   this->_PrepareBuffers(numChannels, numFrames);
+  this->_Apply(inputs, this->_GetPointers(), numChannels, numFrames);
+  return this->_GetPointers();
+}
+
+template <typename SampleType>
+void dsp::noise_gate::Gain<SampleType>::ProcessInPlace(SampleType** buffers, const size_t numChannels,
+                                                       const size_t numFrames)
+{
+  this->_Apply(buffers, buffers, numChannels, numFrames);
+}
 
-  if (this->mGainReductionDB.size() != numChannels)
+template <typename SampleType>
+void dsp::noise_gate::Gain<SampleType>::_Apply(SampleType** inputs, SampleType** outputs, const size_t numChannels,
+                                               const size_t numFrames)
+{
+  if (this->mGainReductionDB == nullptr)
+    throw std::runtime_error("Gain module hasn't been given a gain reduction to apply.");
+  const std::vector<std::vector<SampleType>>& gainReductionDB = *this->mGainReductionDB;
+  if (gainReductionDB.size() != numChannels)
   {
     std::stringstream ss;
-    ss << "Gain module expected to operate on " << this->mGainReductionDB.size() << "channels, but " << numChannels
+    ss << "Gain module expected to operate on " << gainReductionDB.size() << "channels, but " << numChannels
        << " were provided.";
     throw std::runtime_error(ss.str());
   }
-  if ((this->mGainReductionDB.size() == 0) && (numFrames > 0))
+  if ((gainReductionDB.size() == 0) && (numFrames > 0))
   {
     std::stringstream ss;
     ss << "No channels expected by gain module, yet " << numFrames << " were provided?";
     throw std::runtime_error(ss.str());
   }
-  else if (this->mGainReductionDB[0].size() != numFrames)
+  else if (gainReductionDB[0].size() != numFrames)
   {
     std::stringstream ss;
-    ss << "Gain module expected to operate on " << this->mGainReductionDB[0].size() << "frames, but " << numFrames
+    ss << "Gain module expected to operate on " << gainReductionDB[0].size() << "frames, but " << numFrames
        << " were provided.";
     throw std::runtime_error(ss.str());
   }
@@ -188,16 +300,53 @@ SampleType** dsp::noise_gate::Gain<SampleType>::Process(SampleType** inputs, con
   // Apply gain!
   for (auto c = 0; c < numChannels; c++)
     for (auto s = 0; s < numFrames; s++)
-      this->mOutputs[c][s] = _DBToLevel(this->mGainReductionDB[c][s]) * inputs[c][s];
+      outputs[c][s] = _FastDBToLevel((float)gainReductionDB[c][s]) * inputs[c][s];
+}
+
+// Gate========================================================================
 
+template <typename SampleType>
+SampleType** dsp::noise_gate::Gate<SampleType>::Process(SampleType** inputs, const size_t numChannels,
+                                                       const size_t numFrames)
+{
+  this->_PrepareBuffers(numChannels, numFrames);
+  this->_Process(inputs, this->_GetPointers(), numChannels, numFrames);
   return this->_GetPointers();
 }
 
+template <typename SampleType>
+void dsp::noise_gate::Gate<SampleType>::ProcessInPlace(SampleType** buffers, const size_t numChannels,
+                                                       const size_t numFrames)
+{
+  this->_PrepareState(numChannels, numFrames);
+  this->_Process(buffers, buffers, numChannels, numFrames);
+}
+
+template <typename SampleType>
+void dsp::noise_gate::Gate<SampleType>::_Process(SampleType** inputs, SampleType** outputs, const size_t numChannels,
+                                                 const size_t numFrames)
+{
+  const typename Trigger<SampleType>::Constants constants = this->_GetConstants();
+  for (auto c = 0; c < numChannels; c++)
+  {
+    const SampleType* input = inputs[c];
+    SampleType* output = outputs[c];
+    for (auto s = 0; s < numFrames; s++)
+    {
+      const SampleType gainReductionDB = this->_Update(c, input[s], constants);
+      // Fully open is common, and exact.
+      output[s] = gainReductionDB == 0.0 ? input[s] : _FastDBToLevel((float)gainReductionDB) * input[s];
+    }
+  }
+}
+
 template class dsp::noise_gate::Gain<double>;
 template class dsp::noise_gate::Trigger<double>;
 template class dsp::noise_gate::TriggerParams<double>;
+template class dsp::noise_gate::Gate<double>;
 
 
 template class dsp::noise_gate::Gain<float>;
 template class dsp::noise_gate::Trigger<float>;
-template class dsp::noise_gate::TriggerParams<float>;
\ No newline at end of file
+template class dsp::noise_gate::TriggerParams<float>;
+template class dsp::noise_gate::Gate<float>;
\ No newline at end of file
@@ -38,15 +38,27 @@ template <typename SampleType>
 class Gain : public DSP<SampleType>
 {
 public:
+  Gain()
+  : DSP<SampleType>()
+  , mGainReductionDB(nullptr){};
   SampleType** Process(SampleType** inputs, const size_t numChannels, const size_t numFrames) override;
+  void ProcessInPlace(SampleType** buffers, const size_t numChannels, const size_t numFrames) override;
 
-  void SetGainReductionDB(std::vector<std::vector<SampleType>>& gainReductionDB)
+  // Look at the provided gain reduction (doesn't copy it), so it needs to
+  // still be around when Process() is called. (A trigger's is.)
+  void SetGainReductionDB(const std::vector<std::vector<SampleType>>& gainReductionDB)
   {
-    this->mGainReductionDB = gainReductionDB;
+    this->mGainReductionDB = &gainReductionDB;
   }
+  // Not a temporary (e.g. a copy from Trigger::GetGainReductionDB()), which
+  // would be gone by then.
+  void SetGainReductionDB(std::vector<std::vector<SampleType>>&& gainReductionDB) = delete;
 
 private:
-  std::vector<std::vector<SampleType>> mGainReductionDB;
+  // inputs and outputs may be the same.
+  void _Apply(SampleType** inputs, SampleType** outputs, const size_t numChannels, const size_t numFrames);
+
+  const std::vector<std::vector<SampleType>>* mGainReductionDB;
 };
 
 // Part 1 of the noise gate: the trigger.
@@ -93,7 +105,11 @@ class Trigger : public DSP<SampleType>
 public:
   Trigger();
 
+  // Computes the gain reduction and shares it with the listeners. The audio
+  // passes through unchanged.
   SampleType** Process(SampleType** inputs, const size_t numChannels, const size_t numFrames) override;
+  // The audio passes through, so there's nothing to write.
+  void ProcessInPlace(SampleType** buffers, const size_t numChannels, const size_t numFrames) override;
   std::vector<std::vector<SampleType>> GetGainReduction() const { return this->mGainReductionDB; };
   void SetParams(const TriggerParams<SampleType>& params) { this->mParams = params; };
   void SetSampleRate(const SampleType sampleRate) { this->mSampleRate = sampleRate; }
@@ -108,13 +124,31 @@ public:
 
   bool isGating();
 
-private:
+protected:
   enum class State
   {
     MOVING = 0,
     HOLDING
   };
 
+  // Things that the per-sample update needs that only change with the params
+  struct Constants
+  {
+    SampleType alpha;
+    SampleType beta;
+    SampleType threshold;
+    // The threshold, as a power
+    SampleType thresholdPower;
+    SampleType dt;
+    SampleType maxHold;
+    SampleType maxGainReduction;
+    SampleType dOpen;
+    SampleType dClose;
+  };
+  Constants _GetConstants() const;
+  // Take in the next sample of a channel and return its gain reduction.
+  SampleType _Update(const size_t channel, const SampleType sample, const Constants& constants);
+
   bool gating {false};
 
   SampleType _GetGainReduction(const SampleType levelDB) const
@@ -125,6 +159,10 @@ private:
   }
   SampleType _GetMaxGainReduction() const { return this->_GetGainReduction(MINIMUM_LOUDNESS_DB); }
   virtual void _PrepareBuffers(const size_t numChannels, const size_t numFrames) override;
+  // Everything that _PrepareBuffers() does except for the outputs
+  void _PrepareState(const size_t numChannels, const size_t numFrames);
+  // Fill mGainReductionDB and share it with the listeners.
+  void _ComputeGainReduction(SampleType** inputs, const size_t numChannels, const size_t numFrames);
 
   TriggerParams<SampleType> mParams;
   std::vector<State> mState; // One per channel
@@ -142,5 +180,20 @@ private:
   std::unordered_set<Gain<SampleType>*> mGainListeners;
 };
 
+// A trigger and its gain fused into one pass: the gain reduction is applied as
+// it's computed, without going through a buffer.
+// The fast path for a gate that listens to its own input.
+template <typename SampleType>
+class Gate : public Trigger<SampleType>
+{
+public:
+  SampleType** Process(SampleType** inputs, const size_t numChannels, const size_t numFrames) override;
+  void ProcessInPlace(SampleType** buffers, const size_t numChannels, const size_t numFrames) override;
+
+private:
+  // inputs and outputs may be the same.
+  void _Process(SampleType** inputs, SampleType** outputs, const size_t numChannels, const size_t numFrames);
+};
+
 }; // namespace noise_gate
 }; // namespace dsp
\ No newline at end of file
@@ -0,0 +1,249 @@
+//
+//  Oversampler.cpp
+//
+//
+
+#include <algorithm> // std::fill
+#include <cmath> // sin, sqrt
+#include <cstring> // memmove
+#include <stdexcept>
+
+#include "Oversampler.h"
+
+// Number of distinct coefficients of the half-band filters for each stage
+constexpr int _STAGE_1_COEFFICIENTS = 8;
+constexpr int _STAGE_2_COEFFICIENTS = 4;
+// Kaiser window parameter for the half-band designs
+constexpr double _HALF_BAND_BETA = 6.0;
+
+double _HalfBandBesselI0(const double x)
+{
+  double sum = 1.0;
+  double term = 1.0;
+  const double halfX = 0.5 * x;
+  for (int k = 1; k < 50; k++)
+  {
+    term *= (halfX / k) * (halfX / k);
+    sum += term;
+    if (term < 1.0e-12 * sum)
+      break;
+  }
+  return sum;
+}
+
+std::vector<float> dsp::oversampling::GetHalfBandCoefficients(const int numCoefficients)
+{
+  if (numCoefficients < 1)
+    throw std::runtime_error("Half-band filter needs at least one coefficient");
+  const double pi = 3.14159265358979323846;
+  const double halfLength = 2.0 * numCoefficients;
+  const double i0Beta = _HalfBandBesselI0(_HALF_BAND_BETA);
+  std::vector<double> h(numCoefficients);
+  double sum = 0.0;
+  for (int i = 0; i < numCoefficients; i++)
+  {
+    // Offset from the center tap (odd, negative)
+    const double k = 2 * i - 2 * numCoefficients + 1;
+    const double u = k / halfLength;
+    const double window = _HalfBandBesselI0(_HALF_BAND_BETA * std::sqrt(1.0 - u * u)) / i0Beta;
+    h[i] = std::sin(0.5 * pi * k) / (pi * k) * window;
+    sum += 2.0 * h[i];
+  }
+  // Unity gain at DC: the center tap is 1/2, so the rest should sum to 1/2.
+  std::vector<float> coefficients(numCoefficients);
+  for (int i = 0; i < numCoefficients; i++)
+    coefficients[i] = (float)(0.5 * h[i] / sum);
+  return coefficients;
+}
+
+// Upsampler ==================================================================
+
+template <typename SampleType>
+dsp::oversampling::HalfBandUpsampler<SampleType>::HalfBandUpsampler()
+: mMaxInputFrames(0)
+{
+}
+
+template <typename SampleType>
+void dsp::oversampling::HalfBandUpsampler<SampleType>::Reset(const int numCoefficients, const size_t maxInputFrames)
+{
+  this->mCoefficients = GetHalfBandCoefficients(numCoefficients);
+  // Zero-stuffing halves the level, so make it up here.
+  for (auto& c : this->mCoefficients)
+    c *= 2.0f;
+  this->mMaxInputFrames = maxInputFrames;
+  this->mHistory.resize(this->_GetHistoryLength() + maxInputFrames);
+  std::fill(this->mHistory.begin(), this->mHistory.end(), 0.0f);
+  this->mScratch.resize(maxInputFrames);
+}
+
+template <typename SampleType>
+void dsp::oversampling::HalfBandUpsampler<SampleType>::Process(const SampleType* input, const size_t numInputFrames,
+                                                               SampleType* output)
+{
+  if (numInputFrames > this->mMaxInputFrames)
+    throw std::runtime_error("Half-band upsampler given a block longer than it was reset for");
+  const int numCoefficients = this->_GetNumCoefficients();
+  const size_t historyLength = this->_GetHistoryLength();
+  float* x = this->mHistory.data();
+  float* y = this->mScratch.data();
+  for (size_t t = 0; t < numInputFrames; t++)
+    x[historyLength + t] = (float)input[t];
+
+  // Filtered branch. Input t - i pairs with input t - (2N - 1 - i).
+  for (size_t t = 0; t < numInputFrames; t++)
+    y[t] = 0.0f;
+  for (int i = 0; i < numCoefficients; i++)
+  {
+    const float c = this->mCoefficients[i];
+    const float* a = x + historyLength - i;
+    const float* b = x + i;
+    for (size_t t = 0; t < numInputFrames; t++)
+      y[t] += c * (a[t] + b[t]);
+  }
+  // Delay branch: the center tap
+  const float* delayed = x + numCoefficients;
+  for (size_t t = 0; t < numInputFrames; t++)
+  {
+    output[2 * t] = (SampleType)y[t];
+    output[2 * t + 1] = (SampleType)delayed[t];
+  }
+
+  std::memmove(x, x + numInputFrames, historyLength * sizeof(float));
+}
+
+// Downsampler ================================================================
+
+template <typename SampleType>
+dsp::oversampling::HalfBandDownsampler<SampleType>::HalfBandDownsampler()
+: mMaxOutputFrames(0)
+{
+}
+
+template <typename SampleType>
+void dsp::oversampling::HalfBandDownsampler<SampleType>::Reset(const int numCoefficients,
+                                                               const size_t maxOutputFrames)
+{
+  this->mCoefficients = GetHalfBandCoefficients(numCoefficients);
+  this->mMaxOutputFrames = maxOutputFrames;
+  this->mEven.resize(this->_GetEvenHistoryLength() + maxOutputFrames);
+  this->mOdd.resize(this->_GetOddHistoryLength() + maxOutputFrames);
+  std::fill(this->mEven.begin(), this->mEven.end(), 0.0f);
+  std::fill(this->mOdd.begin(), this->mOdd.end(), 0.0f);
+  this->mScratch.resize(maxOutputFrames);
+}
+
+template <typename SampleType>
+void dsp::oversampling::HalfBandDownsampler<SampleType>::Process(const SampleType* input, const size_t numOutputFrames,
+                                                                 SampleType* output)
+{
+  if (numOutputFrames > this->mMaxOutputFrames)
+    throw std::runtime_error("Half-band downsampler given a block longer than it was reset for");
+  const int numCoefficients = this->_GetNumCoefficients();
+  const size_t evenHistoryLength = this->_GetEvenHistoryLength();
+  const size_t oddHistoryLength = this->_GetOddHistoryLength();
+  float* even = this->mEven.data();
+  float* odd = this->mOdd.data();
+  float* y = this->mScratch.data();
+  for (size_t t = 0; t < numOutputFrames; t++)
+  {
+    even[evenHistoryLength + t] = (float)input[2 * t];
+    odd[oddHistoryLength + t] = (float)input[2 * t + 1];
+  }
+
+  // Center tap (odd samples) ...
+  for (size_t t = 0; t < numOutputFrames; t++)
+    y[t] = 0.5f * odd[t];
+  // ...plus the filtered branch (even samples)
+  for (int i = 0; i < numCoefficients; i++)
+  {
+    const float c = this->mCoefficients[i];
+    const float* a = even + evenHistoryLength - i;
+    const float* b = even + i;
+    for (size_t t = 0; t < numOutputFrames; t++)
+      y[t] += c * (a[t] + b[t]);
+  }
+  for (size_t t = 0; t < numOutputFrames; t++)
+    output[t] = (SampleType)y[t];
+
+  std::memmove(even, even + numOutputFrames, evenHistoryLength * sizeof(float));
+  std::memmove(odd, odd + numOutputFrames, oddHistoryLength * sizeof(float));
+}
+
+// Oversampler ================================================================
+
+template <typename SampleType>
+dsp::oversampling::Oversampler<SampleType>::Oversampler()
+: mFactor(1)
+{
+}
+
+template <typename SampleType>
+void dsp::oversampling::Oversampler<SampleType>::Reset(const int factor, const size_t maxFrames)
+{
+  if (factor != 1 && factor != 2 && factor != 4)
+    throw std::runtime_error("Oversampling factor must be 1, 2, or 4");
+  this->mFactor = factor;
+  this->mStage1.resize(factor >= 2 ? 2 * maxFrames : 0);
+  this->mStage2.resize(factor >= 4 ? 4 * maxFrames : 0);
+  if (factor >= 2)
+  {
+    this->mUp1.Reset(_STAGE_1_COEFFICIENTS, maxFrames);
+    this->mDown1.Reset(_STAGE_1_COEFFICIENTS, maxFrames);
+  }
+  if (factor >= 4)
+  {
+    this->mUp2.Reset(_STAGE_2_COEFFICIENTS, 2 * maxFrames);
+    this->mDown2.Reset(_STAGE_2_COEFFICIENTS, 2 * maxFrames);
+  }
+}
+
+template <typename SampleType>
+SampleType* dsp::oversampling::Oversampler<SampleType>::Upsample(const SampleType* input, const size_t numFrames)
+{
+  if (this->mFactor == 1)
+    return const_cast<SampleType*>(input);
+  this->mUp1.Process(input, numFrames, this->mStage1.data());
+  if (this->mFactor == 2)
+    return this->mStage1.data();
+  this->mUp2.Process(this->mStage1.data(), 2 * numFrames, this->mStage2.data());
+  return this->mStage2.data();
+}
+
+template <typename SampleType>
+void dsp::oversampling::Oversampler<SampleType>::Downsample(const SampleType* input, const size_t numFrames,
+                                                            SampleType* output)
+{
+  if (this->mFactor == 1)
+  {
+    if (output != input)
+      std::memmove(output, input, numFrames * sizeof(SampleType));
+    return;
+  }
+  if (this->mFactor == 4)
+  {
+    this->mDown2.Process(input, 2 * numFrames, this->mStage1.data());
+    input = this->mStage1.data();
+  }
+  this->mDown1.Process(input, numFrames, output);
+}
+
+template <typename SampleType>
+double dsp::oversampling::Oversampler<SampleType>::GetLatency() const
+{
+  double latency = 0.0;
+  if (this->mFactor >= 2)
+    latency += this->mUp1.GetLatency() + this->mDown1.GetLatency();
+  if (this->mFactor >= 4)
+    // At twice the base rate
+    latency += 0.5 * (this->mUp2.GetLatency() + this->mDown2.GetLatency());
+  return latency;
+}
+
+template class dsp::oversampling::HalfBandUpsampler<double>;
+template class dsp::oversampling::HalfBandDownsampler<double>;
+template class dsp::oversampling::Oversampler<double>;
+
+template class dsp::oversampling::HalfBandUpsampler<float>;
+template class dsp::oversampling::HalfBandDownsampler<float>;
+template class dsp::oversampling::Oversampler<float>;
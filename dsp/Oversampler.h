@@ -0,0 +1,116 @@
+//
+//  Oversampler.h
+//
+//
+// Polyphase half-band oversampling (2x and 4x)
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace dsp
+{
+namespace oversampling
+{
+// A half-band lowpass has every other coefficient equal to zero, except the
+// center one which is 1/2, and it's symmetric. So, split into its two
+// polyphase branches, one branch is a pure delay and the other has
+// numCoefficients distinct values, each used twice.
+// The filters below only ever compute the non-trivial branch, folding the
+// symmetric pairs together before multiplying.
+//
+// The loops run over the samples in the block for each coefficient (rather
+// than the other way around) so that they vectorize.
+
+// Design the non-trivial branch of a half-band filter of length
+// 4 * numCoefficients - 1.
+// Returns the numCoefficients distinct taps, outermost first.
+std::vector<float> GetHalfBandCoefficients(const int numCoefficients);
+
+// Doubles the sample rate.
+template <typename SampleType>
+class HalfBandUpsampler
+{
+public:
+  HalfBandUpsampler();
+  // Allocate for blocks of up to maxInputFrames and clear the history.
+  void Reset(const int numCoefficients, const size_t maxInputFrames);
+  // Output must have room for 2 * numInputFrames samples.
+  void Process(const SampleType* input, const size_t numInputFrames, SampleType* output);
+  // Group delay, in input samples
+  double GetLatency() const { return 0.5 * (2 * this->_GetNumCoefficients() - 1); };
+
+private:
+  int _GetNumCoefficients() const { return (int)this->mCoefficients.size(); };
+  size_t _GetHistoryLength() const { return 2 * this->mCoefficients.size() - 1; };
+
+  std::vector<float> mCoefficients;
+  // The previous input samples, followed by the current block
+  std::vector<float> mHistory;
+  // Output of the filtered branch, before it's interleaved
+  std::vector<float> mScratch;
+  size_t mMaxInputFrames;
+};
+
+// Halves the sample rate.
+template <typename SampleType>
+class HalfBandDownsampler
+{
+public:
+  HalfBandDownsampler();
+  // Allocate for blocks of up to maxOutputFrames and clear the history.
+  void Reset(const int numCoefficients, const size_t maxOutputFrames);
+  // Input has 2 * numOutputFrames samples.
+  void Process(const SampleType* input, const size_t numOutputFrames, SampleType* output);
+  // Group delay, in output samples
+  double GetLatency() const { return 0.5 * (2 * this->_GetNumCoefficients() - 1); };
+
+private:
+  int _GetNumCoefficients() const { return (int)this->mCoefficients.size(); };
+  size_t _GetEvenHistoryLength() const { return 2 * this->mCoefficients.size() - 1; };
+  size_t _GetOddHistoryLength() const { return this->mCoefficients.size(); };
+
+  std::vector<float> mCoefficients;
+  // The input, split into its even- and odd-indexed samples, each preceded by
+  // the history that the filter needs.
+  std::vector<float> mEven;
+  std::vector<float> mOdd;
+  std::vector<float> mScratch;
+  size_t mMaxOutputFrames;
+};
+
+// A cascade of 1 or 2 half-band stages for 2x or 4x oversampling.
+// The second stage runs at twice the rate of the first, where the transition
+// band is relatively wider, so it gets a shorter filter.
+template <typename SampleType>
+class Oversampler
+{
+public:
+  Oversampler();
+  // factor: 1 (passthrough), 2, or 4
+  void Reset(const int factor, const size_t maxFrames);
+  // Upsample numFrames samples.
+  // Returns a pointer to factor * numFrames samples, owned by this object and
+  // valid until the next call.
+  SampleType* Upsample(const SampleType* input, const size_t numFrames);
+  // Downsample factor * numFrames samples to numFrames samples.
+  void Downsample(const SampleType* input, const size_t numFrames, SampleType* output);
+  int GetFactor() const { return this->mFactor; };
+  // Latency of an upsample-downsample round trip, in samples at the base
+  // rate.
+  double GetLatency() const;
+
+private:
+  int mFactor;
+  HalfBandUpsampler<SampleType> mUp1;
+  HalfBandUpsampler<SampleType> mUp2;
+  HalfBandDownsampler<SampleType> mDown1;
+  HalfBandDownsampler<SampleType> mDown2;
+  // Output of the 2x stage, and (for 4x) its input on the way down.
+  std::vector<SampleType> mStage1;
+  // Output of the 4x stage
+  std::vector<SampleType> mStage2;
+};
+}; // namespace oversampling
+}; // namespace dsp
@@ -6,10 +6,13 @@
 //
 // See: https://webaudio.github.io/Audio-EQ-Cookbook/audio-eq-cookbook.html
 
-#include <algorithm> // std::fill
-#include <cmath> // isnan
+#include <algorithm> // std::fill, std::min
+#include <cmath> // isnan, isfinite, exp
+#include <sstream>
 #include <stdexcept>
 
+#include <Eigen/Dense>
+
 #include "RecursiveLinearFilter.h"
 
 template <typename SampleType>
@@ -94,21 +97,445 @@ void recursive_linear_filter::Base<SampleType>::_PrepareBuffers(const size_t num
   }
 }
 
+// Most lanes that a cascade will use. Beyond this, channels are processed in
+// groups.
+constexpr size_t _MAX_LANES = 16;
+// The pipeline between sections advances this many samples at a time.
+constexpr size_t _SUB_BLOCK = 8;
+
 template <typename SampleType>
-void recursive_linear_filter::Biquad<SampleType>::_AssignCoefficients(const SampleType a0, const SampleType a1, const SampleType a2,
-                                                          const SampleType b0, const SampleType b1, const SampleType b2)
+recursive_linear_filter::BiquadCascade<SampleType>::BiquadCascade(const size_t numSections)
+: dsp::DSP<SampleType>()
+, mRamping(false)
 {
-  this->mInputCoefficients[0] = b0 / a0;
-  this->mInputCoefficients[1] = b1 / a0;
-  this->mInputCoefficients[2] = b2 / a0;
-  // this->mOutputCoefficients[0] = 0.0;  // Always
-  // Sign flip due so we add during main loop (cf Eq. (4))
-  this->mOutputCoefficients[1] = -a1 / a0;
-  this->mOutputCoefficients[2] = -a2 / a0;
+  if (numSections < 1 || numSections > _MAX_LANES)
+  {
+    std::stringstream ss;
+    ss << "Biquad cascade must have between 1 and " << _MAX_LANES << " sections (got " << numSections << ")";
+    throw std::runtime_error(ss.str());
+  }
+  this->mB0.resize(numSections);
+  this->mB1.resize(numSections);
+  this->mB2.resize(numSections);
+  this->mA1.resize(numSections);
+  this->mA2.resize(numSections);
+  this->mRampB0.resize(numSections);
+  this->mRampB1.resize(numSections);
+  this->mRampB2.resize(numSections);
+  this->mRampA1.resize(numSections);
+  this->mRampA2.resize(numSections);
+  this->mRampTargets.resize(numSections);
+  this->mFeed.resize(_SUB_BLOCK * _MAX_LANES);
+  this->mPipeA.resize(_SUB_BLOCK * _MAX_LANES + 1);
+  this->mPipeB.resize(_SUB_BLOCK * _MAX_LANES + 1);
+  this->mMask.resize(_SUB_BLOCK * _MAX_LANES);
+  for (size_t s = 0; s < numSections; s++)
+    this->SetCoefficients(s, {(SampleType)1.0, (SampleType)0.0, (SampleType)0.0, (SampleType)0.0, (SampleType)0.0});
 }
 
 template <typename SampleType>
-void recursive_linear_filter::LowShelf<SampleType>::SetParams(const recursive_linear_filter::BiquadParams<SampleType>& params)
+void recursive_linear_filter::BiquadCascade<SampleType>::SetCoefficients(
+  const size_t section, const recursive_linear_filter::BiquadCoefficients<SampleType>& coefficients)
+{
+  this->mB0[section] = coefficients.b0;
+  this->mB1[section] = coefficients.b1;
+  this->mB2[section] = coefficients.b2;
+  this->mA1[section] = coefficients.a1;
+  this->mA2[section] = coefficients.a2;
+}
+
+template <typename SampleType>
+void recursive_linear_filter::BiquadCascade<SampleType>::Reset()
+{
+  std::fill(this->mZ1.begin(), this->mZ1.end(), (SampleType)0.0);
+  std::fill(this->mZ2.begin(), this->mZ2.end(), (SampleType)0.0);
+}
+
+template <typename SampleType>
+SampleType** recursive_linear_filter::BiquadCascade<SampleType>::Process(SampleType** inputs, const size_t numChannels,
+                                                                        const size_t numFrames)
+{
+  this->_PrepareBuffers(numChannels, numFrames);
+  SampleType** outputs = this->_GetPointers();
+  this->_Process(inputs, outputs, numChannels, numFrames);
+  return outputs;
+}
+
+template <typename SampleType>
+void recursive_linear_filter::BiquadCascade<SampleType>::ProcessInPlace(SampleType** buffers,
+                                                                       const size_t numChannels,
+                                                                       const size_t numFrames)
+{
+  this->_PrepareState(numChannels);
+  this->_Process(buffers, buffers, numChannels, numFrames);
+}
+
+template <typename SampleType>
+void recursive_linear_filter::BiquadCascade<SampleType>::_Process(SampleType** inputs, SampleType** outputs,
+                                                                 const size_t numChannels, const size_t numFrames)
+{
+  this->_ProcessFrames(inputs, outputs, numChannels, 0, numFrames);
+}
+
+template <typename SampleType>
+void recursive_linear_filter::BiquadCascade<SampleType>::_ProcessFrames(SampleType** inputs, SampleType** outputs,
+                                                                       const size_t numChannels,
+                                                                       const size_t startFrame,
+                                                                       const size_t numFrames)
+{
+  const size_t numSections = this->GetNumSections();
+  const size_t channelsPerGroup = _MAX_LANES / numSections;
+  for (size_t firstChannel = 0; firstChannel < numChannels; firstChannel += channelsPerGroup)
+  {
+    const size_t groupChannels = std::min(channelsPerGroup, numChannels - firstChannel);
+    const size_t numLanes = groupChannels * numSections;
+    if (this->mRamping)
+    {
+      if (numLanes <= 4)
+        this->_ProcessChannels<4, true>(inputs, outputs, firstChannel, groupChannels, startFrame, numFrames);
+      else if (numLanes <= 8)
+        this->_ProcessChannels<8, true>(inputs, outputs, firstChannel, groupChannels, startFrame, numFrames);
+      else
+        this->_ProcessChannels<16, true>(inputs, outputs, firstChannel, groupChannels, startFrame, numFrames);
+    }
+    else
+    {
+      if (numLanes <= 4)
+        this->_ProcessChannels<4, false>(inputs, outputs, firstChannel, groupChannels, startFrame, numFrames);
+      else if (numLanes <= 8)
+        this->_ProcessChannels<8, false>(inputs, outputs, firstChannel, groupChannels, startFrame, numFrames);
+      else
+        this->_ProcessChannels<16, false>(inputs, outputs, firstChannel, groupChannels, startFrame, numFrames);
+    }
+  }
+  if (this->mRamping)
+  {
+    // Land exactly on the targets.
+    for (size_t s = 0; s < numSections; s++)
+    {
+      this->SetCoefficients(s, this->mRampTargets[s]);
+      this->mRampB0[s] = this->mRampB1[s] = this->mRampB2[s] = this->mRampA1[s] = this->mRampA2[s] = 0.0;
+    }
+    this->mRamping = false;
+  }
+}
+
+template <typename SampleType>
+void recursive_linear_filter::BiquadCascade<SampleType>::_RampCoefficients(
+  const size_t section, const recursive_linear_filter::BiquadCoefficients<SampleType>& target, const size_t numFrames)
+{
+  if (!this->mRamping)
+  {
+    // Sections that aren't given a ramp stay where they are.
+    for (size_t s = 0; s < this->GetNumSections(); s++)
+      this->mRampTargets[s] = {this->mB0[s], this->mB1[s], this->mB2[s], this->mA1[s], this->mA2[s]};
+    this->mRamping = true;
+  }
+  const SampleType scale = (SampleType)1.0 / (SampleType)std::max(numFrames, (size_t)1);
+  this->mRampB0[section] = (target.b0 - this->mB0[section]) * scale;
+  this->mRampB1[section] = (target.b1 - this->mB1[section]) * scale;
+  this->mRampB2[section] = (target.b2 - this->mB2[section]) * scale;
+  this->mRampA1[section] = (target.a1 - this->mA1[section]) * scale;
+  this->mRampA2[section] = (target.a2 - this->mA2[section]) * scale;
+  this->mRampTargets[section] = target;
+}
+
+template <typename SampleType>
+template <int NumLanes, bool Ramping>
+void recursive_linear_filter::BiquadCascade<SampleType>::_ProcessChannels(SampleType** inputs,
+                                                                          SampleType** outputs,
+                                                                          const size_t firstChannel,
+                                                                          const size_t numChannels,
+                                                                          const size_t startFrame,
+                                                                          const size_t numFrames)
+{
+  typedef Eigen::Array<SampleType, NumLanes, 1> Lanes;
+  const long numSections = (long)this->GetNumSections();
+  const long C = (long)numChannels;
+  const long activeLanes = numSections * C;
+  const long M = (long)_SUB_BLOCK;
+
+  // Lane l is section l % numSections of channel firstChannel + l / numSections,
+  // so each lane's input is the previous step's output from the lane below it,
+  // except for the first section of each channel, which takes new input.
+  // Unused lanes have zero coefficients and no input, so they stay silent.
+  Lanes b0 = Lanes::Zero(), b1 = Lanes::Zero(), b2 = Lanes::Zero(), a1 = Lanes::Zero(), a2 = Lanes::Zero();
+  Lanes z1 = Lanes::Zero(), z2 = Lanes::Zero();
+  // False for the first section of each channel, true for the rest. Selected
+  // rather than multiplied by, so that a NaN or Inf in one channel's last
+  // section doesn't reach the next channel (0 * Inf is NaN).
+  Eigen::Array<bool, NumLanes, 1> chained = Eigen::Array<bool, NumLanes, 1>::Constant(false);
+  for (long l = 0; l < activeLanes; l++)
+  {
+    const long s = l % numSections;
+    b0(l) = this->mB0[s];
+    b1(l) = this->mB1[s];
+    b2(l) = this->mB2[s];
+    a1(l) = this->mA1[s];
+    a2(l) = this->mA2[s];
+    z1(l) = this->mZ1[firstChannel * numSections + l];
+    z2(l) = this->mZ2[firstChannel * numSections + l];
+    chained(l) = s != 0;
+  }
+  // While ramping, each lane's coefficients move on by one step per sample.
+  // Sample i (counting from 0) gets the coefficients after i + 1 steps so that
+  // the last one lands on the target. Section s starts s sub-blocks late.
+  Lanes db0 = Lanes::Zero(), db1 = Lanes::Zero(), db2 = Lanes::Zero(), da1 = Lanes::Zero(), da2 = Lanes::Zero();
+  if (Ramping)
+  {
+    for (long l = 0; l < activeLanes; l++)
+    {
+      const long s = l % numSections;
+      db0(l) = this->mRampB0[s];
+      db1(l) = this->mRampB1[s];
+      db2(l) = this->mRampB2[s];
+      da1(l) = this->mRampA1[s];
+      da2(l) = this->mRampA2[s];
+      const SampleType lead = (SampleType)(1 - s * M);
+      b0(l) += lead * db0(l);
+      b1(l) += lead * db1(l);
+      b2(l) += lead * db2(l);
+      a1(l) += lead * da1(l);
+      a2(l) += lead * da2(l);
+    }
+  }
+
+  // Buffers are [sample][lane]. The outputs are offset by one so that reading
+  // them shifted by a lane stays in bounds.
+  SampleType* feed = this->mFeed.data();
+  SampleType* previous = this->mPipeA.data() + 1;
+  SampleType* current = this->mPipeB.data() + 1;
+  SampleType* mask = this->mMask.data();
+  // The other lanes of the feed need to be zero (the layout depends on
+  // NumLanes and the number of channels, so it's cleared each time).
+  std::fill(this->mFeed.begin(), this->mFeed.end(), (SampleType)0.0);
+
+  const long numSubBlocks = ((long)numFrames + M - 1) / M;
+  const long numSteps = numSubBlocks + numSections - 1;
+  for (long j = 0; j < numSteps; j++)
+  {
+    if (j < numSubBlocks)
+    {
+      const long n = std::min(M, (long)numFrames - j * M);
+      for (long c = 0; c < C; c++)
+        for (long t = 0; t < n; t++)
+          feed[t * NumLanes + c * numSections] = inputs[firstChannel + c][startFrame + j * M + t];
+    }
+    // Section s works on sub-block j - s (if it's in this block). Only the last
+    // sub-block can be short.
+    const bool full = j >= numSections - 1 && (j + 1) * M <= (long)numFrames;
+    if (full && !Ramping)
+    {
+      for (long t = 0; t < M; t++)
+      {
+        const Lanes x = Eigen::Map<const Lanes>(feed + t * NumLanes)
+                        + chained.select(Eigen::Map<const Lanes>(previous + t * NumLanes - 1), (SampleType)0.0);
+        const Lanes y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        Eigen::Map<Lanes>(current + t * NumLanes) = y;
+      }
+    }
+    else
+    {
+      // Filling or draining the pipeline, the short sub-block, or ramping:
+      // hold the state of the lanes that have run out of samples.
+      for (long l = 0; l < NumLanes; l++)
+      {
+        const long subBlock = j - l % numSections;
+        const long n = l >= activeLanes ? M
+                       : (subBlock >= 0 && subBlock < numSubBlocks) ? std::min(M, (long)numFrames - subBlock * M)
+                                                                  : 0;
+        for (long t = 0; t < M; t++)
+          mask[t * NumLanes + l] = t < n ? (SampleType)1.0 : (SampleType)0.0;
+      }
+      for (long t = 0; t < M; t++)
+      {
+        const Lanes x = Eigen::Map<const Lanes>(feed + t * NumLanes)
+                        + chained.select(Eigen::Map<const Lanes>(previous + t * NumLanes - 1), (SampleType)0.0);
+        const Lanes m = Eigen::Map<const Lanes>(mask + t * NumLanes);
+        const Lanes y = b0 * x + z1;
+        const Lanes newZ1 = b1 * x - a1 * y + z2;
+        const Lanes newZ2 = b2 * x - a2 * y;
+        // (Selected, for the same reason as chained)
+        z1 = (m != (SampleType)0.0).select(newZ1, z1);
+        z2 = (m != (SampleType)0.0).select(newZ2, z2);
+        Eigen::Map<Lanes>(current + t * NumLanes) = y;
+        if (Ramping)
+        {
+          b0 += db0;
+          b1 += db1;
+          b2 += db2;
+          a1 += da1;
+          a2 += da2;
+        }
+      }
+    }
+    // The last section finished sub-block j - numSections + 1.
+    const long o = j - numSections + 1;
+    if (o >= 0)
+    {
+      const long n = std::min(M, (long)numFrames - o * M);
+      for (long c = 0; c < C; c++)
+        for (long t = 0; t < n; t++)
+          outputs[firstChannel + c][startFrame + o * M + t] = current[t * NumLanes + (c + 1) * numSections - 1];
+    }
+    std::swap(previous, current);
+  }
+
+  for (long l = 0; l < activeLanes; l++)
+  {
+    this->mZ1[firstChannel * numSections + l] = z1(l);
+    this->mZ2[firstChannel * numSections + l] = z2(l);
+  }
+  // Prevent a NaN from jamming the filter!
+  for (long c = 0; c < C; c++)
+  {
+    const size_t channel = firstChannel + c;
+    bool finite = true;
+    for (long s = 0; s < numSections; s++)
+      finite = finite && std::isfinite(this->mZ1[channel * numSections + s])
+               && std::isfinite(this->mZ2[channel * numSections + s]);
+    if (!finite)
+    {
+      for (long s = 0; s < numSections; s++)
+      {
+        this->mZ1[channel * numSections + s] = 0.0;
+        this->mZ2[channel * numSections + s] = 0.0;
+      }
+      std::fill(outputs[channel] + startFrame, outputs[channel] + startFrame + numFrames, (SampleType)0.0);
+      // Nothing in the pipeline outlives the block; clear it anyway so that
+      // it never holds a NaN.
+      std::fill(this->mPipeA.begin(), this->mPipeA.end(), (SampleType)0.0);
+      std::fill(this->mPipeB.begin(), this->mPipeB.end(), (SampleType)0.0);
+    }
+  }
+}
+
+template <typename SampleType>
+void recursive_linear_filter::BiquadCascade<SampleType>::_PrepareBuffers(const size_t numChannels,
+                                                                        const size_t numFrames)
+{
+  this->dsp::DSP<SampleType>::_PrepareBuffers(numChannels, numFrames);
+  this->_PrepareState(numChannels);
+}
+
+template <typename SampleType>
+void recursive_linear_filter::BiquadCascade<SampleType>::_PrepareState(const size_t numChannels)
+{
+  if (this->mZ1.size() != numChannels * this->GetNumSections())
+  {
+    this->mZ1.resize(numChannels * this->GetNumSections());
+    this->mZ2.resize(numChannels * this->GetNumSections());
+    this->Reset();
+  }
+}
+
+// Move current toward target by the fraction alpha, or all the way if it's
+// within tolerance.
+double _Glide(const double current, const double target, const double alpha, const double tolerance)
+{
+  if (std::abs(target - current) <= tolerance)
+    return target;
+  return current + alpha * (target - current);
+}
+
+template <typename SampleType>
+recursive_linear_filter::SmoothedBiquadCascade<SampleType>::SmoothedBiquadCascade(
+  const std::vector<typename recursive_linear_filter::SmoothedBiquadCascade<SampleType>::Design>& designs,
+  const size_t controlInterval, const double smoothingTime)
+: BiquadCascade<SampleType>(designs.size())
+, mDesigns(designs)
+, mControlInterval(controlInterval)
+, mSmoothingTime(smoothingTime)
+{
+  if (controlInterval < 1)
+    throw std::runtime_error("Control interval must be at least one sample");
+  // Placeholders until SetParams() is called.
+  const BiquadParams<SampleType> placeholder(48000.0, 1000.0, 0.707, 0.0);
+  this->mTargetParams.assign(designs.size(), placeholder);
+  this->mParams.assign(designs.size(), placeholder);
+  this->mDesignedParams.assign(designs.size(), placeholder);
+  this->mHaveParams.assign(designs.size(), false);
+}
+
+template <typename SampleType>
+void recursive_linear_filter::SmoothedBiquadCascade<SampleType>::SetParams(
+  const size_t section, const recursive_linear_filter::BiquadParams<SampleType>& params)
+{
+  this->mTargetParams[section] = params;
+  // Nothing to glide from (or across a sample rate change), so jump.
+  if (!this->mHaveParams[section] || params.GetSampleRate() != this->mParams[section].GetSampleRate())
+  {
+    this->mParams[section] = params;
+    this->mDesignedParams[section] = params;
+    this->SetCoefficients(section, this->mDesigns[section](params));
+    this->mHaveParams[section] = true;
+  }
+}
+
+template <typename SampleType>
+void recursive_linear_filter::SmoothedBiquadCascade<SampleType>::_Process(SampleType** inputs, SampleType** outputs,
+                                                                         const size_t numChannels,
+                                                                         const size_t numFrames)
+{
+  size_t start = 0;
+  while (start < numFrames)
+  {
+    const size_t n = std::min(this->mControlInterval, numFrames - start);
+    if (!this->_UpdateCoefficients(n))
+    {
+      // Everything has settled; do the rest in one go.
+      this->_ProcessFrames(inputs, outputs, numChannels, start, numFrames - start);
+      break;
+    }
+    this->_ProcessFrames(inputs, outputs, numChannels, start, n);
+    start += n;
+  }
+}
+
+template <typename SampleType>
+bool recursive_linear_filter::SmoothedBiquadCascade<SampleType>::_UpdateCoefficients(const size_t numFrames)
+{
+  bool ramping = false;
+  for (size_t s = 0; s < this->GetNumSections(); s++)
+  {
+    if (!this->mHaveParams[s])
+      continue;
+    const BiquadParams<SampleType>& target = this->mTargetParams[s];
+    if (this->mParams[s] != target)
+    {
+      const double sampleRate = target.GetSampleRate();
+      const double alpha = 1.0 - std::exp(-(double)this->mControlInterval / (this->mSmoothingTime * sampleRate));
+      const BiquadParams<SampleType>& current = this->mParams[s];
+      this->mParams[s] = BiquadParams<SampleType>(
+        (SampleType)sampleRate,
+        (SampleType)_Glide(current.GetFrequency(), target.GetFrequency(), alpha, 1.0e-4 * target.GetFrequency()),
+        (SampleType)_Glide(current.GetQuality(), target.GetQuality(), alpha, 1.0e-4 * target.GetQuality()),
+        (SampleType)_Glide(current.GetGainDB(), target.GetGainDB(), alpha, 1.0e-3));
+    }
+    // Only redesign when the parameters moved.
+    if (this->mParams[s] != this->mDesignedParams[s])
+    {
+      this->_RampCoefficients(s, this->mDesigns[s](this->mParams[s]), numFrames);
+      this->mDesignedParams[s] = this->mParams[s];
+      ramping = true;
+    }
+  }
+  return ramping;
+}
+
+template <typename SampleType>
+recursive_linear_filter::BiquadCoefficients<SampleType> recursive_linear_filter::Biquad<
+  SampleType>::_NormalizeCoefficients(const SampleType a0, const SampleType a1, const SampleType a2,
+                                      const SampleType b0, const SampleType b1, const SampleType b2)
+{
+  return {b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+}
+
+template <typename SampleType>
+recursive_linear_filter::BiquadCoefficients<SampleType> recursive_linear_filter::LowShelf<SampleType>::GetCoefficients(
+  const recursive_linear_filter::BiquadParams<SampleType>& params)
 {
   const SampleType a = params.GetA();
   const SampleType omega_0 = params.GetOmega0();
@@ -126,11 +553,18 @@ void recursive_linear_filter::LowShelf<SampleType>::SetParams(const recursive_li
   const SampleType a1 = -2.0 * (am + ap * cosw);
   const SampleType a2 = ap + am * cosw - roota2alpha;
 
-  this->_AssignCoefficients(a0, a1, a2, b0, b1, b2);
+  return Biquad<SampleType>::_NormalizeCoefficients(a0, a1, a2, b0, b1, b2);
 }
 
 template <typename SampleType>
-void recursive_linear_filter::Peaking<SampleType>::SetParams(const recursive_linear_filter::BiquadParams<SampleType>& params)
+void recursive_linear_filter::LowShelf<SampleType>::SetParams(const recursive_linear_filter::BiquadParams<SampleType>& params)
+{
+  this->SetCoefficients(0, GetCoefficients(params));
+}
+
+template <typename SampleType>
+recursive_linear_filter::BiquadCoefficients<SampleType> recursive_linear_filter::Peaking<SampleType>::GetCoefficients(
+  const recursive_linear_filter::BiquadParams<SampleType>& params)
 {
   const SampleType a = params.GetA();
   const SampleType omega_0 = params.GetOmega0();
@@ -144,11 +578,18 @@ void recursive_linear_filter::Peaking<SampleType>::SetParams(const recursive_lin
   const SampleType a1 = -2.0 * cosw;
   const SampleType a2 = 1.0 - alpha / a;
 
-  this->_AssignCoefficients(a0, a1, a2, b0, b1, b2);
+  return Biquad<SampleType>::_NormalizeCoefficients(a0, a1, a2, b0, b1, b2);
 }
 
 template <typename SampleType>
-void recursive_linear_filter::HighShelf<SampleType>::SetParams(const recursive_linear_filter::BiquadParams<SampleType>& params)
+void recursive_linear_filter::Peaking<SampleType>::SetParams(const recursive_linear_filter::BiquadParams<SampleType>& params)
+{
+  this->SetCoefficients(0, GetCoefficients(params));
+}
+
+template <typename SampleType>
+recursive_linear_filter::BiquadCoefficients<SampleType> recursive_linear_filter::HighShelf<SampleType>::GetCoefficients(
+  const recursive_linear_filter::BiquadParams<SampleType>& params)
 {
   const SampleType a = params.GetA();
   const SampleType omega_0 = params.GetOmega0();
@@ -166,13 +607,21 @@ void recursive_linear_filter::HighShelf<SampleType>::SetParams(const recursive_l
   const SampleType a1 = 2.0 * (am - ap * cosw);
   const SampleType a2 = ap - am * cosw - roota2alpha;
 
-  this->_AssignCoefficients(a0, a1, a2, b0, b1, b2);
+  return Biquad<SampleType>::_NormalizeCoefficients(a0, a1, a2, b0, b1, b2);
+}
+
+template <typename SampleType>
+void recursive_linear_filter::HighShelf<SampleType>::SetParams(const recursive_linear_filter::BiquadParams<SampleType>& params)
+{
+  this->SetCoefficients(0, GetCoefficients(params));
 }
 
 template class recursive_linear_filter::Base<double>;
 template class recursive_linear_filter::LevelParams<double>;
 template class recursive_linear_filter::Level<double>;
 template class recursive_linear_filter::BiquadParams<double>;
+template class recursive_linear_filter::BiquadCascade<double>;
+template class recursive_linear_filter::SmoothedBiquadCascade<double>;
 template class recursive_linear_filter::Biquad<double>;
 template class recursive_linear_filter::LowShelf<double>;
 template class recursive_linear_filter::Peaking<double>;
@@ -182,6 +631,8 @@ template class recursive_linear_filter::Base<float>;
 template class recursive_linear_filter::LevelParams<float>;
 template class recursive_linear_filter::Level<float>;
 template class recursive_linear_filter::BiquadParams<float>;
+template class recursive_linear_filter::BiquadCascade<float>;
+template class recursive_linear_filter::SmoothedBiquadCascade<float>;
 template class recursive_linear_filter::Biquad<float>;
 template class recursive_linear_filter::LowShelf<float>;
 template class recursive_linear_filter::Peaking<float>;
@@ -94,6 +94,17 @@ public:
   SampleType GetAlpha(const SampleType omega_0) const { return sin(omega_0) / (2.0 * this->mQuality); };
   SampleType GetCosW(const SampleType omega_0) const { return cos(omega_0); };
 
+  SampleType GetFrequency() const { return this->mFrequency; };
+  SampleType GetGainDB() const { return this->mGainDB; };
+  SampleType GetQuality() const { return this->mQuality; };
+  SampleType GetSampleRate() const { return this->mSampleRate; };
+  bool operator==(const BiquadParams<SampleType>& other) const
+  {
+    return this->mFrequency == other.mFrequency && this->mGainDB == other.mGainDB && this->mQuality == other.mQuality
+           && this->mSampleRate == other.mSampleRate;
+  };
+  bool operator!=(const BiquadParams<SampleType>& other) const { return !(*this == other); };
+
 private:
   SampleType mFrequency;
   SampleType mGainDB;
@@ -101,23 +112,164 @@ private:
   SampleType mSampleRate;
 };
 
+// Coefficients of one biquad section, normalized so that a0 = 1:
+// y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+template <typename SampleType>
+struct BiquadCoefficients
+{
+  SampleType b0;
+  SampleType b1;
+  SampleType b2;
+  SampleType a1;
+  SampleType a2;
+};
+
+// A cascade of biquad sections, applied in series to every channel.
+//
+// Each section is evaluated in transposed direct form II. The sections'
+// coefficients and states are kept in structure-of-arrays form, and every
+// (section, channel) pair is one lane of a small fixed-width vector whose
+// state lives in registers for the whole block. The block is cut into short
+// sub-blocks and section s works on the sub-block that section s-1 finished on
+// the previous step, so all of the lanes are busy at once ("wavefront"
+// scheduling) even for a mono signal. The first and last few steps of each
+// block fill and drain the pipeline, so there's no added latency.
+//
+// Non-finite state is checked once per block; if it shows up, that channel's
+// state is cleared and its output for the block is zeroed.
+template <typename SampleType>
+class BiquadCascade : public dsp::DSP<SampleType>
+{
+public:
+  BiquadCascade(const size_t numSections);
+  SampleType** Process(SampleType** inputs, const size_t numChannels, const size_t numFrames) override;
+  // The filters only write a sub-block after they've read it, so they can work
+  // in place.
+  void ProcessInPlace(SampleType** buffers, const size_t numChannels, const size_t numFrames) override;
+  // Sections start out as pass-through.
+  void SetCoefficients(const size_t section, const BiquadCoefficients<SampleType>& coefficients);
+  size_t GetNumSections() const { return this->mB0.size(); };
+  // Clear the filters' state
+  void Reset();
+
+protected:
+  // Additionally prepares the state for the new channel count.
+  void _PrepareBuffers(const size_t numChannels, const size_t numFrames) override;
+  // Size the state for numChannels (clearing it if that's a change).
+  void _PrepareState(const size_t numChannels);
+  // Filter a block from inputs into outputs (which may be the same).
+  // Assumes that _PrepareState() was called.
+  virtual void _Process(SampleType** inputs, SampleType** outputs, const size_t numChannels, const size_t numFrames);
+  // Filter frames [startFrame, startFrame + numFrames) of the inputs into the
+  // same frames of the outputs.
+  void _ProcessFrames(SampleType** inputs, SampleType** outputs, const size_t numChannels, const size_t startFrame,
+                      const size_t numFrames);
+  // Move a section's coefficients linearly to target over the frames of the
+  // next call to _ProcessFrames(), which must have numFrames frames.
+  // Linear interpolation is stable: the (a1, a2) stability triangle is convex,
+  // so every point between two stable designs is stable too.
+  void _RampCoefficients(const size_t section, const BiquadCoefficients<SampleType>& target, const size_t numFrames);
+  // Process channels [firstChannel, firstChannel + numChannels) with every
+  // section.
+  // Requires numChannels * GetNumSections() <= NumLanes.
+  template <int NumLanes, bool Ramping>
+  void _ProcessChannels(SampleType** inputs, SampleType** outputs, const size_t firstChannel,
+                        const size_t numChannels, const size_t startFrame, const size_t numFrames);
+
+  // Coefficients, one entry per section
+  std::vector<SampleType> mB0;
+  std::vector<SampleType> mB1;
+  std::vector<SampleType> mB2;
+  std::vector<SampleType> mA1;
+  std::vector<SampleType> mA2;
+  // Per-sample change in each coefficient while ramping
+  std::vector<SampleType> mRampB0;
+  std::vector<SampleType> mRampB1;
+  std::vector<SampleType> mRampB2;
+  std::vector<SampleType> mRampA1;
+  std::vector<SampleType> mRampA2;
+  // Where the ramps end
+  std::vector<BiquadCoefficients<SampleType>> mRampTargets;
+  bool mRamping;
+  // State, indexed [channel * numSections + section]
+  std::vector<SampleType> mZ1;
+  std::vector<SampleType> mZ2;
+  // Scratch for _ProcessChannels(), indexed [sample][lane]:
+  // New input for the first section of each channel
+  std::vector<SampleType> mFeed;
+  // Each section's output from the previous and current steps
+  std::vector<SampleType> mPipeA;
+  std::vector<SampleType> mPipeB;
+  // Which lanes have a sample to work on during the fill and drain steps
+  std::vector<SampleType> mMask;
+};
+
+// A cascade whose sections are described by their parameters (frequency, Q,
+// gain), for when those are under the user's (or host's) control.
+//
+// SetParams() only records where a section is headed; it's cheap to call as
+// often as the host likes. The parameters glide toward their targets and are
+// turned into coefficients at the control rate (once every controlInterval
+// samples), and only when they've actually moved. In between, the coefficients
+// are ramped linearly so that there's no zipper noise. Once the parameters
+// settle, processing costs the same as a plain BiquadCascade.
+template <typename SampleType>
+class SmoothedBiquadCascade : public BiquadCascade<SampleType>
+{
+public:
+  // E.g. LowShelf<SampleType>::GetCoefficients
+  typedef BiquadCoefficients<SampleType> (*Design)(const BiquadParams<SampleType>&);
+
+  // One design per section.
+  // smoothingTime: Time constant of the parameter glide, in seconds.
+  SmoothedBiquadCascade(const std::vector<Design>& designs, const size_t controlInterval = 32,
+                        const double smoothingTime = 0.02);
+  // The first call for a section takes effect immediately; later ones glide.
+  void SetParams(const size_t section, const BiquadParams<SampleType>& params);
+
+protected:
+  void _Process(SampleType** inputs, SampleType** outputs, const size_t numChannels,
+                const size_t numFrames) override;
+
+private:
+  // Advance the glides by one control interval and redesign the sections
+  // that moved, ramping to them over the next numFrames.
+  // Returns whether any section is ramping.
+  bool _UpdateCoefficients(const size_t numFrames);
+
+  std::vector<Design> mDesigns;
+  size_t mControlInterval;
+  double mSmoothingTime;
+  // Per section: where the parameters are headed, where they are now, and
+  // what the current coefficients were designed from.
+  std::vector<BiquadParams<SampleType>> mTargetParams;
+  std::vector<BiquadParams<SampleType>> mParams;
+  std::vector<BiquadParams<SampleType>> mDesignedParams;
+  std::vector<bool> mHaveParams;
+};
+
+// A single biquad section
 template <typename SampleType>
-class Biquad : public Base<SampleType>
+class Biquad : public BiquadCascade<SampleType>
 {
 public:
   Biquad()
-  : Base<SampleType>(3, 3){};
+  : BiquadCascade<SampleType>(1){};
   virtual void SetParams(const BiquadParams<SampleType>& params) = 0;
 
 protected:
-  void _AssignCoefficients(const SampleType a0, const SampleType a1, const SampleType a2, const SampleType b0, const SampleType b1,
-                           const SampleType b2);
+  static BiquadCoefficients<SampleType> _NormalizeCoefficients(const SampleType a0, const SampleType a1,
+                                                               const SampleType a2, const SampleType b0,
+                                                               const SampleType b1, const SampleType b2);
 };
 
+// The designs are also available on their own (GetCoefficients()) so that
+// several can be put into one BiquadCascade.
 template <typename SampleType>
 class LowShelf : public Biquad<SampleType>
 {
 public:
+  static BiquadCoefficients<SampleType> GetCoefficients(const BiquadParams<SampleType>& params);
   void SetParams(const BiquadParams<SampleType>& params) override;
 };
 
@@ -125,6 +277,7 @@ template <typename SampleType>
 class Peaking : public Biquad<SampleType>
 {
 public:
+  static BiquadCoefficients<SampleType> GetCoefficients(const BiquadParams<SampleType>& params);
   void SetParams(const BiquadParams<SampleType>& params) override;
 };
 
@@ -132,6 +285,7 @@ template <typename SampleType>
 class HighShelf : public Biquad<SampleType>
 {
 public:
+  static BiquadCoefficients<SampleType> GetCoefficients(const BiquadParams<SampleType>& params);
   void SetParams(const BiquadParams<SampleType>& params) override;
 };
 }; // namespace recursive_linear_filter
\ No newline at end of file
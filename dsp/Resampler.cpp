@@ -0,0 +1,169 @@
+//
+//  Resampler.cpp
+//
+//
+
+#include <algorithm> // std::min
+#include <cmath> // sin, sqrt, ceil, floor
+#include <cstring> // memmove
+#include <stdexcept>
+
+#include <Eigen/Dense>
+
+#include "Resampler.h"
+
+// Stopband attenuation of the anti-aliasing filter
+constexpr double _ATTENUATION_DB = 80.0;
+constexpr double _PI = 3.14159265358979323846;
+
+// Zeroth-order modified Bessel function of the first kind (for the Kaiser
+// window)
+double _BesselI0(const double x)
+{
+  double sum = 1.0;
+  double term = 1.0;
+  const double halfX = 0.5 * x;
+  for (int k = 1; k < 50; k++)
+  {
+    term *= (halfX / k) * (halfX / k);
+    sum += term;
+    if (term < 1.0e-12 * sum)
+      break;
+  }
+  return sum;
+}
+
+template <typename SampleType>
+dsp::Resampler<SampleType>::Resampler()
+: mInputSampleRate(0.0)
+, mOutputSampleRate(0.0)
+, mStep(1.0)
+, mNumTaps(0)
+, mNumPhases(0)
+, mMaxInputFrames(0)
+, mWriteIndex(0)
+, mTime(0.0)
+{
+}
+
+template <typename SampleType>
+void dsp::Resampler<SampleType>::Reset(const double inputSampleRate, const double outputSampleRate,
+                                       const size_t maxInputFrames, const int numTaps, const int numPhases)
+{
+  if (inputSampleRate <= 0.0 || outputSampleRate <= 0.0)
+    throw std::runtime_error("Sample rates must be positive");
+  if (numTaps < 2 || numPhases < 1)
+    throw std::runtime_error("Resampler needs at least 2 taps and 1 phase");
+
+  this->mInputSampleRate = inputSampleRate;
+  this->mOutputSampleRate = outputSampleRate;
+  this->mStep = inputSampleRate / outputSampleRate;
+  this->mNumPhases = numPhases;
+  this->mMaxInputFrames = maxInputFrames;
+
+  // When downsampling, the cutoff comes down with the output Nyquist and the
+  // filter gets longer to keep the same (relative) transition band.
+  const double bandwidth = std::min(1.0, 1.0 / this->mStep);
+  {
+    int taps = (int)std::ceil(numTaps / bandwidth);
+    // Multiple of 8 so that the dot products vectorize without a remainder.
+    taps = 8 * ((taps + 7) / 8);
+    this->mNumTaps = taps;
+  }
+  const int halfTaps = this->mNumTaps / 2;
+
+  // Kaiser design: put the stopband edge at the (output) Nyquist frequency.
+  // Frequencies in cycles per input sample.
+  const double transition = (_ATTENUATION_DB - 7.95) / (14.36 * numTaps) * bandwidth;
+  const double cutoff = 0.5 * bandwidth - 0.5 * transition;
+  const double beta = 0.1102 * (_ATTENUATION_DB - 8.7);
+  const double i0Beta = _BesselI0(beta);
+
+  this->mFilter.resize((this->mNumPhases + 1) * this->mNumTaps);
+  for (int p = 0; p <= this->mNumPhases; p++)
+  {
+    const double fraction = (double)p / this->mNumPhases;
+    for (int k = 0; k < this->mNumTaps; k++)
+    {
+      // Distance from the input sample at this tap to the output sample.
+      const double d = fraction + (halfTaps - 1) - k;
+      const double u = d / halfTaps;
+      const double window = std::abs(u) < 1.0 ? _BesselI0(beta * std::sqrt(1.0 - u * u)) / i0Beta : 0.0;
+      const double x = 2.0 * cutoff * d;
+      const double sinc = std::abs(x) < 1.0e-9 ? 1.0 : std::sin(_PI * x) / (_PI * x);
+      this->mFilter[p * this->mNumTaps + k] = (float)(2.0 * cutoff * sinc * window);
+    }
+  }
+
+  // Room for the new block plus a filter's worth of history.
+  this->mHistory.resize(maxInputFrames + this->mNumTaps + 1);
+  std::fill(this->mHistory.begin(), this->mHistory.end(), 0.0f);
+  // Start with enough zeros that the first output (which lines up with the
+  // first input sample) has a full filter of history behind it.
+  this->mWriteIndex = halfTaps - 1;
+  this->mTime = (double)this->mWriteIndex;
+}
+
+template <typename SampleType>
+size_t dsp::Resampler<SampleType>::Process(const SampleType* input, const size_t numInputFrames, SampleType* output)
+{
+  if (this->mNumTaps == 0)
+    throw std::runtime_error("Resampler used before Reset()");
+  const long halfTaps = this->mNumTaps / 2;
+  size_t numOutputFrames = 0;
+  for (size_t chunkStart = 0; chunkStart < numInputFrames; chunkStart += this->mMaxInputFrames)
+  {
+    const size_t chunkSize = std::min(this->mMaxInputFrames, numInputFrames - chunkStart);
+    // Convert down to float here.
+    for (size_t i = 0; i < chunkSize; i++)
+      this->mHistory[this->mWriteIndex + i] = (float)input[chunkStart + i];
+    this->mWriteIndex += chunkSize;
+
+    // Emit every output whose filter is covered by the history.
+    long index = (long)std::floor(this->mTime);
+    while (index + halfTaps < this->mWriteIndex)
+    {
+      output[numOutputFrames++] = (SampleType)this->_Interpolate(index, this->mTime - index);
+      this->mTime += this->mStep;
+      index = (long)std::floor(this->mTime);
+    }
+
+    // Drop the history that no future output will need.
+    const long start = std::min(index - halfTaps + 1, this->mWriteIndex);
+    if (start > 0)
+    {
+      std::memmove(this->mHistory.data(), this->mHistory.data() + start,
+                   (this->mWriteIndex - start) * sizeof(float));
+      this->mWriteIndex -= start;
+      this->mTime -= start;
+    }
+  }
+  return numOutputFrames;
+}
+
+template <typename SampleType>
+size_t dsp::Resampler<SampleType>::GetMaxOutputFrames(const size_t numInputFrames) const
+{
+  return (size_t)std::ceil(numInputFrames / this->mStep) + 1;
+}
+
+template <typename SampleType>
+double dsp::Resampler<SampleType>::GetLatencySeconds() const
+{
+  return (this->mNumTaps / 2) / this->mInputSampleRate;
+}
+
+template <typename SampleType>
+float dsp::Resampler<SampleType>::_Interpolate(const long index, const double fraction) const
+{
+  const double position = fraction * this->mNumPhases;
+  const int phase = std::min((int)position, this->mNumPhases - 1);
+  const float a = (float)(position - phase);
+  auto x = Eigen::Map<const Eigen::VectorXf>(&this->mHistory[index - this->mNumTaps / 2 + 1], this->mNumTaps);
+  auto h0 = Eigen::Map<const Eigen::VectorXf>(&this->mFilter[phase * this->mNumTaps], this->mNumTaps);
+  auto h1 = Eigen::Map<const Eigen::VectorXf>(&this->mFilter[(phase + 1) * this->mNumTaps], this->mNumTaps);
+  return (1.0f - a) * h0.dot(x) + a * h1.dot(x);
+}
+
+template class dsp::Resampler<double>;
+template class dsp::Resampler<float>;
@@ -0,0 +1,79 @@
+//
+//  Resampler.h
+//
+//
+// Streaming, arbitrary-ratio sample rate conversion.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace dsp
+{
+// A block-streaming polyphase windowed-sinc sample rate converter.
+//
+// The anti-aliasing filter is a Kaiser-windowed sinc that's tabulated as a
+// bank of polyphase branches. Each output sample sits at a fractional position
+// between two input samples; its value is found by taking the dot product of
+// the input history with the two nearest branches and interpolating linearly
+// between them. The dot products are done with Eigen so that they vectorize.
+//
+// The filter is zero-phase w.r.t. the output stream, so the only delay is that
+// an output can't be emitted until the input half a filter length in its
+// future has arrived. See GetLatencySeconds().
+//
+// All memory is allocated by Reset(); Process() doesn't allocate.
+// Mono. Use one per channel.
+template <typename SampleType>
+class Resampler
+{
+public:
+  Resampler();
+  // Design the filter for the provided rates and allocate buffers for blocks
+  // of up to maxInputFrames input samples. Also clears the history.
+  // numTaps is the filter length when upsampling; it's stretched to keep the
+  // same transition band (relative to the output rate) when downsampling.
+  void Reset(const double inputSampleRate, const double outputSampleRate, const size_t maxInputFrames,
+             const int numTaps = 64, const int numPhases = 256);
+  // Push numInputFrames samples and write out all of the output samples that
+  // are ready.
+  // output must have room for GetMaxOutputFrames(numInputFrames) samples.
+  // Returns the number of output samples written.
+  size_t Process(const SampleType* input, const size_t numInputFrames, SampleType* output);
+  // The most output samples that could come out of a call to Process() with
+  // numInputFrames input samples.
+  size_t GetMaxOutputFrames(const size_t numInputFrames) const;
+  // How long an input sample waits before it affects the output.
+  double GetLatencySeconds() const;
+  double GetInputSampleRate() const { return this->mInputSampleRate; };
+  double GetOutputSampleRate() const { return this->mOutputSampleRate; };
+  int GetNumTaps() const { return this->mNumTaps; };
+
+private:
+  // Output sample at the fractional position mTime in mHistory.
+  float _Interpolate(const long index, const double fraction) const;
+
+  double mInputSampleRate;
+  double mOutputSampleRate;
+  // Input samples per output sample
+  double mStep;
+  int mNumTaps;
+  int mNumPhases;
+  size_t mMaxInputFrames;
+
+  // The filter bank. Branch p (0 <= p <= mNumPhases) starts at
+  // mFilter[p * mNumTaps] and is the filter for an output that's p/mNumPhases
+  // of a sample after the input sample at tap mNumTaps/2-1.
+  // (The extra branch at mNumPhases is so that the interpolation never has to
+  // wrap.)
+  std::vector<float> mFilter;
+
+  // The input history
+  std::vector<float> mHistory;
+  // Where the next input sample will be written
+  long mWriteIndex;
+  // Location in mHistory of the next output sample, in input samples.
+  double mTime;
+};
+}; // namespace dsp
@@ -1,6 +1,7 @@
 #include <algorithm> // std::max_element
 #include <algorithm>
 #include <cmath> // pow, tanh, expf
+#include <cstring> // memcpy
 #include <filesystem>
 #include <fstream>
 #include <string>
@@ -25,6 +26,15 @@ dsp::DSP<SampleType>::~DSP()
   this->_DeallocateOutputPointers();
 };
 
+template <typename SampleType>
+void dsp::DSP<SampleType>::ProcessInPlace(SampleType** buffers, const size_t numChannels, const size_t numFrames)
+{
+  SampleType** outputs = this->Process(buffers, numChannels, numFrames);
+  for (size_t c = 0; c < numChannels; c++)
+    if (outputs[c] != buffers[c])
+      std::memcpy(buffers[c], outputs[c], numFrames * sizeof(SampleType));
+}
+
 template <typename SampleType>
 void dsp::DSP<SampleType>::_AllocateOutputPointers(const size_t numChannels)
 {
@@ -28,6 +28,11 @@ public:
   // This object instance will own the data referenced by the pointers and be
   // responsible for its allocation and deallocation.
   virtual SampleType** Process(SampleType** inputs, const size_t numChannels, const size_t numFrames) = 0;
+  // Process the audio in buffers and write the result back over it.
+  // By default, this is Process() followed by a copy, but modules that can
+  // work in place override it so that they skip the copy (and don't need
+  // their own output buffers).
+  virtual void ProcessInPlace(SampleType** buffers, const size_t numChannels, const size_t numFrames);
   // Update the parameters of the DSP object according to the provided params.
   // Not declaring a pure virtual bc there's no concrete definition that can
   // use Params.
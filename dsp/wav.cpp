@@ -5,37 +5,161 @@
 //  Created by Steven Atkinson on 12/31/22.
 //
 
-#include <cmath> // pow
-#include <fstream>
+#include <algorithm> // std::min, std::clamp
+#include <cstring>
 #include <iostream>
-#include <string>
 #include <sstream>
-#include <unordered_set>
+#include <stdexcept>
+#include <string>
 #include <vector>
-#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "wav.h"
 
-bool idIsNotJunk(char* id)
+// FYI: https://www.mmsp.ece.mcgill.ca/Documents/AudioFormats/WAVE/WAVE.html
+// Everything in a WAV file is little-endian, as are the machines that this
+// runs on, so samples are copied straight out of the file.
+
+const uint16_t _AUDIO_FORMAT_PCM = 1;
+const uint16_t _AUDIO_FORMAT_IEEE = 3;
+const uint16_t _AUDIO_FORMAT_ALAW = 6;
+const uint16_t _AUDIO_FORMAT_MULAW = 7;
+const uint16_t _AUDIO_FORMAT_EXTENSIBLE = 0xfffe;
+
+// Samples are decoded this many frames at a time so that the interleaved
+// scratch stays in cache while it's split up by channel.
+constexpr size_t _DECODE_FRAMES = 1024;
+
+uint16_t _ReadUInt16(const uint8_t* bytes)
+{
+  return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+uint32_t _ReadUInt32(const uint8_t* bytes)
 {
-  return strncmp(id, "RIFF", 4) == 0 || strncmp(id, "WAVE", 4) == 0 || strncmp(id, "fmt ", 4) == 0
-         || strncmp(id, "data", 4) == 0;
+  return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
 }
 
-bool ReadChunkAndSkipJunk(std::ifstream& file, char* chunkID)
+// Decoding ===================================================================
+// These are written so that the compiler can vectorize them: no calls, no
+// branches, and the unaligned loads are memcpy's.
+
+void _DecodePCM16(const uint8_t* bytes, const size_t numSamples, float* samples)
 {
-  file.read(chunkID, 4);
-  while (!idIsNotJunk(chunkID) && file.good())
+  const float scale = 1.0f / (float)(1 << 15);
+  for (size_t i = 0; i < numSamples; i++)
   {
-    int junkSize;
-    file.read(reinterpret_cast<char*>(&junkSize), 4);
-    file.ignore(junkSize);
-    // Unused byte if junkSize is odd
-    if ((junkSize % 2) == 1)
-      file.ignore(1);
-    // And now we should be ready for data...
-    file.read(chunkID, 4);
+    int16_t x;
+    std::memcpy(&x, bytes + 2 * i, 2);
+    samples[i] = scale * (float)x;
+  }
+}
+
+void _DecodePCM24(const uint8_t* bytes, const size_t numSamples, float* samples)
+{
+  // Put the 3 bytes at the top of a 32-bit int so that the sign comes along
+  // for free.
+  const float scale = 1.0f / (float)(1u << 31);
+  for (size_t i = 0; i < numSamples; i++)
+  {
+    const uint8_t* b = bytes + 3 * i;
+    const uint32_t x = ((uint32_t)b[0] << 8) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 24);
+    samples[i] = scale * (float)(int32_t)x;
+  }
+}
+
+void _DecodePCM32(const uint8_t* bytes, const size_t numSamples, float* samples)
+{
+  const float scale = 1.0f / (float)(1u << 31);
+  for (size_t i = 0; i < numSamples; i++)
+  {
+    int32_t x;
+    std::memcpy(&x, bytes + 4 * i, 4);
+    samples[i] = scale * (float)x;
+  }
+}
+
+void _Decode(const uint8_t* bytes, const dsp::wav::SampleFormat format, const size_t numSamples, float* samples)
+{
+  switch (format)
+  {
+    case dsp::wav::SampleFormat::PCM16: _DecodePCM16(bytes, numSamples, samples); break;
+    case dsp::wav::SampleFormat::PCM24: _DecodePCM24(bytes, numSamples, samples); break;
+    case dsp::wav::SampleFormat::PCM32: _DecodePCM32(bytes, numSamples, samples); break;
+    case dsp::wav::SampleFormat::FLOAT32: std::memcpy(samples, bytes, 4 * numSamples); break;
+  }
+}
+
+// Encoding ===================================================================
+
+// Round to nearest
+inline int32_t _Round(const float x)
+{
+  return (int32_t)(x + (x >= 0.0f ? 0.5f : -0.5f));
+}
+
+void _EncodePCM16(const float* samples, const size_t numSamples, uint8_t* bytes)
+{
+  for (size_t i = 0; i < numSamples; i++)
+  {
+    const int16_t x = (int16_t)_Round(32767.0f * std::clamp(samples[i], -1.0f, 1.0f));
+    std::memcpy(bytes + 2 * i, &x, 2);
+  }
+}
+
+void _EncodePCM24(const float* samples, const size_t numSamples, uint8_t* bytes)
+{
+  for (size_t i = 0; i < numSamples; i++)
+  {
+    const int32_t x = _Round(8388607.0f * std::clamp(samples[i], -1.0f, 1.0f));
+    uint8_t* b = bytes + 3 * i;
+    b[0] = (uint8_t)(x & 0xff);
+    b[1] = (uint8_t)((x >> 8) & 0xff);
+    b[2] = (uint8_t)((x >> 16) & 0xff);
+  }
+}
+
+void _EncodePCM32(const float* samples, const size_t numSamples, uint8_t* bytes)
+{
+  // Floats can't hold 2^31 - 1, so go through double.
+  for (size_t i = 0; i < numSamples; i++)
+  {
+    const double y = 2147483647.0 * std::clamp((double)samples[i], -1.0, 1.0);
+    const int32_t x = (int32_t)(y + (y >= 0.0 ? 0.5 : -0.5));
+    std::memcpy(bytes + 4 * i, &x, 4);
+  }
+}
+
+void _Encode(const float* samples, const dsp::wav::SampleFormat format, const size_t numSamples, uint8_t* bytes)
+{
+  switch (format)
+  {
+    case dsp::wav::SampleFormat::PCM16: _EncodePCM16(samples, numSamples, bytes); break;
+    case dsp::wav::SampleFormat::PCM24: _EncodePCM24(samples, numSamples, bytes); break;
+    case dsp::wav::SampleFormat::PCM32: _EncodePCM32(samples, numSamples, bytes); break;
+    case dsp::wav::SampleFormat::FLOAT32: std::memcpy(bytes, samples, 4 * numSamples); break;
+  }
+}
+
+size_t _GetBytesPerSample(const dsp::wav::SampleFormat format)
+{
+  switch (format)
+  {
+    case dsp::wav::SampleFormat::PCM16: return 2;
+    case dsp::wav::SampleFormat::PCM24: return 3;
+    default: return 4;
   }
-  return file.good();
 }
 
 std::string dsp::wav::GetMsgForLoadReturnCode(LoadReturnCode retCode)
@@ -74,236 +198,474 @@ std::string dsp::wav::GetMsgForLoadReturnCode(LoadReturnCode retCode)
   return message.str();
 }
 
+
 dsp::wav::LoadReturnCode dsp::wav::Load(const char* fileName, std::vector<float>& audio, double& sampleRate)
 {
-  // FYI: https://www.mmsp.ece.mcgill.ca/Documents/AudioFormats/WAVE/WAVE.html
-  // Open the WAV file for reading
-  std::ifstream wavFile(fileName, std::ios::binary);
-
-  // Check if the file was opened successfully
-  if (!wavFile.is_open())
+  dsp::wav::Reader reader;
+  const dsp::wav::LoadReturnCode retCode = reader.Open(fileName);
+  if (retCode != dsp::wav::LoadReturnCode::SUCCESS)
+    return retCode;
+  // HACK
+  if (reader.GetNumChannels() != 1)
   {
-    std::cerr << "Error opening WAV file" << std::endl;
-    return dsp::wav::LoadReturnCode::ERROR_OPENING;
+    std::cerr << "Require mono (using for IR loading)" << std::endl;
+    return dsp::wav::LoadReturnCode::ERROR_NOT_MONO;
   }
+  sampleRate = reader.GetSampleRate();
+  audio.resize(reader.GetNumFrames());
+  float* output = audio.data();
+  reader.Read(&output, audio.size());
+  return dsp::wav::LoadReturnCode::SUCCESS;
+}
 
-  // WAV file has 3 "chunks": RIFF ("RIFF"), format ("fmt ") and data ("data").
-  // Read the WAV file header
-  char chunkId[4];
-  if (!ReadChunkAndSkipJunk(wavFile, chunkId))
+dsp::wav::LoadReturnCode dsp::wav::Load(const char* fileName, std::vector<std::vector<float>>& audio,
+                                        double& sampleRate)
+{
+  dsp::wav::Reader reader;
+  const dsp::wav::LoadReturnCode retCode = reader.Open(fileName);
+  if (retCode != dsp::wav::LoadReturnCode::SUCCESS)
+    return retCode;
+  sampleRate = reader.GetSampleRate();
+  audio.resize(reader.GetNumChannels());
+  std::vector<float*> outputs(audio.size());
+  for (size_t c = 0; c < audio.size(); c++)
   {
-    std::cerr << "Error while reading for next chunk." << std::endl;
-    return dsp::wav::LoadReturnCode::ERROR_INVALID_FILE;
+    audio[c].resize(reader.GetNumFrames());
+    outputs[c] = audio[c].data();
   }
+  reader.Read(outputs.data(), reader.GetNumFrames());
+  return dsp::wav::LoadReturnCode::SUCCESS;
+}
 
-  if (strncmp(chunkId, "RIFF", 4) != 0)
+void dsp::wav::Save(const char* fileName, const std::vector<std::vector<float>>& audio, const double sampleRate,
+                    const SampleFormat format)
+{
+  std::vector<const float*> inputs(audio.size());
+  for (size_t c = 0; c < audio.size(); c++)
   {
-    std::cerr << "Error: File does not start with expected RIFF chunk. Got" << chunkId << " instead." << std::endl;
-    return dsp::wav::LoadReturnCode::ERROR_NOT_RIFF;
+    if (audio[c].size() != audio[0].size())
+      throw std::runtime_error("Can't save a WAV file whose channels have different lengths");
+    inputs[c] = audio[c].data();
   }
+  dsp::wav::Writer writer;
+  writer.Open(fileName, (int)audio.size(), sampleRate, format);
+  writer.Write(inputs.data(), audio.empty() ? 0 : audio[0].size());
+  writer.Close();
+}
 
-  int chunkSize;
-  wavFile.read(reinterpret_cast<char*>(&chunkSize), 4);
+// Reader =====================================================================
+
+dsp::wav::Reader::Reader()
+: mData(nullptr)
+, mSize(0)
+#ifdef _WIN32
+, mFileHandle(INVALID_HANDLE_VALUE)
+, mMappingHandle(nullptr)
+#else
+, mFileDescriptor(-1)
+#endif
+, mSamples(nullptr)
+, mNumChannels(0)
+, mSampleRate(0.0)
+, mSampleFormat(SampleFormat::PCM16)
+, mNumFrames(0)
+, mPosition(0)
+{
+}
 
-  char format[4];
-  wavFile.read(format, 4);
-  if (strncmp(format, "WAVE", 4) != 0)
-  {
-    std::cerr << "Error: Files' second chunk (format) is not expected WAV. Got" << format << " instead." << std::endl;
-    return dsp::wav::LoadReturnCode::ERROR_NOT_WAVE;
-  }
+dsp::wav::Reader::~Reader()
+{
+  this->Close();
+}
 
-  // Read the format chunk
-  char subchunk1Id[4];
-  if (!ReadChunkAndSkipJunk(wavFile, subchunk1Id))
+dsp::wav::LoadReturnCode dsp::wav::Reader::Open(const char* fileName)
+{
+  this->Close();
+#ifdef _WIN32
+  this->mFileHandle =
+    CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  LARGE_INTEGER size;
+  if (this->mFileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->mFileHandle, &size))
   {
-    std::cerr << "Error while reading for next chunk." << std::endl;
-    return dsp::wav::LoadReturnCode::ERROR_INVALID_FILE;
+    std::cerr << "Error opening WAV file" << std::endl;
+    this->Close();
+    return dsp::wav::LoadReturnCode::ERROR_OPENING;
   }
-  if (strncmp(subchunk1Id, "fmt ", 4) != 0)
+  this->mSize = (size_t)size.QuadPart;
+  if (this->mSize > 0)
   {
-    std::cerr << "Error: Invalid WAV file missing expected fmt section; got " << subchunk1Id << " instead."
-              << std::endl;
-    return dsp::wav::LoadReturnCode::ERROR_MISSING_FMT;
+    this->mMappingHandle = CreateFileMappingA(this->mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (this->mMappingHandle != nullptr)
+      this->mData = (const uint8_t*)MapViewOfFile(this->mMappingHandle, FILE_MAP_READ, 0, 0, 0);
   }
-
-  int subchunk1Size;
-  wavFile.read(reinterpret_cast<char*>(&subchunk1Size), 4);
-  if (subchunk1Size < 16)
+#else
+  this->mFileDescriptor = open(fileName, O_RDONLY);
+  struct stat info;
+  if (this->mFileDescriptor < 0 || fstat(this->mFileDescriptor, &info) != 0)
   {
-    std::cerr << "WAV chunk 1 size is " << subchunk1Size
-              << ", which is smaller than the requried 16 to fit the expected "
-                 "information."
-              << std::endl;
-    return dsp::wav::LoadReturnCode::ERROR_INVALID_FILE;
+    std::cerr << "Error opening WAV file" << std::endl;
+    this->Close();
+    return dsp::wav::LoadReturnCode::ERROR_OPENING;
   }
-
-  unsigned short audioFormat;
-  wavFile.read(reinterpret_cast<char*>(&audioFormat), 2);
-  const short AUDIO_FORMAT_PCM = 1;
-  const short AUDIO_FORMAT_IEEE = 3;
-  std::unordered_set<short> supportedFormats{AUDIO_FORMAT_PCM, AUDIO_FORMAT_IEEE};
-  if (supportedFormats.find(audioFormat) == supportedFormats.end())
+  this->mSize = (size_t)info.st_size;
+  if (this->mSize > 0)
   {
-    std::cerr << "Error: Unsupported WAV format detected. ";
-    switch (audioFormat)
+    void* data = mmap(nullptr, this->mSize, PROT_READ, MAP_PRIVATE, this->mFileDescriptor, 0);
+    if (data != MAP_FAILED)
     {
-      case 6: std::cerr << "(Got: A-law)" << std::endl; return dsp::wav::LoadReturnCode::ERROR_UNSUPPORTED_FORMAT_ALAW;
-      case 7:
-        std::cerr << "(Got: mu-law)" << std::endl;
-        return dsp::wav::LoadReturnCode::ERROR_UNSUPPORTED_FORMAT_MULAW;
-      case 65534:
-        std::cerr << "(Got: Extensible)" << std::endl;
-        return dsp::wav::LoadReturnCode::ERROR_UNSUPPORTED_FORMAT_EXTENSIBLE;
-      default:
-        std::cerr << "(Got unknown format " << audioFormat << ")" << std::endl;
-        return dsp::wav::LoadReturnCode::ERROR_INVALID_FILE;
+      this->mData = (const uint8_t*)data;
+      madvise(data, this->mSize, MADV_SEQUENTIAL);
     }
   }
-
-  short numChannels;
-  wavFile.read(reinterpret_cast<char*>(&numChannels), 2);
-  // HACK
-  if (numChannels != 1)
+#endif
+  if (this->mData == nullptr)
   {
-    std::cerr << "Require mono (using for IR loading)" << std::endl;
-    return dsp::wav::LoadReturnCode::ERROR_NOT_MONO;
+    std::cerr << "Error mapping WAV file" << std::endl;
+    this->Close();
+    return this->mSize == 0 ? dsp::wav::LoadReturnCode::ERROR_NOT_RIFF : dsp::wav::LoadReturnCode::ERROR_OPENING;
   }
 
-  int iSampleRate;
-  wavFile.read(reinterpret_cast<char*>(&iSampleRate), 4);
-  // Store in format we assume (SR is double)
-  sampleRate = (double)iSampleRate;
-
-  int byteRate;
-  wavFile.read(reinterpret_cast<char*>(&byteRate), 4);
+  const dsp::wav::LoadReturnCode retCode = this->_ParseHeader();
+  if (retCode != dsp::wav::LoadReturnCode::SUCCESS)
+    this->Close();
+  return retCode;
+}
 
-  short blockAlign;
-  wavFile.read(reinterpret_cast<char*>(&blockAlign), 2);
+void dsp::wav::Reader::Close()
+{
+#ifdef _WIN32
+  if (this->mData != nullptr)
+    UnmapViewOfFile(this->mData);
+  if (this->mMappingHandle != nullptr)
+    CloseHandle(this->mMappingHandle);
+  if (this->mFileHandle != INVALID_HANDLE_VALUE)
+    CloseHandle(this->mFileHandle);
+  this->mMappingHandle = nullptr;
+  this->mFileHandle = INVALID_HANDLE_VALUE;
+#else
+  if (this->mData != nullptr)
+    munmap(const_cast<uint8_t*>(this->mData), this->mSize);
+  if (this->mFileDescriptor >= 0)
+    close(this->mFileDescriptor);
+  this->mFileDescriptor = -1;
+#endif
+  this->mData = nullptr;
+  this->mSize = 0;
+  this->mSamples = nullptr;
+  this->mNumChannels = 0;
+  this->mNumFrames = 0;
+  this->mPosition = 0;
+}
 
-  short bitsPerSample;
-  wavFile.read(reinterpret_cast<char*>(&bitsPerSample), 2);
+dsp::wav::LoadReturnCode dsp::wav::Reader::_ParseHeader()
+{
+  const uint8_t* data = this->mData;
+  const size_t size = this->mSize;
+  if (size < 12 || std::memcmp(data, "RIFF", 4) != 0)
+  {
+    std::cerr << "Error: File does not start with expected RIFF chunk." << std::endl;
+    return dsp::wav::LoadReturnCode::ERROR_NOT_RIFF;
+  }
+  if (std::memcmp(data + 8, "WAVE", 4) != 0)
+  {
+    std::cerr << "Error: File's RIFF chunk is not WAVE." << std::endl;
+    return dsp::wav::LoadReturnCode::ERROR_NOT_WAVE;
+  }
 
-  // The default is for there to be 16 bytes in the fmt chunk, but sometimes
-  // it's different.
-  if (subchunk1Size > 16)
+  // Walk the chunks, skipping the ones we don't care about, until we have the
+  // format and the data.
+  const uint8_t* fmt = nullptr;
+  size_t fmtSize = 0;
+  const uint8_t* samples = nullptr;
+  size_t dataSize = 0;
+  size_t position = 12;
+  while (position + 8 <= size && (fmt == nullptr || samples == nullptr))
   {
-    const int extraBytes = subchunk1Size - 16;
-    const int skipChars = extraBytes / 4;
-    wavFile.ignore(skipChars);
-    const int remainder = extraBytes % 4;
-    wavFile.read(reinterpret_cast<char*>(&byteRate), remainder);
+    const uint8_t* chunk = data + position;
+    const size_t chunkSize = _ReadUInt32(chunk + 4);
+    const size_t available = size - position - 8;
+    if (std::memcmp(chunk, "fmt ", 4) == 0)
+    {
+      fmt = chunk + 8;
+      fmtSize = std::min(chunkSize, available);
+    }
+    else if (std::memcmp(chunk, "data", 4) == 0)
+    {
+      samples = chunk + 8;
+      // Files that were never finished (or are streamed) can claim more data
+      // than there is.
+      dataSize = std::min(chunkSize, available);
+    }
+    // Chunks are padded to an even length.
+    position += 8 + chunkSize + (chunkSize % 2);
   }
 
-  // Read the data chunk
-  char subchunk2Id[4];
-  if (!ReadChunkAndSkipJunk(wavFile, subchunk2Id))
+  if (fmt == nullptr)
   {
-    std::cerr << "Error while reading for next chunk." << std::endl;
+    std::cerr << "Error: Invalid WAV file missing expected fmt section." << std::endl;
+    return dsp::wav::LoadReturnCode::ERROR_MISSING_FMT;
+  }
+  if (fmtSize < 16)
+  {
+    std::cerr << "WAV fmt chunk size is " << fmtSize
+              << ", which is smaller than the required 16 to fit the expected information." << std::endl;
     return dsp::wav::LoadReturnCode::ERROR_INVALID_FILE;
   }
-  if (strncmp(subchunk2Id, "data", 4) != 0)
+  if (samples == nullptr)
   {
-    std::cerr << "Error: Invalid WAV file" << std::endl;
+    std::cerr << "Error: Invalid WAV file missing data section." << std::endl;
     return dsp::wav::LoadReturnCode::ERROR_INVALID_FILE;
   }
 
-  // Size of the data chunk, in bits.
-  int subchunk2Size;
-  wavFile.read(reinterpret_cast<char*>(&subchunk2Size), 4);
-
-  if (audioFormat == AUDIO_FORMAT_IEEE)
+  uint16_t audioFormat = _ReadUInt16(fmt);
+  const uint16_t numChannels = _ReadUInt16(fmt + 2);
+  const uint32_t sampleRate = _ReadUInt32(fmt + 4);
+  const uint16_t bitsPerSample = _ReadUInt16(fmt + 14);
+  if (audioFormat == _AUDIO_FORMAT_EXTENSIBLE)
   {
-    if (bitsPerSample == 32)
-      dsp::wav::_LoadSamples32(wavFile, subchunk2Size, audio);
-    else
+    // The actual format is the first two bytes of the sub-format GUID.
+    if (fmtSize < 40)
     {
-      std::cerr << "Error: Unsupported bits per sample for IEEE files: " << bitsPerSample << std::endl;
-      return dsp::wav::LoadReturnCode::ERROR_UNSUPPORTED_BITS_PER_SAMPLE;
+      std::cerr << "Error: WAV fmt chunk is too small for the extensible format." << std::endl;
+      return dsp::wav::LoadReturnCode::ERROR_INVALID_FILE;
     }
+    audioFormat = _ReadUInt16(fmt + 24);
+    if (audioFormat != _AUDIO_FORMAT_PCM && audioFormat != _AUDIO_FORMAT_IEEE)
+    {
+      std::cerr << "Error: Unsupported WAV format detected. (Got: Extensible with sub-format " << audioFormat << ")"
+                << std::endl;
+      return dsp::wav::LoadReturnCode::ERROR_UNSUPPORTED_FORMAT_EXTENSIBLE;
+    }
+  }
+
+  if (audioFormat == _AUDIO_FORMAT_PCM && bitsPerSample == 16)
+    this->mSampleFormat = SampleFormat::PCM16;
+  else if (audioFormat == _AUDIO_FORMAT_PCM && bitsPerSample == 24)
+    this->mSampleFormat = SampleFormat::PCM24;
+  else if (audioFormat == _AUDIO_FORMAT_PCM && bitsPerSample == 32)
+    this->mSampleFormat = SampleFormat::PCM32;
+  else if (audioFormat == _AUDIO_FORMAT_IEEE && bitsPerSample == 32)
+    this->mSampleFormat = SampleFormat::FLOAT32;
+  else if (audioFormat == _AUDIO_FORMAT_PCM || audioFormat == _AUDIO_FORMAT_IEEE)
+  {
+    std::cerr << "Error: Unsupported bits per sample: " << bitsPerSample << std::endl;
+    return dsp::wav::LoadReturnCode::ERROR_UNSUPPORTED_BITS_PER_SAMPLE;
   }
-  else if (audioFormat == AUDIO_FORMAT_PCM)
+  else
   {
-    if (bitsPerSample == 16)
-      dsp::wav::_LoadSamples16(wavFile, subchunk2Size, audio);
-    else if (bitsPerSample == 24)
-      dsp::wav::_LoadSamples24(wavFile, subchunk2Size, audio);
-    else if (bitsPerSample == 32)
-      dsp::wav::_LoadSamples32(wavFile, subchunk2Size, audio);
-    else
+    std::cerr << "Error: Unsupported WAV format detected. ";
+    switch (audioFormat)
     {
-      std::cerr << "Error: Unsupported bits per sample for PCM files: " << bitsPerSample << std::endl;
-      return dsp::wav::LoadReturnCode::ERROR_UNSUPPORTED_BITS_PER_SAMPLE;
+      case _AUDIO_FORMAT_ALAW:
+        std::cerr << "(Got: A-law)" << std::endl;
+        return dsp::wav::LoadReturnCode::ERROR_UNSUPPORTED_FORMAT_ALAW;
+      case _AUDIO_FORMAT_MULAW:
+        std::cerr << "(Got: mu-law)" << std::endl;
+        return dsp::wav::LoadReturnCode::ERROR_UNSUPPORTED_FORMAT_MULAW;
+      default:
+        std::cerr << "(Got unknown format " << audioFormat << ")" << std::endl;
+        return dsp::wav::LoadReturnCode::ERROR_INVALID_FILE;
     }
   }
+  if (numChannels == 0 || sampleRate == 0)
+  {
+    std::cerr << "Error: WAV file has no channels or no sample rate." << std::endl;
+    return dsp::wav::LoadReturnCode::ERROR_INVALID_FILE;
+  }
 
-  // Close the WAV file
-  wavFile.close();
+  this->mNumChannels = numChannels;
+  this->mSampleRate = (double)sampleRate;
+  this->mSamples = samples;
+  this->mNumFrames = dataSize / (numChannels * this->_GetBytesPerSample());
+  this->mPosition = 0;
+  return dsp::wav::LoadReturnCode::SUCCESS;
+}
 
-  // Print the number of samples
-  // std::cout << "Number of samples: " << samples.size() << std::endl;
+size_t dsp::wav::Reader::_GetBytesPerSample() const
+{
+  return ::_GetBytesPerSample(this->mSampleFormat);
+}
 
-  return dsp::wav::LoadReturnCode::SUCCESS;
+size_t dsp::wav::Reader::Read(float** outputs, const size_t numFrames)
+{
+  const size_t numChannels = this->mNumChannels;
+  const size_t bytesPerFrame = numChannels * this->_GetBytesPerSample();
+  const size_t numRead = std::min(numFrames, this->mNumFrames - this->mPosition);
+  const uint8_t* bytes = this->mSamples + this->mPosition * bytesPerFrame;
+
+  if (numChannels == 1)
+    // Nothing to split up
+    _Decode(bytes, this->mSampleFormat, numRead, outputs[0]);
+  else
+  {
+    if (this->mScratch.size() < _DECODE_FRAMES * numChannels)
+      this->mScratch.resize(_DECODE_FRAMES * numChannels);
+    float* scratch = this->mScratch.data();
+    for (size_t start = 0; start < numRead; start += _DECODE_FRAMES)
+    {
+      const size_t n = std::min(_DECODE_FRAMES, numRead - start);
+      _Decode(bytes + start * bytesPerFrame, this->mSampleFormat, n * numChannels, scratch);
+      for (size_t c = 0; c < numChannels; c++)
+      {
+        float* output = outputs[c] + start;
+        for (size_t i = 0; i < n; i++)
+          output[i] = scratch[i * numChannels + c];
+      }
+    }
+  }
+  // Pad out the block past the end of the file.
+  for (size_t c = 0; c < numChannels; c++)
+    std::fill(outputs[c] + numRead, outputs[c] + numFrames, 0.0f);
+
+  this->mPosition += numRead;
+  return numRead;
 }
 
-void dsp::wav::_LoadSamples16(std::ifstream& wavFile, const int chunkSize, std::vector<float>& samples)
+void dsp::wav::Reader::Seek(const size_t frame)
 {
-  // Allocate an array to hold the samples
-  std::vector<short> tmp(chunkSize / 2); // 16 bits (2 bytes) per sample
+  this->mPosition = std::min(frame, this->mNumFrames);
+}
 
-  // Read the samples from the file into the array
-  wavFile.read(reinterpret_cast<char*>(tmp.data()), chunkSize);
+// Writer =====================================================================
+
+void _WriteLittleEndian(std::ofstream& file, const uint32_t value, const int numBytes)
+{
+  uint8_t bytes[4];
+  for (int i = 0; i < numBytes; i++)
+    bytes[i] = (uint8_t)((value >> (8 * i)) & 0xff);
+  file.write(reinterpret_cast<const char*>(bytes), numBytes);
+}
 
-  // Copy into the return array
-  const float scale = 1.0 / ((double)(1 << 15));
-  samples.resize(tmp.size());
-  for (auto i = 0; i < samples.size(); i++)
-    samples[i] = scale * ((float)tmp[i]); // 2^16
+dsp::wav::Writer::Writer()
+: mNumChannels(0)
+, mSampleRate(0.0)
+, mSampleFormat(SampleFormat::FLOAT32)
+, mNumFrames(0)
+{
 }
 
-void dsp::wav::_LoadSamples24(std::ifstream& wavFile, const int chunkSize, std::vector<float>& samples)
+dsp::wav::Writer::~Writer()
 {
-  // Allocate an array to hold the samples
-  std::vector<int> tmp(chunkSize / 3); // 24 bits (3 bytes) per sample
-  // Read in and convert the samples
-  for (int& x : tmp)
+  // Nothing can be done about a failed write from here, and throwing would
+  // terminate.
+  try
+  {
+    this->Close();
+  }
+  catch (const std::exception&)
   {
-    x = dsp::wav::_ReadSigned24BitInt(wavFile);
   }
-
-  // Copy into the return array
-  const float scale = 1.0 / ((double)(1 << 23));
-  samples.resize(tmp.size());
-  for (auto i = 0; i < samples.size(); i++)
-    samples[i] = scale * ((float)tmp[i]);
 }
 
-int dsp::wav::_ReadSigned24BitInt(std::ifstream& stream)
+void dsp::wav::Writer::Open(const char* fileName, const int numChannels, const double sampleRate,
+                            const SampleFormat format)
 {
-  // Read the three bytes of the 24-bit integer.
-  std::uint8_t bytes[3];
-  stream.read(reinterpret_cast<char*>(bytes), 3);
+  this->Close();
+  if (numChannels < 1 || numChannels > 65535 || sampleRate <= 0.0)
+  {
+    std::stringstream ss;
+    ss << "Can't write a WAV file with " << numChannels << " channels at " << sampleRate << " Hz";
+    throw std::runtime_error(ss.str());
+  }
+  this->mFile.open(fileName, std::ios::binary | std::ios::trunc);
+  if (!this->mFile.is_open())
+  {
+    std::stringstream ss;
+    ss << "Failed to open " << fileName << " for writing";
+    throw std::runtime_error(ss.str());
+  }
+  this->mNumChannels = numChannels;
+  this->mSampleRate = sampleRate;
+  this->mSampleFormat = format;
+  this->mNumFrames = 0;
+  // Placeholder sizes until Close()
+  this->_WriteHeader();
+}
 
-  // Combine the three bytes into a single integer using bit shifting and
-  // masking. This works by isolating each byte using a bit mask (0xff) and then
-  // shifting the byte to the correct position in the final integer.
-  int value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+void dsp::wav::Writer::Write(const float* const* inputs, const size_t numFrames)
+{
+  if (!this->IsOpen())
+    throw std::runtime_error("WAV writer isn't open");
+  const size_t numChannels = this->mNumChannels;
+  const size_t bytesPerSample = this->_GetBytesPerSample();
+  // The sizes in the header are 32-bit.
+  if ((this->mNumFrames + numFrames) * numChannels * bytesPerSample > 0xffffffffull - 44)
+    throw std::runtime_error("WAV file would be larger than 4GB");
+
+  // Each on its own: a reopened writer can have fewer channels in a wider
+  // format.
+  if (this->mInterleaved.size() < _DECODE_FRAMES * numChannels)
+    this->mInterleaved.resize(_DECODE_FRAMES * numChannels);
+  if (this->mBytes.size() < _DECODE_FRAMES * numChannels * bytesPerSample)
+    this->mBytes.resize(_DECODE_FRAMES * numChannels * bytesPerSample);
+  for (size_t start = 0; start < numFrames; start += _DECODE_FRAMES)
+  {
+    const size_t n = std::min(_DECODE_FRAMES, numFrames - start);
+    const float* samples = inputs[0] + start;
+    if (numChannels > 1)
+    {
+      for (size_t c = 0; c < numChannels; c++)
+      {
+        const float* input = inputs[c] + start;
+        for (size_t i = 0; i < n; i++)
+          this->mInterleaved[i * numChannels + c] = input[i];
+      }
+      samples = this->mInterleaved.data();
+    }
+    _Encode(samples, this->mSampleFormat, n * numChannels, this->mBytes.data());
+    this->mFile.write(reinterpret_cast<const char*>(this->mBytes.data()), n * numChannels * bytesPerSample);
+  }
+  this->mNumFrames += numFrames;
+}
 
-  // The value is stored in two's complement format, so if the most significant
-  // bit (the 24th bit) is set, then the value is negative. In this case, we
-  // need to extend the sign bit to get the correct negative value.
-  if (value & (1 << 23))
+void dsp::wav::Writer::Close()
+{
+  if (!this->IsOpen())
+    return;
+  // Pad the data chunk to an even length.
+  const size_t dataSize = this->mNumFrames * this->mNumChannels * this->_GetBytesPerSample();
+  if (dataSize % 2 == 1)
+    this->mFile.put(0);
+  this->mFile.seekp(0);
+  // Closed either way, so that the writer can be opened again
+  try
+  {
+    this->_WriteHeader();
+  }
+  catch (const std::exception&)
   {
-    value |= ~((1 << 24) - 1);
+    this->mFile.close();
+    throw;
   }
+  this->mFile.close();
+}
 
-  return value;
+void dsp::wav::Writer::_WriteHeader()
+{
+  const uint32_t bytesPerSample = (uint32_t)this->_GetBytesPerSample();
+  const uint32_t blockAlign = this->mNumChannels * bytesPerSample;
+  const uint32_t dataSize = (uint32_t)(this->mNumFrames * blockAlign);
+  const uint32_t sampleRate = (uint32_t)(this->mSampleRate + 0.5);
+  const uint16_t audioFormat = this->mSampleFormat == SampleFormat::FLOAT32 ? _AUDIO_FORMAT_IEEE : _AUDIO_FORMAT_PCM;
+
+  this->mFile.write("RIFF", 4);
+  _WriteLittleEndian(this->mFile, 36 + dataSize + (dataSize % 2), 4);
+  this->mFile.write("WAVE", 4);
+  this->mFile.write("fmt ", 4);
+  _WriteLittleEndian(this->mFile, 16, 4);
+  _WriteLittleEndian(this->mFile, audioFormat, 2);
+  _WriteLittleEndian(this->mFile, this->mNumChannels, 2);
+  _WriteLittleEndian(this->mFile, sampleRate, 4);
+  _WriteLittleEndian(this->mFile, sampleRate * blockAlign, 4);
+  _WriteLittleEndian(this->mFile, blockAlign, 2);
+  _WriteLittleEndian(this->mFile, 8 * bytesPerSample, 2);
+  this->mFile.write("data", 4);
+  _WriteLittleEndian(this->mFile, dataSize, 4);
+  if (!this->mFile.good())
+    throw std::runtime_error("Failed to write WAV file");
 }
 
-void dsp::wav::_LoadSamples32(std::ifstream& wavFile, const int chunkSize, std::vector<float>& samples)
+size_t dsp::wav::Writer::_GetBytesPerSample() const
 {
-  // NOTE: 32-bit is float.
-  samples.resize(chunkSize / 4); // 32 bits (4 bytes) per sample
-  // Read the samples from the file into the array
-  wavFile.read(reinterpret_cast<char*>(samples.data()), chunkSize);
+  return ::_GetBytesPerSample(this->mSampleFormat);
 }
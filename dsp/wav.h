@@ -7,10 +7,11 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <string>
 #include <vector>
-#include <cstdint>
 
 namespace dsp
 {
@@ -32,23 +33,127 @@ enum class LoadReturnCode
   ERROR_OTHER
 };
 
+// How the samples are stored in the file
+enum class SampleFormat
+{
+  PCM16 = 0,
+  PCM24,
+  PCM32,
+  FLOAT32
+};
+
 // Get a string describing the error
 std::string GetMsgForLoadReturnCode(LoadReturnCode rc);
 
-// Load a WAV file into a provided array of doubles,
+// Load a mono WAV file into a provided array of floats,
 // And note the sample rate.
 //
 // Returns: as per return cases above
 LoadReturnCode Load(const char* fileName, std::vector<float>& audio, double& sampleRate);
+// Load a WAV file with any number of channels.
+// audio is indexed [channel][frame].
+LoadReturnCode Load(const char* fileName, std::vector<std::vector<float>>& audio, double& sampleRate);
+
+// Write audio (indexed [channel][frame]) to a WAV file.
+// Throws std::runtime_error if it fails.
+void Save(const char* fileName, const std::vector<std::vector<float>>& audio, const double sampleRate,
+          const SampleFormat format = SampleFormat::FLOAT32);
+
+// Streams audio out of a WAV file, a block at a time.
+//
+// The file is memory-mapped rather than read in, so opening it is cheap no
+// matter how long it is, and only the parts that are read get paged in.
+// Samples are decoded to float in bulk (in loops that vectorize) and then
+// split up by channel.
+//
+// Understands 16-, 24-, and 32-bit PCM and 32-bit float, including
+// WAVE_FORMAT_EXTENSIBLE files with those sub-formats.
+class Reader
+{
+public:
+  Reader();
+  ~Reader();
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  LoadReturnCode Open(const char* fileName);
+  void Close();
+  bool IsOpen() const { return this->mData != nullptr; };
 
-// Load samples, 16-bit
-void _LoadSamples16(std::ifstream& wavFile, const int chunkSize, std::vector<float>& samples);
-// Load samples, 24-bit
-void _LoadSamples24(std::ifstream& wavFile, const int chunkSize, std::vector<float>& samples);
-// Load samples, 32-bit
-void _LoadSamples32(std::ifstream& wavFile, const int chunkSize, std::vector<float>& samples);
+  // Read the next (up to) numFrames frames into outputs[channel][frame].
+  // If the end of the file comes first, the rest of the block is filled with
+  // zeroes, so blocks are always full.
+  // Returns the number of frames that came from the file.
+  size_t Read(float** outputs, const size_t numFrames);
+  // Move to the provided frame.
+  void Seek(const size_t frame);
 
-// Read in a 24-bit sample and convert it to an int
-int _ReadSigned24BitInt(std::ifstream& stream);
+  int GetNumChannels() const { return this->mNumChannels; };
+  double GetSampleRate() const { return this->mSampleRate; };
+  SampleFormat GetSampleFormat() const { return this->mSampleFormat; };
+  size_t GetNumFrames() const { return this->mNumFrames; };
+  // The frame that the next Read() starts at
+  size_t GetPosition() const { return this->mPosition; };
+
+private:
+  // Find the fmt and data chunks in the mapped file.
+  LoadReturnCode _ParseHeader();
+  // Size in bytes of one sample of one channel
+  size_t _GetBytesPerSample() const;
+
+  // The mapped file
+  const uint8_t* mData;
+  size_t mSize;
+#ifdef _WIN32
+  void* mFileHandle;
+  void* mMappingHandle;
+#else
+  int mFileDescriptor;
+#endif
+
+  // Where the samples start
+  const uint8_t* mSamples;
+  int mNumChannels;
+  double mSampleRate;
+  SampleFormat mSampleFormat;
+  size_t mNumFrames;
+  size_t mPosition;
+  // Interleaved, decoded samples waiting to be split up by channel
+  std::vector<float> mScratch;
+};
+
+// Streams audio into a WAV file, a block at a time.
+// The header is filled in by Close() (or the destructor), once the length is
+// known.
+class Writer
+{
+public:
+  Writer();
+  ~Writer();
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  // Throws std::runtime_error if the file can't be opened.
+  void Open(const char* fileName, const int numChannels, const double sampleRate,
+            const SampleFormat format = SampleFormat::FLOAT32);
+  // Append numFrames frames from inputs[channel][frame].
+  // PCM formats clip to [-1, 1].
+  void Write(const float* const* inputs, const size_t numFrames);
+  void Close();
+  bool IsOpen() const { return this->mFile.is_open(); };
+
+private:
+  void _WriteHeader();
+  size_t _GetBytesPerSample() const;
+
+  std::ofstream mFile;
+  int mNumChannels;
+  double mSampleRate;
+  SampleFormat mSampleFormat;
+  size_t mNumFrames;
+  // Interleaved samples, and then their encoded bytes
+  std::vector<float> mInterleaved;
+  std::vector<uint8_t> mBytes;
+};
 }; // namespace wav
 }; // namespace dsp
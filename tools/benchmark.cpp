@@ -0,0 +1,1147 @@
+// Performance benchmarks for the core library.
+//
+// Usage:
+// $ nam_benchmark resample [model.nam]
+// $ nam_benchmark oversample [model.nam]
+// $ nam_benchmark biquad
+// $ nam_benchmark gate
+// $ nam_benchmark chain [model.nam]
+// $ nam_benchmark async model.nam [block size]
+// $ nam_benchmark threads model.nam [block size]
+// $ nam_benchmark render model.nam
+// $ nam_benchmark bypass model.nam
+// $ nam_benchmark prewarm model.nam
+// $ nam_benchmark state model.nam
+// $ nam_benchmark precision model.nam
+// $ nam_benchmark reblock model.nam [block size]
+// $ nam_benchmark small wavenet.nam
+// $ nam_benchmark activations [model.nam]
+// $ nam_benchmark arena model.nam
+// $ nam_benchmark fold model.nam [block size]
+//
+// Times are reported in nanoseconds per (host-rate) sample, single-threaded,
+// except for async, which reports how long the host's callbacks take.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h> // mallinfo2()
+#endif
+
+#include "activations.h"
+#include "async.h"
+#include "bypass.h"
+#include "chain.h"
+#include "ImpulseResponse.h"
+#include "namdsp.h"
+#include "NoiseGate.h"
+#include "Oversampler.h"
+#include "RecursiveLinearFilter.h"
+#include "oversampling.h"
+#include "reblocking.h"
+#include "render.h"
+#include "Resampler.h"
+#include "resampling.h"
+#include "thread_pool.h"
+#include "wav.h"
+#include "wavenet.h"
+
+// How much audio each measurement runs over
+constexpr double _BENCHMARK_SECONDS = 10.0;
+
+// A reproducible test signal
+std::vector<float> _get_noise(const size_t num_frames)
+{
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+  std::vector<float> signal(num_frames);
+  for (auto& x : signal)
+    x = distribution(generator);
+  return signal;
+}
+
+// Run process_block over num_frames in blocks of block_size and return the
+// average time per sample, in ns.
+double _time_per_sample(const size_t num_frames, const int block_size,
+                        const std::function<void(const size_t start, const int n)>& process_block)
+{
+  const auto t_start = std::chrono::steady_clock::now();
+  for (size_t start = 0; start < num_frames; start += block_size)
+    process_block(start, (int)std::min((size_t)block_size, num_frames - start));
+  const auto t_end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t_end - t_start).count() / num_frames;
+}
+
+int _benchmark_resample(int argc, char* argv[])
+{
+  const int block_size = 64;
+  const double conversions[][2] = {{44100.0, 48000.0}, {48000.0, 44100.0}, {48000.0, 96000.0}, {96000.0, 48000.0}};
+
+  std::cout << "Resampler (block size " << block_size << ")" << std::endl;
+  for (const auto& conversion : conversions)
+  {
+    const double input_rate = conversion[0];
+    const double output_rate = conversion[1];
+    const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * input_rate);
+    const std::vector<float> input = _get_noise(num_frames);
+    dsp::Resampler<float> resampler;
+    resampler.Reset(input_rate, output_rate, block_size);
+    std::vector<float> output(resampler.GetMaxOutputFrames(block_size));
+    const double ns = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      resampler.Process(input.data() + start, n, output.data());
+    });
+    std::cout << "  " << (int)input_rate << " -> " << (int)output_rate << ": " << std::setprecision(3) << ns
+              << " ns/sample, " << resampler.GetNumTaps() << " taps, latency "
+              << resampler.GetLatencySeconds() * input_rate << " samples" << std::endl;
+  }
+
+  if (argc < 1)
+    return 0;
+
+  // Whole model, run at its own rate from a host at the "other" common rate
+  auto model = get_dsp<float>(argv[0]);
+  const double model_rate = model->GetExpectedSampleRate();
+  if (model_rate <= 0.0)
+  {
+    std::cerr << "Model doesn't specify its sample rate." << std::endl;
+    return 1;
+  }
+  const double host_rate = model_rate == 44100.0 ? 48000.0 : 44100.0;
+  const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * host_rate);
+  const std::vector<float> input = _get_noise(num_frames);
+  std::vector<float> output(block_size);
+
+  auto time_model = [&](DSP<float>& dsp) {
+    return _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      float* in = const_cast<float*>(input.data()) + start;
+      float* out = output.data();
+      dsp.process(&in, &out, 1, n, 1.0f, 1.0f);
+      dsp.finalize_(n);
+    });
+  };
+  const double ns_direct = time_model(*model);
+  ResamplingDSP<float> resampled(std::move(model), host_rate, block_size);
+  const double ns_resampled = time_model(resampled);
+  std::cout << "Model at " << (int)model_rate << " from a host at " << (int)host_rate << std::endl;
+  std::cout << "  Direct:    " << ns_direct << " ns/sample" << std::endl;
+  std::cout << "  Resampled: " << ns_resampled << " ns/sample, latency " << resampled.GetLatency() << " samples"
+            << std::endl;
+  return 0;
+}
+
+int _benchmark_oversample(int argc, char* argv[])
+{
+  const int block_size = 64;
+  const double sample_rate = 48000.0;
+  const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * sample_rate);
+  const std::vector<float> input = _get_noise(4 * num_frames);
+  std::vector<float> output(4 * block_size);
+
+  // Each half-band stage on its own. Times are per sample at the base rate.
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Half-band stages (block size " << block_size << ", per base-rate sample)" << std::endl;
+  const int num_coefficients[] = {4, 8, 12};
+  for (const int n_coef : num_coefficients)
+  {
+    dsp::oversampling::HalfBandUpsampler<float> up;
+    dsp::oversampling::HalfBandDownsampler<float> down;
+    up.Reset(n_coef, 2 * block_size);
+    down.Reset(n_coef, 2 * block_size);
+    const double ns_up = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      up.Process(input.data() + start, n, output.data());
+    });
+    const double ns_down = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      down.Process(input.data() + 2 * start, n, output.data());
+    });
+    std::cout << "  " << 4 * n_coef - 1 << " taps: up " << ns_up << " ns, down " << ns_down
+              << " ns, round-trip latency " << up.GetLatency() + down.GetLatency() << " samples" << std::endl;
+  }
+
+  const int factors[] = {2, 4};
+  std::cout << "Oversampler round trip (no model)" << std::endl;
+  for (const int factor : factors)
+  {
+    dsp::oversampling::Oversampler<float> oversampler;
+    oversampler.Reset(factor, block_size);
+    const double ns = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      float* up = oversampler.Upsample(input.data() + start, n);
+      oversampler.Downsample(up, n, output.data());
+    });
+    std::cout << "  " << factor << "x: " << ns << " ns/sample, latency " << oversampler.GetLatency() << " samples"
+              << std::endl;
+  }
+
+  if (argc < 1)
+    return 0;
+
+  auto time_model = [&](DSP<float>& dsp) {
+    return _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      float* in = const_cast<float*>(input.data()) + start;
+      float* out = output.data();
+      dsp.process(&in, &out, 1, n, 1.0f, 1.0f);
+      dsp.finalize_(n);
+    });
+  };
+  std::cout << "Model" << std::endl;
+  std::cout << "  1x: " << time_model(*get_dsp<float>(argv[0])) << " ns/sample" << std::endl;
+  for (const int factor : factors)
+  {
+    OversampledDSP<float> oversampled(get_dsp<float>(argv[0]), factor, block_size);
+    std::cout << "  " << factor << "x: " << time_model(oversampled) << " ns/sample";
+    // The same model, with its time scales stretched to run at the higher rate
+    try
+    {
+      auto stretched = get_oversampled_dsp<float>(argv[0], factor, block_size);
+      std::cout << ", stretched " << time_model(*stretched) << " ns/sample";
+    }
+    catch (std::exception& e)
+    {
+      std::cout << " (" << e.what() << ")";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
+
+// A tone stack: low shelf, mid peak, high shelf
+int _benchmark_biquad(int argc, char* argv[])
+{
+  const int block_size = 64;
+  const double sample_rate = 48000.0;
+  const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * sample_rate);
+  const std::vector<float> input = _get_noise(num_frames);
+  const recursive_linear_filter::BiquadParams<float> bass(sample_rate, 150.0, 0.707, 3.0);
+  const recursive_linear_filter::BiquadParams<float> mid(sample_rate, 425.0, 0.707, -2.0);
+  const recursive_linear_filter::BiquadParams<float> treble(sample_rate, 1800.0, 0.707, 4.0);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Tone stack (block size " << block_size << ", per frame)" << std::endl;
+  for (const size_t num_channels : {1, 2})
+  {
+    std::vector<float*> inputs(num_channels);
+
+    recursive_linear_filter::LowShelf<float> low_shelf;
+    recursive_linear_filter::Peaking<float> peaking;
+    recursive_linear_filter::HighShelf<float> high_shelf;
+    low_shelf.SetParams(bass);
+    peaking.SetParams(mid);
+    high_shelf.SetParams(treble);
+    const double ns_separate = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      for (auto& in : inputs)
+        in = const_cast<float*>(input.data()) + start;
+      high_shelf.Process(peaking.Process(low_shelf.Process(inputs.data(), num_channels, n), num_channels, n),
+                         num_channels, n);
+    });
+
+    recursive_linear_filter::BiquadCascade<float> cascade(3);
+    cascade.SetCoefficients(0, recursive_linear_filter::LowShelf<float>::GetCoefficients(bass));
+    cascade.SetCoefficients(1, recursive_linear_filter::Peaking<float>::GetCoefficients(mid));
+    cascade.SetCoefficients(2, recursive_linear_filter::HighShelf<float>::GetCoefficients(treble));
+    const double ns_cascade = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      for (auto& in : inputs)
+        in = const_cast<float*>(input.data()) + start;
+      cascade.Process(inputs.data(), num_channels, n);
+    });
+
+    // The same, with the bass knob being swept, updated every block
+    recursive_linear_filter::SmoothedBiquadCascade<float> smoothed(
+      {&recursive_linear_filter::LowShelf<float>::GetCoefficients, &recursive_linear_filter::Peaking<float>::GetCoefficients,
+       &recursive_linear_filter::HighShelf<float>::GetCoefficients});
+    smoothed.SetParams(1, mid);
+    smoothed.SetParams(2, treble);
+    const double ns_automated = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      for (auto& in : inputs)
+        in = const_cast<float*>(input.data()) + start;
+      const float sweep = (float)std::sin(2.0 * 3.14159265358979 * 0.5 * start / sample_rate);
+      smoothed.SetParams(0, recursive_linear_filter::BiquadParams<float>(sample_rate, 150.0, 0.707, 6.0f * sweep));
+      smoothed.Process(inputs.data(), num_channels, n);
+    });
+    std::cout << "  " << num_channels << " channel(s): separate filters " << ns_separate << " ns, cascade "
+              << ns_cascade << " ns, automated " << ns_automated << " ns" << std::endl;
+  }
+  return 0;
+}
+
+// Noise gate on a signal that alternates between playing and (noisy) silence
+int _benchmark_gate(int argc, char* argv[])
+{
+  const int block_size = 64;
+  const double sample_rate = 48000.0;
+  const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * sample_rate);
+  std::vector<float> input = _get_noise(num_frames);
+  const size_t phrase = (size_t)(0.25 * sample_rate);
+  for (size_t i = 0; i < num_frames; i++)
+    if ((i / phrase) % 2 == 1)
+      input[i] *= 0.001f;
+  const dsp::noise_gate::TriggerParams<float> params(0.01, -80.0, 0.1, 0.005, 0.01, 0.05);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Noise gate (block size " << block_size << ", per frame)" << std::endl;
+  for (const size_t num_channels : {1, 2})
+  {
+    std::vector<float*> inputs(num_channels);
+
+    dsp::noise_gate::Trigger<float> trigger;
+    dsp::noise_gate::Gain<float> gain;
+    trigger.AddListener(&gain);
+    trigger.SetParams(params);
+    trigger.SetSampleRate(sample_rate);
+    const double ns_separate = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      for (auto& in : inputs)
+        in = input.data() + start;
+      gain.Process(trigger.Process(inputs.data(), num_channels, n), num_channels, n);
+    });
+
+    dsp::noise_gate::Gate<float> gate;
+    gate.SetParams(params);
+    gate.SetSampleRate(sample_rate);
+    const double ns_fused = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      for (auto& in : inputs)
+        in = input.data() + start;
+      gate.Process(inputs.data(), num_channels, n);
+    });
+    std::cout << "  " << num_channels << " channel(s): trigger + gain " << ns_separate << " ns, gate " << ns_fused
+              << " ns" << std::endl;
+  }
+  return 0;
+}
+
+// Gate trigger -> [model] -> tone stack -> IR -> gate gain, as a plugin would
+// run it, one stage's output to the next, vs. through a Chain.
+int _benchmark_chain(int argc, char* argv[])
+{
+  const int block_size = 64;
+  const int num_channels = 2;
+  const double sample_rate = 48000.0;
+  const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * sample_rate);
+  const std::vector<float> noise = _get_noise(num_frames);
+  const std::vector<double> input(noise.begin(), noise.end());
+  std::vector<std::vector<double>> output(num_channels, std::vector<double>(block_size));
+
+  // A made-up 100 ms cabinet IR
+  const std::filesystem::path ir_path = std::filesystem::temp_directory_path() / "nam_benchmark_ir.wav";
+  {
+    std::vector<std::vector<float>> ir(1, std::vector<float>((size_t)(0.1 * sample_rate)));
+    for (size_t i = 0; i < ir[0].size(); i++)
+      ir[0][i] = noise[i] * (float)std::exp(-50.0 * i / sample_rate);
+    dsp::wav::Save(ir_path.string().c_str(), ir, sample_rate);
+  }
+  const recursive_linear_filter::BiquadParams<double> bass(sample_rate, 150.0, 0.707, 3.0);
+  const recursive_linear_filter::BiquadParams<double> mid(sample_rate, 425.0, 0.707, -2.0);
+  const recursive_linear_filter::BiquadParams<double> treble(sample_rate, 1800.0, 0.707, 4.0);
+  const dsp::noise_gate::TriggerParams<double> gate_params(0.01, -80.0, 0.1, 0.005, 0.01, 0.05);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Gate -> " << (argc >= 1 ? "model -> " : "") << "tone stack -> IR -> gate (" << num_channels
+            << " channels, block size " << block_size << ", per frame)" << std::endl;
+
+  // Each stage hands its own output buffer to the next (double throughout).
+  double ns_separate = 0.0;
+  {
+    dsp::noise_gate::Trigger<double> trigger;
+    dsp::noise_gate::Gain<double> gain;
+    trigger.AddListener(&gain);
+    trigger.SetParams(gate_params);
+    trigger.SetSampleRate(sample_rate);
+    std::unique_ptr<DSP<double>> model = argc >= 1 ? get_dsp<double>(argv[0]) : nullptr;
+    std::vector<std::vector<double>> model_output(num_channels, std::vector<double>(block_size));
+    std::vector<double*> model_pointers = {model_output[0].data(), model_output[1].data()};
+    recursive_linear_filter::BiquadCascade<double> tone_stack(3);
+    tone_stack.SetCoefficients(0, recursive_linear_filter::LowShelf<double>::GetCoefficients(bass));
+    tone_stack.SetCoefficients(1, recursive_linear_filter::Peaking<double>::GetCoefficients(mid));
+    tone_stack.SetCoefficients(2, recursive_linear_filter::HighShelf<double>::GetCoefficients(treble));
+    dsp::ImpulseResponse<double> ir(ir_path.string().c_str(), sample_rate);
+    std::vector<double*> inputs(num_channels);
+    ns_separate = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      for (auto& in : inputs)
+        in = const_cast<double*>(input.data()) + start;
+      double** x = trigger.Process(inputs.data(), num_channels, n);
+      if (model != nullptr)
+      {
+        model->process(x, model_pointers.data(), num_channels, n, 1.0, 1.0);
+        model->finalize_(n);
+        x = model_pointers.data();
+      }
+      x = gain.Process(ir.Process(tone_stack.Process(x, num_channels, n), num_channels, n), num_channels, n);
+      for (int c = 0; c < num_channels; c++)
+        std::copy(x[c], x[c] + n, output[c].begin());
+    });
+  }
+
+  // The same stages (float) in a Chain
+  double ns_chain = 0.0;
+  {
+    dsp::noise_gate::Trigger<float> trigger;
+    dsp::noise_gate::Gain<float> gain;
+    trigger.AddListener(&gain);
+    trigger.SetParams(dsp::noise_gate::TriggerParams<float>(0.01, -80.0, 0.1, 0.005, 0.01, 0.05));
+    trigger.SetSampleRate(sample_rate);
+    std::unique_ptr<DSP<float>> model = argc >= 1 ? get_dsp<float>(argv[0]) : nullptr;
+    recursive_linear_filter::BiquadCascade<float> tone_stack(3);
+    tone_stack.SetCoefficients(0, recursive_linear_filter::LowShelf<float>::GetCoefficients(
+                                    recursive_linear_filter::BiquadParams<float>(sample_rate, 150.0, 0.707, 3.0)));
+    tone_stack.SetCoefficients(1, recursive_linear_filter::Peaking<float>::GetCoefficients(
+                                    recursive_linear_filter::BiquadParams<float>(sample_rate, 425.0, 0.707, -2.0)));
+    tone_stack.SetCoefficients(2, recursive_linear_filter::HighShelf<float>::GetCoefficients(
+                                    recursive_linear_filter::BiquadParams<float>(sample_rate, 1800.0, 0.707, 4.0)));
+    dsp::ImpulseResponse<float> ir(ir_path.string().c_str(), (float)sample_rate);
+    Chain<double> chain(num_channels, block_size);
+    chain.add(&trigger);
+    if (model != nullptr)
+      chain.add(model.get());
+    chain.add(&tone_stack);
+    chain.add(&ir);
+    chain.add(&gain);
+    std::vector<double*> inputs(num_channels);
+    std::vector<double*> outputs = {output[0].data(), output[1].data()};
+    ns_chain = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      for (auto& in : inputs)
+        in = const_cast<double*>(input.data()) + start;
+      chain.process(inputs.data(), outputs.data(), n);
+    });
+  }
+  std::filesystem::remove(ir_path);
+
+  std::cout << "  Stage by stage: " << ns_separate << " ns, chain: " << ns_chain << " ns" << std::endl;
+  return 0;
+}
+
+// A model run directly vs. on a worker thread (AsyncDSP), in real time, as a
+// host with small buffers would. What matters is the worst callbacks, not
+// the average.
+int _benchmark_async(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The async benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const int block_size = argc >= 2 ? std::atoi(argv[1]) : 32;
+  const double seconds = 5.0;
+
+  auto time_callbacks = [&](DSP<float>& dsp, const double sample_rate) {
+    const size_t num_blocks = (size_t)(seconds * sample_rate / block_size);
+    const std::vector<float> input = _get_noise(num_blocks * block_size);
+    std::vector<float> output(block_size);
+    std::vector<double> durations;
+    durations.reserve(num_blocks);
+    const auto period = std::chrono::duration<double>(block_size / sample_rate);
+    auto deadline = std::chrono::steady_clock::now();
+    for (size_t b = 0; b < num_blocks; b++)
+    {
+      // The host's next callback comes at the start of the next period.
+      std::this_thread::sleep_until(deadline);
+      deadline += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+      const auto t_start = std::chrono::steady_clock::now();
+      float* in = const_cast<float*>(input.data()) + b * block_size;
+      float* out = output.data();
+      dsp.process(&in, &out, 1, block_size, 1.0f, 1.0f);
+      dsp.finalize_(block_size);
+      durations.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t_start).count());
+    }
+    std::sort(durations.begin(), durations.end());
+    double total = 0.0;
+    for (const double d : durations)
+      total += d;
+    const double period_us = 1.0e6 * period.count();
+    const size_t misses = durations.end() - std::upper_bound(durations.begin(), durations.end(), period_us);
+    std::cout << "mean " << total / durations.size() << ", p99 " << durations[(size_t)(0.99 * (durations.size() - 1))]
+              << ", max " << durations.back() << " us; " << misses << " of " << durations.size()
+              << " callbacks over the " << period_us << " us period";
+  };
+
+  std::cout << std::fixed << std::setprecision(2);
+  auto model = get_dsp<float>(argv[0]);
+  const double sample_rate = model->GetExpectedSampleRate() > 0.0 ? model->GetExpectedSampleRate() : 48000.0;
+  std::cout << "Callbacks of " << block_size << " frames at " << (int)sample_rate << " Hz" << std::endl;
+  std::cout << "  Direct: ";
+  time_callbacks(*model, sample_rate);
+  std::cout << std::endl;
+
+  AsyncDSP<float> async_model(std::move(model), block_size);
+  std::cout << "  Async:  ";
+  time_callbacks(async_model, sample_rate);
+  std::cout << std::endl
+            << "          latency " << async_model.GetLatency() << " samples, "
+            << async_model.get_num_dropped_frames() << " frames dropped, worker "
+            << (async_model.is_realtime() ? "" : "not ") << "realtime" << std::endl;
+  return 0;
+}
+
+// A model with its work split across 1 to 8 threads (the first being the
+// caller's), with the default thresholds. The output should be the same no
+// matter how many threads.
+int _benchmark_threads(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The threads benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const int block_size = argc >= 2 ? std::atoi(argv[1]) : 64;
+  const size_t num_frames = (size_t)(0.2 * _BENCHMARK_SECONDS * 48000.0);
+  const std::vector<float> input = _get_noise(num_frames);
+  std::vector<float> reference(num_frames);
+  std::vector<float> output(num_frames);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Block size " << block_size << ", " << std::thread::hardware_concurrency() << " cores" << std::endl;
+  double ns_serial = 0.0;
+  for (int num_threads = 1; num_threads <= 8; num_threads *= 2)
+  {
+    auto model = get_dsp<float>(argv[0]);
+    std::unique_ptr<ThreadPool> pool(num_threads > 1 ? new ThreadPool(num_threads - 1) : nullptr);
+    model->set_thread_pool(pool.get());
+    std::vector<float>& y = num_threads == 1 ? reference : output;
+    const double ns = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      float* in = const_cast<float*>(input.data()) + start;
+      float* out = y.data() + start;
+      model->process(&in, &out, 1, n, 1.0f, 1.0f);
+      model->finalize_(n);
+    });
+    if (num_threads == 1)
+      ns_serial = ns;
+    double max_difference = 0.0;
+    for (size_t i = 0; i < num_frames; i++)
+      max_difference = std::max(max_difference, (double)std::fabs(y[i] - reference[i]));
+    std::cout << "  " << num_threads << " thread" << (num_threads > 1 ? "s: " : ":  ") << ns << " ns/sample ("
+              << ns_serial / ns << "x), max difference " << std::setprecision(6) << max_difference
+              << std::setprecision(2) << std::endl;
+  }
+  return 0;
+}
+
+// Rendering a file offline on 1 to 8 threads. The output should be the same
+// as rendering it in one piece.
+int _benchmark_render(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The render benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * 48000.0);
+  const std::vector<float> input = _get_noise(num_frames);
+  std::vector<float> reference(num_frames);
+  std::vector<float> output(num_frames);
+  auto model = get_dsp<float>(argv[0]);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Warm-up " << model->get_warm_up_frames() << " frames, " << std::thread::hardware_concurrency()
+            << " cores" << std::endl;
+  double ns_serial = 0.0;
+  for (int num_threads = 1; num_threads <= 8; num_threads *= 2)
+  {
+    std::vector<float>& y = num_threads == 1 ? reference : output;
+    const auto t_start = std::chrono::steady_clock::now();
+    render_offline(*model, input.data(), y.data(), (long)num_frames, num_threads);
+    const auto t_end = std::chrono::steady_clock::now();
+    const double ns = std::chrono::duration<double, std::nano>(t_end - t_start).count() / num_frames;
+    if (num_threads == 1)
+      ns_serial = ns;
+    double max_difference = 0.0;
+    for (size_t i = 0; i < num_frames; i++)
+      max_difference = std::max(max_difference, (double)std::fabs(y[i] - reference[i]));
+    std::cout << "  " << num_threads << " thread" << (num_threads > 1 ? "s: " : ":  ") << ns << " ns/sample ("
+              << ns_serial / ns << "x), max difference " << std::setprecision(6) << max_difference
+              << std::setprecision(2) << std::endl;
+  }
+  return 0;
+}
+
+// A model on a track that's playing half of the time (alternating seconds of
+// noise and digital silence), run directly vs. with silent blocks bypassed.
+// The output should be the same.
+int _benchmark_bypass(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The bypass benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const int block_size = 64;
+  const double sample_rate = 48000.0;
+  const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * sample_rate);
+  std::vector<float> input = _get_noise(num_frames);
+  for (size_t i = 0; i < num_frames; i++)
+    if ((size_t)(i / sample_rate) % 2 == 1)
+      input[i] = 0.0f;
+  std::vector<float> reference(num_frames);
+  std::vector<float> output(num_frames);
+
+  auto model = get_dsp<float>(argv[0]);
+  const double ns_direct = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+    float* in = input.data() + start;
+    float* out = reference.data() + start;
+    model->process(&in, &out, 1, n, 1.0f, 1.0f);
+    model->finalize_(n);
+  });
+  SilenceBypassDSP<float> bypassed(get_dsp<float>(argv[0]), block_size);
+  const double ns_bypassed = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+    float* in = input.data() + start;
+    float* out = output.data() + start;
+    bypassed.process(&in, &out, 1, n, 1.0f, 1.0f);
+    bypassed.finalize_(n);
+  });
+  double max_difference = 0.0;
+  for (size_t i = 0; i < num_frames; i++)
+    max_difference = std::max(max_difference, (double)std::fabs(output[i] - reference[i]));
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Half silence (block size " << block_size << "), "
+            << bypassed.get_num_bypassed_frames() * 100.0 / num_frames << "% of frames bypassed" << std::endl;
+  std::cout << "  Direct: " << ns_direct << " ns/sample, bypassed: " << ns_bypassed << " ns/sample ("
+            << ns_direct / ns_bypassed << "x), max difference " << std::setprecision(6) << max_difference << std::endl;
+  return 0;
+}
+
+// Loading with and without DSPLoadOptions::prewarm, and how long the plain
+// model takes to catch up with the prewarmed one
+int _benchmark_prewarm(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The prewarm benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const int block_size = 64;
+  const double sample_rate = 48000.0;
+  // Outputs closer than this count as the same
+  const double tolerance = 1.0e-4;
+  const size_t num_frames = (size_t)sample_rate;
+  std::vector<float> input = _get_noise(num_frames);
+
+  auto time_load = [&](const bool prewarm, std::unique_ptr<DSP<float>>& model) {
+    DSPLoadOptions options;
+    options.prewarm = prewarm;
+    const auto t_start = std::chrono::steady_clock::now();
+    model = get_dsp<float>(std::filesystem::path(argv[0]), options);
+    const auto t_end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(t_end - t_start).count();
+  };
+  auto run = [&](DSP<float>& model, std::vector<float>& output) {
+    output.resize(num_frames);
+    for (size_t start = 0; start < num_frames; start += block_size)
+    {
+      const int n = (int)std::min((size_t)block_size, num_frames - start);
+      float* in = input.data() + start;
+      float* out = output.data() + start;
+      model.process(&in, &out, 1, n, 1.0f, 1.0f);
+      model.finalize_(n);
+    }
+  };
+  std::unique_ptr<DSP<float>> plain, prewarmed;
+  const double ms_plain = time_load(false, plain);
+  const double ms_prewarmed = time_load(true, prewarmed);
+  std::vector<float> plain_output, prewarmed_output;
+  run(*plain, plain_output);
+  run(*prewarmed, prewarmed_output);
+  size_t catch_up = 0;
+  for (size_t i = 0; i < num_frames; i++)
+    if (std::fabs(plain_output[i] - prewarmed_output[i]) > tolerance)
+      catch_up = i + 1;
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Load: " << ms_plain << " ms, with prewarm: " << ms_prewarmed << " ms" << std::endl;
+  std::cout << "  Without it, the output is off (by more than " << std::defaultfloat << tolerance << std::fixed << ") for the first " << catch_up
+            << " samples (" << catch_up * 1000.0 / sample_rate << " ms at " << (int)sample_rate << " Hz)"
+            << std::endl;
+  return 0;
+}
+
+// Saving and restoring a running model's state, next to the other ways of
+// getting a model that's ready to go
+int _benchmark_state(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The state benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const int block_size = 64;
+  const int num_repeats = 100;
+  const size_t num_frames = 48000;
+  std::vector<float> input = _get_noise(num_frames);
+  std::vector<float> output(num_frames);
+  auto run = [&](DSP<float>& model, float* out) {
+    for (size_t start = 0; start < num_frames; start += block_size)
+    {
+      const int n = (int)std::min((size_t)block_size, num_frames - start);
+      float* in = input.data() + start;
+      float* o = out + start;
+      model.process(&in, &o, 1, n, 1.0f, 1.0f);
+      model.finalize_(n);
+    }
+  };
+  // Average of num_repeats, in us
+  auto time = [&](const std::function<void()>& f) {
+    const auto t_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_repeats; i++)
+      f();
+    const auto t_end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t_end - t_start).count() / num_repeats;
+  };
+
+  auto model = get_dsp<float>(argv[0]);
+  auto other = get_dsp<float>(argv[0]);
+  run(*model, output.data());
+  DSPState state;
+  if (!model->get_state(state))
+  {
+    std::cerr << "This model's state can't be saved." << std::endl;
+    return 1;
+  }
+  const double us_get = time([&]() { model->get_state(state); });
+  const double us_set = time([&]() { other->set_state(state); });
+  const double us_clone = time([&]() { model->clone(); });
+  const double us_prewarm = time([&]() { other->prewarm(); });
+
+  // The restored copy should carry on exactly as the original does.
+  other->set_state(state);
+  std::vector<float> other_output(num_frames);
+  run(*model, output.data());
+  run(*other, other_output.data());
+  double max_difference = 0.0;
+  for (size_t i = 0; i < num_frames; i++)
+    max_difference = std::max(max_difference, (double)std::fabs(output[i] - other_output[i]));
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "State: " << state.size() / 1024.0 << " kB" << std::endl;
+  std::cout << "  get_state: " << us_get << " us, set_state: " << us_set << " us" << std::endl;
+  std::cout << "  (clone: " << us_clone << " us, prewarm: " << us_prewarm << " us)" << std::endl;
+  std::cout << "  Restored vs. original: max difference " << std::setprecision(6) << max_difference << std::endl;
+  return 0;
+}
+
+// Bytes on the heap, or 0 if we can't tell
+size_t _get_heap_in_use()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  const struct mallinfo2 info = mallinfo2();
+  // Big blocks are mapped separately.
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+// A model with its weights at fp32, fp16, and bf16: error against fp32 on a
+// calibration signal (a sine sweep, then noise), memory, and speed
+int _benchmark_precision(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The precision benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const int block_size = 64;
+  const double sample_rate = 48000.0;
+  const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * sample_rate);
+  // Log sweep from 20 Hz to 20 kHz over the first half, at -6 dBFS
+  std::vector<float> input = _get_noise(num_frames);
+  const size_t sweep_frames = num_frames / 2;
+  const double sweep_rate = std::log(20000.0 / 20.0);
+  const double sweep_seconds = sweep_frames / sample_rate;
+  for (size_t i = 0; i < sweep_frames; i++)
+  {
+    const double t = i / sample_rate;
+    const double phase =
+      2.0 * 3.14159265358979 * 20.0 * sweep_seconds / sweep_rate * (std::exp(t / sweep_seconds * sweep_rate) - 1.0);
+    input[i] = (float)(0.5 * std::sin(phase));
+  }
+
+  std::vector<float> reference;
+  std::cout << std::fixed;
+  const EWeightPrecision precisions[] = {
+    EWeightPrecision::kFloat32, EWeightPrecision::kFloat16, EWeightPrecision::kBFloat16, EWeightPrecision::kInt8};
+  const char* names[] = {"fp32", "fp16", "bf16", "int8"};
+  for (int p = 0; p < 4; p++)
+  {
+    DSPLoadOptions options;
+    options.weight_precision = precisions[p];
+    const size_t heap_before = _get_heap_in_use();
+    std::unique_ptr<DSP<float>> model;
+    try
+    {
+      model = get_dsp<float>(std::filesystem::path(argv[0]), options);
+    }
+    catch (std::exception& e)
+    {
+      // Int8 needs a model from nam_quantize.
+      std::cout << "  " << names[p] << ": " << e.what() << std::endl;
+      continue;
+    }
+    const size_t heap = _get_heap_in_use() - heap_before;
+    std::vector<float> output(num_frames);
+    const double ns = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      float* in = input.data() + start;
+      float* out = output.data() + start;
+      model->process(&in, &out, 1, n, 1.0f, 1.0f);
+      model->finalize_(n);
+    });
+    std::cout << "  " << names[p] << ": " << std::setprecision(2) << ns << " ns/sample";
+    if (heap > 0)
+      std::cout << ", model takes " << heap / 1024.0 << " kB";
+    if (p == 0)
+      reference = output;
+    else
+    {
+      // Error-to-signal ratio
+      double error = 0.0, signal = 0.0;
+      for (size_t i = 0; i < num_frames; i++)
+      {
+        error += (output[i] - reference[i]) * (output[i] - reference[i]);
+        signal += reference[i] * reference[i];
+      }
+      std::cout << ", ESR vs. fp32 " << std::scientific << std::setprecision(3) << error / signal << std::fixed;
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
+
+// A model at host buffer sizes from 16 to 2048 frames, run directly and
+// through ReblockingDSP in each mode. kThroughput's output should be the
+// direct output, a block later.
+int _benchmark_reblock(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The reblock benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const int block_size = argc >= 2 ? std::atoi(argv[1]) : 256;
+  const size_t num_frames = (size_t)(0.2 * _BENCHMARK_SECONDS * 48000.0);
+  const std::vector<float> input = _get_noise(num_frames);
+  std::vector<float> reference(num_frames);
+  std::vector<float> output(num_frames);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Block size " << block_size << " (kThroughput adds " << block_size << " samples of latency)"
+            << std::endl;
+  for (int host_size = 16; host_size <= 2048; host_size *= 2)
+  {
+    auto model = get_dsp<float>(argv[0]);
+    const double ns_direct = _time_per_sample(num_frames, host_size, [&](const size_t start, const int n) {
+      float* in = const_cast<float*>(input.data()) + start;
+      float* out = reference.data() + start;
+      model->process(&in, &out, 1, n, 1.0f, 1.0f);
+      model->finalize_(n);
+    });
+    std::cout << "  Host buffers of " << host_size << ": direct " << ns_direct << " ns/sample";
+    for (const auto mode : {EReblockingMode::kZeroLatency, EReblockingMode::kThroughput})
+    {
+      ReblockingDSP<float> reblocked(get_dsp<float>(argv[0]), block_size, mode);
+      const double ns = _time_per_sample(num_frames, host_size, [&](const size_t start, const int n) {
+        float* in = const_cast<float*>(input.data()) + start;
+        float* out = output.data() + start;
+        reblocked.process(&in, &out, 1, n, 1.0f, 1.0f);
+        reblocked.finalize_(n);
+      });
+      const size_t delay = mode == EReblockingMode::kThroughput ? block_size : 0;
+      double max_difference = 0.0;
+      for (size_t i = delay; i < num_frames; i++)
+        max_difference = std::max(max_difference, (double)std::fabs(output[i] - reference[i - delay]));
+      std::cout << (mode == EReblockingMode::kThroughput ? ", throughput " : ", zero latency ") << ns
+                << " ns/sample (" << ns_direct / ns << "x, max difference " << std::setprecision(6)
+                << max_difference << std::setprecision(2) << ")";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
+
+// A WaveNet at blocks of 1 to 64 frames, with and without the small-block
+// path (see WaveNet::set_small_block_frames())
+int _benchmark_small(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The small benchmark needs a WaveNet model." << std::endl;
+    return 1;
+  }
+  const size_t num_frames = (size_t)(0.2 * _BENCHMARK_SECONDS * 48000.0);
+  const std::vector<float> input = _get_noise(num_frames);
+  std::vector<float> reference(num_frames);
+  std::vector<float> output(num_frames);
+
+  std::cout << std::fixed << std::setprecision(2);
+  for (const int block_size : {1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64})
+  {
+    double ns[2];
+    for (int small = 0; small < 2; small++)
+    {
+      std::unique_ptr<DSP<float>> model = get_dsp<float>(argv[0]);
+      auto wavenet = dynamic_cast<wavenet::WaveNet<float>*>(model.get());
+      if (wavenet == nullptr)
+      {
+        std::cerr << "The small benchmark needs a WaveNet model." << std::endl;
+        return 1;
+      }
+      wavenet->set_small_block_frames(small ? block_size : 0);
+      std::vector<float>& out_buffer = small ? output : reference;
+      ns[small] = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+        float* in = const_cast<float*>(input.data()) + start;
+        float* out = out_buffer.data() + start;
+        model->process(&in, &out, 1, n, 1.0f, 1.0f);
+        model->finalize_(n);
+      });
+    }
+    double max_difference = 0.0;
+    for (size_t i = 0; i < num_frames; i++)
+      max_difference = std::max(max_difference, (double)std::fabs(output[i] - reference[i]));
+    std::cout << "  Blocks of " << block_size << ": large " << ns[0] << " ns/sample, small " << ns[1]
+              << " ns/sample (" << ns[0] / ns[1] << "x, max difference " << std::setprecision(6) << max_difference
+              << std::setprecision(2) << ")" << std::endl;
+  }
+  return 0;
+}
+
+// Tanh and sigmoid: exact, the rational approximation, and tables of each
+// size with each interpolation (activations::ActivationTable), for time and
+// the largest error against std::tanh and expf. Then, given a model, the
+// model with each EActivationPolicy.
+int _benchmark_activations(int argc, char* argv[])
+{
+  const size_t num_values = (size_t)(_BENCHMARK_SECONDS * 48000.0);
+  const int block_size = 4096;
+  // Mostly in the curved part, as a model's would be
+  std::vector<float> input = _get_noise(num_values);
+  for (auto& x : input)
+    x *= 8.0f;
+  std::vector<float> work(block_size);
+  // Per value, with a copy of the input each time
+  auto time = [&](const std::function<void(float* data, const long size)>& apply) {
+    return _time_per_sample(num_values, block_size, [&](const size_t start, const int n) {
+      std::copy(input.begin() + start, input.begin() + start + n, work.begin());
+      apply(work.data(), n);
+    });
+  };
+  // Against the reference, every 1e-4 over [-20, 20]
+  auto max_error = [](const std::function<float(float)>& f, const std::function<float(float)>& reference) {
+    double error = 0.0;
+    for (int i = -200000; i <= 200000; i++)
+    {
+      const float x = 1.0e-4f * i;
+      error = std::max(error, (double)std::fabs(f(x) - reference(x)));
+    }
+    return error;
+  };
+
+  struct Function
+  {
+    std::string name;
+    float (*exact)(float);
+    float (*fast)(float);
+    float range;
+  };
+  const Function functions[] = {{"Tanh", activations::tanh, activations::fast_tanh, 8.0f},
+                                {"Sigmoid", activations::sigmoid, activations::fast_sigmoid, 16.0f}};
+  for (const auto& function : functions)
+  {
+    std::cout << function.name << " (ns/value, max error)" << std::endl;
+    const double ns_exact = time([&](float* data, const long size) {
+      for (long i = 0; i < size; i++)
+        data[i] = function.exact(data[i]);
+    });
+    std::cout << std::fixed << std::setprecision(2) << "  Exact: " << ns_exact << " ns" << std::endl;
+    const double ns_fast = time([&](float* data, const long size) {
+      for (long i = 0; i < size; i++)
+        data[i] = function.fast(data[i]);
+    });
+    std::cout << "  Fast: " << ns_fast << " ns, " << std::scientific << std::setprecision(2)
+              << max_error(function.fast, function.exact) << std::endl;
+    for (const int size : {64, 256, 1024, 2048, 4096, 16384})
+    {
+      std::cout << "  Table of " << size << ":";
+      for (const auto interpolation : {activations::EInterpolation::kLinear, activations::EInterpolation::kCubic})
+      {
+        const activations::ActivationTable table(function.exact, function.range, size, interpolation);
+        const double ns = time([&](float* data, const long n) { table.apply(data, n); });
+        const double error = max_error([&](const float x) { return table(x); }, function.exact);
+        std::cout << (interpolation == activations::EInterpolation::kLinear ? " linear " : ", cubic ") << std::fixed
+                  << std::setprecision(2) << ns << " ns, " << std::scientific << std::setprecision(2) << error;
+      }
+      std::cout << std::endl;
+    }
+    std::cout << std::fixed;
+  }
+
+  if (argc < 1)
+    return 0;
+
+  const size_t num_frames = (size_t)(0.2 * _BENCHMARK_SECONDS * 48000.0);
+  const int model_block_size = 64;
+  const std::vector<float> model_input = _get_noise(num_frames);
+  std::vector<float> reference(num_frames);
+  std::vector<float> output(num_frames);
+  std::cout << std::setprecision(2) << "Model (block size " << model_block_size << ")" << std::endl;
+  const std::pair<EActivationPolicy, std::string> policies[] = {
+    {EActivationPolicy::kExact, "Exact"}, {EActivationPolicy::kFast, "Fast"}, {EActivationPolicy::kTable, "Table"}};
+  for (const auto& policy : policies)
+  {
+    DSPLoadOptions options;
+    options.activation_policy = policy.first;
+    std::unique_ptr<DSP<float>> model = get_dsp<float>(std::filesystem::path(argv[0]), options);
+    std::vector<float>& out_buffer = policy.first == EActivationPolicy::kExact ? reference : output;
+    const double ns = _time_per_sample(num_frames, model_block_size, [&](const size_t start, const int n) {
+      float* in = const_cast<float*>(model_input.data()) + start;
+      float* out = out_buffer.data() + start;
+      model->process(&in, &out, 1, n, 1.0f, 1.0f);
+      model->finalize_(n);
+    });
+    std::cout << "  " << policy.second << ": " << ns << " ns/sample";
+    if (policy.first != EActivationPolicy::kExact)
+    {
+      double max_difference = 0.0;
+      for (size_t i = 0; i < num_frames; i++)
+        max_difference = std::max(max_difference, (double)std::fabs(output[i] - reference[i]));
+      std::cout << " (max difference " << std::setprecision(6) << max_difference << std::setprecision(2) << ")";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
+
+// A model's arena (see arena.h) with each of its options: its size (and the
+// model's in all), what the OS gave, and the time at a block size that takes
+// WaveNet's small-block path
+int _benchmark_arena(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The arena benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const int block_size = 64;
+  const size_t num_frames = (size_t)(0.2 * _BENCHMARK_SECONDS * 48000.0);
+  const std::vector<float> input = _get_noise(num_frames);
+  std::vector<float> output(num_frames);
+
+  std::cout << std::fixed << std::setprecision(2) << "Arena (block size " << block_size << ")" << std::endl;
+  for (int o = 0; o < 4; o++)
+  {
+    DSPLoadOptions options;
+    options.arena.huge_pages = (o & 1) != 0;
+    options.arena.lock = (o & 2) != 0;
+    std::unique_ptr<DSP<float>> model = get_dsp<float>(std::filesystem::path(argv[0]), options);
+    if (model->get_arena() == nullptr)
+    {
+      std::cerr << "The model doesn't have an arena." << std::endl;
+      return 1;
+    }
+    const double ns = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      float* in = const_cast<float*>(input.data()) + start;
+      float* out = output.data() + start;
+      model->process(&in, &out, 1, n, 1.0f, 1.0f);
+      model->finalize_(n);
+    });
+    // (After a block, which the arena's scratch is laid out for)
+    const Arena& arena = *model->get_arena();
+    const char* names[] = {"Default", "Huge pages", "Locked", "Huge pages, locked"};
+    std::cout << "  " << names[o] << ": " << model->get_arena_size() / 1024.0 << " kB of "
+              << model->get_memory_size() / 1024.0 << " kB";
+    if (options.arena.huge_pages)
+      std::cout << (arena.has_huge_pages() ? " (huge pages)" : " (no huge pages)");
+    if (options.arena.lock)
+      std::cout << (arena.is_locked() ? " (locked)" : " (couldn't lock)");
+    std::cout << ", " << ns << " ns/sample" << std::endl;
+  }
+  return 0;
+}
+
+// A model as trained and with its load-time passes (ConvNet's BatchNorm and
+// WaveNet's head scale folded into the weights; see
+// DSPLoadOptions::fold_weights), which should differ only by rounding.
+int _benchmark_fold(int argc, char* argv[])
+{
+  if (argc < 1)
+  {
+    std::cerr << "The fold benchmark needs a model." << std::endl;
+    return 1;
+  }
+  const int block_size = argc >= 2 ? std::atoi(argv[1]) : 64;
+  const size_t num_frames = (size_t)(_BENCHMARK_SECONDS * 48000.0);
+  const std::vector<float> input = _get_noise(num_frames);
+  std::vector<float> outputs[2] = {std::vector<float>(num_frames), std::vector<float>(num_frames)};
+
+  std::cout << std::fixed << std::setprecision(2);
+  double ns[2];
+  for (int fold = 0; fold < 2; fold++)
+  {
+    DSPLoadOptions options;
+    options.fold_weights = fold == 1;
+    std::unique_ptr<DSP<float>> model = get_dsp<float>(std::filesystem::path(argv[0]), options);
+    ns[fold] = _time_per_sample(num_frames, block_size, [&](const size_t start, const int n) {
+      float* in = const_cast<float*>(input.data()) + start;
+      float* out = outputs[fold].data() + start;
+      model->process(&in, &out, 1, n, 1.0f, 1.0f);
+      model->finalize_(n);
+    });
+  }
+  double max_difference = 0.0;
+  for (size_t i = 0; i < num_frames; i++)
+    max_difference = std::max(max_difference, (double)std::fabs(outputs[1][i] - outputs[0][i]));
+  std::cout << "  Unfolded " << ns[0] << " ns/sample, folded " << ns[1] << " ns/sample (" << ns[0] / ns[1]
+            << "x, max difference " << std::setprecision(6) << max_difference << ")" << std::endl;
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <resample|oversample|biquad|gate|chain|async|threads|render|bypass|prewarm|state|precision|reblock|small|activations|arena|fold> [model.nam]"
+              << std::endl;
+    return 1;
+  }
+  const std::string command = argv[1];
+  if (command == "resample")
+    return _benchmark_resample(argc - 2, argv + 2);
+  if (command == "oversample")
+    return _benchmark_oversample(argc - 2, argv + 2);
+  if (command == "biquad")
+    return _benchmark_biquad(argc - 2, argv + 2);
+  if (command == "gate")
+    return _benchmark_gate(argc - 2, argv + 2);
+  if (command == "chain")
+    return _benchmark_chain(argc - 2, argv + 2);
+  if (command == "async")
+    return _benchmark_async(argc - 2, argv + 2);
+  if (command == "threads")
+    return _benchmark_threads(argc - 2, argv + 2);
+  if (command == "render")
+    return _benchmark_render(argc - 2, argv + 2);
+  if (command == "bypass")
+    return _benchmark_bypass(argc - 2, argv + 2);
+  if (command == "prewarm")
+    return _benchmark_prewarm(argc - 2, argv + 2);
+  if (command == "state")
+    return _benchmark_state(argc - 2, argv + 2);
+  if (command == "precision")
+    return _benchmark_precision(argc - 2, argv + 2);
+  if (command == "reblock")
+    return _benchmark_reblock(argc - 2, argv + 2);
+  if (command == "small")
+    return _benchmark_small(argc - 2, argv + 2);
+  if (command == "activations")
+    return _benchmark_activations(argc - 2, argv + 2);
+  if (command == "arena")
+    return _benchmark_arena(argc - 2, argv + 2);
+  if (command == "fold")
+    return _benchmark_fold(argc - 2, argv + 2);
+  std::cerr << "Unknown benchmark " << command << std::endl;
+  return 1;
+}
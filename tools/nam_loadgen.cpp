@@ -0,0 +1,307 @@
+// Load generator for the stream scheduler: runs more and more streams of a
+// model, each fed in real time, and reports throughput and block latency.
+//
+// Usage:
+// $ nam_loadgen model.nam [max streams] [socket path]
+//
+// Without a socket path, the streams run in-process on a StreamScheduler.
+// With one, they go through a running nam_serve.
+//
+// Latency is from submitting a block to receiving its output. An overrun is
+// a block that couldn't be submitted on time because the stream's queue was
+// full, i.e. the streams aren't keeping up.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "namdsp.h"
+#include "scheduler.h"
+#include "serve_protocol.h"
+
+constexpr double _SAMPLE_RATE = 48000.0;
+constexpr int _BLOCK_SIZE = 64;
+// How long each step runs
+constexpr double _STEP_SECONDS = 3.0;
+
+using _Clock = std::chrono::steady_clock;
+
+// Where the streams run
+class _Transport
+{
+public:
+  virtual ~_Transport() = default;
+  // Returns the stream's handle.
+  virtual int open(const std::string& model_path) = 0;
+  virtual void close(const int stream) = 0;
+  virtual bool submit(const int stream, const float* input, const int num_frames) = 0;
+  // Returns the block's number of frames, or 0 if none has finished.
+  virtual int receive(const int stream, float* output) = 0;
+};
+
+class _LocalTransport : public _Transport
+{
+public:
+  _LocalTransport(const int max_streams)
+  : _scheduler(0, max_streams){};
+  int open(const std::string& model_path) override
+  {
+    return this->_scheduler.add_stream(get_dsp<float>(std::filesystem::path(model_path)), _BLOCK_SIZE,
+                                       serve::NUM_SLOTS);
+  };
+  void close(const int stream) override { this->_scheduler.remove_stream(stream); };
+  bool submit(const int stream, const float* input, const int num_frames) override
+  {
+    return this->_scheduler.submit(stream, &input, num_frames);
+  };
+  int receive(const int stream, float* output) override { return this->_scheduler.receive(stream, &output); };
+
+private:
+  StreamScheduler _scheduler;
+};
+
+// Talks to nam_serve as described in serve_protocol.h
+class _ServerTransport : public _Transport
+{
+public:
+  _ServerTransport(const std::string& socket_path);
+  ~_ServerTransport();
+  int open(const std::string& model_path) override;
+  void close(const int stream) override;
+  bool submit(const int stream, const float* input, const int num_frames) override;
+  int receive(const int stream, float* output) override;
+
+private:
+  struct _Ring
+  {
+    int stream;
+    serve::RingHeader* header;
+    size_t size;
+    uint32_t submitted;
+    uint32_t read;
+  };
+  // Send a command and return the reply; throws on ERR.
+  std::string _request_(const std::string& command);
+
+  int _socket;
+  std::string _received;
+  // By stream
+  std::vector<_Ring> _rings;
+};
+
+_ServerTransport::_ServerTransport(const std::string& socket_path)
+{
+  this->_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  if (this->_socket < 0 || connect(this->_socket, (sockaddr*)&address, sizeof(address)) != 0)
+  {
+    std::stringstream ss;
+    ss << "Can't connect to nam_serve at " << socket_path << ": " << std::strerror(errno);
+    throw std::runtime_error(ss.str());
+  }
+}
+
+_ServerTransport::~_ServerTransport()
+{
+  // The server closes our streams when we hang up.
+  for (const _Ring& ring : this->_rings)
+    if (ring.header != nullptr)
+      munmap(ring.header, ring.size);
+  ::close(this->_socket);
+}
+
+std::string _ServerTransport::_request_(const std::string& command)
+{
+  const std::string line = command + "\n";
+  if (write(this->_socket, line.data(), line.size()) != (ssize_t)line.size())
+    throw std::runtime_error("Lost the connection to nam_serve");
+  size_t end;
+  while ((end = this->_received.find('\n')) == std::string::npos)
+  {
+    char buffer[1024];
+    const ssize_t n = read(this->_socket, buffer, sizeof(buffer));
+    if (n <= 0)
+      throw std::runtime_error("Lost the connection to nam_serve");
+    this->_received.append(buffer, n);
+  }
+  const std::string reply = this->_received.substr(0, end);
+  this->_received.erase(0, end + 1);
+  if (reply.compare(0, 3, "OK ") != 0 && reply != "OK")
+    throw std::runtime_error("nam_serve: " + reply);
+  return reply;
+}
+
+int _ServerTransport::open(const std::string& model_path)
+{
+  std::stringstream command;
+  command << "OPEN " << std::filesystem::absolute(model_path).string() << " " << _BLOCK_SIZE;
+  std::stringstream reply(this->_request_(command.str()));
+  std::string ok, name;
+  _Ring ring = {-1, nullptr, serve::get_ring_size(_BLOCK_SIZE), 0, 0};
+  reply >> ok >> ring.stream >> name;
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  void* memory = fd >= 0 ? mmap(nullptr, ring.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  if (fd >= 0)
+    ::close(fd);
+  if (memory == MAP_FAILED)
+    throw std::runtime_error("Can't map the ring " + name);
+  ring.header = static_cast<serve::RingHeader*>(memory);
+  if (ring.header->magic != serve::RING_MAGIC || ring.header->max_num_frames != _BLOCK_SIZE
+      || ring.header->num_slots != serve::NUM_SLOTS)
+    throw std::runtime_error("Unexpected ring " + name);
+  this->_rings.push_back(ring);
+  return (int)this->_rings.size() - 1;
+}
+
+void _ServerTransport::close(const int stream)
+{
+  _Ring& ring = this->_rings[stream];
+  this->_request_("CLOSE " + std::to_string(ring.stream));
+  munmap(ring.header, ring.size);
+  ring.header = nullptr;
+}
+
+bool _ServerTransport::submit(const int stream, const float* input, const int num_frames)
+{
+  _Ring& ring = this->_rings[stream];
+  if (ring.submitted - ring.read >= (uint32_t)serve::NUM_SLOTS)
+    return false;
+  *serve::get_slot_num_frames(ring.header, _BLOCK_SIZE, serve::NUM_SLOTS, ring.submitted) = num_frames;
+  std::memcpy(serve::get_slot_samples(ring.header, _BLOCK_SIZE, serve::NUM_SLOTS, ring.submitted), input,
+              num_frames * sizeof(float));
+  ring.header->submitted.store(++ring.submitted, std::memory_order_release);
+  return true;
+}
+
+int _ServerTransport::receive(const int stream, float* output)
+{
+  _Ring& ring = this->_rings[stream];
+  if (ring.header->completed.load(std::memory_order_acquire) == ring.read)
+    return 0;
+  const int num_frames =
+    std::max(0, std::min(*serve::get_slot_num_frames(ring.header, _BLOCK_SIZE, serve::NUM_SLOTS, ring.read), _BLOCK_SIZE));
+  std::memcpy(output, serve::get_slot_samples(ring.header, _BLOCK_SIZE, serve::NUM_SLOTS, ring.read),
+              num_frames * sizeof(float));
+  ring.read++;
+  return num_frames;
+}
+
+// Run num_streams streams for _STEP_SECONDS and print a line of results.
+void _run_step(_Transport& transport, const std::string& model_path, const int num_streams)
+{
+  std::vector<int> streams;
+  for (int i = 0; i < num_streams; i++)
+    streams.push_back(transport.open(model_path));
+
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+  std::vector<float> input(_BLOCK_SIZE), output(_BLOCK_SIZE);
+  for (auto& x : input)
+    x = distribution(generator);
+
+  const auto period = std::chrono::duration_cast<_Clock::duration>(std::chrono::duration<double>(_BLOCK_SIZE / _SAMPLE_RATE));
+  const auto start = _Clock::now();
+  const auto stop = start + std::chrono::duration_cast<_Clock::duration>(std::chrono::duration<double>(_STEP_SECONDS));
+  // Per stream: when the next block is due (staggered, as tracks' callbacks
+  // would be), and when the blocks in flight were submitted
+  std::vector<_Clock::time_point> next_due(num_streams);
+  std::vector<std::vector<_Clock::time_point>> submitted(num_streams, std::vector<_Clock::time_point>(serve::NUM_SLOTS));
+  std::vector<size_t> num_submitted(num_streams, 0), num_received(num_streams, 0);
+  for (int i = 0; i < num_streams; i++)
+    next_due[i] = start + period * i / num_streams;
+  std::vector<double> latencies;
+  long num_overruns = 0;
+  size_t frames_processed = 0;
+
+  auto now = start;
+  while (now < stop)
+  {
+    auto next_event = stop;
+    for (int i = 0; i < num_streams; i++)
+    {
+      while (transport.receive(streams[i], output.data()) > 0)
+      {
+        const auto submitted_at = submitted[i][num_received[i]++ % serve::NUM_SLOTS];
+        latencies.push_back(std::chrono::duration<double, std::micro>(_Clock::now() - submitted_at).count());
+        frames_processed += _BLOCK_SIZE;
+      }
+      if (next_due[i] <= now)
+      {
+        if (transport.submit(streams[i], input.data(), _BLOCK_SIZE))
+          submitted[i][num_submitted[i]++ % serve::NUM_SLOTS] = now;
+        else
+          num_overruns++;
+        next_due[i] += period;
+      }
+      next_event = std::min(next_event, next_due[i]);
+    }
+    // Poll for output while waiting for the next block to come due.
+    now = _Clock::now();
+    if (next_event > now)
+      std::this_thread::sleep_for(std::min(next_event - now, _Clock::duration(std::chrono::microseconds(20))));
+    now = _Clock::now();
+  }
+  const double elapsed = std::chrono::duration<double>(now - start).count();
+  for (const int stream : streams)
+    transport.close(stream);
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](const double p) {
+    return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+  };
+  std::cout << std::setw(7) << num_streams << std::fixed << std::setprecision(2) << std::setw(10)
+            << frames_processed / (elapsed * _SAMPLE_RATE) << "x" << std::setprecision(0) << std::setw(10)
+            << percentile(0.5) << std::setw(10) << percentile(0.99) << std::setw(10) << percentile(0.999)
+            << std::setw(10) << (latencies.empty() ? 0.0 : latencies.back()) << std::setw(10) << num_overruns
+            << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " model.nam [max streams] [socket path]" << std::endl;
+    return 1;
+  }
+  const std::string model_path = argv[1];
+  const int max_streams = argc >= 3 ? std::atoi(argv[2]) : 64;
+  try
+  {
+    std::unique_ptr<_Transport> transport;
+    if (argc >= 4)
+      transport.reset(new _ServerTransport(argv[3]));
+    else
+      transport.reset(new _LocalTransport(max_streams));
+
+    std::cout << "Block size " << _BLOCK_SIZE << " at " << _SAMPLE_RATE << " Hz, "
+              << (argc >= 4 ? "through nam_serve" : "in-process") << "; latencies in us" << std::endl;
+    std::cout << "streams   realtime       p50       p99     p99.9       max  overruns" << std::endl;
+    for (int num_streams = 1; num_streams <= max_streams; num_streams *= 2)
+      _run_step(*transport, model_path, num_streams);
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,163 @@
+// Calibrates a model for int8 weights (EWeightPrecision::kInt8) and reports
+// how the int8 model compares with the fp32 one.
+//
+// Usage:
+// $ nam_quantize model.nam calibration.wav output.nam [test.wav]
+//
+// The model is run at fp32 over calibration.wav, which should be typical
+// input (e.g. DI guitar at playing level), and the range that each
+// convolution's input covered is saved in output.nam, a copy of model.nam.
+// The weights stay fp32 in the file; they're quantized when it's loaded with
+// DSPLoadOptions::weight_precision = kInt8, and it loads as before otherwise.
+//
+// The report runs test.wav (or calibration.wav, if there isn't one) through
+// both, and gives the error-to-signal ratio (ESR) of the int8 model's output
+// against the fp32 model's, and how fast each was.
+//
+// The model sees the first channel of the WAV files, without resampling.
+
+#include <algorithm> // std::max
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "namdsp.h"
+#include "wav.h"
+
+// Frames per block, as a plugin might have
+constexpr const int _BLOCK_SIZE = 64;
+
+// The first channel of a WAV file
+std::vector<float> _read_wav(const std::string& path, const double expected_sample_rate)
+{
+  dsp::wav::Reader reader;
+  const dsp::wav::LoadReturnCode rc = reader.Open(path.c_str());
+  if (rc != dsp::wav::LoadReturnCode::SUCCESS)
+    throw std::runtime_error(path + ": " + dsp::wav::GetMsgForLoadReturnCode(rc));
+  if (expected_sample_rate > 0.0 && reader.GetSampleRate() != expected_sample_rate)
+    std::cout << "(" << path << " is at " << reader.GetSampleRate() << " Hz, but the model expects "
+              << expected_sample_rate << " Hz)" << std::endl;
+  std::vector<std::vector<float>> channels(reader.GetNumChannels(), std::vector<float>(reader.GetNumFrames()));
+  std::vector<float*> pointers;
+  for (auto& channel : channels)
+    pointers.push_back(channel.data());
+  reader.Read(pointers.data(), reader.GetNumFrames());
+  return channels[0];
+}
+
+// Run input through the model. Returns the output and sets the time that it
+// took, in nanoseconds per sample.
+std::vector<float> _run(DSP<float>& model, std::vector<float>& input, double& ns_per_sample)
+{
+  std::vector<float> output(input.size());
+  const auto t_start = std::chrono::steady_clock::now();
+  for (size_t start = 0; start < input.size(); start += _BLOCK_SIZE)
+  {
+    const int num_frames = (int)std::min((size_t)_BLOCK_SIZE, input.size() - start);
+    float* in = input.data() + start;
+    float* out = output.data() + start;
+    model.process(&in, &out, 1, num_frames, 1.0f, 1.0f);
+    model.finalize_(num_frames);
+  }
+  const auto t_end = std::chrono::steady_clock::now();
+  ns_per_sample = std::chrono::duration<double, std::nano>(t_end - t_start).count() / std::max((size_t)1, input.size());
+  return output;
+}
+
+// Calibrate the model on the input. Returns the ranges, in the order that
+// DSP::get_activation_ranges() gives them.
+std::vector<float> _calibrate(DSP<float>& model, std::vector<float>& input)
+{
+  std::vector<ActivationRange*> ranges;
+  model.get_activation_ranges(ranges);
+  if (ranges.empty())
+    throw std::runtime_error("The model doesn't have any convolutions to quantize");
+  for (auto range : ranges)
+    range->calibrating = true;
+  double ns_per_sample;
+  _run(model, input, ns_per_sample);
+  std::vector<float> values;
+  for (auto range : ranges)
+  {
+    range->calibrating = false;
+    if (!(range->max_abs > 0.0f))
+      throw std::runtime_error("Some of the model's convolutions saw nothing but silence; is the calibration file "
+                               "quiet?");
+    values.push_back(range->max_abs);
+  }
+  return values;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " model.nam calibration.wav output.nam [test.wav]" << std::endl;
+    return 1;
+  }
+  const std::filesystem::path model_path(argv[1]);
+  const std::string calibration_path = argv[2];
+  const std::filesystem::path output_path(argv[3]);
+  const std::string test_path = argc > 4 ? argv[4] : calibration_path;
+
+  try
+  {
+    DSPLoadOptions options;
+    options.prewarm = true;
+    std::unique_ptr<DSP<float>> model = get_dsp<float>(model_path, options);
+    std::vector<float> calibration = _read_wav(calibration_path, model->GetExpectedSampleRate());
+    const std::vector<float> ranges = _calibrate(*model, calibration);
+    std::cout << "Calibrated " << ranges.size() << " convolutions on " << calibration_path << std::endl;
+
+    nlohmann::json j;
+    {
+      std::ifstream i(model_path);
+      i >> j;
+    }
+    j["int8_calibration"] = {{"activation_ranges", ranges}};
+    {
+      std::ofstream o(output_path);
+      o << j.dump();
+      if (!o)
+        throw std::runtime_error("Couldn't write " + output_path.string());
+    }
+    std::cout << "Wrote " << output_path.string() << std::endl;
+
+    // The report
+    std::vector<float> test = test_path == calibration_path ? calibration
+                                                            : _read_wav(test_path, model->GetExpectedSampleRate());
+    std::unique_ptr<DSP<float>> fp32 = get_dsp<float>(output_path, options);
+    options.weight_precision = EWeightPrecision::kInt8;
+    std::unique_ptr<DSP<float>> int8 = get_dsp<float>(output_path, options);
+    double fp32_ns, int8_ns;
+    const std::vector<float> reference = _run(*fp32, test, fp32_ns);
+    const std::vector<float> output = _run(*int8, test, int8_ns);
+    double error = 0.0, signal = 0.0, peak_error = 0.0;
+    for (size_t i = 0; i < test.size(); i++)
+    {
+      const double e = output[i] - reference[i];
+      error += e * e;
+      signal += (double)reference[i] * reference[i];
+      peak_error = std::max(peak_error, std::abs(e));
+    }
+    std::cout << "On " << test_path << ":" << std::endl;
+    std::cout << "  ESR vs. fp32: " << std::scientific << std::setprecision(3) << error / signal << " ("
+              << std::fixed << std::setprecision(1) << 10.0 * std::log10(error / signal) << " dB)" << std::endl;
+    std::cout << "  Peak error: " << std::scientific << std::setprecision(3) << peak_error << std::endl;
+    std::cout << std::fixed << std::setprecision(2) << "  fp32: " << fp32_ns << " ns/sample, int8: " << int8_ns
+              << " ns/sample (" << fp32_ns / int8_ns << "x)" << std::endl;
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,239 @@
+// Renders WAV files through a model (and, optionally, the plugin's noise gate,
+// tone stack, and a cabinet IR), and reports how fast it went.
+//
+// Usage:
+// $ nam_render [options] model.nam input.wav [input.wav ...]
+//
+// Options:
+//   --ir <ir.wav>           Cabinet IR, after the tone stack
+//   --gate <threshold dB>   Noise gate, around everything else
+//   --bass <dB>, --mid <dB>, --treble <dB>
+//                           Tone stack; flat (and skipped) unless given
+//   --output-dir <dir>      Where the outputs go (default: next to the inputs)
+//   --block-size <frames>   Frames per block (default: 4096)
+//   --prewarm               Start the model where silence would leave it,
+//                           instead of fading it in
+//
+// Each input.wav is written to input_nam.wav in the same format. The model
+// sees the first channel; its output goes to all of them. The model is
+// loaded once and a fresh copy is used for each file. Models that were
+// trained at a different sample rate than a file's are resampled.
+
+#include <algorithm> // std::max
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "chain.h"
+#include "ImpulseResponse.h"
+#include "namdsp.h"
+#include "NoiseGate.h"
+#include "RecursiveLinearFilter.h"
+#include "resampling.h"
+#include "wav.h"
+
+// What to put around the model
+struct _Settings
+{
+  std::string ir_path;
+  bool gate = false;
+  float gate_threshold = -80.0f;
+  bool tone_stack = false;
+  float bass = 0.0f;
+  float mid = 0.0f;
+  float treble = 0.0f;
+  std::filesystem::path output_dir;
+  int block_size = 4096;
+  bool prewarm = false;
+};
+
+// The most memory the process has held at once, in MB
+double _get_peak_memory()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0.0;
+  return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  // Bytes
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  // Kilobytes
+  return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+// Render one file. Returns the seconds that it took and sets how many seconds
+// of audio were in it.
+double _render_file(const DSP<float>& model, const std::filesystem::path& input_path,
+                    const std::filesystem::path& output_path, const _Settings& settings, double& audio_seconds)
+{
+  dsp::wav::Reader reader;
+  const dsp::wav::LoadReturnCode rc = reader.Open(input_path.string().c_str());
+  if (rc != dsp::wav::LoadReturnCode::SUCCESS)
+    throw std::runtime_error(input_path.string() + ": " + dsp::wav::GetMsgForLoadReturnCode(rc));
+  const int num_channels = reader.GetNumChannels();
+  const double sample_rate = reader.GetSampleRate();
+  const int block_size = settings.block_size;
+  audio_seconds = reader.GetNumFrames() / sample_rate;
+
+  // Everything but the model is made for the file's sample rate.
+  std::unique_ptr<DSP<float>> copy = model.clone();
+  if (copy == nullptr)
+    throw std::runtime_error("The model can't be copied");
+  ResamplingDSP<float> resampled(std::move(copy), sample_rate, block_size);
+  if (resampled.IsResampling())
+    std::cout << "  (resampling the model from " << model.GetExpectedSampleRate() << " Hz)" << std::endl;
+
+  dsp::noise_gate::Trigger<float> trigger;
+  dsp::noise_gate::Gain<float> gain;
+  trigger.AddListener(&gain);
+  trigger.SetParams(dsp::noise_gate::TriggerParams<float>(0.01f, settings.gate_threshold, 0.1f, 0.005f, 0.01f, 0.05f));
+  trigger.SetSampleRate((float)sample_rate);
+  recursive_linear_filter::BiquadCascade<float> tone_stack(3);
+  tone_stack.SetCoefficients(0, recursive_linear_filter::LowShelf<float>::GetCoefficients(
+                                  recursive_linear_filter::BiquadParams<float>(sample_rate, 150.0, 0.707, settings.bass)));
+  tone_stack.SetCoefficients(1, recursive_linear_filter::Peaking<float>::GetCoefficients(
+                                  recursive_linear_filter::BiquadParams<float>(sample_rate, 425.0, 0.707, settings.mid)));
+  tone_stack.SetCoefficients(2, recursive_linear_filter::HighShelf<float>::GetCoefficients(
+                                  recursive_linear_filter::BiquadParams<float>(sample_rate, 1800.0, 0.707, settings.treble)));
+  std::unique_ptr<dsp::ImpulseResponse<float>> ir;
+  if (!settings.ir_path.empty())
+  {
+    ir.reset(new dsp::ImpulseResponse<float>(settings.ir_path.c_str(), (float)sample_rate));
+    if (ir->GetWavState() != dsp::wav::LoadReturnCode::SUCCESS)
+      throw std::runtime_error(settings.ir_path + ": " + dsp::wav::GetMsgForLoadReturnCode(ir->GetWavState()));
+  }
+
+  Chain<float> chain(num_channels, block_size);
+  if (settings.gate)
+    chain.add(&trigger);
+  chain.add(&resampled);
+  if (settings.tone_stack)
+    chain.add(&tone_stack);
+  if (ir != nullptr)
+    chain.add(ir.get());
+  if (settings.gate)
+    chain.add(&gain);
+
+  dsp::wav::Writer writer;
+  writer.Open(output_path.string().c_str(), num_channels, sample_rate, reader.GetSampleFormat());
+  std::vector<std::vector<float>> buffers(num_channels, std::vector<float>(block_size));
+  std::vector<float*> pointers;
+  for (auto& buffer : buffers)
+    pointers.push_back(buffer.data());
+
+  const auto t_start = std::chrono::steady_clock::now();
+  size_t num_frames;
+  while ((num_frames = reader.Read(pointers.data(), block_size)) > 0)
+  {
+    chain.process(pointers.data(), pointers.data(), (int)num_frames);
+    writer.Write(pointers.data(), num_frames);
+  }
+  writer.Close();
+  const auto t_end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t_end - t_start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  _Settings settings;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--ir" && has_value)
+      settings.ir_path = argv[++i];
+    else if (arg == "--gate" && has_value)
+    {
+      settings.gate = true;
+      settings.gate_threshold = (float)std::atof(argv[++i]);
+    }
+    else if ((arg == "--bass" || arg == "--mid" || arg == "--treble") && has_value)
+    {
+      settings.tone_stack = true;
+      const float value = (float)std::atof(argv[++i]);
+      (arg == "--bass" ? settings.bass : arg == "--mid" ? settings.mid : settings.treble) = value;
+    }
+    else if (arg == "--output-dir" && has_value)
+      settings.output_dir = argv[++i];
+    else if (arg == "--block-size" && has_value)
+      settings.block_size = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--prewarm")
+      settings.prewarm = true;
+    else if (arg.compare(0, 2, "--") == 0)
+    {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return 1;
+    }
+    else
+      paths.push_back(arg);
+  }
+  if (paths.size() < 2)
+  {
+    std::cerr << "Usage: " << argv[0]
+              << " [--ir ir.wav] [--gate dB] [--bass dB] [--mid dB] [--treble dB] [--output-dir dir] "
+                 "[--block-size frames] [--prewarm] model.nam input.wav [input.wav ...]"
+              << std::endl;
+    return 1;
+  }
+
+  try
+  {
+    const auto t_start = std::chrono::steady_clock::now();
+    DSPLoadOptions options;
+    options.prewarm = settings.prewarm;
+    std::unique_ptr<DSP<float>> model = get_dsp<float>(std::filesystem::path(paths[0]), options);
+    const auto t_end = std::chrono::steady_clock::now();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Loaded " << paths[0] << " in " << std::chrono::duration<double, std::milli>(t_end - t_start).count()
+              << " ms" << std::endl;
+
+    double total_audio = 0.0;
+    double total_time = 0.0;
+    for (size_t i = 1; i < paths.size(); i++)
+    {
+      const std::filesystem::path input_path(paths[i]);
+      const std::filesystem::path output_dir =
+        settings.output_dir.empty() ? input_path.parent_path() : settings.output_dir;
+      const std::filesystem::path output_path =
+        output_dir / (input_path.stem().string() + "_nam" + input_path.extension().string());
+      std::cout << input_path.string() << " -> " << output_path.string() << std::endl;
+      double audio = 0.0;
+      const double seconds = _render_file(*model, input_path, output_path, settings, audio);
+      std::cout << "  " << audio << " s of audio in " << seconds << " s (" << audio / seconds << "x realtime)"
+                << std::endl;
+      total_audio += audio;
+      total_time += seconds;
+    }
+    if (paths.size() > 2)
+      std::cout << "Total: " << total_audio << " s of audio in " << total_time << " s (" << total_audio / total_time
+                << "x realtime)" << std::endl;
+    std::cout << "Peak memory: " << _get_peak_memory() << " MB" << std::endl;
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
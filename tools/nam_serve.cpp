@@ -0,0 +1,343 @@
+// A local render server: runs models for other processes on this machine on a
+// StreamScheduler. See serve_protocol.h for how to talk to it.
+//
+// Usage:
+// $ nam_serve [socket path] [threads]
+//
+// Stop it with Ctrl-C (or SIGTERM).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "namdsp.h"
+#include "scheduler.h"
+#include "serve_protocol.h"
+
+// How long the I/O thread sleeps after a pass with nothing to move
+constexpr std::chrono::microseconds _IO_IDLE_SLEEP(20);
+// How often the control loop checks whether it's been told to stop, in ms
+constexpr int _POLL_TIMEOUT = 200;
+
+std::atomic<bool> _stop(false);
+
+void _handle_signal(int)
+{
+  _stop.store(true);
+}
+
+class _Server
+{
+public:
+  _Server(const int num_threads)
+  : _scheduler(num_threads)
+  , _num_rings(0){};
+  ~_Server();
+  // Until told to stop
+  void run(const std::string& socket_path);
+
+private:
+  struct _Stream
+  {
+    int client;
+    std::string ring_name;
+    serve::RingHeader* ring;
+    size_t ring_size;
+    // What the ring was made with (the client can write its header)
+    int max_num_frames;
+    int num_slots;
+    // Blocks handed to the scheduler
+    uint32_t taken;
+  };
+
+  // Moves blocks between the rings and the scheduler.
+  void _move_blocks();
+  std::string _handle_command_(const int client, const std::string& line);
+  std::string _open_(const int client, const std::string& model_path, const int max_num_frames);
+  std::string _close_(const int client, const int stream);
+  void _close_stream_(const int stream);
+  void _close_client_(const int client);
+
+  StreamScheduler _scheduler;
+  // By scheduler handle. Guards the I/O thread against streams being opened
+  // and closed.
+  std::mutex _streams_mutex;
+  std::map<int, _Stream> _streams;
+  int _num_rings;
+};
+
+_Server::~_Server()
+{
+  std::vector<int> streams;
+  for (const auto& stream : this->_streams)
+    streams.push_back(stream.first);
+  for (const int stream : streams)
+    this->_close_stream_(stream);
+}
+
+void _Server::run(const std::string& socket_path)
+{
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (listener < 0 || socket_path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("Can't make the control socket");
+  std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  unlink(socket_path.c_str());
+  if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0)
+  {
+    std::stringstream ss;
+    ss << "Can't listen on " << socket_path << ": " << std::strerror(errno);
+    throw std::runtime_error(ss.str());
+  }
+  std::cout << "Listening on " << socket_path << " with " << this->_scheduler.get_num_threads() << " threads"
+            << std::endl;
+
+  std::thread io_thread([this] {
+    while (!_stop.load())
+      this->_move_blocks();
+  });
+
+  // Control: the listener, then the clients, with what they've sent so far
+  std::vector<pollfd> fds = {{listener, POLLIN, 0}};
+  std::map<int, std::string> received;
+  while (!_stop.load())
+  {
+    if (poll(fds.data(), fds.size(), _POLL_TIMEOUT) <= 0)
+      continue;
+    if (fds[0].revents & POLLIN)
+    {
+      const int client = accept(listener, nullptr, nullptr);
+      if (client >= 0)
+        fds.push_back({client, POLLIN, 0});
+    }
+    for (size_t i = 1; i < fds.size(); i++)
+    {
+      if (fds[i].revents == 0)
+        continue;
+      const int client = fds[i].fd;
+      char buffer[1024];
+      const ssize_t n = read(client, buffer, sizeof(buffer));
+      if (n <= 0)
+      {
+        this->_close_client_(client);
+        received.erase(client);
+        close(client);
+        fds.erase(fds.begin() + i--);
+        continue;
+      }
+      std::string& pending = received[client];
+      pending.append(buffer, n);
+      size_t end;
+      while ((end = pending.find('\n')) != std::string::npos)
+      {
+        const std::string reply = this->_handle_command_(client, pending.substr(0, end)) + "\n";
+        pending.erase(0, end + 1);
+        if (write(client, reply.data(), reply.size()) < 0)
+          break;
+      }
+    }
+  }
+
+  io_thread.join();
+  for (size_t i = 1; i < fds.size(); i++)
+  {
+    this->_close_client_(fds[i].fd);
+    close(fds[i].fd);
+  }
+  close(listener);
+  unlink(socket_path.c_str());
+}
+
+void _Server::_move_blocks()
+{
+  bool moved = false;
+  {
+    std::lock_guard<std::mutex> lock(this->_streams_mutex);
+    for (auto& it : this->_streams)
+    {
+      const int stream = it.first;
+      _Stream& s = it.second;
+      serve::RingHeader* ring = s.ring;
+      // In
+      const uint32_t submitted = ring->submitted.load(std::memory_order_acquire);
+      while (s.taken != submitted)
+      {
+        const int num_frames = std::max(
+          0, std::min((int)*serve::get_slot_num_frames(ring, s.max_num_frames, s.num_slots, s.taken), s.max_num_frames));
+        const float* input = serve::get_slot_samples(ring, s.max_num_frames, s.num_slots, s.taken);
+        if (!this->_scheduler.submit(stream, &input, num_frames))
+          break;
+        s.taken++;
+        moved = true;
+      }
+      // Out, over the input in the same slot
+      uint32_t completed = ring->completed.load(std::memory_order_relaxed);
+      float* output = serve::get_slot_samples(ring, s.max_num_frames, s.num_slots, completed);
+      while (this->_scheduler.receive(stream, &output) > 0)
+      {
+        ring->completed.store(++completed, std::memory_order_release);
+        output = serve::get_slot_samples(ring, s.max_num_frames, s.num_slots, completed);
+        moved = true;
+      }
+    }
+  }
+  if (!moved)
+    std::this_thread::sleep_for(_IO_IDLE_SLEEP);
+}
+
+std::string _Server::_handle_command_(const int client, const std::string& line)
+{
+  std::stringstream ss(line);
+  std::string command;
+  ss >> command;
+  try
+  {
+    if (command == "OPEN")
+    {
+      // The path might have spaces; the block size is the last word.
+      const size_t split = line.find_last_of(' ');
+      if (split == std::string::npos || split <= command.size())
+        return "ERR Usage: OPEN <model.nam> <max frames>";
+      const std::string model_path = line.substr(command.size() + 1, split - command.size() - 1);
+      return this->_open_(client, model_path, std::atoi(line.c_str() + split + 1));
+    }
+    if (command == "CLOSE")
+    {
+      int stream = -1;
+      ss >> stream;
+      return this->_close_(client, stream);
+    }
+    if (command == "STATS")
+    {
+      std::lock_guard<std::mutex> lock(this->_streams_mutex);
+      std::stringstream reply;
+      reply << "OK " << this->_streams.size() << " " << this->_scheduler.get_num_blocks() << " "
+            << this->_scheduler.get_num_steals();
+      return reply.str();
+    }
+    return "ERR Unknown command " + command;
+  }
+  catch (std::exception& e)
+  {
+    // Keep it to one line.
+    std::string message = e.what();
+    message.erase(message.find_last_not_of("\n") + 1);
+    std::replace(message.begin(), message.end(), '\n', ' ');
+    return "ERR " + message;
+  }
+}
+
+std::string _Server::_open_(const int client, const std::string& model_path, const int max_num_frames)
+{
+  if (max_num_frames < 1)
+    return "ERR Need a positive block size";
+  std::unique_ptr<DSP<float>> model = get_dsp<float>(std::filesystem::path(model_path));
+  const int latency = model->GetLatency();
+
+  std::stringstream name;
+  name << "/nam_serve." << getpid() << "." << this->_num_rings++;
+  const size_t ring_size = serve::get_ring_size(max_num_frames);
+  const int fd = shm_open(name.str().c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    return std::string("ERR Can't make the ring: ") + std::strerror(errno);
+  void* memory = MAP_FAILED;
+  if (ftruncate(fd, ring_size) == 0)
+    memory = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    shm_unlink(name.str().c_str());
+    return std::string("ERR Can't map the ring: ") + std::strerror(errno);
+  }
+  serve::RingHeader* ring = new (memory) serve::RingHeader;
+  ring->magic = serve::RING_MAGIC;
+  ring->max_num_frames = max_num_frames;
+  ring->num_slots = serve::NUM_SLOTS;
+  ring->submitted.store(0);
+  ring->completed.store(0);
+
+  std::lock_guard<std::mutex> lock(this->_streams_mutex);
+  const int stream = this->_scheduler.add_stream(std::move(model), max_num_frames, serve::NUM_SLOTS);
+  this->_streams[stream] = {client, name.str(), ring, ring_size, max_num_frames, serve::NUM_SLOTS, 0};
+  std::stringstream reply;
+  reply << "OK " << stream << " " << name.str() << " " << latency;
+  return reply.str();
+}
+
+std::string _Server::_close_(const int client, const int stream)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_streams_mutex);
+    auto it = this->_streams.find(stream);
+    if (it == this->_streams.end() || it->second.client != client)
+      return "ERR No such stream";
+  }
+  this->_close_stream_(stream);
+  return "OK";
+}
+
+void _Server::_close_stream_(const int stream)
+{
+  std::lock_guard<std::mutex> lock(this->_streams_mutex);
+  auto it = this->_streams.find(stream);
+  if (it == this->_streams.end())
+    return;
+  this->_scheduler.remove_stream(stream);
+  munmap(it->second.ring, it->second.ring_size);
+  shm_unlink(it->second.ring_name.c_str());
+  this->_streams.erase(it);
+}
+
+void _Server::_close_client_(const int client)
+{
+  std::vector<int> streams;
+  {
+    std::lock_guard<std::mutex> lock(this->_streams_mutex);
+    for (const auto& stream : this->_streams)
+      if (stream.second.client == client)
+        streams.push_back(stream.first);
+  }
+  for (const int stream : streams)
+    this->_close_stream_(stream);
+}
+
+int main(int argc, char* argv[])
+{
+  const std::string socket_path = argc >= 2 ? argv[1] : serve::DEFAULT_SOCKET_PATH;
+  const int num_threads = argc >= 3 ? std::atoi(argv[2]) : 0;
+  std::signal(SIGINT, _handle_signal);
+  std::signal(SIGTERM, _handle_signal);
+  std::signal(SIGPIPE, SIG_IGN);
+  try
+  {
+    _Server server(num_threads);
+    server.run(socket_path);
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
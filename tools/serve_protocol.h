@@ -0,0 +1,66 @@
+#pragma once
+// What nam_serve and its clients agree on
+//
+// Control: a Unix socket. Each command and reply is one line of text.
+//   OPEN <model.nam> <max frames>  ->  OK <stream> <ring name> <latency>
+//   CLOSE <stream>                 ->  OK
+//   STATS                          ->  OK <streams> <blocks> <steals>
+// Failures reply "ERR <message>". A client's streams are closed when it
+// disconnects.
+//
+// Audio: each stream has a ring of blocks in shared memory (shm_open() the
+// ring name). The client writes a block into slot (submitted % num_slots)
+// and then increments submitted. The server processes blocks in order,
+// writes the output over the input in the same slot, and increments
+// completed. The client can reuse a slot once it's read the output, so it
+// keeps submitted - (blocks it's read) <= num_slots. Mono.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace serve
+{
+constexpr const char* DEFAULT_SOCKET_PATH = "/tmp/nam_serve.sock";
+constexpr uint32_t RING_MAGIC = 0x314d414e; // "NAM1"
+constexpr int NUM_SLOTS = 8;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Need lock-free atomics to share them across processes");
+
+struct RingHeader
+{
+  uint32_t magic;
+  int32_t max_num_frames;
+  int32_t num_slots;
+  // Written by the client, read by the server, and vice versa. On their own
+  // cache lines so the two processes don't fight over them.
+  alignas(64) std::atomic<uint32_t> submitted;
+  alignas(64) std::atomic<uint32_t> completed;
+};
+
+// A slot is its number of frames followed by the samples.
+inline size_t get_slot_size(const int max_num_frames)
+{
+  return sizeof(float) * (1 + max_num_frames);
+}
+
+inline size_t get_ring_size(const int max_num_frames)
+{
+  return sizeof(RingHeader) + NUM_SLOTS * get_slot_size(max_num_frames);
+}
+
+// The slot for a block. The other side can write the ring's header, so
+// max_num_frames and num_slots are the ones that the ring was made with,
+// from each side's own copy.
+inline int32_t* get_slot_num_frames(RingHeader* ring, const int max_num_frames, const int num_slots,
+                                    const uint32_t block)
+{
+  uint8_t* slots = reinterpret_cast<uint8_t*>(ring) + sizeof(RingHeader);
+  return reinterpret_cast<int32_t*>(slots + (block % num_slots) * get_slot_size(max_num_frames));
+}
+
+inline float* get_slot_samples(RingHeader* ring, const int max_num_frames, const int num_slots, const uint32_t block)
+{
+  return reinterpret_cast<float*>(get_slot_num_frames(ring, max_num_frames, num_slots, block) + 1);
+}
+}; // namespace serve